@@ -0,0 +1,260 @@
+// Compiled without /clr: uses std::async
+
+#include "CalibrationCache.h"
+
+#include <chrono>
+#include <future>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			int BinningFactor(ML::CameraV2::Binning binning) {
+				return 1 << static_cast<int>(binning);
+			}
+
+			// One worker per filter, loaded concurrently
+			Result Load(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config, CalibrationSet& set) {
+				std::vector<std::future<Result>> loads;
+				for (auto filter : config.ColorFilterList) {
+					ML::MLColorimeter::MLColorimeterAlgorithms* worker = new ML::MLColorimeter::MLColorimeterAlgorithms();
+					set.Workers[filter] = worker;
+					ML::MLColorimeter::CalibrationConfig workerConfig = config;
+					workerConfig.ColorFilterList = { filter };
+					loads.push_back(std::async(std::launch::async, [worker, workerConfig, configPath]() {
+						Result ret = worker->ML_SetConfigPath(configPath.c_str());
+						if (!ret.success) return ret;
+						return worker->ML_LoadCalibrationData(workerConfig);
+					}));
+				}
+				Result ret;
+				for (auto& load : loads) {
+					Result r = load.get();
+					if (!r.success && ret.success) ret = r;
+				}
+				int stages = (config.Dark_Flag ? 1 : 0) + (config.FFC_Flag ? 1 : 0) + (config.Luminance_Flag ? 1 : 0);
+				set.Maps = static_cast<std::uint64_t>(config.ColorFilterList.size()) * stages;
+				return ret;
+			}
+		}
+
+		CalibrationSet::~CalibrationSet() {
+			for (auto& pair : Workers) {
+				delete pair.second;
+			}
+		}
+
+		struct CalibrationCache::State
+		{
+			struct Entry
+			{
+				std::string Key;
+				std::shared_ptr<CalibrationSet> Set;
+				bool Prefetched;
+			};
+
+			mutable std::mutex lock;
+			// Most recently used first
+			std::list<Entry> entries;
+			// Prefetches, finished ones are removed by Reap()
+			std::map<std::string, std::shared_future<Result>> loading;
+			std::uint64_t budget = DefaultBudgetBytes;
+			std::uint64_t frameBytes = DefaultFrameBytes;
+			// Incremented by Clear(), loads started before do not insert their set
+			std::uint64_t generation = 0;
+			CalibrationCacheCounters counters;
+
+			std::list<Entry>::iterator Find(const std::string& key) {
+				for (auto it = entries.begin(); it != entries.end(); ++it) {
+					if (it->Key == key) return it;
+				}
+				return entries.end();
+			}
+
+			std::uint64_t Bytes() const {
+				std::uint64_t bytes = 0;
+				for (const auto& entry : entries) {
+					bytes += entry.Set->Maps * frameBytes;
+				}
+				return bytes;
+			}
+
+			// Caller holds the lock
+			void Trim() {
+				while (entries.size() > 1 && Bytes() > budget) {
+					entries.pop_back();
+					counters.Evictions++;
+				}
+			}
+
+			// Caller holds the lock. Never called from a prefetch task: releasing the last reference of a
+			// std::async future waits for its task.
+			void Reap() {
+				for (auto it = loading.begin(); it != loading.end();) {
+					if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+						it = loading.erase(it);
+					}
+					else {
+						++it;
+					}
+				}
+			}
+
+			// Caller holds the lock
+			void Insert(const std::string& key, const std::shared_ptr<CalibrationSet>& set, bool prefetched) {
+				Entry entry = { key, set, prefetched };
+				entries.push_front(entry);
+				Trim();
+			}
+		};
+
+		CalibrationCache::CalibrationCache()
+			: state(new State()) {
+		}
+
+		CalibrationCache::~CalibrationCache() {
+			std::map<std::string, std::shared_future<Result>> running;
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				running = state->loading;
+			}
+			for (auto& pair : running) {
+				pair.second.wait();
+			}
+		}
+
+		std::string CalibrationCache::Key(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			std::ostringstream ss;
+			ss << moduleId << '|' << configPath << '|' << config.InputPath << '|' << config.Aperture << '|' << static_cast<int>(config.NDFilter)
+				<< '|' << config.LightSource << '|' << config.RX.Sphere << '|' << config.RX.Cylinder << '|' << config.RX.Axis
+				<< '|' << config.Dark_Flag << config.FFC_Flag << config.ColorShift_Flag << config.Distortion_Flag << '|';
+			for (auto filter : config.ColorFilterList) {
+				ss << static_cast<int>(filter) << ',';
+			}
+			return ss.str();
+		}
+
+		Result CalibrationCache::Acquire(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config,
+			std::shared_ptr<CalibrationSet>& set) {
+			std::string key = Key(moduleId, configPath, config);
+			std::shared_future<Result> pending;
+			std::uint64_t generation;
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->Reap();
+				generation = state->generation;
+				auto it = state->Find(key);
+				if (it != state->entries.end()) {
+					state->counters.Hits++;
+					if (it->Prefetched) {
+						state->counters.PrefetchHits++;
+						it->Prefetched = false;
+					}
+					state->entries.splice(state->entries.begin(), state->entries, it);
+					set = it->Set;
+					return Result();
+				}
+				auto running = state->loading.find(key);
+				if (running != state->loading.end()) {
+					pending = running->second;
+				}
+			}
+
+			if (pending.valid()) {
+				Result ret = pending.get();
+				std::lock_guard<std::mutex> guard(state->lock);
+				generation = state->generation;
+				auto it = state->Find(key);
+				if (ret.success && it != state->entries.end()) {
+					state->counters.Hits++;
+					state->counters.PrefetchHits++;
+					it->Prefetched = false;
+					state->entries.splice(state->entries.begin(), state->entries, it);
+					set = it->Set;
+					return ret;
+				}
+				// Failed, or evicted before it was used: load it here
+			}
+
+			std::shared_ptr<CalibrationSet> created = std::make_shared<CalibrationSet>();
+			Result ret = Load(configPath, config, *created);
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->counters.Misses++;
+			if (!ret.success) {
+				return ret;
+			}
+			set = created;
+			if (state->generation != generation) {
+				return ret;
+			}
+			auto it = state->Find(key);
+			if (it != state->entries.end()) {
+				state->entries.erase(it);
+			}
+			state->Insert(key, created, false);
+			return ret;
+		}
+
+		void CalibrationCache::Prefetch(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			std::string key = Key(moduleId, configPath, config);
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->Reap();
+			if (state->Find(key) != state->entries.end() || state->loading.find(key) != state->loading.end()) {
+				return;
+			}
+			State* owner = state.get();
+			std::uint64_t generation = state->generation;
+			state->loading[key] = std::async(std::launch::async, [owner, key, configPath, config, generation]() {
+				std::shared_ptr<CalibrationSet> created = std::make_shared<CalibrationSet>();
+				Result ret = Load(configPath, config, *created);
+				std::lock_guard<std::mutex> guard(owner->lock);
+				if (ret.success && owner->generation == generation && owner->Find(key) == owner->entries.end()) {
+					owner->Insert(key, created, true);
+				}
+				return ret;
+			}).share();
+		}
+
+		void CalibrationCache::SetBudget(std::uint64_t bytes) {
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->budget = bytes;
+			state->Trim();
+		}
+
+		void CalibrationCache::SetFrameSize(cv::Size size, ML::CameraV2::Binning binning) {
+			std::uint64_t factor = BinningFactor(binning);
+			std::uint64_t bytes = static_cast<std::uint64_t>(size.area()) * factor * factor * sizeof(float);
+			std::lock_guard<std::mutex> guard(state->lock);
+			if (bytes == 0 || bytes == state->frameBytes) return;
+			state->frameBytes = bytes;
+			state->Trim();
+		}
+
+		void CalibrationCache::Clear() {
+			std::map<std::string, std::shared_future<Result>> running;
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->generation++;
+				state->entries.clear();
+				running.swap(state->loading);
+			}
+			// Their sets are not inserted any more; wait so none of them still loads after Clear()
+			for (auto& pair : running) {
+				pair.second.wait();
+			}
+		}
+
+		CalibrationCacheCounters CalibrationCache::GetCounters() const {
+			std::lock_guard<std::mutex> guard(state->lock);
+			CalibrationCacheCounters counters = state->counters;
+			counters.Count = state->entries.size();
+			counters.Bytes = state->Bytes();
+			counters.BudgetBytes = state->budget;
+			return counters;
+		}
+	}
+}
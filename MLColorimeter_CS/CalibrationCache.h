@@ -0,0 +1,93 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and CalibrationCache.cpp (compiled without /clr)
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "MLCamaraCommon.h"
+#include "MLColorimeterAlgorithms.h"
+#include "MLColorimeterCommon.h"
+#include "MLFilterWheelClass.h"
+#include "Result.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// Calibration data of one configuration, loaded into one MLColorimeterAlgorithms worker per color filter.
+		struct CalibrationSet
+		{
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::MLColorimeterAlgorithms*> Workers;
+			// Full-frame maps the workers loaded: dark, flat field and luminance K, one each per filter and stage
+			std::uint64_t Maps = 0;
+
+			CalibrationSet() = default;
+			~CalibrationSet();
+
+			CalibrationSet(const CalibrationSet&) = delete;
+			CalibrationSet& operator=(const CalibrationSet&) = delete;
+		};
+
+		struct CalibrationCacheCounters
+		{
+			std::uint64_t Hits = 0;
+			std::uint64_t Misses = 0;
+			// Hits on a set loaded by Prefetch(), included in Hits
+			std::uint64_t PrefetchHits = 0;
+			std::uint64_t Evictions = 0;
+			std::uint64_t Count = 0;
+			std::uint64_t Bytes = 0;
+			std::uint64_t BudgetBytes = 0;
+		};
+
+		/// LRU cache of loaded calibration sets, keyed by module, config path and the parts of the CalibrationConfig
+		/// that select calibration data (input path, aperture, ND, RX, light source, stage flags, filters).
+		/// Workers hold the data of the run they process, so modules never share a set, even for the same path.
+		/// Least recently used sets are dropped once the cache is over its memory budget; the most recent set is
+		/// always kept. Sets in use by a caller stay alive until released. Thread safe.
+		/// The SDK keeps the loaded data private, so the size of a set is an estimate: its full-frame maps as float
+		/// images of the sensor size, without the camera matrix and other small data.
+		class CalibrationCache
+		{
+		public:
+			static const std::uint64_t DefaultBudgetBytes = 2ULL * 1024 * 1024 * 1024;
+			/// Size of a map until SetFrameSize(): a float image of a 4096 x 3072 sensor
+			static const std::uint64_t DefaultFrameBytes = 4096ULL * 3072 * sizeof(float);
+
+			CalibrationCache();
+			// Waits for running prefetches
+			~CalibrationCache();
+
+			CalibrationCache(const CalibrationCache&) = delete;
+			CalibrationCache& operator=(const CalibrationCache&) = delete;
+
+			static std::string Key(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+
+			/// Cached set of a configuration, loaded now on a miss; waits for a running prefetch of the same key.
+			Result Acquire(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config,
+				std::shared_ptr<CalibrationSet>& set);
+
+			/// Load a configuration in the background unless it is cached or already loading.
+			void Prefetch(int moduleId, const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+
+			void SetBudget(std::uint64_t bytes);
+
+			/// Sensor size the maps are estimated at, from a captured frame and its binning. Evicts if the cached
+			/// sets no longer fit the budget.
+			void SetFrameSize(cv::Size size, ML::CameraV2::Binning binning);
+
+			/// Drop every cached set and wait for running prefetches, which are dropped as well. A load that
+			/// was running during Clear() is returned to its caller but not cached.
+			void Clear();
+
+			CalibrationCacheCounters GetCounters() const;
+
+		private:
+			// Holds the std::mutex and the prefetch futures
+			struct State;
+			std::unique_ptr<State> state;
+		};
+	}
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <map>
+#include "MLColorimeterCommon.h"
+#include "MLFilterWheelClass.h"
+#include "ModuleCommon.h"
+#include "CalibrationPipeline.h"
+#include "MLConverters.h"
+#include "NativeImage.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Calibration data of one module, kept on the native side.
+		/// Metadata of every stage/filter entry is converted when the view is created, images are only
+		/// wrapped when GetImage() or GetData() is called. Dispose the view to release the native data.
+		/// </summary>
+		public ref class CalibrationDataView
+		{
+		public:
+			~CalibrationDataView() {
+				this->!CalibrationDataView();
+			}
+
+			!CalibrationDataView() {
+				delete data;
+				data = nullptr;
+			}
+
+			/// <summary>
+			/// Calibration stages present in the data.
+			/// </summary>
+			property IEnumerable<CalibrationEnum>^ Stages {
+				IEnumerable<CalibrationEnum>^ get() {
+					CheckDisposed();
+					return metadata->Keys;
+				}
+			}
+
+			/// <summary>
+			/// Filters present for a stage.
+			/// </summary>
+			/// <param name="stage">Calibration stage.</param>
+			/// <returns>The filters, empty if the stage is missing.</returns>
+			IEnumerable<MLFilterEnum>^ GetFilters(CalibrationEnum stage) {
+				CheckDisposed();
+				Dictionary<MLFilterEnum, CaliProcessData^>^ filters;
+				if (metadata->TryGetValue(stage, filters)) {
+					return filters->Keys;
+				}
+				return gcnew array<MLFilterEnum>(0);
+			}
+
+			/// <summary>
+			/// Check whether a stage/filter entry exists.
+			/// </summary>
+			bool Contains(CalibrationEnum stage, MLFilterEnum filter) {
+				CheckDisposed();
+				Dictionary<MLFilterEnum, CaliProcessData^>^ filters;
+				return metadata->TryGetValue(stage, filters) && filters->ContainsKey(filter);
+			}
+
+			/// <summary>
+			/// Metadata of an entry, without image. The returned object is shared by the view, do not modify it.
+			/// </summary>
+			/// <param name="stage">Calibration stage.</param>
+			/// <param name="filter">Filter of the entry.</param>
+			/// <returns>The metadata, Image is nullptr.</returns>
+			CaliProcessData^ GetMetadata(CalibrationEnum stage, MLFilterEnum filter) {
+				CheckDisposed();
+				Dictionary<MLFilterEnum, CaliProcessData^>^ filters;
+				if (!metadata->TryGetValue(stage, filters) || !filters->ContainsKey(filter)) {
+					throw gcnew KeyNotFoundException(String::Format("No calibration data for {0}/{1}.", stage, filter));
+				}
+				return filters[filter];
+			}
+
+			/// <summary>
+			/// Image of an entry. The handle shares the native buffer and stays valid after the view is disposed.
+			/// </summary>
+			/// <param name="stage">Calibration stage.</param>
+			/// <param name="filter">Filter of the entry.</param>
+			/// <returns>The image, or nullptr if the entry has none.</returns>
+			NativeImage^ GetImage(CalibrationEnum stage, MLFilterEnum filter) {
+				const cv::Mat& image = FindNative(stage, filter).Img;
+				return image.empty() ? nullptr : gcnew NativeImage(image);
+			}
+
+			/// <summary>
+			/// Full entry, metadata and image, as a new CaptureData.
+			/// </summary>
+			CaliProcessData^ GetData(CalibrationEnum stage, MLFilterEnum filter) {
+				return MLConverter::ToManaged(FindNative(stage, filter));
+			}
+
+			/// <summary>
+			/// Convert the whole view to the dictionary returned by ML_GetCalibrationData().
+			/// </summary>
+			Dictionary<CalibrationEnum, Dictionary<MLFilterEnum, CaliProcessData^>^>^ ToDictionary() {
+				CheckDisposed();
+				Dictionary<CalibrationEnum, Dictionary<MLFilterEnum, CaliProcessData^>^>^ dict =
+					gcnew Dictionary<CalibrationEnum, Dictionary<MLFilterEnum, CaliProcessData^>^>();
+				for (const auto& outerPair : *data) {
+					dict->Add(MLConverter::ToManaged(outerPair.first), MLConverter::ToManaged(outerPair.second));
+				}
+				return dict;
+			}
+
+		internal:
+			CalibrationDataView(NativeCalibrationData&& source) {
+				data = new NativeCalibrationData(std::move(source));
+				metadata = gcnew Dictionary<CalibrationEnum, Dictionary<MLFilterEnum, CaliProcessData^>^>();
+				for (const auto& outerPair : *data) {
+					Dictionary<MLFilterEnum, CaliProcessData^>^ filters = gcnew Dictionary<MLFilterEnum, CaliProcessData^>();
+					for (const auto& innerPair : outerPair.second) {
+						filters->Add(MLConverter::ToManaged(innerPair.first), MLConverter::ToManaged(innerPair.second, false));
+					}
+					metadata->Add(MLConverter::ToManaged(outerPair.first), filters);
+				}
+			}
+
+			const NativeCalibrationData& GetNativeData() {
+				CheckDisposed();
+				return *data;
+			}
+
+		private:
+			void CheckDisposed() {
+				if (data == nullptr) {
+					throw gcnew ObjectDisposedException("CalibrationDataView");
+				}
+			}
+
+			const ML::MLColorimeter::CaliProcessData& FindNative(CalibrationEnum stage, MLFilterEnum filter) {
+				CheckDisposed();
+				auto outer = data->find(MLConverter::ToNative(stage));
+				if (outer != data->end()) {
+					auto inner = outer->second.find(MLConverter::ToNative(filter));
+					if (inner != outer->second.end()) {
+						return inner->second;
+					}
+				}
+				throw gcnew KeyNotFoundException(String::Format("No calibration data for {0}/{1}.", stage, filter));
+			}
+
+			NativeCalibrationData* data;
+			Dictionary<CalibrationEnum, Dictionary<MLFilterEnum, CaliProcessData^>^>^ metadata;
+		};
+	}
+}
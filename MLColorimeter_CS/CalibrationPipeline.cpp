@@ -0,0 +1,480 @@
+// Compiled without /clr: uses std::async
+
+#include "CalibrationPipeline.h"
+
+#include <chrono>
+#include <future>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			typedef std::chrono::steady_clock Clock;
+
+			double ElapsedMs(Clock::time_point start) {
+				return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			}
+
+			NativeStageTiming MakeTiming(const std::string& stage, ML::MLFilterWheel::MLFilterEnum filter, double ms) {
+				NativeStageTiming timing;
+				timing.Stage = stage;
+				timing.Filter = filter;
+				timing.Milliseconds = ms;
+				return timing;
+			}
+
+			struct FilterOutput
+			{
+				Result ret;
+				NativeCalibrationData data;
+				double ms = 0.0;
+			};
+
+			bool HasModuleStages(const ML::MLColorimeter::CalibrationConfig& config) {
+				return config.Exposure_Flag || config.FourColor_Flag || config.Luminance_Flag || config.FOVCrop_Flag;
+			}
+
+			// Mean and largest absolute difference where both images are non-zero, away from the zero border of each
+			NativeRemapDifference Difference(const cv::Mat& actual, const cv::Mat& expected) {
+				cv::Mat a, e;
+				actual.reshape(1).convertTo(a, CV_64F);
+				expected.reshape(1).convertTo(e, CV_64F);
+				cv::Mat covered = (a != 0) & (e != 0);
+				cv::erode(covered, covered, cv::Mat());
+				cv::Mat difference;
+				cv::absdiff(a, e, difference);
+				NativeRemapDifference result;
+				if (cv::countNonZero(covered) == 0) return result;
+				result.Mean = cv::mean(difference, covered)[0];
+				cv::minMaxLoc(difference, nullptr, &result.Max, nullptr, nullptr, covered);
+				return result;
+			}
+
+			// Latest per-filter output, the input of the module-wide stages
+			const ML::MLColorimeter::CaliProcessData* LatestStage(const NativeCalibrationData& data, ML::MLFilterWheel::MLFilterEnum filter) {
+				const ML::MLColorimeter::CalibrationEnum order[] = {
+					ML::MLColorimeter::CalibrationEnum::Distortion,
+					ML::MLColorimeter::CalibrationEnum::ColorShift,
+					ML::MLColorimeter::CalibrationEnum::FFC,
+					ML::MLColorimeter::CalibrationEnum::Raw };
+				for (auto stage : order) {
+					auto outer = data.find(stage);
+					if (outer == data.end()) continue;
+					auto inner = outer->second.find(filter);
+					if (inner != outer->second.end() && !inner->second.Img.empty()) {
+						return &inner->second;
+					}
+				}
+				return nullptr;
+			}
+		}
+
+		struct CalibrationPipeline::PendingRun
+		{
+			ML::MLColorimeter::CalibrationConfig config;
+			ML::MLColorimeter::CalibrationConfig filterConfig;
+			bool remap = false;
+			// Color shifts applied by the pipeline: merged into the remap, or alone as a translation
+			bool shift = false;
+			Clock::time_point total;
+			Clock::time_point chainsStart;
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> captureData;
+			std::map<ML::MLFilterWheel::MLFilterEnum, std::future<FilterOutput>> chains;
+		};
+
+		CalibrationPipeline::CalibrationPipeline(int moduleId, ML::MLColorimeter::MLColorimeterAlgorithms* module, CalibrationCache* cache)
+			: moduleId(moduleId), module(module), cache(cache) {
+		}
+
+		CalibrationPipeline::~CalibrationPipeline() {
+			// Running chains use the workers
+			pending.reset();
+		}
+
+		void CalibrationPipeline::SetDistortion(const cv::Mat& cameraMatrix, const cv::Mat& coefficients, const std::string& cacheDirectory) {
+			distortionMatrix = cameraMatrix.clone();
+			distortionCoefficients = coefficients.clone();
+			remapCache.SetDirectory(cacheDirectory);
+		}
+
+		void CalibrationPipeline::ClearDistortion() {
+			distortionMatrix.release();
+			distortionCoefficients.release();
+			remapCache.Clear();
+		}
+
+		void CalibrationPipeline::SetColorShift(const std::map<ML::MLFilterWheel::MLFilterEnum, cv::Point2d>& shifts) {
+			colorShift = shifts;
+		}
+
+		void CalibrationPipeline::SetSweepPlan(const std::vector<ML::MLColorimeter::CalibrationConfig>& plan) {
+			sweepPlan = plan;
+		}
+
+		ML::MLColorimeter::CalibrationConfig CalibrationPipeline::FilterConfig(const ML::MLColorimeter::CalibrationConfig& config) const {
+			// Distortion by remap: the workers neither load nor run the SDK's distortion stage,
+			// nor its color shift stage if the pipeline applies the shifts
+			ML::MLColorimeter::CalibrationConfig filterConfig = config;
+			if (config.Distortion_Flag && HasDistortion()) {
+				filterConfig.Distortion_Flag = false;
+			}
+			if (config.ColorShift_Flag && !colorShift.empty()) {
+				filterConfig.ColorShift_Flag = false;
+			}
+			return filterConfig;
+		}
+
+		Result CalibrationPipeline::CheckColorShift(const ML::MLColorimeter::CalibrationConfig& config) const {
+			if (!config.ColorShift_Flag || colorShift.empty()) return Result();
+			// The SDK's distortion stage would run after shifts the SDK did not apply
+			if (config.Distortion_Flag && !HasDistortion()) {
+				return Result(false, "Color shifts are set but the distortion stage has no remap, set one or clear the shifts.");
+			}
+			for (auto filter : config.ColorFilterList) {
+				if (colorShift.find(filter) == colorShift.end()) {
+					return Result(false, "Color shift is missing a filter of ColorFilterList.");
+				}
+			}
+			return Result();
+		}
+
+		void CalibrationPipeline::Prefetch(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			cache->Prefetch(moduleId, configPath, FilterConfig(config));
+		}
+
+		Result CalibrationPipeline::Preload(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			std::shared_ptr<CalibrationSet> set;
+			Result ret = cache->Acquire(moduleId, configPath, FilterConfig(config), set);
+			if (ret.success) {
+				ret = PrepareRemap(config);
+			}
+			return ret;
+		}
+
+		Result CalibrationPipeline::PrepareRemap(const ML::MLColorimeter::CalibrationConfig& config) {
+			if (!config.Distortion_Flag || !HasDistortion()) {
+				return Result();
+			}
+			bool mergeShift = config.ColorShift_Flag && !colorShift.empty();
+			for (const RemapGeometry& geometry : remapCache.Geometries()) {
+				for (auto filter : config.ColorFilterList) {
+					cv::Point2d shift;
+					if (mergeShift) {
+						auto it = colorShift.find(filter);
+						if (it == colorShift.end()) continue;
+						shift = it->second;
+					}
+					if (remapCache.Get(distortionMatrix, distortionCoefficients, geometry.Size, geometry.Binning, shift) == nullptr) {
+						return Result(false, "Invalid camera matrix or distortion coefficients.");
+					}
+				}
+			}
+			return Result();
+		}
+
+		void CalibrationPipeline::PrefetchNext(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			std::string key = CalibrationCache::Key(moduleId, configPath, FilterConfig(config));
+			for (std::size_t i = 0; i + 1 < sweepPlan.size(); i++) {
+				if (CalibrationCache::Key(moduleId, configPath, FilterConfig(sweepPlan[i])) == key) {
+					cache->Prefetch(moduleId, configPath, FilterConfig(sweepPlan[i + 1]));
+					return;
+				}
+			}
+		}
+
+		Result CalibrationPipeline::Process(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> captureData = module->ML_GetCaptureDataMap();
+			if (captureData.empty()) {
+				return Result(false, "No capture data, call ML_SetCaptureDataMap() first.");
+			}
+			for (auto filter : config.ColorFilterList) {
+				if (captureData.find(filter) == captureData.end()) {
+					return Result(false, "Capture data is missing a filter of ColorFilterList.");
+				}
+			}
+			Result ret = Begin(configPath, config);
+			if (!ret.success) return ret;
+			for (auto filter : config.ColorFilterList) {
+				ret = StartFilter(filter, captureData[filter]);
+				if (!ret.success) {
+					Finish();
+					return ret;
+				}
+			}
+			return Finish();
+		}
+
+		Result CalibrationPipeline::Begin(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config) {
+			pending.reset();
+			result.clear();
+			timings.clear();
+
+			std::unique_ptr<PendingRun> next(new PendingRun());
+			next->total = Clock::now();
+			next->config = config;
+			next->remap = config.Distortion_Flag && HasDistortion();
+			next->shift = config.ColorShift_Flag && !colorShift.empty();
+			next->filterConfig = FilterConfig(config);
+			Result ret = CheckColorShift(config);
+			if (!ret.success) return ret;
+
+			Clock::time_point start = Clock::now();
+			ret = cache->Acquire(moduleId, configPath, next->filterConfig, workers);
+			timings.push_back(MakeTiming("LoadCalibrationData", ML::MLFilterWheel::MLFilterEnum::Unknown, ElapsedMs(start)));
+			if (!ret.success) return ret;
+			PrefetchNext(configPath, config);
+			if (next->remap) {
+				// Usually built by the Preload() of the calibration load already
+				start = Clock::now();
+				ret = PrepareRemap(config);
+				timings.push_back(MakeTiming("RemapTables", ML::MLFilterWheel::MLFilterEnum::Unknown, ElapsedMs(start)));
+				if (!ret.success) return ret;
+			}
+			pending = std::move(next);
+			return ret;
+		}
+
+		Result CalibrationPipeline::StartFilter(ML::MLFilterWheel::MLFilterEnum filter, const ML::MLColorimeter::CaptureData& data) {
+			if (!pending) {
+				return Result(false, "Begin() was not called or failed.");
+			}
+			auto worker = workers->Workers.find(filter);
+			if (worker == workers->Workers.end()) {
+				return Result(false, "Filter is not in ColorFilterList.");
+			}
+			if (pending->chains.empty()) {
+				pending->chainsStart = Clock::now();
+			}
+			pending->captureData[filter] = data;
+			cache->SetFrameSize(data.Img.size(), data.Binning);
+
+			bool remap = pending->remap;
+			bool translate = pending->shift && !remap;
+			cv::Point2d shift = pending->shift ? colorShift[filter] : cv::Point2d();
+			if (remap) {
+				// Built by Begin() unless the image size or binning is new
+				Clock::time_point start = Clock::now();
+				if (remapCache.Get(distortionMatrix, distortionCoefficients, data.Img.size(), data.Binning, shift) == nullptr) {
+					return Result(false, "Invalid camera matrix or distortion coefficients.");
+				}
+				timings.push_back(MakeTiming("RemapTables", filter, ElapsedMs(start)));
+			}
+
+			// Per-filter chain, independent of the other filters until the four color stage
+			ML::MLColorimeter::MLColorimeterAlgorithms* algorithms = worker->second;
+			ML::MLColorimeter::CalibrationConfig workerConfig = pending->filterConfig;
+			workerConfig.ColorFilterList = { filter };
+			workerConfig.Exposure_Flag = false;
+			workerConfig.FourColor_Flag = false;
+			workerConfig.Luminance_Flag = false;
+			workerConfig.FOVCrop_Flag = false;
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> input;
+			input[filter] = data;
+			pending->chains[filter] = std::async(std::launch::async, [this, algorithms, workerConfig, input, filter, remap, translate, shift]() {
+				Clock::time_point chainStart = Clock::now();
+				FilterOutput output;
+				output.ret = algorithms->ML_SetCaptureDataMap(input, false);
+				if (output.ret.success) {
+					output.ret = algorithms->ML_Process(workerConfig);
+				}
+				if (output.ret.success) {
+					output.data = algorithms->ML_GetCalibrationData();
+				}
+				if (output.ret.success && remap) {
+					const ML::MLColorimeter::CaliProcessData* latest = LatestStage(output.data, filter);
+					if (latest != nullptr) {
+						std::shared_ptr<const RemapTables> tables =
+							remapCache.Get(distortionMatrix, distortionCoefficients, latest->Img.size(), latest->Binning, shift);
+						ML::MLColorimeter::CaliProcessData corrected = *latest;
+						corrected.Img = cv::Mat();
+						RemapCache::Apply(latest->Img, corrected.Img, *tables);
+						output.data[ML::MLColorimeter::CalibrationEnum::Distortion][filter] = corrected;
+					}
+				}
+				if (output.ret.success && translate) {
+					// Color shift without undistortion, in place of the SDK's color shift stage
+					const ML::MLColorimeter::CaliProcessData* latest = LatestStage(output.data, filter);
+					if (latest != nullptr) {
+						ML::MLColorimeter::CaliProcessData shifted = *latest;
+						shifted.Img = cv::Mat();
+						RemapCache::Translate(latest->Img, shifted.Img, shift, latest->Binning);
+						output.data[ML::MLColorimeter::CalibrationEnum::ColorShift][filter] = shifted;
+					}
+				}
+				output.ms = ElapsedMs(chainStart);
+				return output;
+			});
+			return Result();
+		}
+
+		Result CalibrationPipeline::Finish() {
+			if (!pending) {
+				return Result(false, "Begin() was not called or failed.");
+			}
+			std::unique_ptr<PendingRun> finished = std::move(pending);
+			const ML::MLColorimeter::CalibrationConfig& config = finished->config;
+
+			Result ret;
+			for (auto filter : config.ColorFilterList) {
+				if (finished->chains.find(filter) == finished->chains.end()) {
+					ret = Result(false, "Capture data is missing a filter of ColorFilterList.");
+				}
+			}
+			for (auto& chain : finished->chains) {
+				FilterOutput output = chain.second.get();
+				timings.push_back(MakeTiming("FilterChain", chain.first, output.ms));
+				if (!output.ret.success && ret.success) ret = output.ret;
+				for (auto& stage : output.data) {
+					for (auto& entry : stage.second) {
+						result[stage.first][entry.first] = entry.second;
+					}
+				}
+			}
+			timings.push_back(MakeTiming("FilterChains", ML::MLFilterWheel::MLFilterEnum::Unknown, ElapsedMs(finished->chainsStart)));
+			if (!ret.success) return ret;
+
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData>& captureData = finished->captureData;
+			if (HasModuleStages(config)) {
+				Clock::time_point start = Clock::now();
+				std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> corrected;
+				for (auto filter : config.ColorFilterList) {
+					ML::MLColorimeter::CaptureData data = captureData[filter];
+					const ML::MLColorimeter::CaliProcessData* latest = LatestStage(result, filter);
+					if (latest != nullptr) {
+						data.Img = latest->Img;
+					}
+					corrected[filter] = data;
+				}
+				ML::MLColorimeter::CalibrationConfig moduleConfig = config;
+				moduleConfig.Dark_Flag = false;
+				moduleConfig.FFC_Flag = false;
+				moduleConfig.ColorShift_Flag = false;
+				moduleConfig.Distortion_Flag = false;
+				ret = module->ML_SetCaptureDataMap(corrected, false);
+				if (ret.success) {
+					ret = module->ML_Process(moduleConfig);
+				}
+				if (ret.success) {
+					// Per-filter stages come from the workers, the module adds the rest
+					NativeCalibrationData moduleData = module->ML_GetCalibrationData();
+					for (auto& stage : moduleData) {
+						if (result.find(stage.first) == result.end()) {
+							result[stage.first] = stage.second;
+						}
+					}
+				}
+				timings.push_back(MakeTiming("ModuleStages", ML::MLFilterWheel::MLFilterEnum::Unknown, ElapsedMs(start)));
+			}
+			// The module's capture data is the uncorrected input, as after ML_SetCaptureDataMap()
+			module->ML_SetCaptureDataMap(captureData, false);
+			timings.push_back(MakeTiming("Total", ML::MLFilterWheel::MLFilterEnum::Unknown, ElapsedMs(finished->total)));
+			return ret;
+		}
+
+		Result CalibrationPipeline::CompareRemap(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config,
+			std::map<ML::MLFilterWheel::MLFilterEnum, NativeRemapDifference>& differences) {
+			differences.clear();
+			bool remap = config.Distortion_Flag && HasDistortion();
+			bool shift = config.ColorShift_Flag && !colorShift.empty();
+			if (!remap && !shift) {
+				return Result(false, "Neither a distortion remap nor a color shift applies to the configuration.");
+			}
+			Result ret = CheckColorShift(config);
+			if (!ret.success) return ret;
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> captureData = module->ML_GetCaptureDataMap();
+			for (auto filter : config.ColorFilterList) {
+				if (captureData.find(filter) == captureData.end()) {
+					return Result(false, "Capture data is missing a filter of ColorFilterList.");
+				}
+			}
+
+			// The SDK's stages the pipeline replaces, alone, on an instance of its own so the module's data is untouched
+			ML::MLColorimeter::CalibrationConfig sdkConfig = config;
+			sdkConfig.Dark_Flag = false;
+			sdkConfig.FFC_Flag = false;
+			sdkConfig.ColorShift_Flag = shift;
+			sdkConfig.Distortion_Flag = remap;
+			sdkConfig.Exposure_Flag = false;
+			sdkConfig.FourColor_Flag = false;
+			sdkConfig.Luminance_Flag = false;
+			sdkConfig.FOVCrop_Flag = false;
+			ML::MLColorimeter::MLColorimeterAlgorithms sdk;
+			ret = sdk.ML_SetConfigPath(configPath.c_str());
+			if (ret.success) ret = sdk.ML_LoadCalibrationData(sdkConfig);
+			if (ret.success) ret = sdk.ML_SetCaptureDataMap(captureData, false);
+			if (ret.success) ret = sdk.ML_Process(sdkConfig);
+			if (!ret.success) return ret;
+			NativeCalibrationData expected = sdk.ML_GetCalibrationData();
+
+			for (auto filter : config.ColorFilterList) {
+				const ML::MLColorimeter::CaptureData& data = captureData[filter];
+				cv::Point2d offset = shift ? colorShift[filter] : cv::Point2d();
+				cv::Mat corrected;
+				if (remap) {
+					std::shared_ptr<const RemapTables> tables =
+						remapCache.Get(distortionMatrix, distortionCoefficients, data.Img.size(), data.Binning, offset);
+					if (tables == nullptr) {
+						return Result(false, "Invalid camera matrix or distortion coefficients.");
+					}
+					RemapCache::Apply(data.Img, corrected, *tables);
+				}
+				else {
+					RemapCache::Translate(data.Img, corrected, offset, data.Binning);
+				}
+				const ML::MLColorimeter::CaliProcessData* reference = LatestStage(expected, filter);
+				if (reference == nullptr || reference->Img.size() != data.Img.size() || reference->Img.type() != data.Img.type()) {
+					return Result(false, "The SDK's correction gave no image like the capture data.");
+				}
+				differences[filter] = Difference(corrected, reference->Img);
+			}
+			return Result();
+		}
+
+		Result CalibrationPipeline::ProcessModules(const std::vector<std::pair<CalibrationPipeline*, std::string>>& jobs,
+			const ML::MLColorimeter::CalibrationConfig& config, bool parallel) {
+			Result ret;
+			if (!parallel) {
+				for (auto& job : jobs) {
+					Result r = job.first->Process(job.second, config);
+					if (!r.success && ret.success) ret = r;
+				}
+				return ret;
+			}
+			std::vector<std::future<Result>> runs;
+			for (auto& job : jobs) {
+				CalibrationPipeline* pipeline = job.first;
+				std::string configPath = job.second;
+				runs.push_back(std::async(std::launch::async, [pipeline, configPath, &config]() {
+					return pipeline->Process(configPath, config);
+				}));
+			}
+			for (auto& run : runs) {
+				Result r = run.get();
+				if (!r.success && ret.success) ret = r;
+			}
+			return ret;
+		}
+
+		Result CalibrationPipeline::FinishModules(const std::vector<CalibrationPipeline*>& pipelines, bool parallel) {
+			Result ret;
+			if (!parallel) {
+				for (CalibrationPipeline* pipeline : pipelines) {
+					Result r = pipeline->Finish();
+					if (!r.success && ret.success) ret = r;
+				}
+				return ret;
+			}
+			std::vector<std::future<Result>> runs;
+			for (CalibrationPipeline* pipeline : pipelines) {
+				runs.push_back(std::async(std::launch::async, [pipeline]() {
+					return pipeline->Finish();
+				}));
+			}
+			for (auto& run : runs) {
+				Result r = run.get();
+				if (!r.success && ret.success) ret = r;
+			}
+			return ret;
+		}
+	}
+}
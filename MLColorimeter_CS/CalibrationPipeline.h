@@ -0,0 +1,147 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and CalibrationPipeline.cpp (compiled without /clr)
+
+#include <map>
+#include <string>
+#include <vector>
+#include "MLColorimeterAlgorithms.h"
+#include "MLColorimeterCommon.h"
+#include "MLFilterWheelClass.h"
+#include "Result.h"
+#include "RemapCache.h"
+#include "CalibrationCache.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		typedef std::map<ML::MLColorimeter::CalibrationEnum,
+			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaliProcessData>> NativeCalibrationData;
+
+		/// Wall-clock time of one pipeline step.
+		struct NativeStageTiming
+		{
+			std::string Stage;
+			// Filter of a per-filter step, Unknown for module-wide steps
+			ML::MLFilterWheel::MLFilterEnum Filter = ML::MLFilterWheel::MLFilterEnum::Unknown;
+			double Milliseconds = 0.0;
+		};
+
+		/// Difference between the remap and the SDK's correction of one filter image, in gray levels,
+		/// over the pixels both corrections cover.
+		struct NativeRemapDifference
+		{
+			double Mean = 0.0;
+			double Max = 0.0;
+		};
+
+		/// Runs the per-filter part of ML_Process (dark, FFC, color shift, distortion) for every color filter
+		/// concurrently, then the module-wide part (exposure, four color, luminance, FOV crop) on the module's own
+		/// MLColorimeterAlgorithms instance.
+		/// Each filter gets a private MLColorimeterAlgorithms worker loaded with that filter's calibration data,
+		/// the workers of every configuration come from a CalibrationCache shared by the pipelines.
+		/// With SetSweepPlan() the next configuration of the plan is prefetched while the current one is processed.
+		/// With SetDistortion() the distortion stage is done by the pipeline with cached remap tables,
+		/// with SetColorShift() also the color shift stage, in the same remap or, without the distortion stage,
+		/// as a translation.
+		class CalibrationPipeline
+		{
+		public:
+			/// moduleId: module of the pipeline, its workers are its own in the cache.
+			/// cache: shared calibration cache, must outlive the pipeline.
+			CalibrationPipeline(int moduleId, ML::MLColorimeter::MLColorimeterAlgorithms* module, CalibrationCache* cache);
+			~CalibrationPipeline();
+
+			CalibrationPipeline(const CalibrationPipeline&) = delete;
+			CalibrationPipeline& operator=(const CalibrationPipeline&) = delete;
+
+			/// Process the capture data set on the module with ML_SetCaptureDataMap().
+			Result Process(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+
+			/// Streamed Process(): Begin(), StartFilter() for every filter of ColorFilterList as soon as its frame is
+			/// captured, its chain then runs in the background, and Finish() once all are started.
+			/// Finish() waits for the chains, runs the module-wide stages and sets the captured frames as the module's
+			/// capture data. After Begin() succeeded Finish() must be called, also if StartFilter() failed.
+			Result Begin(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+			Result StartFilter(ML::MLFilterWheel::MLFilterEnum filter, const ML::MLColorimeter::CaptureData& data);
+			Result Finish();
+
+			/// Correct distortion with cv::remap and tables from a RemapCache instead of the SDK's DistortionCorrect.
+			/// cameraMatrix: 3x3 for unbinned sensor pixels; coefficients: as for cv::undistort;
+			/// cacheDirectory: where tables are persisted, empty to keep them in memory only.
+			/// The tables are built when calibration data is loaded (Preload(), Begin()) for every image size and
+			/// binning corrected before, so measurements only look them up; a new size or binning builds its tables
+			/// on its first frame.
+			void SetDistortion(const cv::Mat& cameraMatrix, const cv::Mat& coefficients, const std::string& cacheDirectory);
+
+			/// Go back to the SDK's distortion stage.
+			void ClearDistortion();
+
+			/// Per-filter color shift (as in ColorShiftMap) replacing the SDK's color shift stage, in the convention of
+			/// RemapCache::Get(). Folded into the distortion remap tables, so color shift and distortion resample each
+			/// filter once, or applied alone with RemapCache::Translate() when Distortion_Flag is false. Processing
+			/// fails if Distortion_Flag is set without SetDistortion(), or if a filter of ColorFilterList has no
+			/// entry. An empty map goes back to the SDK's color shift stage.
+			void SetColorShift(const std::map<ML::MLFilterWheel::MLFilterEnum, cv::Point2d>& shifts);
+
+			bool HasDistortion() const { return !distortionMatrix.empty(); }
+
+			/// Configurations processed in this order; after each Process() the configuration following the
+			/// processed one is loaded in the background. An empty plan disables prefetching.
+			void SetSweepPlan(const std::vector<ML::MLColorimeter::CalibrationConfig>& plan);
+
+			/// Start loading the workers of a configuration in the background, see CalibrationCache::Prefetch().
+			void Prefetch(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+
+			/// Load the workers of a configuration into the cache now, or wait for their prefetch, and build its
+			/// remap tables.
+			Result Preload(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+
+			/// Correct the module's capture data (set with ML_SetCaptureDataMap()) as the pipeline does for config
+			/// (remap tables, color shifts) and, on a separate MLColorimeterAlgorithms instance loaded from configPath,
+			/// with the SDK's distortion and color shift stages it replaces, and compare the two per filter of
+			/// ColorFilterList. Checks the camera matrix, coefficients and shift signs given to SetDistortion() and
+			/// SetColorShift() against the calibration data the SDK uses.
+			Result CompareRemap(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config,
+				std::map<ML::MLFilterWheel::MLFilterEnum, NativeRemapDifference>& differences);
+
+			/// Calibration data of the last Process(), same layout as ML_GetCalibrationData().
+			const NativeCalibrationData& GetCalibrationData() const { return result; }
+
+			/// Step timings of the last Process().
+			const std::vector<NativeStageTiming>& GetTimings() const { return timings; }
+
+			/// Process several modules, concurrently if parallel is true.
+			static Result ProcessModules(const std::vector<std::pair<CalibrationPipeline*, std::string>>& jobs,
+				const ML::MLColorimeter::CalibrationConfig& config, bool parallel);
+
+			/// Finish() several modules, concurrently if parallel is true.
+			static Result FinishModules(const std::vector<CalibrationPipeline*>& pipelines, bool parallel);
+
+		private:
+			// Config the workers are loaded and run with: without the stages done by the pipeline itself
+			ML::MLColorimeter::CalibrationConfig FilterConfig(const ML::MLColorimeter::CalibrationConfig& config) const;
+			// Color shifts of config can be applied: a remap for the distortion stage and a shift per filter
+			Result CheckColorShift(const ML::MLColorimeter::CalibrationConfig& config) const;
+			void PrefetchNext(const std::string& configPath, const ML::MLColorimeter::CalibrationConfig& config);
+			// Tables of every filter of config for every geometry in the remap cache
+			Result PrepareRemap(const ML::MLColorimeter::CalibrationConfig& config);
+
+			int moduleId;
+			ML::MLColorimeter::MLColorimeterAlgorithms* module;
+			CalibrationCache* cache;
+			// Set of the last Process(), kept while it runs even if the cache drops it
+			std::shared_ptr<CalibrationSet> workers;
+			std::vector<ML::MLColorimeter::CalibrationConfig> sweepPlan;
+			// Run between Begin() and Finish(), holds the chain futures
+			struct PendingRun;
+			std::unique_ptr<PendingRun> pending;
+			NativeCalibrationData result;
+			std::vector<NativeStageTiming> timings;
+			cv::Mat distortionMatrix;
+			cv::Mat distortionCoefficients;
+			std::map<ML::MLFilterWheel::MLFilterEnum, cv::Point2d> colorShift;
+			RemapCache remapCache;
+		};
+	}
+}
@@ -0,0 +1,124 @@
+// Compiled without /clr: AVX2 intrinsics
+
+#include "CorrectionKernels.h"
+
+#include <immintrin.h>
+#include <intrin.h>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			struct RowInputs
+			{
+				const ushort* raw;
+				const ushort* dark16;
+				const float* dark32;
+				const float* flat;
+				float* dst;
+			};
+
+			RowInputs GetRow(const cv::Mat& raw, const cv::Mat& dark, const cv::Mat& flat, cv::Mat& dst, int y) {
+				RowInputs row;
+				row.raw = raw.ptr<ushort>(y);
+				row.dark16 = !dark.empty() && dark.depth() == CV_16U ? dark.ptr<ushort>(y) : nullptr;
+				row.dark32 = !dark.empty() && dark.depth() == CV_32F ? dark.ptr<float>(y) : nullptr;
+				row.flat = flat.empty() ? nullptr : flat.ptr<float>(y);
+				row.dst = dst.ptr<float>(y);
+				return row;
+			}
+
+			// Same operation order as the multi-pass path: subtract, divide, multiply
+			void ScalarRow(const RowInputs& row, int begin, int end, float scale) {
+				for (int x = begin; x < end; x++) {
+					float v = static_cast<float>(row.raw[x]);
+					if (row.dark16 != nullptr) v = v - static_cast<float>(row.dark16[x]);
+					else if (row.dark32 != nullptr) v = v - row.dark32[x];
+					if (row.flat != nullptr) v = v / row.flat[x];
+					row.dst[x] = v * scale;
+				}
+			}
+
+			inline __m256 LoadU16(const ushort* p) {
+				__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(v));
+			}
+
+			void Avx2Row(const RowInputs& row, int width, float scale) {
+				const __m256 vscale = _mm256_set1_ps(scale);
+				int x = 0;
+				for (; x + 8 <= width; x += 8) {
+					__m256 v = LoadU16(row.raw + x);
+					if (row.dark16 != nullptr) v = _mm256_sub_ps(v, LoadU16(row.dark16 + x));
+					else if (row.dark32 != nullptr) v = _mm256_sub_ps(v, _mm256_loadu_ps(row.dark32 + x));
+					if (row.flat != nullptr) v = _mm256_div_ps(v, _mm256_loadu_ps(row.flat + x));
+					_mm256_storeu_ps(row.dst + x, _mm256_mul_ps(v, vscale));
+				}
+				ScalarRow(row, x, width, scale);
+			}
+
+			bool MultiPass(const cv::Mat& raw, const cv::Mat& dark, const cv::Mat& flat, float scale, cv::Mat& dst) {
+				cv::Mat corrected;
+				if (!dark.empty()) {
+					cv::subtract(raw, dark, corrected, cv::noArray(), CV_32F);
+				}
+				else {
+					raw.convertTo(corrected, CV_32F);
+				}
+				if (!flat.empty()) {
+					cv::Mat flattened;
+					cv::divide(corrected, flat, flattened);
+					corrected = flattened;
+				}
+				cv::multiply(corrected, cv::Scalar(scale), dst);
+				return true;
+			}
+		}
+
+		bool IsAvx2Available() {
+			static const bool available = []() {
+				int info[4];
+				__cpuid(info, 0);
+				if (info[0] < 7) return false;
+				__cpuid(info, 1);
+				bool osxsave = (info[2] & (1 << 27)) != 0;
+				bool avx = (info[2] & (1 << 28)) != 0;
+				if (!osxsave || !avx) return false;
+				// OS must save the YMM registers
+				if ((_xgetbv(0) & 0x6) != 0x6) return false;
+				__cpuidex(info, 7, 0);
+				return (info[1] & (1 << 5)) != 0;
+			}();
+			return available;
+		}
+
+		bool DarkFlatExposureCorrect(const cv::Mat& raw, const cv::Mat& dark, const cv::Mat& flat, float scale,
+			cv::Mat& dst, NativeKernelPath path) {
+			if (raw.empty() || raw.type() != CV_16UC1) return false;
+			if (!dark.empty() && (dark.size() != raw.size() || (dark.type() != CV_16UC1 && dark.type() != CV_32FC1))) return false;
+			if (!flat.empty() && (flat.size() != raw.size() || flat.type() != CV_32FC1)) return false;
+
+			if (path == KernelMultiPass) {
+				return MultiPass(raw, dark, flat, scale, dst);
+			}
+			bool avx2 = IsAvx2Available();
+			if (path == KernelAvx2 && !avx2) return false;
+			bool useAvx2 = path == KernelAvx2 || (path == KernelAuto && avx2);
+
+			dst.create(raw.size(), CV_32FC1);
+			int width = raw.cols;
+			cv::parallel_for_(cv::Range(0, raw.rows), [&](const cv::Range& rows) {
+				for (int y = rows.start; y < rows.end; y++) {
+					RowInputs row = GetRow(raw, dark, flat, dst, y);
+					if (useAvx2) {
+						Avx2Row(row, width, scale);
+					}
+					else {
+						ScalarRow(row, 0, width, scale);
+					}
+				}
+			});
+			return true;
+		}
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and CorrectionKernels.cpp (compiled without /clr)
+
+#include <opencv2/opencv.hpp>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		enum NativeKernelPath
+		{
+			KernelAuto = 0,
+			KernelAvx2 = 1,
+			KernelScalar = 2,
+			KernelMultiPass = 3
+		};
+
+		/// True if the CPU and OS support AVX2.
+		bool IsAvx2Available();
+
+		/// dst = (raw - dark) / flat * scale, evaluated in float in that order.
+		/// raw: CV_16UC1; dark: CV_16UC1 or CV_32FC1, may be empty; flat: CV_32FC1, may be empty;
+		/// dst: CV_32FC1, (re)allocated if its size or type differ.
+		/// KernelMultiPass is the reference: cv::subtract, cv::divide and cv::multiply with a temporary per step.
+		/// The fused paths make one pass without temporaries and give bit-identical results.
+		/// @return false if the inputs are invalid or the requested path is not available.
+		bool DarkFlatExposureCorrect(const cv::Mat& raw, const cv::Mat& dark, const cv::Mat& flat, float scale,
+			cv::Mat& dst, NativeKernelPath path);
+	}
+}
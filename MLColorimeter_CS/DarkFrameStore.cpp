@@ -0,0 +1,336 @@
+// Compiled without /clr: uses std::mutex and Win32 file mapping
+
+#include "DarkFrameStore.h"
+
+#include <Windows.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			const std::uint32_t StoreMagic = 0x4B444C4D; // "MLDK"
+			const std::uint32_t StoreVersion = 1;
+			const std::uint64_t PageSize = 4096;
+			const std::size_t InterpolationCacheSize = 8;
+
+#pragma pack(push, 1)
+			struct StoreHeader
+			{
+				std::uint32_t Magic;
+				std::uint32_t Version;
+				std::uint32_t Count;
+				std::uint32_t Reserved;
+			};
+
+			struct StoreEntry
+			{
+				double ExposureTime;
+				std::int32_t Binning;
+				std::int32_t PixelFormat;
+				std::int32_t Width;
+				std::int32_t Height;
+				std::int32_t Type;
+				std::int32_t Reserved;
+				std::uint64_t Offset;
+				std::uint64_t Step;
+			};
+#pragma pack(pop)
+
+			std::uint64_t AlignToPage(std::uint64_t offset) {
+				return (offset + PageSize - 1) / PageSize * PageSize;
+			}
+
+			// Types the correction kernels take as dark, see DarkFlatExposureCorrect()
+			bool IsDarkType(int type) {
+				return type == CV_16UC1 || type == CV_32FC1;
+			}
+
+			bool SameExposure(double a, double b) {
+				return std::fabs(a - b) <= 1e-6 * (std::max)(1.0, std::fabs(b));
+			}
+
+			struct CachedDark
+			{
+				double ExposureTime;
+				std::int32_t Binning;
+				std::int32_t PixelFormat;
+				cv::Mat Image;
+			};
+		}
+
+		struct DarkFrameStore::State
+		{
+			HANDLE file = INVALID_HANDLE_VALUE;
+			HANDLE mapping = nullptr;
+			const unsigned char* base = nullptr;
+			std::vector<StoreEntry> entries;
+			mutable std::mutex lock;
+			mutable std::deque<CachedDark> cache;
+
+			cv::Mat View(const StoreEntry& entry) const {
+				return cv::Mat(entry.Height, entry.Width, entry.Type,
+					const_cast<unsigned char*>(base + entry.Offset), static_cast<std::size_t>(entry.Step));
+			}
+
+			// Entries of a binning/pixel format, by ascending exposure time
+			std::vector<const StoreEntry*> Select(ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format) const {
+				std::vector<const StoreEntry*> selected;
+				for (const auto& entry : entries) {
+					if (entry.Binning == static_cast<std::int32_t>(binning) && entry.PixelFormat == static_cast<std::int32_t>(format)) {
+						selected.push_back(&entry);
+					}
+				}
+				std::sort(selected.begin(), selected.end(), [](const StoreEntry* a, const StoreEntry* b) {
+					return a->ExposureTime < b->ExposureTime;
+				});
+				return selected;
+			}
+		};
+
+		DarkFrameStore::DarkFrameStore()
+			: state(new State()) {
+		}
+
+		DarkFrameStore::~DarkFrameStore() {
+			Close();
+		}
+
+		bool DarkFrameStore::Write(const std::string& path, const std::vector<NativeDarkFrame>& frames, std::string& error) {
+			std::vector<cv::Mat> images;
+			std::vector<StoreEntry> entries;
+			std::uint64_t offset = AlignToPage(sizeof(StoreHeader) + frames.size() * sizeof(StoreEntry));
+			for (const auto& frame : frames) {
+				cv::Mat image = frame.Image;
+				if (image.empty() && !frame.Path.empty()) {
+					image = cv::imread(frame.Path, cv::IMREAD_UNCHANGED);
+				}
+				if (image.empty()) {
+					error = "Dark frame has no image: " + frame.Path;
+					return false;
+				}
+				if (!IsDarkType(image.type())) {
+					error = "Dark frame must be single channel 16-bit or float.";
+					return false;
+				}
+				for (const auto& other : entries) {
+					if (other.Binning != static_cast<std::int32_t>(frame.Binning) || other.PixelFormat != static_cast<std::int32_t>(frame.PixelFormat)) {
+						continue;
+					}
+					if (other.Width != image.cols || other.Height != image.rows) {
+						error = "Dark frames of one binning and pixel format must have the same size.";
+						return false;
+					}
+					if (SameExposure(frame.ExposureTime, other.ExposureTime)) {
+						error = "Dark frames of one binning and pixel format must have different exposure times.";
+						return false;
+					}
+				}
+				StoreEntry entry = {};
+				entry.ExposureTime = frame.ExposureTime;
+				entry.Binning = static_cast<std::int32_t>(frame.Binning);
+				entry.PixelFormat = static_cast<std::int32_t>(frame.PixelFormat);
+				entry.Width = image.cols;
+				entry.Height = image.rows;
+				entry.Type = image.type();
+				entry.Step = static_cast<std::uint64_t>(image.cols) * image.elemSize();
+				entry.Offset = offset;
+				offset = AlignToPage(offset + entry.Step * image.rows);
+				entries.push_back(entry);
+				images.push_back(image);
+			}
+
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				error = "Cannot create " + path;
+				return false;
+			}
+			StoreHeader header = { StoreMagic, StoreVersion, static_cast<std::uint32_t>(entries.size()), 0 };
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			if (!entries.empty()) {
+				out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(StoreEntry));
+			}
+			const std::vector<char> padding(static_cast<std::size_t>(PageSize), 0);
+			std::uint64_t position = sizeof(StoreHeader) + entries.size() * sizeof(StoreEntry);
+			for (std::size_t i = 0; i < entries.size(); i++) {
+				out.write(padding.data(), static_cast<std::streamsize>(entries[i].Offset - position));
+				for (int y = 0; y < images[i].rows; y++) {
+					out.write(reinterpret_cast<const char*>(images[i].ptr(y)), static_cast<std::streamsize>(entries[i].Step));
+				}
+				position = entries[i].Offset + entries[i].Step * entries[i].Height;
+			}
+			if (!out) {
+				error = "Failed to write " + path;
+				return false;
+			}
+			return true;
+		}
+
+		bool DarkFrameStore::Open(const std::string& path, std::string& error) {
+			Close();
+			state->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+			if (state->file == INVALID_HANDLE_VALUE) {
+				error = "Cannot open " + path;
+				return false;
+			}
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(state->file, &size) || static_cast<std::uint64_t>(size.QuadPart) < sizeof(StoreHeader)) {
+				error = "Not a dark frame store: " + path;
+				Close();
+				return false;
+			}
+			state->mapping = CreateFileMappingA(state->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (state->mapping != nullptr) {
+				state->base = static_cast<const unsigned char*>(MapViewOfFile(state->mapping, FILE_MAP_READ, 0, 0, 0));
+			}
+			if (state->base == nullptr) {
+				error = "Cannot map " + path;
+				Close();
+				return false;
+			}
+
+			const StoreHeader* header = reinterpret_cast<const StoreHeader*>(state->base);
+			std::uint64_t fileSize = static_cast<std::uint64_t>(size.QuadPart);
+			if (header->Magic != StoreMagic || header->Version != StoreVersion
+				|| sizeof(StoreHeader) + static_cast<std::uint64_t>(header->Count) * sizeof(StoreEntry) > fileSize) {
+				error = "Not a dark frame store: " + path;
+				Close();
+				return false;
+			}
+			const StoreEntry* entries = reinterpret_cast<const StoreEntry*>(state->base + sizeof(StoreHeader));
+			for (std::uint32_t i = 0; i < header->Count; i++) {
+				const StoreEntry& entry = entries[i];
+				if (!IsDarkType(entry.Type) || entry.Width <= 0 || entry.Height <= 0
+					|| entry.Step != static_cast<std::uint64_t>(entry.Width) * CV_ELEM_SIZE(entry.Type)) {
+					error = "Dark frame store has an invalid entry: " + path;
+					Close();
+					return false;
+				}
+				if (entry.Offset + entry.Step * entry.Height > fileSize) {
+					error = "Dark frame store is truncated: " + path;
+					Close();
+					return false;
+				}
+				for (const auto& other : state->entries) {
+					if (other.Binning == entry.Binning && other.PixelFormat == entry.PixelFormat
+						&& SameExposure(entry.ExposureTime, other.ExposureTime)) {
+						error = "Dark frame store has two frames of one exposure time: " + path;
+						Close();
+						return false;
+					}
+				}
+				state->entries.push_back(entry);
+			}
+			return true;
+		}
+
+		void DarkFrameStore::Close() {
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->cache.clear();
+			state->entries.clear();
+			if (state->base != nullptr) {
+				UnmapViewOfFile(state->base);
+				state->base = nullptr;
+			}
+			if (state->mapping != nullptr) {
+				CloseHandle(state->mapping);
+				state->mapping = nullptr;
+			}
+			if (state->file != INVALID_HANDLE_VALUE) {
+				CloseHandle(state->file);
+				state->file = INVALID_HANDLE_VALUE;
+			}
+		}
+
+		bool DarkFrameStore::IsOpen() const {
+			return state->base != nullptr;
+		}
+
+		std::size_t DarkFrameStore::Count() const {
+			return state->entries.size();
+		}
+
+		std::vector<double> DarkFrameStore::GetExposureTimes(ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format) const {
+			std::vector<double> times;
+			for (const StoreEntry* entry : state->Select(binning, format)) {
+				times.push_back(entry->ExposureTime);
+			}
+			return times;
+		}
+
+		void DarkFrameStore::Prefetch(ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format) const {
+			volatile unsigned char sink = 0;
+			for (const StoreEntry* entry : state->Select(binning, format)) {
+				const unsigned char* data = state->base + entry->Offset;
+				std::uint64_t length = entry->Step * entry->Height;
+				for (std::uint64_t i = 0; i < length; i += PageSize) {
+					sink ^= data[i];
+				}
+			}
+		}
+
+		bool DarkFrameStore::GetDark(double exposureTime, ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format,
+			cv::Mat& dark) const {
+			std::vector<const StoreEntry*> selected = state->Select(binning, format);
+			if (selected.empty()) {
+				return false;
+			}
+			for (const StoreEntry* entry : selected) {
+				if (SameExposure(exposureTime, entry->ExposureTime)) {
+					dark = state->View(*entry);
+					return true;
+				}
+			}
+			if (selected.size() == 1) {
+				dark = state->View(*selected.front());
+				return true;
+			}
+
+			std::int32_t binningKey = static_cast<std::int32_t>(binning);
+			std::int32_t formatKey = static_cast<std::int32_t>(format);
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				for (const auto& cached : state->cache) {
+					if (cached.Binning == binningKey && cached.PixelFormat == formatKey && SameExposure(exposureTime, cached.ExposureTime)) {
+						dark = cached.Image;
+						return true;
+					}
+				}
+			}
+
+			// Two nearest stored exposure times, the outermost pair outside the range
+			std::size_t upper = 1;
+			while (upper + 1 < selected.size() && selected[upper]->ExposureTime < exposureTime) {
+				upper++;
+			}
+			const StoreEntry& e0 = *selected[upper - 1];
+			const StoreEntry& e1 = *selected[upper];
+			// Open() rejects equal exposure times; a pair closer than that has no slope to interpolate along
+			if (!(e1.ExposureTime - e0.ExposureTime > 0.0)) {
+				dark = state->View(e0);
+				return true;
+			}
+			double weight = (exposureTime - e0.ExposureTime) / (e1.ExposureTime - e0.ExposureTime);
+			cv::Mat interpolated;
+			cv::addWeighted(state->View(e0), 1.0 - weight, state->View(e1), weight, 0.0, interpolated, CV_32F);
+			if (weight < 0.0 || weight > 1.0) {
+				cv::max(interpolated, 0.0, interpolated);
+			}
+
+			std::lock_guard<std::mutex> guard(state->lock);
+			CachedDark cached = { exposureTime, binningKey, formatKey, interpolated };
+			state->cache.push_front(cached);
+			if (state->cache.size() > InterpolationCacheSize) {
+				state->cache.pop_back();
+			}
+			dark = interpolated;
+			return true;
+		}
+	}
+}
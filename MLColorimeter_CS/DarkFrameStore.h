@@ -0,0 +1,75 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and DarkFrameStore.cpp (compiled without /clr)
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "MLCamaraCommon.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// One dark frame to put into a store, from Image or, if Image is empty, read from Path.
+		struct NativeDarkFrame
+		{
+			double ExposureTime = 0.0;
+			ML::CameraV2::Binning Binning = ML::CameraV2::Binning::ONE_BY_ONE;
+			ML::CameraV2::MLPixelFormat PixelFormat = ML::CameraV2::MLPixelFormat::MLMono12;
+			cv::Mat Image;
+			std::string Path;
+		};
+
+		/// Dark frames of all exposure times, binnings and pixel formats in one memory-mapped file.
+		/// Layout: header, entry table, then every frame at a page-aligned offset, so a frame is only read
+		/// from disk when its pages are first touched (or by Prefetch()).
+		/// GetDark() returns the stored frame for a known exposure time and a linear interpolation of the two
+		/// nearest exposure times otherwise. Interpolated frames of the last few requests are kept, so repeated
+		/// requests for the same exposure time cost nothing. Thread safe once opened.
+		class DarkFrameStore
+		{
+		public:
+			DarkFrameStore();
+			~DarkFrameStore();
+
+			DarkFrameStore(const DarkFrameStore&) = delete;
+			DarkFrameStore& operator=(const DarkFrameStore&) = delete;
+
+			/// Write a store file. Frames must be single channel 16-bit or float, the dark types of the correction kernels,
+			/// and those of one binning/pixel format must have one size and different exposure times.
+			static bool Write(const std::string& path, const std::vector<NativeDarkFrame>& frames, std::string& error);
+
+			/// Map a store file, read only. Fails if an entry's type, step or extent does not match the file, or if two
+			/// entries of a binning/pixel format have the same exposure time.
+			bool Open(const std::string& path, std::string& error);
+
+			/// Unmap the file, views returned by GetDark() become invalid.
+			void Close();
+
+			bool IsOpen() const;
+
+			std::size_t Count() const;
+
+			/// Stored exposure times of a binning/pixel format, ascending.
+			std::vector<double> GetExposureTimes(ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format) const;
+
+			/// Touch every page of the frames of a binning/pixel format.
+			void Prefetch(ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format) const;
+
+			/// Dark frame for an exposure time.
+			/// A stored exposure time gives a read-only view on the mapping, valid until Close(), in the stored type.
+			/// Any other gives a CV_32FC1 interpolation of the two nearest stored exposure times, extrapolated
+			/// linearly outside the stored range and clamped at 0; shared with the cache, do not modify it.
+			/// A single stored frame is returned for every exposure time.
+			/// @return false if the store has no frame of the binning/pixel format.
+			bool GetDark(double exposureTime, ML::CameraV2::Binning binning, ML::CameraV2::MLPixelFormat format,
+				cv::Mat& dark) const;
+
+		private:
+			// Holds the std::mutex and the Win32 handles
+			struct State;
+			std::unique_ptr<State> state;
+		};
+	}
+}
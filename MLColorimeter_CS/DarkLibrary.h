@@ -0,0 +1,167 @@
+#pragma once
+
+#include "DarkFrameStore.h"
+#include "MLConverters.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// One dark frame to write into a DarkLibrary.
+		/// </summary>
+		public ref class DarkFrame {
+		public:
+			property double ExposureTime;
+			property MLCommon::Binning Binning;
+			property MLCommon::MLPixelFormat PixelFormat;
+			/// <summary>
+			/// Dark image, single channel 16-bit or float. If nullptr the image is read from FilePath.
+			/// </summary>
+			property NativeImage^ Image;
+			/// <summary>
+			/// TIFF file of the dark image, used when Image is nullptr.
+			/// </summary>
+			property String^ FilePath;
+
+			DarkFrame() {
+				ExposureTime = 0;
+				Binning = MLCommon::Binning::ONE_BY_ONE;
+				PixelFormat = MLCommon::MLPixelFormat::MLMono12;
+				Image = nullptr;
+				FilePath = "";
+			}
+		};
+
+		/// <summary>
+		/// Dark frames of every exposure time, binning and pixel format in one memory-mapped file.
+		/// Frames are paged in from disk on first use, or up front with Prefetch(). Exposure times that are not
+		/// stored are interpolated linearly from the two nearest stored ones, and the last few interpolations are
+		/// kept, so repeated auto-exposure measurements get their dark without disk reads or recomputation.
+		/// </summary>
+		public ref class DarkLibrary
+		{
+		public:
+			~DarkLibrary() {
+				this->!DarkLibrary();
+			}
+
+			!DarkLibrary() {
+				delete store;
+				store = nullptr;
+			}
+
+			/// <summary>
+			/// Write a library file.
+			/// </summary>
+			/// <param name="path">File to create, overwritten if it exists.</param>
+			/// <param name="frames">Dark frames; frames of one binning and pixel format must have the same size and
+			/// different exposure times.</param>
+			static void Write(String^ path, IEnumerable<DarkFrame^>^ frames) {
+				if (path == nullptr) throw gcnew ArgumentNullException("path");
+				if (frames == nullptr) throw gcnew ArgumentNullException("frames");
+				std::vector<NativeDarkFrame> nativeFrames;
+				for each (DarkFrame^ frame in frames) {
+					if (frame == nullptr) throw gcnew ArgumentException("frames contains nullptr.");
+					NativeDarkFrame native;
+					native.ExposureTime = frame->ExposureTime;
+					native.Binning = MLConverter::ToNative(frame->Binning);
+					native.PixelFormat = MLConverter::ToNative(frame->PixelFormat);
+					if (frame->Image != nullptr) {
+						native.Image = frame->Image->GetMat();
+					}
+					else if (frame->FilePath != nullptr) {
+						native.Path = MLConverter::ToNative(frame->FilePath);
+					}
+					nativeFrames.push_back(native);
+				}
+				std::string error;
+				if (!DarkFrameStore::Write(MLConverter::ToNative(path), nativeFrames, error)) {
+					throw gcnew InvalidOperationException(MLConverter::ToManaged(error));
+				}
+			}
+
+			/// <summary>
+			/// Open a library file, read only. Dispose the library to unmap it.
+			/// </summary>
+			static DarkLibrary^ Open(String^ path) {
+				if (path == nullptr) throw gcnew ArgumentNullException("path");
+				DarkLibrary^ library = gcnew DarkLibrary();
+				std::string error;
+				if (!library->store->Open(MLConverter::ToNative(path), error)) {
+					delete library;
+					throw gcnew System::IO::IOException(MLConverter::ToManaged(error));
+				}
+				return library;
+			}
+
+			/// <summary>
+			/// Number of stored frames.
+			/// </summary>
+			property int Count {
+				int get() { return static_cast<int>(GetStore().Count()); }
+			}
+
+			/// <summary>
+			/// Stored exposure times of a binning and pixel format, ascending.
+			/// </summary>
+			array<double>^ GetExposureTimes(Binning binning, MLPixelFormat pixelFormat) {
+				std::vector<double> times = GetStore().GetExposureTimes(MLConverter::ToNative(binning), MLConverter::ToNative(pixelFormat));
+				array<double>^ result = gcnew array<double>(static_cast<int>(times.size()));
+				for (int i = 0; i < result->Length; i++) {
+					result[i] = times[i];
+				}
+				return result;
+			}
+
+			/// <summary>
+			/// Read the frames of a binning and pixel format into memory now, e.g. before a measurement series.
+			/// </summary>
+			void Prefetch(Binning binning, MLPixelFormat pixelFormat) {
+				GetStore().Prefetch(MLConverter::ToNative(binning), MLConverter::ToNative(pixelFormat));
+			}
+
+			/// <summary>
+			/// Dark frame for an exposure time: the stored frame, or a float interpolation of the two nearest stored
+			/// exposure times (extrapolated outside the stored range, clamped at 0).
+			/// </summary>
+			/// <param name="exposureTime">Exposure time, same unit as the stored frames.</param>
+			/// <param name="binning">Camera binning.</param>
+			/// <param name="pixelFormat">Camera pixel format.</param>
+			/// <returns>A new image, or an image shared with the interpolation cache which must not be modified.</returns>
+			NativeImage^ GetDark(double exposureTime, Binning binning, MLPixelFormat pixelFormat) {
+				cv::Mat dark = GetDarkMat(exposureTime, binning, pixelFormat);
+				// A stored frame is a view on the mapping, copy it so the image outlives the library
+				return gcnew NativeImage(dark.u == nullptr ? dark.clone() : dark);
+			}
+
+		internal:
+			DarkFrameStore& GetStore() {
+				if (store == nullptr) {
+					throw gcnew ObjectDisposedException("DarkLibrary");
+				}
+				return *store;
+			}
+
+			/// Without copy, a stored frame is only valid while the library is open.
+			cv::Mat GetDarkMat(double exposureTime, Binning binning, MLPixelFormat pixelFormat) {
+				cv::Mat dark;
+				if (!GetStore().GetDark(exposureTime, MLConverter::ToNative(binning), MLConverter::ToNative(pixelFormat), dark)) {
+					throw gcnew KeyNotFoundException(String::Format("No dark frame for {0}/{1}.", binning, pixelFormat));
+				}
+				return dark;
+			}
+
+		private:
+			DarkLibrary() {
+				store = new DarkFrameStore();
+			}
+
+			DarkFrameStore* store;
+		};
+	}
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+using namespace System;
+using namespace System::Threading;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// What a callback queue does when it is full.
+		/// </summary>
+		public enum class OverflowPolicy {
+			/// <summary>Discard the oldest queued event to make room.</summary>
+			DropOldest,
+			/// <summary>Discard the incoming event.</summary>
+			DropNewest,
+			/// <summary>Block the SDK thread until the dispatcher frees a slot.</summary>
+			Block
+		};
+
+		/// <summary>
+		/// Settings of an asynchronous callback dispatcher.
+		/// </summary>
+		public ref class DispatchOptions
+		{
+		public:
+			DispatchOptions() {
+				Capacity = 64;
+				Policy = OverflowPolicy::DropOldest;
+			}
+
+			/// <summary>
+			/// Queue capacity, rounded up to a power of two.
+			/// </summary>
+			property int Capacity;
+
+			/// <summary>
+			/// Behaviour when the queue is full.
+			/// </summary>
+			property OverflowPolicy Policy;
+		};
+
+		/// <summary>
+		/// Snapshot of a callback queue.
+		/// </summary>
+		public value struct DispatchStatistics
+		{
+			/// <summary>Events currently waiting in the queue.</summary>
+			int Depth;
+			/// <summary>Highest queue depth observed.</summary>
+			int MaxDepth;
+			/// <summary>Events accepted into the queue.</summary>
+			long long Enqueued;
+			/// <summary>Events delivered to the managed handler.</summary>
+			long long Dispatched;
+			/// <summary>Events discarded by the overflow policy.</summary>
+			long long Dropped;
+			/// <summary>Mean time between enqueue and delivery, in milliseconds.</summary>
+			double AverageLatencyMs;
+			/// <summary>Longest time between enqueue and delivery, in milliseconds.</summary>
+			double MaxLatencyMs;
+		};
+
+		/// <summary>
+		/// Bounded lock-free queue fed by an SDK callback thread and drained by the dispatcher thread.
+		/// T must be trivially copyable and provide Discard(), which is called for events dropped by the overflow policy.
+		/// Each entry carries a sequence number telling whether it is free, being written or readable, so under
+		/// DropOldest the producer takes the oldest entry exactly like the consumer does and never reads an entry
+		/// the other side is using.
+		/// </summary>
+		template <typename T>
+		class DispatchQueue
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "DispatchQueue items must be trivially copyable");
+
+		public:
+			DispatchQueue(int capacity, int policy) : policy(policy) {
+				size_t size = 1;
+				while (size < static_cast<size_t>(capacity > 1 ? capacity : 2)) size <<= 1;
+				mask = size - 1;
+				entries.reset(new Entry[size]);
+				for (size_t i = 0; i < size; i++) {
+					entries[i].sequence.store(i, std::memory_order_relaxed);
+				}
+				itemEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+				spaceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+			}
+
+			~DispatchQueue() {
+				T item;
+				long long time;
+				while (Take(item, time)) {
+					item.Discard();
+				}
+				CloseHandle(itemEvent);
+				CloseHandle(spaceEvent);
+			}
+
+			/// Called on the SDK thread.
+			/// @return false if the event was discarded.
+			bool Enqueue(const T& item) {
+				LARGE_INTEGER now;
+				QueryPerformanceCounter(&now);
+				for (;;) {
+					size_t position;
+					Entry* entry = Claim(tailIndex, 0, position);
+					if (entry != nullptr) {
+						entry->value = item;
+						entry->time = now.QuadPart;
+						entry->sequence.store(position + 1, std::memory_order_release);
+						enqueued.fetch_add(1);
+						UpdateMaxDepth(static_cast<int>(position + 1 - headIndex.load()));
+						SetEvent(itemEvent);
+						return true;
+					}
+					if (policy == static_cast<int>(OverflowPolicy::DropNewest) || closed.load()) {
+						dropped.fetch_add(1);
+						T discarded = item;
+						discarded.Discard();
+						return false;
+					}
+					if (policy == static_cast<int>(OverflowPolicy::DropOldest)) {
+						// The consumer may have taken it first, then there is room anyway
+						T oldest;
+						long long time;
+						if (Take(oldest, time)) {
+							dropped.fetch_add(1);
+							oldest.Discard();
+						}
+						continue;
+					}
+					WaitForSingleObject(spaceEvent, 1);
+				}
+			}
+
+			/// Called on the dispatcher thread.
+			bool TryDequeue(T& item, long long& latency) {
+				long long time;
+				if (!Take(item, time)) return false;
+				LARGE_INTEGER now;
+				QueryPerformanceCounter(&now);
+				latency = now.QuadPart - time;
+				dispatched.fetch_add(1);
+				latencySum.fetch_add(latency);
+				long long currentMax = latencyMax.load();
+				while (latency > currentMax && !latencyMax.compare_exchange_weak(currentMax, latency)) {}
+				SetEvent(spaceEvent);
+				return true;
+			}
+
+			/// Stop blocking producers, further events that do not fit are dropped.
+			void Close() {
+				closed.store(true);
+				SetEvent(spaceEvent);
+				SetEvent(itemEvent);
+			}
+
+			HANDLE GetItemEvent() const { return itemEvent; }
+
+			DispatchStatistics GetStatistics() const {
+				LARGE_INTEGER frequency;
+				QueryPerformanceFrequency(&frequency);
+				double ticksToMs = 1000.0 / static_cast<double>(frequency.QuadPart);
+				DispatchStatistics statistics;
+				size_t head = headIndex.load();
+				statistics.Depth = static_cast<int>(tailIndex.load() - head);
+				statistics.MaxDepth = maxDepth.load();
+				statistics.Enqueued = enqueued.load();
+				statistics.Dispatched = dispatched.load();
+				statistics.Dropped = dropped.load();
+				statistics.AverageLatencyMs = statistics.Dispatched > 0 ? latencySum.load() * ticksToMs / statistics.Dispatched : 0.0;
+				statistics.MaxLatencyMs = latencyMax.load() * ticksToMs;
+				return statistics;
+			}
+
+		private:
+			// sequence == position: free for the producer at position
+			// sequence == position + 1: written, readable by the consumer at position
+			struct Entry {
+				std::atomic<size_t> sequence;
+				T value;
+				long long time;
+			};
+
+			// Claim the entry at index (tail: offset 0, head: offset 1), nullptr if the queue is full / empty
+			Entry* Claim(std::atomic<size_t>& index, size_t offset, size_t& position) {
+				position = index.load(std::memory_order_relaxed);
+				for (;;) {
+					Entry& entry = entries[position & mask];
+					size_t sequence = entry.sequence.load(std::memory_order_acquire);
+					std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence - (position + offset));
+					if (difference == 0) {
+						if (index.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+							return &entry;
+						}
+					}
+					else if (difference < 0) {
+						return nullptr;
+					}
+					else {
+						position = index.load(std::memory_order_relaxed);
+					}
+				}
+			}
+
+			// Take the oldest entry and free it for the producer
+			bool Take(T& item, long long& time) {
+				size_t position;
+				Entry* entry = Claim(headIndex, 1, position);
+				if (entry == nullptr) return false;
+				item = entry->value;
+				time = entry->time;
+				entry->sequence.store(position + mask + 1, std::memory_order_release);
+				return true;
+			}
+
+			void UpdateMaxDepth(int depth) {
+				int currentMax = maxDepth.load();
+				while (depth > currentMax && !maxDepth.compare_exchange_weak(currentMax, depth)) {}
+			}
+
+			std::unique_ptr<Entry[]> entries;
+			size_t mask;
+			int policy;
+			HANDLE itemEvent;
+			HANDLE spaceEvent;
+			std::atomic<size_t> headIndex{ 0 };
+			std::atomic<size_t> tailIndex{ 0 };
+			std::atomic<bool> closed{ false };
+			std::atomic<int> maxDepth{ 0 };
+			std::atomic<long long> enqueued{ 0 };
+			std::atomic<long long> dispatched{ 0 };
+			std::atomic<long long> dropped{ 0 };
+			std::atomic<long long> latencySum{ 0 };
+			std::atomic<long long> latencyMax{ 0 };
+		};
+
+		/// <summary>
+		/// Managed thread draining a DispatchQueue into TOwner::Dispatch(const T&).
+		/// </summary>
+		template <typename T, typename TOwner>
+		ref class CallbackDispatcher
+		{
+		public:
+			CallbackDispatcher(TOwner owner, DispatchOptions^ options) : owner(owner), stopping(false) {
+				if (options == nullptr) {
+					options = gcnew DispatchOptions();
+				}
+				if (options->Capacity <= 0) {
+					throw gcnew ArgumentOutOfRangeException("Capacity");
+				}
+				queue = new DispatchQueue<T>(options->Capacity, static_cast<int>(options->Policy));
+				thread = gcnew Thread(gcnew ThreadStart(this, &CallbackDispatcher::Run));
+				thread->IsBackground = true;
+				thread->Name = "MLColorimeter callback dispatcher";
+				thread->Start();
+			}
+
+			~CallbackDispatcher() {
+				this->!CallbackDispatcher();
+			}
+
+			!CallbackDispatcher() {
+				if (queue == nullptr) return;
+				stopping = true;
+				queue->Close();
+				if (thread != nullptr && thread != Thread::CurrentThread) {
+					thread->Join();
+				}
+				delete queue;
+				queue = nullptr;
+			}
+
+			DispatchQueue<T>* GetQueue() { return queue; }
+
+			property DispatchStatistics Statistics {
+				DispatchStatistics get() { return queue->GetStatistics(); }
+			}
+
+		private:
+			void Run() {
+				T item;
+				long long latency;
+				while (!stopping) {
+					WaitForSingleObject(queue->GetItemEvent(), INFINITE);
+					while (queue->TryDequeue(item, latency)) {
+						try {
+							owner->Dispatch(item);
+						}
+						catch (Exception^ ex) {
+							// A throwing handler must not stop the dispatcher
+							System::Diagnostics::Trace::WriteLine(ex->ToString());
+						}
+					}
+				}
+			}
+
+			TOwner owner;
+			DispatchQueue<T>* queue;
+			Thread^ thread;
+			volatile bool stopping;
+		};
+	}
+}
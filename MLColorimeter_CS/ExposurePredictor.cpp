@@ -0,0 +1,291 @@
+// Compiled without /clr: uses std::async
+
+#include "ExposurePredictor.h"
+#include "StatisticsKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <string>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			typedef std::chrono::steady_clock Clock;
+
+			// Above this fraction of the full scale a sample is treated as saturated
+			const double SaturatedLevel = 0.98;
+			// Largest change of the exposure time in one step
+			const double MaxStep = 16.0;
+
+			int Key(ML::MLFilterWheel::MLFilterEnum nd, ML::MLFilterWheel::MLFilterEnum filter) {
+				return static_cast<int>(nd) * 64 + static_cast<int>(filter);
+			}
+		}
+
+		struct ExposurePredictor::State
+		{
+			mutable std::mutex mutex;
+			PredictiveExposureSettings settings;
+			// Learned log sensitivity of each (ND, color filter) pair, relative to the first one seen
+			std::map<int, double> gains;
+
+			struct Last
+			{
+				int Key;
+				double Time;
+				double Sensitivity;
+			};
+			// Last converged pair of each module
+			std::map<int, Last> last;
+		};
+
+		ExposurePredictor::ExposurePredictor() : state(new State()) {
+		}
+
+		ExposurePredictor::~ExposurePredictor() {
+		}
+
+		void ExposurePredictor::SetSettings(const PredictiveExposureSettings& settings) {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->settings = settings;
+		}
+
+		PredictiveExposureSettings ExposurePredictor::GetSettings() const {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			return state->settings;
+		}
+
+		void ExposurePredictor::Reset() {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->gains.clear();
+			state->last.clear();
+		}
+
+		int ExposurePredictor::LearnedCount() const {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			return static_cast<int>(state->gains.size());
+		}
+
+		double ExposurePredictor::GrayLevel(const cv::Mat& image, double percentile, int stride) {
+			return GrayLevel(image, ML::CameraV2::Binning::ONE_BY_ONE, cv::Rect(), percentile, stride);
+		}
+
+		double ExposurePredictor::GrayLevel(const cv::Mat& image, ML::CameraV2::Binning binning, const cv::Rect& roi,
+			double percentile, int stride) {
+			if (image.empty()) return 0;
+			PixelStatisticsOptions options;
+			options.Stride = std::max(stride, 1);
+			if (!roi.empty()) {
+				int factor = 1 << static_cast<int>(binning);
+				options.Roi = cv::Rect(roi.x / factor, roi.y / factor, std::max(roi.width / factor, 1), std::max(roi.height / factor, 1));
+				options.Roi &= cv::Rect(0, 0, image.cols, image.rows);
+				if (options.Roi.empty()) return 0;
+			}
+			cv::Mat region = options.Roi.empty() ? image : image(options.Roi);
+			std::vector<PixelStatistics> channels;
+			if (image.channels() == 1) {
+				if (ComputePixelStatistics(image, options, channels, KernelAuto)) {
+					return HistogramPercentile(channels[0], percentile);
+				}
+			}
+			else {
+				// The kernel takes one channel: the brightest channel of the region decides
+				options.Roi = cv::Rect();
+				double level = 0;
+				bool computed = true;
+				for (int c = 0; c < image.channels() && computed; c++) {
+					cv::Mat plane;
+					cv::extractChannel(region, plane, c);
+					computed = ComputePixelStatistics(plane, options, channels, KernelAuto);
+					if (computed) level = std::max(level, HistogramPercentile(channels[0], percentile));
+				}
+				if (computed) return level;
+			}
+			// Depths the kernel does not take (float): the largest value of the region
+			double maxValue = 0;
+			cv::minMaxLoc(region.reshape(1), nullptr, &maxValue);
+			return maxValue;
+		}
+
+		double ExposurePredictor::FullScale(ML::CameraV2::MLPixelFormat format, const cv::Mat& image) {
+			switch (format) {
+			case ML::CameraV2::MLPixelFormat::MLMono8: return 255;
+			case ML::CameraV2::MLPixelFormat::MLMono10: return 1023;
+			case ML::CameraV2::MLPixelFormat::MLMono12: return 4095;
+			case ML::CameraV2::MLPixelFormat::MLMono16: return 65535;
+			default: return image.depth() == CV_16U ? 65535 : 255;
+			}
+		}
+
+		double ExposurePredictor::NextTime(double previousTime, double previousLevel, double time, double level,
+			double target, double fullScale) {
+			double next;
+			if (level >= SaturatedLevel * fullScale) {
+				next = time / 4;
+			}
+			else if (level <= 0) {
+				next = time * 8;
+			}
+			else {
+				// Secant through the last two samples, proportional (line through the origin) without a usable pair
+				double slope = 0;
+				if (previousTime > 0 && previousTime != time && previousLevel < SaturatedLevel * fullScale) {
+					slope = (level - previousLevel) / (time - previousTime);
+				}
+				next = slope > 0 ? time + (target - level) / slope : time * target / level;
+			}
+			return std::min(std::max(next, time / MaxStep), time * MaxStep);
+		}
+
+		double ExposurePredictor::Seed(int moduleID, int key, double fallback) const {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			auto last = state->last.find(moduleID);
+			if (last == state->last.end()) return fallback;
+			auto to = state->gains.find(key);
+			auto from = state->gains.find(last->second.Key);
+			if (to == state->gains.end() || from == state->gains.end()) return last->second.Time;
+			double sensitivity = last->second.Sensitivity * std::exp(to->second - from->second);
+			return sensitivity > 0 ? state->settings.TargetLevel / sensitivity : last->second.Time;
+		}
+
+		void ExposurePredictor::Learn(int moduleID, int key, double time, double sensitivity) {
+			std::lock_guard<std::mutex> lock(state->mutex);
+			auto last = state->last.find(moduleID);
+			if (last != state->last.end() && last->second.Key != key) {
+				double& reference = state->gains.emplace(last->second.Key, 0.0).first->second;
+				double observed = reference + std::log(sensitivity / last->second.Sensitivity);
+				auto gain = state->gains.find(key);
+				if (gain == state->gains.end()) {
+					state->gains[key] = observed;
+				}
+				else {
+					gain->second += state->settings.LearningRate * (observed - gain->second);
+				}
+			}
+			state->last[moduleID] = State::Last{ key, time, sensitivity };
+		}
+
+		Result ExposurePredictor::RunModule(int moduleID, ML::MLColorimeter::MLMonoBusinessManage* module, int key, double initialTime,
+			ExposureOutcome& outcome) {
+			Clock::time_point start = Clock::now();
+			PredictiveExposureSettings settings = GetSettings();
+			double time = std::min(std::max(Seed(moduleID, key, initialTime), settings.MinTime), settings.MaxTime);
+			outcome.InitialTime = time;
+			Result ret;
+
+			// Coarser binning for the intermediate frames; summed binning collects factor^2 more signal per pixel
+			ML::CameraV2::Binning binning = module->ML_GetBinning();
+			double previewScale = 1;
+			bool preview = false;
+			if (settings.PreviewBinning > binning && module->ML_SetBinning(settings.PreviewBinning).success) {
+				preview = true;
+				int factor = 1 << (settings.PreviewBinning - binning);
+				previewScale = module->ML_GetBinningMode() == ML::CameraV2::BinningMode::SUM ? factor * factor : 1;
+				time = std::max(time / previewScale, settings.MinTime);
+			}
+
+			double previousTime = 0, previousLevel = 0;
+			double fullScale = 0;
+			for (int iteration = 1; ; iteration++) {
+				// The last allowed frame is always taken at the camera's binning
+				bool last = iteration >= settings.MaxIterations;
+				if (preview && last) {
+					preview = false;
+					ret = module->ML_SetBinning(binning);
+					if (!ret.success) break;
+					time = std::min(time * previewScale, settings.MaxTime);
+				}
+				ML::MLColorimeter::ExposureSetting exposure;
+				exposure.Mode = ML::MLColorimeter::ExposureMode::Fixed;
+				exposure.ExposureTime = time;
+				ret = module->ML_SetExposure(exposure);
+				if (ret.success) ret = module->ML_CaptureImageSync();
+				if (!ret.success) break;
+				cv::Mat image = module->ML_GetImage();
+				if (fullScale == 0) fullScale = FullScale(module->ML_GetPixelFormat(), image);
+				double level = GrayLevel(image, preview ? settings.PreviewBinning : binning, settings.Roi,
+					settings.Percentile, settings.SampleStride);
+				double target = settings.TargetLevel * fullScale;
+				outcome.Time = time;
+				outcome.Level = level / fullScale;
+				outcome.Iterations = iteration;
+				if (preview) outcome.PreviewIterations++;
+				bool within = std::abs(level - target) <= settings.Tolerance * target;
+				if (within && !preview) {
+					outcome.Converged = true;
+					break;
+				}
+				if (within) {
+					// Converged at the preview binning: one more frame at the camera's binning
+					preview = false;
+					ret = module->ML_SetBinning(binning);
+					if (!ret.success) break;
+					time = std::min(time * previewScale, settings.MaxTime);
+					previousTime = 0;
+					continue;
+				}
+				if (last) break;
+				double next = std::min(std::max(NextTime(previousTime, previousLevel, time, level, target, fullScale),
+					settings.MinTime), settings.MaxTime);
+				if (next == time && !preview) {
+					// Clamped to the range, the last frame is the best there is
+					break;
+				}
+				previousTime = time;
+				previousLevel = level;
+				time = next;
+			}
+			if (preview) {
+				Result restored = module->ML_SetBinning(binning);
+				if (ret.success) ret = restored;
+				// The capture is not at the camera's binning, not usable as the measurement frame
+				if (ret.success) ret = Result(false, "Auto exposure ended at the preview binning.");
+			}
+			if (ret.success && !outcome.Converged) {
+				ret = Result(false, "Auto exposure of module " + std::to_string(moduleID) + " did not converge: gray level "
+					+ std::to_string(outcome.Level) + " of the full scale after " + std::to_string(outcome.Iterations)
+					+ " frames, exposure time " + std::to_string(outcome.Time) + " ms.", NotConvergedCode);
+			}
+			if (outcome.Converged) {
+				// Sensitivity in fractions of the full scale per millisecond, independent of the pixel format
+				Learn(moduleID, key, outcome.Time, outcome.Level / outcome.Time);
+			}
+			outcome.Milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			return ret;
+		}
+
+		Result ExposurePredictor::Run(const std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>>& modules,
+			ML::MLFilterWheel::MLFilterEnum nd, ML::MLFilterWheel::MLFilterEnum filter, double initialTime, bool parallel,
+			std::map<int, ExposureOutcome>& outcomes) {
+			int key = Key(nd, filter);
+			std::vector<ExposureOutcome> results(modules.size());
+			Result ret;
+			if (!parallel) {
+				for (std::size_t i = 0; i < modules.size(); i++) {
+					Result r = RunModule(modules[i].first, modules[i].second, key, initialTime, results[i]);
+					if (!r.success && ret.success) ret = r;
+				}
+			}
+			else {
+				std::vector<std::future<Result>> runs;
+				for (std::size_t i = 0; i < modules.size(); i++) {
+					runs.push_back(std::async(std::launch::async, [this, &modules, &results, i, key, initialTime]() {
+						return RunModule(modules[i].first, modules[i].second, key, initialTime, results[i]);
+					}));
+				}
+				for (auto& run : runs) {
+					Result r = run.get();
+					if (!r.success && ret.success) ret = r;
+				}
+			}
+			for (std::size_t i = 0; i < modules.size(); i++) {
+				outcomes[modules[i].first] = results[i];
+			}
+			return ret;
+		}
+	}
+}
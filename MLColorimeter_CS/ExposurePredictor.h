@@ -0,0 +1,112 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and ExposurePredictor.cpp (compiled without /clr)
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "MLMonoBusinessManage.h"
+#include "MLFilterWheelClass.h"
+#include "Result.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		struct PredictiveExposureSettings
+		{
+			/// Target gray level, fraction of the full scale of the pixel format.
+			double TargetLevel = 0.7;
+			/// Accepted relative deviation from the target.
+			double Tolerance = 0.05;
+			/// Percentile of the sampled pixels used as the gray level.
+			double Percentile = 0.99;
+			/// Every SampleStride-th pixel of every SampleStride-th row is sampled.
+			int SampleStride = 4;
+			int MaxIterations = 10;
+			/// Exposure time range, in milliseconds.
+			double MinTime = 0.05;
+			double MaxTime = 30000;
+			/// Weight of a new observation in the learned transmission ratios.
+			double LearningRate = 0.3;
+			/// Binning of the intermediate iterations. If coarser than the camera's binning, the iterations run at
+			/// it and only the last frame is captured at the camera's binning, with the exposure rescaled.
+			ML::CameraV2::Binning PreviewBinning = ML::CameraV2::Binning::ONE_BY_ONE;
+			/// Region of the gray level, in unbinned sensor pixels, empty for the whole frame.
+			cv::Rect Roi;
+		};
+
+		/// Outcome of one module's auto exposure.
+		struct ExposureOutcome
+		{
+			double InitialTime = 0;
+			double Time = 0;
+			double Level = 0;
+			int Iterations = 0;
+			/// Iterations run at the preview binning, included in Iterations.
+			int PreviewIterations = 0;
+			bool Converged = false;
+			double Milliseconds = 0;
+		};
+
+		/// Auto exposure that starts each filter from the previous filter's converged exposure, scaled by the learned
+		/// transmission ratio of the two (ND, color filter) pairs, and updates the exposure with a secant step on the
+		/// measured gray levels. The ratios are shared by all modules. The last capture of a module is taken at the
+		/// exposure it converged to and at the camera's binning, so it can be used as the measurement frame.
+		/// Intermediate iterations can run at a coarser binning and measure only a region. Thread safe.
+		class ExposurePredictor
+		{
+		public:
+			ExposurePredictor();
+			~ExposurePredictor();
+
+			ExposurePredictor(const ExposurePredictor&) = delete;
+			ExposurePredictor& operator=(const ExposurePredictor&) = delete;
+
+			void SetSettings(const PredictiveExposureSettings& settings);
+			PredictiveExposureSettings GetSettings() const;
+
+			/// Forget the learned ratios and the previous exposures.
+			void Reset();
+
+			/// Number of (ND, color filter) pairs with a learned ratio.
+			int LearnedCount() const;
+
+			/// Error code of Run() when a module stopped short of the target: out of iterations, or the exposure time
+			/// clamped to its range. The last frame is still captured and reported, but is not a valid measurement.
+			static const int NotConvergedCode = 2;
+
+			/// Run auto exposure on the modules, concurrently if parallel is true.
+			/// initialTime is used for a module with nothing to predict from. Fails with NotConvergedCode if a module
+			/// did not reach the target; the outcomes are filled in either case.
+			Result Run(const std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>>& modules,
+				ML::MLFilterWheel::MLFilterEnum nd, ML::MLFilterWheel::MLFilterEnum filter, double initialTime, bool parallel,
+				std::map<int, ExposureOutcome>& outcomes);
+
+			/// Gray level of an image: the percentile of every stride-th pixel of every stride-th row.
+			static double GrayLevel(const cv::Mat& image, double percentile, int stride);
+
+			/// Gray level of the region roi (unbinned sensor pixels) of an image taken at the given binning.
+			/// For a multi-channel image, the largest gray level of its channels.
+			static double GrayLevel(const cv::Mat& image, ML::CameraV2::Binning binning, const cv::Rect& roi,
+				double percentile, int stride);
+
+			/// Largest pixel value of the pixel format, or of the image depth if the format is not a mono one.
+			static double FullScale(ML::CameraV2::MLPixelFormat format, const cv::Mat& image);
+
+			/// Next exposure time from the last sample and, if valid, the one before (secant), else proportional.
+			/// Saturated or black samples only scale the time by a fixed factor.
+			static double NextTime(double previousTime, double previousLevel, double time, double level,
+				double target, double fullScale);
+
+		private:
+			Result RunModule(int moduleID, ML::MLColorimeter::MLMonoBusinessManage* module, int key, double initialTime,
+				ExposureOutcome& outcome);
+			double Seed(int moduleID, int key, double fallback) const;
+			void Learn(int moduleID, int key, double time, double sensitivity);
+
+			struct State;
+			std::unique_ptr<State> state;
+		};
+	}
+}
@@ -0,0 +1,657 @@
+// Compiled without /clr: uses std::async
+
+#include "FocusSweep.h"
+#include "MtfAnalysis.h"
+#include "ML_addInInterface.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <thread>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			const int MaxSteps = 10000;
+			// Probes of the adaptive refinement, and their offsets from the vertex in rough steps
+			const int MaxRefinements = 20;
+			const double Offsets[] = { 0, -0.5, 0.5 };
+			// Fly scan: passes at decreasing speed, the fraction of the blur limit aimed at, and how long the motion may
+			// take to report moving (unit: millisecond)
+			const int MaxFlyPasses = 3;
+			const double SpeedMargin = 0.8;
+			const int MotionStartTimeout = 2000;
+
+			std::vector<double> Steps(double from, double to, double step) {
+				std::vector<double> positions;
+				double span = (to - from) / step;
+				if (span < 0 || span >= MaxSteps) return positions;
+				int count = static_cast<int>(std::floor(span + 1e-9)) + 1;
+				for (int i = 0; i < count; i++) positions.push_back(from + i * step);
+				// The end of the range is always measured
+				if (positions.back() < to - 1e-9) positions.push_back(to);
+				return positions;
+			}
+
+			// Mean MTF of the ROIs of a frame, NaN if none could be measured
+			double Sharpness(const cv::Mat& frame, const std::vector<cv::Rect>& rois, double frequency, const MtfSettings& settings) {
+				std::vector<double> values;
+				if (CalculateSdkMtfAtFrequency(frame, rois, frequency, settings, values) == 0) {
+					return std::numeric_limits<double>::quiet_NaN();
+				}
+				double sum = 0;
+				int count = 0;
+				for (double value : values) {
+					if (std::isnan(value)) continue;
+					sum += value;
+					count++;
+				}
+				return sum / count;
+			}
+
+			// Index of the best step of a curve after a moving average over smooth steps, -1 if nothing was measured.
+			// offset: sub-step position of the peak from a parabola through its neighbours, -0.5 to 0.5.
+			int Peak(const std::vector<double>& curve, double smooth, double& offset) {
+				int window = smooth != DBL_MAX && smooth >= 2 ? static_cast<int>(smooth) : 1;
+				int n = static_cast<int>(curve.size());
+				std::vector<double> smoothed(n, std::numeric_limits<double>::quiet_NaN());
+				for (int i = 0; i < n; i++) {
+					double sum = 0;
+					int count = 0;
+					for (int j = std::max(i - window / 2, 0); j <= std::min(i + (window - 1) / 2, n - 1); j++) {
+						if (std::isnan(curve[j])) continue;
+						sum += curve[j];
+						count++;
+					}
+					if (count > 0) smoothed[i] = sum / count;
+				}
+				int best = -1;
+				for (int i = 0; i < n; i++) {
+					if (!std::isnan(smoothed[i]) && (best < 0 || smoothed[i] > smoothed[best])) best = i;
+				}
+				offset = 0;
+				if (best > 0 && best + 1 < n && !std::isnan(smoothed[best - 1]) && !std::isnan(smoothed[best + 1])) {
+					double curvature = smoothed[best - 1] - 2 * smoothed[best] + smoothed[best + 1];
+					if (curvature < 0) {
+						offset = std::min(std::max(0.5 * (smoothed[best - 1] - smoothed[best + 1]) / curvature, -0.5), 0.5);
+					}
+				}
+				return best;
+			}
+
+			Result Validate(const ML::MLColorimeter::ThroughFocusConfig& config, NativeFocusStrategy strategy) {
+				if (config.FocusMin == DBL_MAX || config.FocusMax == DBL_MAX || config.Freq == DBL_MAX) {
+					return Result(false, "FocusMin, FocusMax and Freq must be set in the config or ThroughFocus.json.");
+				}
+				// The fly scan has no steps
+				if (strategy != FocusFlyScan && (config.RoughStep == DBL_MAX || config.FineRange == DBL_MAX || config.FineStep == DBL_MAX)) {
+					return Result(false, "RoughStep, FineRange and FineStep must be set in the config or ThroughFocus.json.");
+				}
+				if (strategy != FocusFlyScan && (config.RoughStep <= 0 || config.FineStep <= 0 || config.FineRange < 0)) {
+					return Result(false, "RoughStep and FineStep must be positive and FineRange not negative.");
+				}
+				if (config.ROIs.empty()) {
+					return Result(false, "The wrapper through focus needs at least one ROI.");
+				}
+				return Result();
+			}
+
+			// Move, capture and score every position. Pipelined, the move to step k + 1 overlaps the MTF of step k.
+			Result SweepPhase(FocusDevice& device, const std::vector<double>& positions,
+				const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, bool pipelined, std::vector<double>& motion, std::vector<double>& vid,
+				std::vector<double>& mtf) {
+				std::size_t n = positions.size();
+				motion.assign(n, std::numeric_limits<double>::quiet_NaN());
+				vid.assign(n, std::numeric_limits<double>::quiet_NaN());
+				mtf.assign(n, std::numeric_limits<double>::quiet_NaN());
+				std::vector<std::future<double>> pending(n);
+				Result ret = device.MoveTo(positions[0]);
+				for (std::size_t k = 0; k < n && ret.success; k++) {
+					// A copy, so the capture at the next step cannot overwrite a frame still being scored
+					cv::Mat frame;
+					ret = device.Capture(frame);
+					if (!ret.success) break;
+					motion[k] = device.Position();
+					vid[k] = device.Vid();
+					if (!pipelined) {
+						mtf[k] = Sharpness(frame, config.ROIs, config.Freq, mtfSettings);
+						if (k + 1 < n) ret = device.MoveTo(positions[k + 1]);
+						continue;
+					}
+					if (k + 1 < n) ret = device.StartMove(positions[k + 1]);
+					// At most two frames are waiting for their MTF
+					if (k >= 2) pending[k - 2].wait();
+					pending[k] = std::async(std::launch::async, [&config, &mtfSettings, frame]() {
+						return Sharpness(frame, config.ROIs, config.Freq, mtfSettings);
+					});
+					if (k + 1 < n && ret.success) ret = device.WaitForMove();
+				}
+				for (std::size_t k = 0; k < n; k++) {
+					if (pending[k].valid()) mtf[k] = pending[k].get();
+				}
+				return ret;
+			}
+
+			// Move, capture and score one position. An unmeasured position scores below any measured one.
+			Result Probe(FocusDevice& device, double position, const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, FocusSample& sample) {
+				Result ret = device.MoveTo(position);
+				if (!ret.success) return ret;
+				cv::Mat frame;
+				ret = device.Capture(frame);
+				if (!ret.success) return ret;
+				sample.Motion = device.Position();
+				sample.Vid = device.Vid();
+				sample.Mtf = Sharpness(frame, config.ROIs, config.Freq, mtfSettings);
+				if (std::isnan(sample.Mtf)) sample.Mtf = -DBL_MAX;
+				return ret;
+			}
+
+			// Noise of a curve from the root mean square of its second differences, which the curvature of a peak only
+			// raises: the upper end of its 95% confidence interval, as few differences often look smoother than the
+			// noise is. -1 until three second differences are known.
+			double CurveNoise(const std::vector<double>& values) {
+				double sum = 0;
+				int count = 0;
+				for (std::size_t i = 2; i < values.size(); i++) {
+					if (values[i - 2] == -DBL_MAX || values[i - 1] == -DBL_MAX || values[i] == -DBL_MAX) continue;
+					double difference = values[i - 2] - 2 * values[i - 1] + values[i];
+					sum += difference * difference;
+					count++;
+				}
+				if (count < 3) return -1;
+				// 5% quantile of chi-square with count degrees of freedom (Wilson-Hilferty)
+				double spread = 2.0 / (9 * count);
+				double quantile = count * std::pow(1 - spread - 1.645 * std::sqrt(spread), 3);
+				// A second difference of independent samples has 6 times their variance
+				return std::sqrt(sum / quantile / 6);
+			}
+
+			struct Parabola
+			{
+				bool Concave = false;
+				double Vertex = 0;
+				// Half-width of the 95% confidence interval of Vertex, DBL_MAX without a residual degree of freedom
+				double Interval = DBL_MAX;
+			};
+
+			// Least-squares parabola through the measured samples with a <= position <= c
+			Parabola FitParabola(const std::vector<double>& positions, const std::vector<double>& values, double a, double c) {
+				// 97.5% quantiles of Student's t with 1 to 10 degrees of freedom, about 2 beyond
+				static const double Quantiles[] = { 12.71, 4.30, 3.18, 2.78, 2.57, 2.45, 2.36, 2.31, 2.26, 2.23 };
+				Parabola fit;
+				// Centered and scaled for a well-conditioned normal matrix
+				double center = (a + c) / 2, scale = std::max((c - a) / 2, 1e-12);
+				cv::Matx33d normal = cv::Matx33d::zeros();
+				cv::Vec3d moments(0, 0, 0);
+				std::vector<std::pair<cv::Vec3d, double>> rows;
+				for (std::size_t i = 0; i < positions.size(); i++) {
+					if (positions[i] < a || positions[i] > c || values[i] == -DBL_MAX) continue;
+					double u = (positions[i] - center) / scale;
+					cv::Vec3d row(1, u, u * u);
+					normal += row * row.t();
+					moments += values[i] * row;
+					rows.push_back(std::make_pair(row, values[i]));
+				}
+				int n = static_cast<int>(rows.size());
+				if (n < 3) return fit;
+				bool ok = false;
+				cv::Matx33d inverse = normal.inv(cv::DECOMP_LU, &ok);
+				if (!ok) return fit;
+				cv::Vec3d p = inverse * moments;
+				if (!(p[2] < 0)) return fit;
+				fit.Concave = true;
+				fit.Vertex = center - p[1] / (2 * p[2]) * scale;
+				if (n == 3) return fit;
+				double residual = 0;
+				for (const auto& row : rows) {
+					double error = row.second - p.dot(row.first);
+					residual += error * error;
+				}
+				// Delta method: gradient of -p1 / (2 p2) with respect to the coefficients
+				cv::Vec3d gradient(0, -1 / (2 * p[2]), p[1] / (2 * p[2] * p[2]));
+				double variance = residual / (n - 3) * gradient.dot(inverse * gradient);
+				double quantile = n - 3 <= 10 ? Quantiles[n - 4] : 2.0;
+				fit.Interval = quantile * std::sqrt(variance) * scale;
+				return fit;
+			}
+
+			// Highest measured sample with a <= position <= c, a if none
+			double BestSample(const std::vector<double>& positions, const std::vector<double>& values, double a, double c) {
+				double best = a, value = -DBL_MAX;
+				for (std::size_t i = 0; i < positions.size(); i++) {
+					if (positions[i] >= a && positions[i] <= c && values[i] > value) {
+						best = positions[i];
+						value = values[i];
+					}
+				}
+				return best;
+			}
+
+			Result GridSearch(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, const FocusSweepSettings& settings, double lo, double hi,
+				FocusSweepCurves& curves) {
+				std::vector<double> rough = Steps(lo, hi, config.RoughStep);
+				if (rough.empty()) return Result(false, "Too many rough focus steps.");
+				curves.Captures = 0;
+				Result ret = SweepPhase(device, rough, config, mtfSettings, settings.Pipelined,
+					curves.RoughMotion, curves.RoughVid, curves.RoughMtf);
+				if (!ret.success) return ret;
+				curves.Captures += static_cast<int>(rough.size());
+				double offset;
+				int best = Peak(curves.RoughMtf, DBL_MAX, offset);
+				if (best < 0) return Result(false, "No ROI could be measured in the rough focus sweep.");
+
+				double center = curves.RoughMotion[best];
+				std::vector<double> fine = Steps(std::max(center - config.FineRange / 2, lo),
+					std::min(center + config.FineRange / 2, hi), config.FineStep);
+				if (fine.empty()) return Result(false, "Too many fine focus steps.");
+				ret = SweepPhase(device, fine, config, mtfSettings, settings.Pipelined,
+					curves.Motion, curves.Vid, curves.Mtf);
+				if (!ret.success) return ret;
+				curves.Captures += static_cast<int>(fine.size());
+				best = Peak(curves.Mtf, config.Smooth, offset);
+				if (best < 0) return Result(false, "No ROI could be measured in the fine focus sweep.");
+
+				// Interpolated between the measured neighbours of the peak
+				int neighbour = offset < 0 ? best - 1 : best + 1;
+				curves.BestPosition = offset == 0 ? curves.Motion[best] :
+					curves.Motion[best] + std::abs(offset) * (curves.Motion[neighbour] - curves.Motion[best]);
+				return ret;
+			}
+
+			Result AdaptiveSearch(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, const FocusSweepSettings& settings, double lo, double hi,
+				FocusSweepCurves& curves) {
+				double tolerance = settings.Tolerance > 0 ? settings.Tolerance : config.FineStep;
+				return AdaptiveFocusSearch([&](double position, FocusSample& sample) {
+					return Probe(device, position, config, mtfSettings, sample);
+				}, lo, hi, config.RoughStep, tolerance, curves);
+			}
+
+			// One move from lo to hi while frames are captured back to back. Stops the move and returns early with
+			// tooFast set once a frame travels more than limit during its exposure.
+			Result FlyPass(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, double lo, double hi, double limit, FocusSweepCurves& curves, bool& tooFast) {
+				curves.Motion.clear();
+				curves.Vid.clear();
+				curves.Mtf.clear();
+				curves.MaxFrameTravel = 0;
+				tooFast = false;
+
+				Result ret = device.MoveTo(lo);
+				if (!ret.success) return ret;
+				ret = device.StartMove(hi);
+				if (!ret.success) return ret;
+				// The motion may not report moving for a while after the command
+				double slack = (hi - lo) * 1e-3;
+				double deadline = device.Now() + MotionStartTimeout;
+				while (hi - lo > slack && !device.IsMoving() && device.Position() < lo + slack) {
+					if (device.Now() > deadline) {
+						device.StopMove();
+						return Result(false, "The motion did not start the fly scan.");
+					}
+					device.Sleep(1);
+				}
+
+				double exposure = device.ExposureTime();
+				std::vector<std::future<double>> pending;
+				for (int k = 0; k < MaxSteps; k++) {
+					// The frame captured once the motion has stopped or reached hi is the last one
+					bool moving = device.IsMoving();
+					double before = device.Now();
+					double positionBefore = device.Position();
+					double vidBefore = device.Vid();
+					cv::Mat frame;
+					double start = device.Now();
+					ret = device.Capture(frame);
+					if (!ret.success) break;
+					double positionAfter = device.Position();
+					double vidAfter = device.Vid();
+					double after = device.Now();
+
+					// Exposure midpoint and travel between the two readings, assuming the exposure starts with the capture
+					// call and the motion is uniform
+					double span = after - before;
+					double midpoint = start - before + exposure / 2;
+					double fraction = span > 0 ? std::min(midpoint / span, 1.0) : 0.5;
+					double travel = std::abs(positionAfter - positionBefore) * (span > 0 ? std::min(exposure / span, 1.0) : 1.0);
+					curves.Motion.push_back(positionBefore + fraction * (positionAfter - positionBefore));
+					curves.Vid.push_back(vidBefore + fraction * (vidAfter - vidBefore));
+					curves.MaxFrameTravel = std::max(curves.MaxFrameTravel, travel);
+
+					// At most two frames are waiting for their MTF
+					if (pending.size() >= 2) pending[pending.size() - 2].wait();
+					pending.push_back(std::async(std::launch::async, [&config, &mtfSettings, frame]() {
+						return Sharpness(frame, config.ROIs, config.Freq, mtfSettings);
+					}));
+					if (travel > limit) {
+						tooFast = true;
+						break;
+					}
+					if (!moving || positionAfter >= hi - slack) break;
+				}
+				for (auto& value : pending) {
+					curves.Mtf.push_back(value.get());
+				}
+				curves.Captures += static_cast<int>(curves.Mtf.size());
+				if (!ret.success || tooFast) device.StopMove();
+				return ret;
+			}
+
+			Result FlyScan(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+				const MtfSettings& mtfSettings, double lo, double hi, FocusSweepCurves& curves) {
+				curves.RoughMotion.clear();
+				curves.RoughVid.clear();
+				curves.RoughMtf.clear();
+				curves.Captures = 0;
+				// Motion blur allowed in a frame, unlimited if FineStep is unset or the speed cannot be set
+				int speed = device.Speed();
+				double limit = config.FineStep != DBL_MAX && config.FineStep > 0 && speed > 0 ? config.FineStep : DBL_MAX;
+				bool tooFast = false;
+				Result ret;
+				// Blur against speed setting, measured by the passes: a secant through the last two, or through the
+				// origin (no travel at speed 0) after the first, so a setting not linear in velocity is corrected
+				// by each pass
+				int previousSpeed = 0;
+				double previousTravel = 0;
+				for (int pass = 0; pass < MaxFlyPasses; pass++) {
+					ret = FlyPass(device, config, mtfSettings, lo, hi, limit, curves, tooFast);
+					if (!ret.success || !tooFast) break;
+					int current = device.Speed();
+					double slope = current != previousSpeed ? (curves.MaxFrameTravel - previousTravel) / (current - previousSpeed) : 0;
+					if (!(slope > 0)) break;
+					int slower = static_cast<int>(current - (curves.MaxFrameTravel - SpeedMargin * limit) / slope);
+					previousSpeed = current;
+					previousTravel = curves.MaxFrameTravel;
+					if (slower < 1 || slower >= current) break;
+					ret = device.SetSpeed(slower);
+					if (!ret.success) break;
+				}
+				if (speed > 0 && device.Speed() != speed) {
+					Result restored = device.SetSpeed(speed);
+					if (ret.success) ret = restored;
+				}
+				if (!ret.success) return ret;
+				if (tooFast) return Result(false, "The motion travels more than FineStep during an exposure even at a lower speed.");
+
+				std::vector<double> positions, values;
+				for (std::size_t i = 0; i < curves.Mtf.size(); i++) {
+					if (std::isnan(curves.Mtf[i])) continue;
+					positions.push_back(curves.Motion[i]);
+					values.push_back(curves.Mtf[i]);
+				}
+				if (!GaussianPeak(positions, values, curves.BestPosition)) {
+					return Result(false, "No ROI could be measured in the fly scan.");
+				}
+				return ret;
+			}
+
+			Result SweepModule(ML::MLColorimeter::MLMonoBusinessManage* module, const std::string& keyName,
+				const ML::MLColorimeter::ThroughFocusConfig& requested, const FocusSweepSettings& settings,
+				FocusSweepCurves& curves) {
+				ML::MLColorimeter::MLColorimeterConfig* moduleConfig = module->ML_GetBusinessManageConfig();
+				ML::MLColorimeter::ThroughFocusConfig config = moduleConfig != nullptr ?
+					ResolveFocusConfig(requested, moduleConfig->GetThroughFocusConfig()) : requested;
+
+				MtfSettings mtfSettings;
+				mtfSettings.ChessMode = config.ChessMode;
+				mtfSettings.FocalLength = config.FocalLength != DBL_MAX ? config.FocalLength : 0;
+				mtfSettings.LpmmUnit = config.LpmmUnit;
+				mtfSettings.BinNum = 1 << static_cast<int>(module->ML_GetBinning());
+				ModuleFocusDevice device(module, keyName);
+				return SweepDevice(device, config, settings, mtfSettings, curves);
+			}
+		}
+
+		double FocusDevice::Now() {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		void FocusDevice::Sleep(double milliseconds) {
+			std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(milliseconds));
+		}
+
+		ModuleFocusDevice::ModuleFocusDevice(ML::MLColorimeter::MLMonoBusinessManage* module, const std::string& keyName)
+			: module(module), keyName(keyName) {
+		}
+
+		Result ModuleFocusDevice::MoveTo(double position) {
+			return module->ML_SetPosistionAbsSync(keyName, position);
+		}
+
+		Result ModuleFocusDevice::StartMove(double position) {
+			return module->ML_SetPosistionAbsAsync(keyName, position);
+		}
+
+		Result ModuleFocusDevice::WaitForMove() {
+			return module->ML_WaitForMovingStop();
+		}
+
+		bool ModuleFocusDevice::IsMoving() {
+			return module->ML_IsModuleMotorsMoving();
+		}
+
+		Result ModuleFocusDevice::StopMove() {
+			return module->ML_StopMotionMovement(keyName);
+		}
+
+		Result ModuleFocusDevice::Capture(cv::Mat& frame) {
+			Result ret = module->ML_CaptureImageSync();
+			if (ret.success) frame = module->ML_GetImage().clone();
+			return ret;
+		}
+
+		double ModuleFocusDevice::Position() {
+			return module->ML_GetMotionPosition(keyName);
+		}
+
+		double ModuleFocusDevice::Vid() {
+			return module->ML_GetVID();
+		}
+
+		double ModuleFocusDevice::ExposureTime() {
+			return module->ML_GetExposureTime();
+		}
+
+		int ModuleFocusDevice::Speed() {
+			ActuatorBase* actuator = Actuator();
+			return actuator != nullptr ? actuator->GetSpeed() : 0;
+		}
+
+		Result ModuleFocusDevice::SetSpeed(int speed) {
+			ActuatorBase* actuator = Actuator();
+			if (actuator == nullptr) return Result(false, "The motion " + keyName + " has no actuator to set the speed of.");
+			try {
+				actuator->SetSpeed(speed);
+			}
+			catch (const std::exception& e) {
+				return Result(false, e.what());
+			}
+			// The pluginException returned cannot be read outside the SDK; the setting is read back instead
+			if (actuator->GetSpeed() != speed) {
+				return Result(false, "The motion " + keyName + " did not take the speed " + std::to_string(speed) + ".");
+			}
+			return Result();
+		}
+
+		ActuatorBase* ModuleFocusDevice::Actuator() {
+			return dynamic_cast<ActuatorBase*>(module->ML_GetOneModuleByName(keyName));
+		}
+
+		Result AdaptiveFocusSearch(const FocusProbe& probe, double lo, double hi, double roughStep, double tolerance,
+			FocusSweepCurves& curves) {
+			curves.RoughMotion.clear();
+			curves.RoughVid.clear();
+			curves.RoughMtf.clear();
+			curves.Motion.clear();
+			curves.Vid.clear();
+			curves.Mtf.clear();
+			curves.Captures = 0;
+			std::vector<double> rough = Steps(lo, hi, roughStep);
+			if (rough.empty()) return Result(false, "Too many rough focus steps.");
+
+			// Commanded position and score of every capture
+			std::vector<double> positions, values;
+			std::vector<FocusSample> samples;
+			// First capture and mean score of each rough step, and whether it was probed twice
+			std::vector<FocusSample> steps;
+			std::vector<double> levels;
+			std::vector<bool> repeated;
+			auto capture = [&](double position, FocusSample& sample) {
+				Result r = probe(position, sample);
+				if (!r.success) return r;
+				curves.Captures++;
+				positions.push_back(position);
+				values.push_back(sample.Mtf);
+				samples.push_back(sample);
+				return r;
+			};
+			int best = -1;
+			Result ret;
+			for (std::size_t k = 0; k < rough.size(); k++) {
+				FocusSample sample;
+				ret = capture(rough[k], sample);
+				if (!ret.success) return ret;
+				steps.push_back(sample);
+				levels.push_back(sample.Mtf);
+				repeated.push_back(false);
+				if (sample.Mtf > -DBL_MAX && (best < 0 || sample.Mtf > levels[best])) best = static_cast<int>(k);
+				if (best < 0) continue;
+				// The peak is bracketed once the two steps after the best one are lower by more than five times the noise
+				auto dropped = [&]() {
+					double noise = CurveNoise(levels);
+					return static_cast<int>(k) - best >= 2 && noise >= 0 &&
+						levels[best] - std::max(levels[k - 1], levels[k]) > 5 * noise;
+				};
+				// Picked as the highest of several noisy steps, the best one reads high; a second capture there does not
+				while (dropped() && !repeated[best]) {
+					ret = capture(rough[best], sample);
+					if (!ret.success) return ret;
+					repeated[best] = true;
+					if (sample.Mtf > -DBL_MAX) levels[best] = (levels[best] + sample.Mtf) / 2;
+					best = static_cast<int>(std::max_element(levels.begin(), levels.end()) - levels.begin());
+				}
+				if (dropped()) break;
+			}
+			for (std::size_t k = 0; k < steps.size(); k++) {
+				curves.RoughMotion.push_back(steps[k].Motion);
+				curves.RoughVid.push_back(steps[k].Vid);
+				curves.RoughMtf.push_back(levels[k] > -DBL_MAX ? levels[k] : std::numeric_limits<double>::quiet_NaN());
+			}
+			if (best < 0) return Result(false, "No ROI could be measured in the rough focus sweep.");
+
+			// Fit window from the rough step before the best one to the step after it, shifted by a step when the
+			// vertex leaves it
+			std::size_t refined = samples.size();
+			int last = static_cast<int>(rough.size()) - 1, window = best;
+			double a = rough[std::max(window - 1, 0)], c = rough[std::min(window + 1, last)];
+			Parabola fit = FitParabola(positions, values, a, c);
+			for (int i = 0; i < MaxRefinements; i++) {
+				double center = fit.Concave ? std::min(std::max(fit.Vertex, a), c) : BestSample(positions, values, a, c);
+				// Converged, or the peak lies beyond an end of the range
+				if (2 * fit.Interval <= tolerance || fit.Vertex + fit.Interval < lo || fit.Vertex - fit.Interval > hi) break;
+				// At the vertex, then half a step on either side of it, where the fit's slope is best determined
+				double x = std::min(std::max(center + Offsets[i % 3] * roughStep, a), c);
+				FocusSample sample;
+				ret = capture(x, sample);
+				if (!ret.success) return ret;
+				fit = FitParabola(positions, values, a, c);
+				if (fit.Concave && ((fit.Vertex > c && window < last) || (fit.Vertex < a && window > 0))) {
+					window += fit.Vertex > c ? 1 : -1;
+					a = rough[std::max(window - 1, 0)];
+					c = rough[std::min(window + 1, last)];
+					fit = FitParabola(positions, values, a, c);
+				}
+			}
+
+			// The rough steps of the first window and the probes, by measured position
+			double first = rough[std::max(best - 1, 0)], end = rough[std::min(best + 1, last)];
+			std::vector<FocusSample> probes;
+			for (std::size_t i = 0; i < samples.size(); i++) {
+				if (i >= refined || (positions[i] >= first && positions[i] <= end)) probes.push_back(samples[i]);
+			}
+			std::sort(probes.begin(), probes.end(), [](const FocusSample& l, const FocusSample& r) { return l.Motion < r.Motion; });
+			for (const FocusSample& sample : probes) {
+				curves.Motion.push_back(sample.Motion);
+				curves.Vid.push_back(sample.Vid);
+				curves.Mtf.push_back(sample.Mtf > -DBL_MAX ? sample.Mtf : std::numeric_limits<double>::quiet_NaN());
+			}
+			curves.BestPosition = fit.Concave ? std::min(std::max(fit.Vertex, lo), hi) : BestSample(positions, values, a, c);
+			return ret;
+		}
+
+		Result SweepDevice(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+			const FocusSweepSettings& settings, const MtfSettings& mtfSettings, FocusSweepCurves& curves) {
+			Result ret = Validate(config, settings.Strategy);
+			if (!ret.success) return ret;
+			double lo = std::min(config.FocusMin, config.FocusMax), hi = std::max(config.FocusMin, config.FocusMax);
+			if (settings.Strategy == FocusFlyScan) {
+				ret = FlyScan(device, config, mtfSettings, lo, hi, curves);
+			}
+			else if (settings.Strategy == FocusAdaptive) {
+				ret = AdaptiveSearch(device, config, mtfSettings, settings, lo, hi, curves);
+			}
+			else {
+				ret = GridSearch(device, config, mtfSettings, settings, lo, hi, curves);
+			}
+			if (!ret.success) return ret;
+			ret = device.MoveTo(curves.BestPosition);
+			if (!ret.success) return ret;
+			curves.BestVid = device.Vid();
+			return ret;
+		}
+
+		ML::MLColorimeter::ThroughFocusConfig ResolveFocusConfig(const ML::MLColorimeter::ThroughFocusConfig& requested,
+			const ML::MLColorimeter::ThroughFocusConfig& defaults) {
+			ML::MLColorimeter::ThroughFocusConfig config = requested;
+			double ML::MLColorimeter::ThroughFocusConfig::* fields[] = {
+				&ML::MLColorimeter::ThroughFocusConfig::FocusMax, &ML::MLColorimeter::ThroughFocusConfig::FocusMin,
+				&ML::MLColorimeter::ThroughFocusConfig::ReferencePosition, &ML::MLColorimeter::ThroughFocusConfig::FocalLength,
+				&ML::MLColorimeter::ThroughFocusConfig::FocalPlanesObjectSpace, &ML::MLColorimeter::ThroughFocusConfig::RoughStep,
+				&ML::MLColorimeter::ThroughFocusConfig::FineRange, &ML::MLColorimeter::ThroughFocusConfig::FineStep,
+				&ML::MLColorimeter::ThroughFocusConfig::Freq, &ML::MLColorimeter::ThroughFocusConfig::Smooth
+			};
+			for (auto field : fields) {
+				if (config.*field == DBL_MAX) config.*field = defaults.*field;
+			}
+			if (config.ROIs.empty()) config.ROIs = defaults.ROIs;
+			return config;
+		}
+
+		Result FocusSweep(const std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>>& modules,
+			const std::string& keyName, const ML::MLColorimeter::ThroughFocusConfig& config,
+			const FocusSweepSettings& settings, bool parallel, std::map<int, FocusSweepCurves>& curves) {
+			std::vector<FocusSweepCurves> results(modules.size());
+			Result ret;
+			if (!parallel) {
+				for (std::size_t i = 0; i < modules.size(); i++) {
+					Result r = SweepModule(modules[i].second, keyName, config, settings, results[i]);
+					if (!r.success && ret.success) ret = r;
+				}
+			}
+			else {
+				std::vector<std::future<Result>> runs;
+				for (std::size_t i = 0; i < modules.size(); i++) {
+					runs.push_back(std::async(std::launch::async, [&modules, &keyName, &config, &settings, &results, i]() {
+						return SweepModule(modules[i].second, keyName, config, settings, results[i]);
+					}));
+				}
+				for (auto& run : runs) {
+					Result r = run.get();
+					if (!r.success && ret.success) ret = r;
+				}
+			}
+			curves.clear();
+			for (std::size_t i = 0; i < modules.size(); i++) {
+				curves[modules[i].first] = results[i];
+			}
+			return ret;
+		}
+	}
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and FocusSweep.cpp (compiled without /clr)
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "MLMonoBusinessManage.h"
+#include "MtfAnalysis.h"
+#include "Result.h"
+
+class ActuatorBase;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		enum NativeFocusStrategy
+		{
+			/// Rough grid over the whole range, then a fine grid around its best step.
+			FocusGrid = 0,
+			/// Rough grid stopped once the peak is bracketed, then probes at the vertex of a parabola fitted to the
+			/// bracket until the vertex is known to within the tolerance (see AdaptiveFocusSearch()).
+			FocusAdaptive = 1,
+			/// One move over the whole range while frames are captured back to back, each tagged with the position
+			/// at its exposure midpoint. The peak is a Gaussian fit of the curve. A move that travels more than
+			/// FineStep during an exposure is stopped and run again at a lower speed, interpolated from the travel
+			/// measured at the speeds tried so far; the speed is restored afterwards.
+			FocusFlyScan = 2
+		};
+
+		struct FocusSweepSettings
+		{
+			NativeFocusStrategy Strategy = FocusGrid;
+			/// Grid: compute the MTF of a frame on a worker thread while the motion moves to the next step.
+			bool Pipelined = true;
+			/// Adaptive: width of the 95% confidence interval of the peak at which the search stops, in motion units.
+			/// 0 for FineStep.
+			double Tolerance = 0;
+		};
+
+		/// Curves of one module's sweep, one value per step: motion position, VID and mean MTF of the ROIs at Freq.
+		/// Adaptive: the rough curves stop at the bracket (a step captured twice holds its mean MTF) and the fine
+		/// curves hold the captures of the first fit window and the probes, by motion position.
+		/// Fly scan: the rough curves are empty and the fine curves hold the frames of the move.
+		struct FocusSweepCurves
+		{
+			std::vector<double> RoughMotion;
+			std::vector<double> RoughVid;
+			std::vector<double> RoughMtf;
+			std::vector<double> Motion;
+			std::vector<double> Vid;
+			std::vector<double> Mtf;
+			/// Fly scan: largest travel of the motion during the exposure of one frame, its motion blur. Measured from
+			/// the positions read around each capture, assuming a uniform motion during the capture.
+			double MaxFrameTravel = 0;
+			/// Frames captured by the sweep, without the capture-free move to the best position.
+			int Captures = 0;
+			double BestPosition = 0;
+			double BestVid = 0;
+		};
+
+		/// Motion and camera of one module as driven by a sweep. ModuleFocusDevice drives a module of the SDK; the
+		/// managed FocusSweeper adapts an IFocusDevice. Calls come from one sweep thread at a time.
+		class FocusDevice
+		{
+		public:
+			virtual ~FocusDevice() {}
+			/// Move and return once the motion has stopped.
+			virtual Result MoveTo(double position) = 0;
+			/// Start a move and return; WaitForMove() returns once it has stopped.
+			virtual Result StartMove(double position) = 0;
+			virtual Result WaitForMove() = 0;
+			virtual bool IsMoving() = 0;
+			virtual Result StopMove() = 0;
+			/// Capture a frame into a buffer owned by the caller, which the next capture does not overwrite.
+			virtual Result Capture(cv::Mat& frame) = 0;
+			virtual double Position() = 0;
+			virtual double Vid() = 0;
+			/// Exposure time of a capture (unit: millisecond).
+			virtual double ExposureTime() = 0;
+			/// Speed setting of the motion, in the unit of its actuator, increasing with its velocity; 0 if it has none.
+			virtual int Speed() = 0;
+			virtual Result SetSpeed(int speed) = 0;
+			/// Time in milliseconds from an arbitrary origin, by which a fly scan times its frames; the steady clock.
+			virtual double Now();
+			/// Let time pass while the motion is polled; a sleep.
+			virtual void Sleep(double milliseconds);
+		};
+
+		/// FocusDevice of the motion keyName of a module.
+		class ModuleFocusDevice : public FocusDevice
+		{
+		public:
+			ModuleFocusDevice(ML::MLColorimeter::MLMonoBusinessManage* module, const std::string& keyName);
+			Result MoveTo(double position) override;
+			Result StartMove(double position) override;
+			Result WaitForMove() override;
+			bool IsMoving() override;
+			Result StopMove() override;
+			/// ML_CaptureImageSync() and a clone of ML_GetImage(), which shares the SDK's frame buffer.
+			Result Capture(cv::Mat& frame) override;
+			double Position() override;
+			double Vid() override;
+			double ExposureTime() override;
+			/// GetSpeed() / SetSpeed() of the actuator ML_GetOneModuleByName(keyName) returns.
+			int Speed() override;
+			Result SetSpeed(int speed) override;
+
+		private:
+			ActuatorBase* Actuator();
+
+			ML::MLColorimeter::MLMonoBusinessManage* module;
+			std::string keyName;
+		};
+
+		/// One capture of a search: measured motion position, VID and mean MTF of the ROIs, -DBL_MAX if no ROI
+		/// could be measured.
+		struct FocusSample
+		{
+			double Motion = 0;
+			double Vid = 0;
+			double Mtf = 0;
+		};
+
+		/// Move to a commanded position, capture and score into sample.
+		typedef std::function<Result(double position, FocusSample& sample)> FocusProbe;
+
+		/// Adaptive search of FocusSweep() over a probe. Rough steps from lo by roughStep stop once the two steps
+		/// after the best one are lower by more than five times the noise of the curve, or at hi. The noise is the
+		/// upper 95% confidence bound of the RMS second difference of the rough steps, and the best step is captured
+		/// a second time before its drop is trusted, as the highest of several noisy steps reads high.
+		/// Up to 20 probes follow, each refitting a least-squares parabola to every capture from the rough step
+		/// before the best one to the step after it (a window shifted by a step when the vertex leaves it), and going
+		/// to the vertex or half a rough step on either side of it in turn. No single probe decides: the search stops
+		/// once the 95% confidence interval of the vertex, from the residual of the fit, is narrower than tolerance,
+		/// or lies beyond an end of the range.
+		/// The search runs on commanded positions; the curves hold the measured ones. curves.BestPosition is the
+		/// vertex of the last fit (the best capture in the window if it is not concave), within [lo, hi].
+		Result AdaptiveFocusSearch(const FocusProbe& probe, double lo, double hi, double roughStep, double tolerance,
+			FocusSweepCurves& curves);
+
+		/// requested with its unset (DBL_MAX) fields and empty ROIs taken from defaults.
+		ML::MLColorimeter::ThroughFocusConfig ResolveFocusConfig(const ML::MLColorimeter::ThroughFocusConfig& requested,
+			const ML::MLColorimeter::ThroughFocusConfig& defaults);
+
+		/// Through focus run by the wrapper: a rough sweep from FocusMin to FocusMax by RoughStep, then a fine sweep
+		/// of FineRange around the best rough step by FineStep, each step scored by the mean SDK MTF (CalculateMTF()
+		/// with ChessMode, LpmmUnit, FocalLength and the module's binning) of the ROIs at Freq. The best position is interpolated on the fine curve (smoothed over Smooth steps) and the
+		/// motion is left there. Unset config fields come from the module's ThroughFocus.json.
+		/// Pipelined, the next move is issued as soon as a frame is captured and the frame's MTF is computed on a
+		/// worker, joined at the end of each phase; the curves are the same as without pipelining.
+		/// The adaptive strategy replaces both grids by a bracketing search and usually needs far fewer captures;
+		/// the fly scan replaces them by a single move and needs no settling at all.
+		/// The modules are swept concurrently if parallel is true.
+		Result FocusSweep(const std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>>& modules,
+			const std::string& keyName, const ML::MLColorimeter::ThroughFocusConfig& config,
+			const FocusSweepSettings& settings, bool parallel, std::map<int, FocusSweepCurves>& curves);
+
+		/// Sweep of one device as FocusSweep() runs it on each module, with a resolved config: the strategy of
+		/// settings, then a move to the best position. mtfSettings scores the frames.
+		Result SweepDevice(FocusDevice& device, const ML::MLColorimeter::ThroughFocusConfig& config,
+			const FocusSweepSettings& settings, const MtfSettings& mtfSettings, FocusSweepCurves& curves);
+	}
+}
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <cfloat>
+#include <limits>
+#include <vcclr.h>
+#include "FocusSweep.h"
+#include "MLConverters.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Motion and camera swept by FocusSweeper.Sweep(). A call that fails throws; the sweep stops and reports the
+		/// exception message. Calls come from one worker thread at a time.
+		/// </summary>
+		public interface class IFocusDevice
+		{
+			/// <summary>
+			/// Move and return once the motion has stopped.
+			/// </summary>
+			void MoveTo(double position);
+
+			/// <summary>
+			/// Start a move and return; WaitForMove() returns once it has stopped.
+			/// </summary>
+			void StartMove(double position);
+
+			void WaitForMove();
+
+			property bool IsMoving { bool get(); }
+
+			void StopMove();
+
+			/// <summary>
+			/// Capture a frame. The sweep copies the frame and disposes the returned image.
+			/// </summary>
+			NativeImage^ Capture();
+
+			property double Position { double get(); }
+
+			property double Vid { double get(); }
+
+			/// <summary>
+			/// Exposure time of a capture (unit: millisecond).
+			/// </summary>
+			property double ExposureTime { double get(); }
+
+			/// <summary>
+			/// Speed setting of the motion, in its own unit, increasing with its velocity; 0 if it cannot be set.
+			/// A fly scan whose frames blur by more than FineStep lowers it, by the blur measured at the speeds it
+			/// tried, and restores it at the end.
+			/// </summary>
+			property int Speed { int get(); void set(int value); }
+		};
+
+		/// <summary>
+		/// Time source of an IFocusDevice that also implements it, used by a fly scan instead of the steady clock,
+		/// e.g. by a simulated device.
+		/// </summary>
+		public interface class IFocusClock
+		{
+			/// <summary>
+			/// Time in milliseconds from an arbitrary origin.
+			/// </summary>
+			property double Now { double get(); }
+
+			/// <summary>
+			/// Let time pass while the sweep polls the motion.
+			/// </summary>
+			void Sleep(double milliseconds);
+		};
+
+		/// <summary>
+		/// Curves of one sweep, as returned by the curve getters after a wrapper ML_ThroughFocus().
+		/// </summary>
+		public ref class FocusSweepResult
+		{
+		public:
+			property array<double>^ RoughMotion;
+			property array<double>^ RoughVid;
+			property array<double>^ RoughMtf;
+			property array<double>^ Motion;
+			property array<double>^ Vid;
+			property array<double>^ Mtf;
+			property double BestPosition;
+			property double BestVid;
+			/// <summary>
+			/// Frames captured by the sweep.
+			/// </summary>
+			property int Captures;
+			/// <summary>
+			/// FlyScan: largest travel of the motion during the exposure of one frame, its motion blur.
+			/// </summary>
+			property double MaxFrameTravel;
+
+		internal:
+			FocusSweepResult(const FocusSweepCurves& curves) {
+				RoughMotion = ToArray(curves.RoughMotion);
+				RoughVid = ToArray(curves.RoughVid);
+				RoughMtf = ToArray(curves.RoughMtf);
+				Motion = ToArray(curves.Motion);
+				Vid = ToArray(curves.Vid);
+				Mtf = ToArray(curves.Mtf);
+				BestPosition = curves.BestPosition;
+				BestVid = curves.BestVid;
+				Captures = curves.Captures;
+				MaxFrameTravel = curves.MaxFrameTravel;
+			}
+
+		private:
+			static array<double>^ ToArray(const std::vector<double>& values) {
+				array<double>^ result = gcnew array<double>(static_cast<int>(values.size()));
+				for (int i = 0; i < result->Length; i++) {
+					result[i] = values[i];
+				}
+				return result;
+			}
+		};
+
+		// FocusDevice calling an IFocusDevice, exceptions turned into failed results
+		class ManagedFocusDevice : public FocusDevice
+		{
+		public:
+			explicit ManagedFocusDevice(IFocusDevice^ device) : device(device) {
+			}
+
+			Result MoveTo(double position) override {
+				try {
+					device->MoveTo(position);
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			Result StartMove(double position) override {
+				try {
+					device->StartMove(position);
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			Result WaitForMove() override {
+				try {
+					device->WaitForMove();
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			bool IsMoving() override {
+				try {
+					return device->IsMoving;
+				}
+				catch (Exception^) {
+					return false;
+				}
+			}
+
+			Result StopMove() override {
+				try {
+					device->StopMove();
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			Result Capture(cv::Mat& frame) override {
+				try {
+					NativeImage^ image = device->Capture();
+					if (image == nullptr) return Result(false, "The device returned no frame.");
+					try {
+						frame = image->GetMat().clone();
+					}
+					finally {
+						delete image;
+					}
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			double Position() override {
+				try {
+					return device->Position;
+				}
+				catch (Exception^) {
+					return std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+
+			double Vid() override {
+				try {
+					return device->Vid;
+				}
+				catch (Exception^) {
+					return std::numeric_limits<double>::quiet_NaN();
+				}
+			}
+
+			double ExposureTime() override {
+				try {
+					return device->ExposureTime;
+				}
+				catch (Exception^) {
+					return 0;
+				}
+			}
+
+			int Speed() override {
+				try {
+					return device->Speed;
+				}
+				catch (Exception^) {
+					return 0;
+				}
+			}
+
+			Result SetSpeed(int speed) override {
+				try {
+					device->Speed = speed;
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Failed(e);
+				}
+			}
+
+			double Now() override {
+				IFocusClock^ clock = dynamic_cast<IFocusClock^>(static_cast<IFocusDevice^>(device));
+				if (clock == nullptr) return FocusDevice::Now();
+				try {
+					return clock->Now;
+				}
+				catch (Exception^) {
+					return FocusDevice::Now();
+				}
+			}
+
+			void Sleep(double milliseconds) override {
+				IFocusClock^ clock = dynamic_cast<IFocusClock^>(static_cast<IFocusDevice^>(device));
+				if (clock == nullptr) {
+					FocusDevice::Sleep(milliseconds);
+					return;
+				}
+				try {
+					clock->Sleep(milliseconds);
+				}
+				catch (Exception^) {
+				}
+			}
+
+		private:
+			static Result Failed(Exception^ e) {
+				return Result(false, MLConverter::ToNative(e->Message));
+			}
+
+			gcroot<IFocusDevice^> device;
+		};
+
+		// FocusProbe calling a managed score of a position, exceptions turned into failed results
+		class ManagedFocusProbe
+		{
+		public:
+			explicit ManagedFocusProbe(Func<double, double>^ score) : score(score) {
+			}
+
+			Result operator()(double position, FocusSample& sample) const {
+				try {
+					sample.Motion = position;
+					sample.Vid = 0;
+					sample.Mtf = score->Invoke(position);
+					if (Double::IsNaN(sample.Mtf)) sample.Mtf = -DBL_MAX;
+					return Result();
+				}
+				catch (Exception^ e) {
+					return Result(false, MLConverter::ToNative(e->Message));
+				}
+			}
+
+		private:
+			gcroot<Func<double, double>^> score;
+		};
+
+		/// <summary>
+		/// The wrapper's through focus (ML_ThroughFocus() with a SweepMode other than Sdk) on any motion and camera.
+		/// </summary>
+		public ref class FocusSweeper
+		{
+		public:
+			/// <summary>
+			/// Sweep a device as ML_ThroughFocus() sweeps a module, and leave it at the best position.
+			/// No ThroughFocus.json fills unset fields: FocusMin, FocusMax and Freq must be set, and RoughStep,
+			/// FineRange and FineStep too except for FlyScan. Frames are scored by the SDK MTF of the ROIs at Freq.
+			/// </summary>
+			/// <param name="device">Motion and camera.</param>
+			/// <param name="config">Range, steps, ROIs and SweepMode (not Sdk).</param>
+			/// <param name="binNum">Binning factor of the frames (1, 2, 4 or 8).</param>
+			static FocusSweepResult^ Sweep(IFocusDevice^ device, ThroughFocusConfig^ config, int binNum) {
+				if (device == nullptr) throw gcnew ArgumentNullException("device");
+				if (config == nullptr) throw gcnew ArgumentNullException("config");
+				if (config->SweepMode == FocusSweepMode::Sdk) {
+					throw gcnew ArgumentException("The SDK through focus cannot sweep a device.", "config");
+				}
+				if (binNum != 1 && binNum != 2 && binNum != 4 && binNum != 8) {
+					throw gcnew ArgumentOutOfRangeException("binNum", "binNum must be 1, 2, 4 or 8.");
+				}
+				MtfSettings mtfSettings;
+				mtfSettings.ChessMode = config->ChessMode;
+				mtfSettings.FocalLength = config->FocalLength != Double::MaxValue ? config->FocalLength : 0;
+				mtfSettings.LpmmUnit = config->LpmmUnit;
+				mtfSettings.BinNum = binNum;
+
+				ManagedFocusDevice native(device);
+				FocusSweepCurves curves;
+				Result ret = SweepDevice(native, MLConverter::ToNative(config), ToNative(config), mtfSettings, curves);
+				if (!ret.success) {
+					throw gcnew InvalidOperationException(MLConverter::ToManaged(ret.errorMsg));
+				}
+				return gcnew FocusSweepResult(curves);
+			}
+
+			/// <summary>
+			/// The search of FocusSweepMode::Adaptive over any focus measure, to tune or test it without a device.
+			/// Motion holds the probed positions and Vid is 0.
+			/// </summary>
+			/// <param name="probe">Moves to a position and returns its score, NaN if it cannot be measured.</param>
+			/// <param name="lo">Start of the range.</param>
+			/// <param name="hi">End of the range.</param>
+			/// <param name="roughStep">Step of the rough phase.</param>
+			/// <param name="tolerance">Width of the 95% confidence interval of the peak at which the search stops.</param>
+			static FocusSweepResult^ AdaptiveSearch(Func<double, double>^ probe, double lo, double hi, double roughStep,
+				double tolerance) {
+				if (probe == nullptr) throw gcnew ArgumentNullException("probe");
+				if (!(lo <= hi)) throw gcnew ArgumentException("lo must not be above hi.", "lo");
+				if (!(roughStep > 0)) throw gcnew ArgumentOutOfRangeException("roughStep", "roughStep must be positive.");
+				if (!(tolerance > 0)) throw gcnew ArgumentOutOfRangeException("tolerance", "tolerance must be positive.");
+				FocusSweepCurves curves;
+				Result ret = AdaptiveFocusSearch(ManagedFocusProbe(probe), lo, hi, roughStep, tolerance, curves);
+				if (!ret.success) {
+					throw gcnew InvalidOperationException(MLConverter::ToManaged(ret.errorMsg));
+				}
+				return gcnew FocusSweepResult(curves);
+			}
+
+		internal:
+			static FocusSweepSettings ToNative(ThroughFocusConfig^ config) {
+				FocusSweepSettings settings;
+				settings.Strategy = config->SweepMode == FocusSweepMode::Adaptive ? FocusAdaptive :
+					config->SweepMode == FocusSweepMode::FlyScan ? FocusFlyScan : FocusGrid;
+				settings.Pipelined = config->SweepMode == FocusSweepMode::Pipelined;
+				settings.Tolerance = config->FocusTolerance;
+				return settings;
+			}
+		};
+	}
+}
@@ -0,0 +1,194 @@
+// Compiled without /clr: uses std::async
+
+#include "FrameAverager.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <future>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			template <typename T>
+			void SigmaClipRows(const cv::Mat& frame, cv::Mat& mean, cv::Mat& m2, cv::Mat& accepted, double sigma,
+				int minSamples, const cv::Range& rows) {
+				const float k = static_cast<float>(sigma);
+				for (int y = rows.start; y < rows.end; y++) {
+					const T* in = frame.ptr<T>(y);
+					float* meanRow = mean.ptr<float>(y);
+					float* m2Row = m2.ptr<float>(y);
+					ushort* n = accepted.ptr<ushort>(y);
+					for (int x = 0; x < frame.cols; x++) {
+						float value = static_cast<float>(in[x]);
+						if (n[x] >= minSamples) {
+							float sd = std::sqrt(m2Row[x] / n[x]);
+							// At least one gray level, so identical samples do not reject all later ones
+							if (std::abs(value - meanRow[x]) > k * std::max(sd, 1.0f)) continue;
+						}
+						if (n[x] == USHRT_MAX) continue;
+						n[x]++;
+						float delta = value - meanRow[x];
+						meanRow[x] += delta / n[x];
+						m2Row[x] += delta * (value - meanRow[x]);
+					}
+				}
+			}
+
+			template <typename T>
+			void MedianRows(const cv::Mat& a, const cv::Mat& b, const cv::Mat& c, cv::Mat& sum, const cv::Range& rows) {
+				for (int y = rows.start; y < rows.end; y++) {
+					const T* ra = a.ptr<T>(y);
+					const T* rb = b.ptr<T>(y);
+					const T* rc = c.ptr<T>(y);
+					int* out = sum.ptr<int>(y);
+					for (int x = 0; x < a.cols; x++) {
+						int lo = std::min(ra[x], rb[x]), hi = std::max(ra[x], rb[x]);
+						out[x] += 3 * std::max(lo, std::min(hi, static_cast<int>(rc[x])));
+					}
+				}
+			}
+		}
+
+		FrameAverager::FrameAverager(const FrameAverageSettings& settings) : settings(settings) {
+		}
+
+		bool FrameAverager::Add(const cv::Mat& frame) {
+			if (frame.empty() || (frame.type() != CV_8UC1 && frame.type() != CV_16UC1)) return false;
+			if (count == 0) {
+				type = frame.type();
+				size = frame.size();
+				if (settings.Rejection == RejectSigmaClip) {
+					mean = cv::Mat::zeros(size, CV_32FC1);
+					m2 = cv::Mat::zeros(size, CV_32FC1);
+					accepted = cv::Mat::zeros(size, CV_16UC1);
+				}
+				else {
+					sum = cv::Mat::zeros(size, CV_32SC1);
+				}
+			}
+			else if (frame.type() != type || frame.size() != size) {
+				return false;
+			}
+
+			if (settings.Rejection == RejectSigmaClip) {
+				AddSigmaClip(frame);
+			}
+			else if (settings.Rejection == RejectMedianOfThree) {
+				AddMedianOfThree(frame);
+			}
+			else {
+				cv::add(sum, frame, sum, cv::noArray(), CV_32S);
+			}
+			count++;
+			return true;
+		}
+
+		void FrameAverager::AddSigmaClip(const cv::Mat& frame) {
+			double sigma = settings.Sigma;
+			int minSamples = std::max(settings.MinSamples, 1);
+			cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& rows) {
+				if (frame.depth() == CV_8U) SigmaClipRows<uchar>(frame, mean, m2, accepted, sigma, minSamples, rows);
+				else SigmaClipRows<ushort>(frame, mean, m2, accepted, sigma, minSamples, rows);
+			});
+		}
+
+		void FrameAverager::AddMedianOfThree(const cv::Mat& frame) {
+			int position = count % 3;
+			if (position < 2) {
+				// Copied into the held buffer, which is reused from group to group
+				frame.copyTo(held[position]);
+				return;
+			}
+			cv::parallel_for_(cv::Range(0, frame.rows), [&](const cv::Range& rows) {
+				if (frame.depth() == CV_8U) MedianRows<uchar>(held[0], held[1], frame, sum, rows);
+				else MedianRows<ushort>(held[0], held[1], frame, sum, rows);
+			});
+		}
+
+		cv::Mat FrameAverager::Average() const {
+			if (count == 0) return cv::Mat();
+			cv::Mat average;
+			if (settings.Rejection == RejectSigmaClip) {
+				average = mean.clone();
+			}
+			else {
+				cv::Mat total = sum;
+				int pending = settings.Rejection == RejectMedianOfThree ? count % 3 : 0;
+				if (pending > 0) {
+					// An incomplete group is averaged as it is
+					total = sum.clone();
+					for (int i = 0; i < pending; i++) cv::add(total, held[i], total, cv::noArray(), CV_32S);
+				}
+				total.convertTo(average, CV_32F, 1.0 / count);
+			}
+			if (settings.KeepDepth) {
+				cv::Mat rounded;
+				average.convertTo(rounded, CV_MAT_DEPTH(type));
+				return rounded;
+			}
+			return average;
+		}
+
+		std::size_t FrameAverager::BufferBytes() const {
+			std::size_t bytes = 0;
+			for (const cv::Mat* m : { &sum, &mean, &m2, &accepted, &held[0], &held[1] }) {
+				bytes += m->total() * m->elemSize();
+			}
+			return bytes;
+		}
+
+		void FrameAverager::Reset() {
+			count = 0;
+			type = -1;
+			size = cv::Size();
+			sum.release();
+			mean.release();
+			m2.release();
+			accepted.release();
+			held[0].release();
+			held[1].release();
+		}
+
+		Result CaptureAverage(ML::MLColorimeter::MLBinoBusinessManage* bino, ML::MLColorimeter::OperationMode mode, int count,
+			const FrameAverageSettings& settings, std::map<int, cv::Mat>& averages) {
+			if (count < 1) return Result(false, "The frame count must be positive.");
+			std::map<int, FrameAverager> averagers;
+			std::future<bool> pending;
+			Result ret;
+			for (int i = 0; i < count; i++) {
+				// Exposes while the previous frames are being accumulated
+				ret = bino->ML_CaptureImageSync(mode);
+				if (!ret.success) break;
+				std::map<int, cv::Mat> frames = bino->ML_GetImage();
+				// The SDK captures the next frame into the same buffers
+				for (auto& frame : frames) {
+					frame.second = frame.second.clone();
+				}
+				if (pending.valid() && !pending.get()) {
+					ret = Result(false, "The frames must be 8-bit or 16-bit single channel and keep their size.");
+					break;
+				}
+				pending = std::async(std::launch::async, [&averagers, &settings, frames]() {
+					bool added = true;
+					for (const auto& frame : frames) {
+						auto averager = averagers.emplace(frame.first, FrameAverager(settings)).first;
+						added = averager->second.Add(frame.second) && added;
+					}
+					return added;
+				});
+			}
+			if (pending.valid() && !pending.get() && ret.success) {
+				ret = Result(false, "The frames must be 8-bit or 16-bit single channel and keep their size.");
+			}
+			if (!ret.success) return ret;
+
+			averages.clear();
+			for (const auto& averager : averagers) {
+				averages[averager.first] = averager.second.Average();
+			}
+			return ret;
+		}
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and FrameAverager.cpp (compiled without /clr)
+
+#include <map>
+#include <opencv2/opencv.hpp>
+#include "MLBinoBusinessManage.h"
+#include "Result.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		enum NativeFrameRejection
+		{
+			RejectNone = 0,
+			/// Online sigma clipping against the running mean and standard deviation of each pixel.
+			RejectSigmaClip = 1,
+			/// Frames are taken in groups of three and the per-pixel median of each group is averaged.
+			RejectMedianOfThree = 2
+		};
+
+		struct FrameAverageSettings
+		{
+			NativeFrameRejection Rejection = RejectNone;
+			/// Sigma clipping: a sample further than Sigma standard deviations (at least Sigma gray levels) from the
+			/// running mean is rejected once MinSamples samples were accepted.
+			double Sigma = 3.0;
+			int MinSamples = 3;
+			/// Round the average to the depth of the frames instead of returning CV_32FC1.
+			bool KeepDepth = false;
+		};
+
+		/// Streaming mean of CV_8UC1 / CV_16UC1 frames. The buffers do not depend on the number of frames:
+		/// a 32-bit sum, plus two held frames for the median of three, or the running mean, M2 and sample count
+		/// for sigma clipping. Not thread safe.
+		class FrameAverager
+		{
+		public:
+			explicit FrameAverager(const FrameAverageSettings& settings = FrameAverageSettings());
+
+			/// Accumulate a frame.
+			/// @return false if the frame is not CV_8UC1 / CV_16UC1 or differs from the first frame.
+			bool Add(const cv::Mat& frame);
+
+			int Count() const { return count; }
+
+			/// Mean of the frames added so far, CV_32FC1 or the frame depth with KeepDepth. Empty before the first frame.
+			cv::Mat Average() const;
+
+			/// Bytes held by the accumulator.
+			std::size_t BufferBytes() const;
+
+			void Reset();
+
+		private:
+			void AddSigmaClip(const cv::Mat& frame);
+			void AddMedianOfThree(const cv::Mat& frame);
+
+			FrameAverageSettings settings;
+			int count = 0;
+			int type = -1;
+			cv::Size size;
+			// CV_32SC1 sum; for the median of three, each group median counts three times
+			cv::Mat sum;
+			// Sigma clipping: CV_32FC1 running mean and M2, CV_16UC1 accepted samples
+			cv::Mat mean;
+			cv::Mat m2;
+			cv::Mat accepted;
+			// Median of three: frames of the group in progress
+			cv::Mat held[2];
+		};
+
+		/// Capture count frames on every module and average them with a FrameAverager per module. The frames of
+		/// capture i are copied out of the SDK buffers and accumulated on a worker thread while capture i + 1 is
+		/// exposed, so at most two copies per module are alive and the accumulation hides behind the exposure.
+		Result CaptureAverage(ML::MLColorimeter::MLBinoBusinessManage* bino, ML::MLColorimeter::OperationMode mode, int count,
+			const FrameAverageSettings& settings, std::map<int, cv::Mat>& averages);
+	}
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include "MLCamaraCommon.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Fixed ring of native frame buffers used by the camera callback.
+		/// A slot is leased when a frame is copied in and returned by Release(); buffers are reused
+		/// as long as the frame size and type do not change, so steady-state grabbing allocates nothing.
+		/// </summary>
+		class FrameBufferPool
+		{
+		public:
+			struct Slot {
+				cv::Mat buffer;
+				// Lease generation << 1 | leased bit: a stale Release() of an earlier lease cannot free a later one
+				std::atomic<unsigned long long> state{ 0 };
+				ML::CameraV2::MLPixelFormat format = ML::CameraV2::MLPixelFormat::MLMono8;
+				long long sequence = 0;
+				long long timestamp = 0;
+			};
+
+			explicit FrameBufferPool(int slotCount)
+				: slotCount(slotCount > 0 ? slotCount : 1), slots(new Slot[slotCount > 0 ? slotCount : 1]) {}
+
+			/// Copy a frame into a free slot.
+			/// @param lease  set to the lease of the slot, to be passed back to Release().
+			/// @return the slot index, or -1 if every slot is leased and the frame was dropped.
+			int Store(const cv::Mat& frame, ML::CameraV2::MLPixelFormat format, unsigned long long& lease) {
+				long long sequence = received.fetch_add(1) + 1;
+				int start = next.fetch_add(1) % slotCount;
+				for (int i = 0; i < slotCount; i++) {
+					int index = (start + i) % slotCount;
+					unsigned long long state = slots[index].state.load();
+					// Next generation, leased
+					if ((state & 1) == 0 && slots[index].state.compare_exchange_strong(state, state + 3)) {
+						LARGE_INTEGER counter;
+						QueryPerformanceCounter(&counter);
+						Slot& slot = slots[index];
+						// copyTo 在尺寸和类型不变时复用已有缓冲区
+						frame.copyTo(slot.buffer);
+						slot.format = format;
+						slot.sequence = sequence;
+						slot.timestamp = counter.QuadPart;
+						leasedCount.fetch_add(1);
+						lease = state + 3;
+						return index;
+					}
+				}
+				dropped.fetch_add(1);
+				return -1;
+			}
+
+			/// Return a slot. Ignored unless lease is the slot's current lease, so releasing twice or after the
+			/// slot was leased again is harmless.
+			void Release(int index, unsigned long long lease) {
+				if (index < 0 || index >= slotCount) return;
+				unsigned long long expected = lease;
+				if ((lease & 1) != 0 && slots[index].state.compare_exchange_strong(expected, lease - 1)) {
+					leasedCount.fetch_sub(1);
+				}
+			}
+
+			bool IsLeased(int index, unsigned long long lease) const {
+				return index >= 0 && index < slotCount && (lease & 1) != 0 && slots[index].state.load() == lease;
+			}
+
+			Slot& GetSlot(int index) { return slots[index]; }
+			int GetSlotCount() const { return slotCount; }
+			int GetLeasedCount() const { return leasedCount.load(); }
+			long long GetReceivedCount() const { return received.load(); }
+			long long GetDroppedCount() const { return dropped.load(); }
+
+		private:
+			int slotCount;
+			std::unique_ptr<Slot[]> slots;
+			std::atomic<int> next{ 0 };
+			std::atomic<int> leasedCount{ 0 };
+			std::atomic<long long> received{ 0 };
+			std::atomic<long long> dropped{ 0 };
+		};
+
+		ref class FramePool;
+
+		/// <summary>
+		/// A frame leased from a FramePool slot.
+		/// Call Release() (or Dispose()) as soon as the pixels are no longer needed. The pool owns one PooledFrame
+		/// per slot and hands the same object out again for a later frame of that slot, so a frame must not be used
+		/// after Release(): until then it only gives access to its own lease, and releasing it twice does nothing.
+		/// A leased frame keeps its pool alive.
+		/// </summary>
+		public ref class PooledFrame
+		{
+		public:
+			~PooledFrame() {
+				Release();
+			}
+
+			/// <summary>
+			/// Return the slot to the pool.
+			/// </summary>
+			void Release();
+
+			/// <summary>
+			/// False once the frame was released.
+			/// </summary>
+			property bool IsLeased {
+				bool get();
+			}
+
+			/// <summary>
+			/// Pointer to the first pixel, valid until Release().
+			/// </summary>
+			property IntPtr Data {
+				IntPtr get() { return IntPtr(LeasedSlot().buffer.data); }
+			}
+
+			property int Width {
+				int get() { return LeasedSlot().buffer.cols; }
+			}
+
+			property int Height {
+				int get() { return LeasedSlot().buffer.rows; }
+			}
+
+			property int Channels {
+				int get() { return LeasedSlot().buffer.channels(); }
+			}
+
+			property ImageDepth Depth {
+				ImageDepth get() { return static_cast<ImageDepth>(LeasedSlot().buffer.depth()); }
+			}
+
+			property int Stride {
+				int get() { return static_cast<int>(LeasedSlot().buffer.step[0]); }
+			}
+
+			/// <summary>
+			/// Number of bytes addressable from Data.
+			/// </summary>
+			property long long Length {
+				long long get() {
+					const cv::Mat& m = LeasedSlot().buffer;
+					return static_cast<long long>(m.step[0]) * m.rows;
+				}
+			}
+
+			property MLPixelFormat Format {
+				MLPixelFormat get() { return static_cast<MLPixelFormat>(static_cast<int>(LeasedSlot().format)); }
+			}
+
+			/// <summary>
+			/// Sequence number of the frame as received from the camera, gaps mean dropped frames.
+			/// </summary>
+			property long long Sequence {
+				long long get() { return LeasedSlot().sequence; }
+			}
+
+			/// <summary>
+			/// Arrival time in System.Diagnostics.Stopwatch ticks.
+			/// </summary>
+			property long long Timestamp {
+				long long get() { return LeasedSlot().timestamp; }
+			}
+
+			/// <summary>
+			/// Index of the slot holding this frame.
+			/// </summary>
+			property int SlotIndex {
+				int get() { return index; }
+			}
+
+			/// <summary>
+			/// Deep copy of the pixels into an independent image, for frames that must outlive the lease.
+			/// </summary>
+			NativeImage^ ToImage() {
+				return gcnew NativeImage(LeasedSlot().buffer.clone());
+			}
+
+		internal:
+			PooledFrame(FramePool^ owner, int index) : owner(owner), index(index), lease(0) {}
+
+			// Set by the pool each time the slot is leased again; the previous lease was released by then
+			void Lease(unsigned long long value) { lease = value; }
+
+		private:
+			FrameBufferPool::Slot& LeasedSlot();
+
+			// A reference to the pool rather than its native ring: the pool cannot be finalized while a handler
+			// still holds one of its frames
+			FramePool^ owner;
+			int index;
+			unsigned long long lease;
+		};
+
+		/// <summary>
+		/// Ring of reusable frame buffers with lease/return semantics. Leasing a frame allocates nothing: each slot
+		/// has one PooledFrame, reused for every frame stored in it.
+		/// </summary>
+		public ref class FramePool
+		{
+		public:
+			FramePool(int slotCount) {
+				pool = new FrameBufferPool(slotCount);
+				frames = gcnew array<PooledFrame^>(pool->GetSlotCount());
+				for (int i = 0; i < frames->Length; i++) {
+					frames[i] = gcnew PooledFrame(this, i);
+				}
+			}
+
+			/// <summary>
+			/// Throws InvalidOperationException while frames are still leased, as their pixels are in the pool.
+			/// </summary>
+			~FramePool() {
+				if (pool != nullptr && pool->GetLeasedCount() > 0) {
+					throw gcnew InvalidOperationException("Frames of the pool are still leased; release them first.");
+				}
+				this->!FramePool();
+			}
+
+			!FramePool() {
+				delete pool;
+				pool = nullptr;
+			}
+
+			property int SlotCount {
+				int get() { return NativePool().GetSlotCount(); }
+			}
+
+			/// <summary>
+			/// Number of slots currently leased to handlers.
+			/// </summary>
+			property int LeasedCount {
+				int get() { return NativePool().GetLeasedCount(); }
+			}
+
+			/// <summary>
+			/// Number of frames received from the camera.
+			/// </summary>
+			property long long ReceivedFrames {
+				long long get() { return NativePool().GetReceivedCount(); }
+			}
+
+			/// <summary>
+			/// Number of frames dropped because every slot was leased.
+			/// </summary>
+			property long long DroppedFrames {
+				long long get() { return NativePool().GetDroppedCount(); }
+			}
+
+		internal:
+			FrameBufferPool* GetNativePool() { return pool; }
+
+			PooledFrame^ GetFrame(int index, unsigned long long lease) {
+				PooledFrame^ frame = frames[index];
+				frame->Lease(lease);
+				return frame;
+			}
+
+			FrameBufferPool& NativePool() {
+				if (pool == nullptr) {
+					throw gcnew ObjectDisposedException("FramePool");
+				}
+				return *pool;
+			}
+
+		private:
+			FrameBufferPool* pool;
+			array<PooledFrame^>^ frames;
+		};
+
+		inline void PooledFrame::Release() {
+			FrameBufferPool* pool = owner->GetNativePool();
+			if (pool != nullptr) {
+				pool->Release(index, lease);
+			}
+		}
+
+		inline bool PooledFrame::IsLeased::get() {
+			FrameBufferPool* pool = owner->GetNativePool();
+			return pool != nullptr && pool->IsLeased(index, lease);
+		}
+
+		inline FrameBufferPool::Slot& PooledFrame::LeasedSlot() {
+			FrameBufferPool& pool = owner->NativePool();
+			if (!pool.IsLeased(index, lease)) {
+				throw gcnew ObjectDisposedException("PooledFrame", "The frame was released.");
+			}
+			return pool.GetSlot(index);
+		}
+	}
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+using namespace System::IO;
+using namespace System::Text;
+using namespace System::Runtime::InteropServices;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// CRC-32 lookup table, IEEE 802.3 polynomial, reflected.
+		/// Built on first use; the initialization of a function-local static is thread-safe.
+		inline const uint32_t* Crc32Table() {
+			static const std::array<uint32_t, 256> table = [] {
+				std::array<uint32_t, 256> values;
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++) {
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					values[i] = c;
+				}
+				return values;
+			}();
+			return table.data();
+		}
+
+		/// <summary>
+		/// Fixed-size header of a serialized frame, little-endian.
+		/// Layout: header, metadata block (MetadataSize bytes), packed pixel rows (PayloadSize bytes),
+		/// then a CRC-32 of everything before it when the checksum flag (bit 0 of Flags) is set.
+		/// </summary>
+#pragma pack(push, 1)
+		struct FrameHeader
+		{
+			uint32_t Magic;
+			uint16_t Version;
+			uint16_t HeaderSize;
+			uint32_t Flags;
+			int32_t Depth;
+			int32_t Channels;
+			int32_t Rows;
+			int32_t Cols;
+			int32_t MetadataSize;
+			int64_t Stride;
+			int64_t PayloadSize;
+			uint32_t Reserved[4];
+		};
+#pragma pack(pop)
+
+		/// <summary>
+		/// Reads and writes frames in the versioned "MLFR" container.
+		/// Pixels are streamed through a small chunk buffer, so neither side needs a full-size temporary
+		/// and any Stream can be used (FileStream, MemoryMappedViewStream, NetworkStream...).
+		/// </summary>
+		public ref class FrameSerializer abstract sealed
+		{
+		public:
+			/// <summary>
+			/// "MLFR" in little-endian byte order.
+			/// </summary>
+			literal unsigned int Magic = 0x52464C4D;
+
+			/// <summary>
+			/// Current container version.
+			/// </summary>
+			literal unsigned short Version = 1;
+
+			/// <summary>
+			/// Write a frame to a stream.
+			/// </summary>
+			/// <param name="stream">Destination stream, written from its current position.</param>
+			/// <param name="image">Frame to write.</param>
+			/// <param name="metadata">Capture metadata stored with the frame, may be nullptr. Its Image is ignored.</param>
+			/// <param name="checksum">Append a CRC-32 of the record.</param>
+			static void Write(Stream^ stream, NativeImage^ image, CaptureData^ metadata, bool checksum) {
+				if (stream == nullptr) throw gcnew ArgumentNullException("stream");
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				Write(stream, image->GetMat(), metadata, checksum);
+			}
+
+			/// <summary>
+			/// Write a frame without metadata or checksum.
+			/// </summary>
+			static void Write(Stream^ stream, NativeImage^ image) {
+				Write(stream, image, nullptr, false);
+			}
+
+			/// <summary>
+			/// Read a frame written by Write().
+			/// </summary>
+			/// <param name="stream">Source stream, read from its current position.</param>
+			/// <param name="metadata">Receives the capture metadata, or nullptr if the record has none.</param>
+			/// <returns>The frame, with tightly packed rows.</returns>
+			static NativeImage^ Read(Stream^ stream, [Out] CaptureData^% metadata) {
+				if (stream == nullptr) throw gcnew ArgumentNullException("stream");
+				array<Byte>^ chunk = gcnew array<Byte>(ChunkSize);
+				uint32_t crc = 0xFFFFFFFF;
+
+				FrameHeader header;
+				ReadExactly(stream, chunk, static_cast<int>(sizeof(FrameHeader)));
+				{
+					pin_ptr<Byte> pinned = &chunk[0];
+					memcpy(&header, pinned, sizeof(FrameHeader));
+					crc = Crc32Update(crc, pinned, sizeof(FrameHeader));
+				}
+				if (header.Magic != Magic) {
+					throw gcnew InvalidDataException("Not an MLFR frame.");
+				}
+				if (header.Version > Version || header.HeaderSize < sizeof(FrameHeader)) {
+					throw gcnew InvalidDataException(String::Format("Unsupported frame version {0}.", header.Version));
+				}
+				if (header.Depth < CV_8U || header.Depth > CV_64F || header.Channels < 1 || header.Channels > CV_CN_MAX) {
+					throw gcnew InvalidDataException("Invalid pixel type.");
+				}
+				int64_t rowBytes = static_cast<int64_t>(header.Cols) * CV_ELEM_SIZE(CV_MAKETYPE(header.Depth, header.Channels));
+				if (header.Rows < 0 || header.Cols < 0 || header.Stride != rowBytes || header.PayloadSize != rowBytes * header.Rows) {
+					throw gcnew InvalidDataException("Frame geometry does not match its payload size.");
+				}
+				// Newer minor versions may extend the header, skip what this reader does not know
+				SkipBytes(stream, chunk, header.HeaderSize - static_cast<int>(sizeof(FrameHeader)), crc);
+
+				metadata = nullptr;
+				if (header.MetadataSize > 0) {
+					array<Byte>^ block = gcnew array<Byte>(header.MetadataSize);
+					ReadExactly(stream, block, header.MetadataSize);
+					pin_ptr<Byte> pinned = &block[0];
+					crc = Crc32Update(crc, pinned, header.MetadataSize);
+					metadata = ReadMetadata(block);
+				}
+
+				cv::Mat mat(header.Rows, header.Cols, CV_MAKETYPE(header.Depth, header.Channels));
+				int64_t remaining = header.PayloadSize;
+				unsigned char* dst = mat.data;
+				while (remaining > 0) {
+					int count = static_cast<int>(remaining < ChunkSize ? remaining : ChunkSize);
+					ReadExactly(stream, chunk, count);
+					pin_ptr<Byte> pinned = &chunk[0];
+					memcpy(dst, pinned, count);
+					crc = Crc32Update(crc, pinned, count);
+					dst += count;
+					remaining -= count;
+				}
+
+				if ((header.Flags & ChecksumFlag) != 0) {
+					ReadExactly(stream, chunk, 4);
+					uint32_t stored = BitConverter::ToUInt32(chunk, 0);
+					if (stored != ~crc) {
+						throw gcnew InvalidDataException("Frame checksum mismatch.");
+					}
+				}
+				return gcnew NativeImage(mat);
+			}
+
+			/// <summary>
+			/// Read a frame and discard its metadata.
+			/// </summary>
+			static NativeImage^ Read(Stream^ stream) {
+				CaptureData^ metadata;
+				return Read(stream, metadata);
+			}
+
+			/// <summary>
+			/// Write a CaptureData, its Image as the frame and the other fields as metadata.
+			/// </summary>
+			static void Write(Stream^ stream, CaptureData^ data, bool checksum) {
+				if (data == nullptr) throw gcnew ArgumentNullException("data");
+				if (data->Image == nullptr) throw gcnew ArgumentException("CaptureData has no image.");
+				Write(stream, data->Image, data, checksum);
+			}
+
+			/// <summary>
+			/// Read a record back into a CaptureData with Image set.
+			/// </summary>
+			static CaptureData^ ReadCaptureData(Stream^ stream) {
+				CaptureData^ metadata;
+				NativeImage^ image = Read(stream, metadata);
+				if (metadata == nullptr) metadata = gcnew CaptureData();
+				metadata->Image = image;
+				return metadata;
+			}
+
+			/// <summary>
+			/// Size in bytes of the record Write() produces, e.g. to size a memory-mapped file.
+			/// </summary>
+			static long long GetSerializedSize(NativeImage^ image, CaptureData^ metadata, bool checksum) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				const cv::Mat& mat = image->GetMat();
+				long long size = sizeof(FrameHeader) + static_cast<long long>(mat.cols) * mat.elemSize() * mat.rows;
+				if (metadata != nullptr) size += WriteMetadata(metadata)->Length;
+				if (checksum) size += 4;
+				return size;
+			}
+
+		internal:
+			static void Write(Stream^ stream, const cv::Mat& mat, CaptureData^ metadata, bool checksum) {
+				if (mat.dims > 2) {
+					throw gcnew ArgumentException("Only 2D images can be serialized.");
+				}
+				array<Byte>^ metadataBlock = metadata != nullptr ? WriteMetadata(metadata) : nullptr;
+				int64_t rowBytes = static_cast<int64_t>(mat.cols) * mat.elemSize();
+
+				FrameHeader header = {};
+				header.Magic = Magic;
+				header.Version = Version;
+				header.HeaderSize = sizeof(FrameHeader);
+				header.Flags = checksum ? ChecksumFlag : 0;
+				header.Depth = mat.depth();
+				header.Channels = mat.channels();
+				header.Rows = mat.rows;
+				header.Cols = mat.cols;
+				header.MetadataSize = metadataBlock != nullptr ? metadataBlock->Length : 0;
+				header.Stride = rowBytes;
+				header.PayloadSize = rowBytes * mat.rows;
+
+				array<Byte>^ chunk = gcnew array<Byte>(static_cast<int>(rowBytes > ChunkSize ? rowBytes : ChunkSize));
+				uint32_t crc = 0xFFFFFFFF;
+				{
+					pin_ptr<Byte> pinned = &chunk[0];
+					memcpy(pinned, &header, sizeof(FrameHeader));
+					crc = Crc32Update(crc, pinned, sizeof(FrameHeader));
+				}
+				stream->Write(chunk, 0, static_cast<int>(sizeof(FrameHeader)));
+
+				if (metadataBlock != nullptr && metadataBlock->Length > 0) {
+					pin_ptr<Byte> pinned = &metadataBlock[0];
+					crc = Crc32Update(crc, pinned, metadataBlock->Length);
+					stream->Write(metadataBlock, 0, metadataBlock->Length);
+				}
+
+				// Pack as many rows as fit into the chunk, this also drops the row padding of strided images
+				int rowsPerChunk = static_cast<int>(chunk->Length / (rowBytes > 0 ? rowBytes : 1));
+				for (int row = 0; row < mat.rows; row += rowsPerChunk) {
+					int rows = rowsPerChunk < mat.rows - row ? rowsPerChunk : mat.rows - row;
+					int count = static_cast<int>(rowBytes * rows);
+					{
+						pin_ptr<Byte> pinned = &chunk[0];
+						unsigned char* dst = pinned;
+						if (mat.isContinuous()) {
+							memcpy(dst, mat.ptr(row), count);
+						}
+						else {
+							for (int r = 0; r < rows; r++) {
+								memcpy(dst + rowBytes * r, mat.ptr(row + r), rowBytes);
+							}
+						}
+						crc = Crc32Update(crc, dst, count);
+					}
+					stream->Write(chunk, 0, count);
+				}
+
+				if (checksum) {
+					array<Byte>^ trailer = BitConverter::GetBytes(static_cast<UInt32>(~crc));
+					stream->Write(trailer, 0, trailer->Length);
+				}
+			}
+
+		private:
+			literal int ChunkSize = 1 << 20;
+			literal unsigned int ChecksumFlag = 1;
+
+			static array<Byte>^ WriteMetadata(CaptureData^ metadata) {
+				MemoryStream^ buffer = gcnew MemoryStream();
+				BinaryWriter^ writer = gcnew BinaryWriter(buffer, Encoding::UTF8);
+				writer->Write(metadata->SerialNumber != nullptr ? metadata->SerialNumber : "");
+				writer->Write(metadata->ModuleName != nullptr ? metadata->ModuleName : "");
+				writer->Write(metadata->Key != nullptr ? metadata->Key : "");
+				writer->Write(metadata->Aperture != nullptr ? metadata->Aperture : "");
+				writer->Write(metadata->LightSource != nullptr ? metadata->LightSource : "");
+				writer->Write(static_cast<int>(metadata->NDFilter));
+				writer->Write(static_cast<int>(metadata->ColorFilter));
+				RXCombination^ rx = metadata->MovementRX != nullptr ? metadata->MovementRX : gcnew RXCombination();
+				writer->Write(rx->Sphere);
+				writer->Write(rx->Cylinder);
+				writer->Write(rx->Axis);
+				writer->Write(metadata->VID);
+				writer->Write(metadata->ExposureTime);
+				writer->Write(static_cast<int>(metadata->Bining));
+				writer->Write(static_cast<int>(metadata->PixelFormat));
+				writer->Flush();
+				return buffer->ToArray();
+			}
+
+			static CaptureData^ ReadMetadata(array<Byte>^ block) {
+				BinaryReader^ reader = gcnew BinaryReader(gcnew MemoryStream(block), Encoding::UTF8);
+				CaptureData^ metadata = gcnew CaptureData();
+				metadata->SerialNumber = reader->ReadString();
+				metadata->ModuleName = reader->ReadString();
+				metadata->Key = reader->ReadString();
+				metadata->Aperture = reader->ReadString();
+				metadata->LightSource = reader->ReadString();
+				metadata->NDFilter = static_cast<MLFilterEnum>(reader->ReadInt32());
+				metadata->ColorFilter = static_cast<MLFilterEnum>(reader->ReadInt32());
+				metadata->MovementRX->Sphere = reader->ReadDouble();
+				metadata->MovementRX->Cylinder = reader->ReadDouble();
+				metadata->MovementRX->Axis = reader->ReadInt32();
+				metadata->VID = reader->ReadDouble();
+				metadata->ExposureTime = reader->ReadDouble();
+				metadata->Bining = static_cast<Binning>(reader->ReadInt32());
+				metadata->PixelFormat = static_cast<MLPixelFormat>(reader->ReadInt32());
+				return metadata;
+			}
+
+			static void ReadExactly(Stream^ stream, array<Byte>^ buffer, int count) {
+				int offset = 0;
+				while (offset < count) {
+					int read = stream->Read(buffer, offset, count - offset);
+					if (read <= 0) {
+						throw gcnew EndOfStreamException("Unexpected end of frame data.");
+					}
+					offset += read;
+				}
+			}
+
+			static void SkipBytes(Stream^ stream, array<Byte>^ chunk, int count, uint32_t& crc) {
+				while (count > 0) {
+					int step = count < chunk->Length ? count : chunk->Length;
+					ReadExactly(stream, chunk, step);
+					pin_ptr<Byte> pinned = &chunk[0];
+					crc = Crc32Update(crc, pinned, step);
+					count -= step;
+				}
+			}
+
+			static uint32_t Crc32Update(uint32_t crc, const unsigned char* data, size_t length) {
+				const uint32_t* table = Crc32Table();
+				for (size_t i = 0; i < length; i++) {
+					crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+				}
+				return crc;
+			}
+		};
+	}
+}
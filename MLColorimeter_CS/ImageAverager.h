@@ -0,0 +1,93 @@
+#pragma once
+
+#include "FrameAverager.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Streaming mean of 8-bit or 16-bit single channel frames, with the outlier rejection of
+		/// ML_CaptureAverageImage(). The memory does not grow with the number of frames.
+		/// </summary>
+		public ref class ImageAverager
+		{
+		public:
+			/// <param name="config">Outlier rejection, nullptr for a plain mean.</param>
+			ImageAverager(AveragingConfig^ config) : averager(new FrameAverager(ToNative(config))) {
+			}
+
+			~ImageAverager() {
+				this->!ImageAverager();
+			}
+
+			!ImageAverager() {
+				if (averager != nullptr) {
+					delete averager;
+					averager = nullptr;
+				}
+			}
+
+			/// <summary>
+			/// Accumulate a frame; the frame is not referenced afterwards.
+			/// </summary>
+			void Add(NativeImage^ frame) {
+				if (frame == nullptr) throw gcnew ArgumentNullException("frame");
+				if (!GetAverager().Add(frame->GetMat())) {
+					throw gcnew ArgumentException("The frame must be 8-bit or 16-bit single channel and match the first frame.", "frame");
+				}
+			}
+
+			property int Count {
+				int get() { return GetAverager().Count(); }
+			}
+
+			/// <summary>
+			/// Bytes held by the accumulator.
+			/// </summary>
+			property long long BufferBytes {
+				long long get() { return static_cast<long long>(GetAverager().BufferBytes()); }
+			}
+
+			/// <summary>
+			/// Mean of the frames added so far: a float image, or one of the frame depth with KeepPixelDepth.
+			/// </summary>
+			NativeImage^ Average() {
+				if (Count == 0) throw gcnew InvalidOperationException("No frame was added.");
+				return gcnew NativeImage(GetAverager().Average());
+			}
+
+			void Reset() {
+				GetAverager().Reset();
+			}
+
+		internal:
+			static FrameAverageSettings ToNative(AveragingConfig^ config) {
+				FrameAverageSettings settings;
+				if (config != nullptr) {
+					if (config->Rejection == FrameRejection::SigmaClip && (config->Sigma <= 0 || config->MinSamples < 1)) {
+						throw gcnew ArgumentOutOfRangeException("config", "Sigma and MinSamples must be positive.");
+					}
+					settings.Rejection = static_cast<NativeFrameRejection>(config->Rejection);
+					settings.Sigma = config->Sigma;
+					settings.MinSamples = config->MinSamples;
+					settings.KeepDepth = config->KeepPixelDepth;
+				}
+				return settings;
+			}
+
+		private:
+			FrameAverager& GetAverager() {
+				if (averager == nullptr) {
+					throw gcnew ObjectDisposedException("ImageAverager");
+				}
+				return *averager;
+			}
+
+			FrameAverager* averager;
+		};
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "CorrectionKernels.h"
+#include "DarkLibrary.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Implementation used by ImageCorrection and ImageStatistics.
+		/// </summary>
+		public enum class CorrectionKernel {
+			/// <summary>Fused kernel, AVX2 when the CPU supports it.</summary>
+			Auto = KernelAuto,
+			/// <summary>Fused AVX2 kernel, fails on CPUs without AVX2.</summary>
+			Avx2 = KernelAvx2,
+			/// <summary>Fused scalar kernel.</summary>
+			Scalar = KernelScalar,
+			/// <summary>Reference: one OpenCV pass and one temporary per step.</summary>
+			MultiPass = KernelMultiPass
+		};
+
+		/// <summary>
+		/// Pixel corrections applied before the SDK calibration stages.
+		/// </summary>
+		public ref class ImageCorrection abstract sealed
+		{
+		public:
+			/// <summary>
+			/// True if the fused AVX2 kernel can run on this machine.
+			/// </summary>
+			static property bool IsAvx2Supported {
+				bool get() { return IsAvx2Available(); }
+			}
+
+			/// <summary>
+			/// Dark subtraction, flat-field division and exposure normalization in one pass:
+			/// destination = (raw - dark) / flat * scale, evaluated in float in that order.
+			/// All kernels give bit-identical results.
+			/// </summary>
+			/// <param name="raw">Raw frame, 16-bit single channel.</param>
+			/// <param name="dark">Dark frame, 16-bit or float single channel, nullptr to skip.</param>
+			/// <param name="flat">Flat-field frame (LightFFCMap entry), float single channel, nullptr to skip.</param>
+			/// <param name="scale">Exposure normalization factor, e.g. reference exposure / exposure time.</param>
+			/// <param name="destination">Float single channel image of the raw size, written in place.</param>
+			/// <param name="kernel">Implementation to use.</param>
+			static void DarkFlatExposure(NativeImage^ raw, NativeImage^ dark, NativeImage^ flat, float scale,
+				NativeImage^ destination, CorrectionKernel kernel) {
+				if (raw == nullptr) throw gcnew ArgumentNullException("raw");
+				if (destination == nullptr) throw gcnew ArgumentNullException("destination");
+				const cv::Mat& rawMat = raw->GetMat();
+				cv::Mat dst = destination->GetMat();
+				if (dst.size() != rawMat.size() || dst.type() != CV_32FC1) {
+					throw gcnew ArgumentException("Destination must be a float single channel image of the raw size.");
+				}
+				uchar* data = dst.data;
+				Run(rawMat, dark != nullptr ? dark->GetMat() : cv::Mat(), flat, scale, dst, kernel);
+				if (dst.data != data) {
+					throw gcnew InvalidOperationException("Destination was reallocated.");
+				}
+			}
+
+			/// <summary>
+			/// Same as DarkFlatExposure(raw, dark, flat, scale, destination, kernel) into a new image.
+			/// </summary>
+			static NativeImage^ DarkFlatExposure(NativeImage^ raw, NativeImage^ dark, NativeImage^ flat, float scale,
+				CorrectionKernel kernel) {
+				if (raw == nullptr) throw gcnew ArgumentNullException("raw");
+				cv::Mat dst;
+				Run(raw->GetMat(), dark != nullptr ? dark->GetMat() : cv::Mat(), flat, scale, dst, kernel);
+				return gcnew NativeImage(dst);
+			}
+
+			/// <summary>
+			/// Same as DarkFlatExposure(raw, dark, flat, scale, destination, kernel) with the dark of the exposure
+			/// time taken from a dark library, read in place without copying it.
+			/// </summary>
+			/// <param name="raw">Raw frame, 16-bit single channel.</param>
+			/// <param name="darks">Dark library of the camera.</param>
+			/// <param name="exposureTime">Exposure time of the raw frame.</param>
+			/// <param name="binning">Binning of the raw frame.</param>
+			/// <param name="pixelFormat">Pixel format of the raw frame.</param>
+			/// <param name="flat">Flat-field frame, float single channel, nullptr to skip.</param>
+			/// <param name="scale">Exposure normalization factor.</param>
+			/// <param name="destination">Float single channel image of the raw size, written in place.</param>
+			/// <param name="kernel">Implementation to use.</param>
+			static void DarkFlatExposure(NativeImage^ raw, DarkLibrary^ darks, double exposureTime, Binning binning,
+				MLPixelFormat pixelFormat, NativeImage^ flat, float scale, NativeImage^ destination, CorrectionKernel kernel) {
+				if (darks == nullptr) throw gcnew ArgumentNullException("darks");
+				if (raw == nullptr) throw gcnew ArgumentNullException("raw");
+				if (destination == nullptr) throw gcnew ArgumentNullException("destination");
+				const cv::Mat& rawMat = raw->GetMat();
+				cv::Mat dst = destination->GetMat();
+				if (dst.size() != rawMat.size() || dst.type() != CV_32FC1) {
+					throw gcnew ArgumentException("Destination must be a float single channel image of the raw size.");
+				}
+				Run(rawMat, darks->GetDarkMat(exposureTime, binning, pixelFormat), flat, scale, dst, kernel);
+			}
+
+		internal:
+			static void Run(const cv::Mat& raw, const cv::Mat& darkMat, NativeImage^ flat, float scale, cv::Mat& dst, CorrectionKernel kernel) {
+				cv::Mat flatMat = flat != nullptr ? flat->GetMat() : cv::Mat();
+				if (kernel == CorrectionKernel::Avx2 && !IsAvx2Available()) {
+					throw gcnew PlatformNotSupportedException("AVX2 is not supported on this CPU.");
+				}
+				if (!DarkFlatExposureCorrect(raw, darkMat, flatMat, scale, dst, static_cast<NativeKernelPath>(kernel))) {
+					throw gcnew ArgumentException("Raw must be 16-bit single channel, dark 16-bit or float and flat float, all of the same size.");
+				}
+			}
+		};
+	}
+}
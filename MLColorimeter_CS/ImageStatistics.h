@@ -0,0 +1,157 @@
+#pragma once
+
+#include "StatisticsKernels.h"
+#include "ImageCorrection.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// What ImageStatistics.Compute() samples.
+		/// </summary>
+		public ref class StatisticsOptions
+		{
+		public:
+			StatisticsOptions() {
+				Stride = 1;
+				Bits = 0;
+				SaturationLevel = 0;
+				Bayer = false;
+			}
+
+			/// <summary>
+			/// Region to measure, empty for the whole image.
+			/// </summary>
+			property Rect Roi;
+
+			/// <summary>
+			/// Every Stride-th pixel of every Stride-th row is sampled (every Stride-th 2x2 block for Bayer data).
+			/// </summary>
+			property int Stride;
+
+			/// <summary>
+			/// Significant bits of the data (8, 10, 12, 16), 0 for the image depth. Sets the histogram size.
+			/// </summary>
+			property int Bits;
+
+			/// <summary>
+			/// Pixels at or above this value count as saturated, 0 for the full scale of Bits.
+			/// </summary>
+			property int SaturationLevel;
+
+			/// <summary>
+			/// Raw Bayer data: one result per position of the 2x2 color filter array.
+			/// </summary>
+			property bool Bayer;
+
+		internal:
+			PixelStatisticsOptions ToNative() {
+				PixelStatisticsOptions native;
+				native.Roi = cv::Rect(Roi.X, Roi.Y, Roi.Width, Roi.Height);
+				native.Stride = Stride;
+				native.Bits = Bits;
+				native.SaturationLevel = SaturationLevel;
+				native.Bayer = Bayer;
+				return native;
+			}
+		};
+
+		/// <summary>
+		/// Histogram, saturation count and moments of an 8/16-bit single channel image, computed in one
+		/// multithreaded pass. Used by the predictive auto exposure and the frame gray level of the camera callback.
+		/// </summary>
+		public ref class ImageStatistics
+		{
+		public:
+			/// <summary>
+			/// Statistics of an image. Mono data gives one result, Bayer data four, in the order
+			/// (0,0), (1,0), (0,1), (1,1) of image coordinates.
+			/// </summary>
+			/// <param name="image">8-bit or 16-bit single channel image.</param>
+			/// <param name="options">What to sample, nullptr for every pixel.</param>
+			/// <param name="kernel">Implementation to use; MultiPass is the OpenCV reference.</param>
+			/// <returns>The statistics of each channel.</returns>
+			static array<ImageStatistics^>^ Compute(NativeImage^ image, StatisticsOptions^ options, CorrectionKernel kernel) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				if (kernel == CorrectionKernel::Avx2 && !IsAvx2Available()) {
+					throw gcnew PlatformNotSupportedException("AVX2 is not supported on this CPU.");
+				}
+				PixelStatisticsOptions native = options != nullptr ? options->ToNative() : PixelStatisticsOptions();
+				std::vector<PixelStatistics> channels;
+				if (!ComputePixelStatistics(image->GetMat(), native, channels, static_cast<NativeKernelPath>(kernel))) {
+					throw gcnew ArgumentException("The image must be 8-bit or 16-bit single channel and the options must fit it.");
+				}
+				array<ImageStatistics^>^ result = gcnew array<ImageStatistics^>(static_cast<int>(channels.size()));
+				for (int i = 0; i < result->Length; i++) {
+					result[i] = gcnew ImageStatistics(channels[i]);
+				}
+				return result;
+			}
+
+			/// <summary>
+			/// Statistics of a mono image with the fastest kernel.
+			/// </summary>
+			static ImageStatistics^ Compute(NativeImage^ image, StatisticsOptions^ options) {
+				if (options != nullptr && options->Bayer) {
+					throw gcnew ArgumentException("Use Compute(image, options, kernel) for Bayer data.", "options");
+				}
+				return Compute(image, options, CorrectionKernel::Auto)[0];
+			}
+
+			/// <summary>
+			/// Count of the samples with each value, 2^Bits bins; larger values are in the last bin.
+			/// </summary>
+			property array<unsigned int>^ Histogram;
+			property long long Count;
+			property long long Saturated;
+			property int Min;
+			property int Max;
+			property double Mean;
+
+			/// <summary>
+			/// Population standard deviation.
+			/// </summary>
+			property double Std;
+
+			/// <summary>
+			/// Fraction of the samples at or above the saturation level.
+			/// </summary>
+			property double SaturatedFraction {
+				double get() { return Count > 0 ? static_cast<double>(Saturated) / Count : 0; }
+			}
+
+			/// <summary>
+			/// Smallest value with at least the given fraction of the samples at or below it.
+			/// </summary>
+			/// <param name="percentile">Fraction between 0 and 1.</param>
+			double Percentile(double percentile) {
+				long long rank = static_cast<long long>(Math::Ceiling(Math::Min(Math::Max(percentile, 0.0), 1.0) * Count));
+				long long seen = 0;
+				for (int value = 0; value < Histogram->Length; value++) {
+					seen += Histogram[value];
+					if (seen >= rank && seen > 0) return value;
+				}
+				return Histogram->Length > 0 ? Histogram->Length - 1 : 0;
+			}
+
+		internal:
+			ImageStatistics(const PixelStatistics& native) {
+				Histogram = gcnew array<unsigned int>(static_cast<int>(native.Histogram.size()));
+				if (Histogram->Length > 0) {
+					pin_ptr<unsigned int> pinned = &Histogram[0];
+					std::copy(native.Histogram.begin(), native.Histogram.end(), static_cast<unsigned int*>(pinned));
+				}
+				Count = native.Count;
+				Saturated = native.Saturated;
+				Min = native.Min;
+				Max = native.Max;
+				Mean = native.Mean;
+				Std = native.Std;
+			}
+		};
+	}
+}
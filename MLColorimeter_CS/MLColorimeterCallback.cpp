@@ -16,9 +16,49 @@ namespace MLColorimeterCS {
 			unmanagedCallback = new MLCameraCallbackWrapper(this);
 		}
 
+		ManagedCameraCallback::ManagedCameraCallback(NotifyCameraStateChangedDelegate^ stateChanged,
+			NotifyCameraPooledFrameReceivedDelegate^ pooledFrameReceived,
+			NotifyCameraGrayLevelDelegate^ grayLevel,
+			int poolSlotCount) {
+			if (poolSlotCount <= 0) {
+				throw gcnew ArgumentOutOfRangeException("poolSlotCount");
+			}
+			this->stateChangedDelegate = stateChanged;
+			this->pooledFrameReceivedDelegate = pooledFrameReceived;
+			this->grayLevelDelegate = grayLevel;
+			this->framePool = gcnew MLCommon::FramePool(poolSlotCount);
+
+			// Frames are copied into the pool instead of being wrapped one by one
+			unmanagedCallback = new MLCameraCallbackWrapper(this, framePool->GetNativePool());
+		}
+
 		// MLCameraCallbackWrapper 캯ʵ
-		MLCameraCallbackWrapper::MLCameraCallbackWrapper(ManagedCameraCallback^ callback) {
+		MLCameraCallbackWrapper::MLCameraCallbackWrapper(ManagedCameraCallback^ callback, MLCommon::FrameBufferPool* pool) {
 			this->managedCallback = callback;
+			this->framePool = pool;
+			this->dispatchQueue = nullptr;
+			this->frameGrayLevel = false;
+			this->frameGrayLevelFailed = false;
+			this->grayLevelPercentile = 1;
+		}
+
+		void ManagedCameraCallback::EnableAsyncDispatch(MLCommon::DispatchOptions^ options) {
+			if (dispatcher != nullptr) {
+				throw gcnew InvalidOperationException("Asynchronous dispatch is already enabled.");
+			}
+			dispatcher = gcnew MLCommon::CallbackDispatcher<CameraEvent, ManagedCameraCallback^>(this, options);
+			static_cast<MLCameraCallbackWrapper*>(unmanagedCallback)->SetDispatchQueue(dispatcher->GetQueue());
+		}
+
+		void ManagedCameraCallback::EnableFrameGrayLevel(MLCommon::StatisticsOptions^ options, double percentile) {
+			if (percentile < 0 || percentile > 1) {
+				throw gcnew ArgumentOutOfRangeException("percentile");
+			}
+			if (options != nullptr && options->Stride < 1) {
+				throw gcnew ArgumentOutOfRangeException("options", "Stride must be positive.");
+			}
+			MLCommon::PixelStatisticsOptions native = options != nullptr ? options->ToNative() : MLCommon::PixelStatisticsOptions();
+			static_cast<MLCameraCallbackWrapper*>(unmanagedCallback)->SetFrameGrayLevel(native, percentile);
 		}
 	};
 
@@ -36,6 +76,15 @@ namespace MLColorimeterCS {
 		// MLMotionCallbackWrapper 캯ʵ
 		MLMotionCallbackWrapper::MLMotionCallbackWrapper(ManagedMotionCallback^ callback) {
 			this->managedCallback = callback;
+			this->dispatchQueue = nullptr;
+		}
+
+		void ManagedMotionCallback::EnableAsyncDispatch(MLCommon::DispatchOptions^ options) {
+			if (dispatcher != nullptr) {
+				throw gcnew InvalidOperationException("Asynchronous dispatch is already enabled.");
+			}
+			dispatcher = gcnew MLCommon::CallbackDispatcher<MotionEvent, ManagedMotionCallback^>(this, options);
+			static_cast<MLMotionCallbackWrapper*>(unmanagedCallback)->SetDispatchQueue(dispatcher->GetQueue());
 		}
 	}
 
@@ -51,6 +100,15 @@ namespace MLColorimeterCS {
 		// MLFilterWheelCallbackWrapper 캯ʵ
 		MLFilterWheelCallbackWrapper::MLFilterWheelCallbackWrapper(ManagedFilterWheelCallback^ callback) {
 			this->managedCallback = callback;
+			this->dispatchQueue = nullptr;
+		}
+
+		void ManagedFilterWheelCallback::EnableAsyncDispatch(MLCommon::DispatchOptions^ options) {
+			if (dispatcher != nullptr) {
+				throw gcnew InvalidOperationException("Asynchronous dispatch is already enabled.");
+			}
+			dispatcher = gcnew MLCommon::CallbackDispatcher<FilterWheelEvent, ManagedFilterWheelCallback^>(this, options);
+			static_cast<MLFilterWheelCallbackWrapper*>(unmanagedCallback)->SetDispatchQueue(dispatcher->GetQueue());
 		}
 	}
 }
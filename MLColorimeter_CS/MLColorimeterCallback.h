@@ -5,6 +5,9 @@
 #include "ModuleCommon.h"
 #include "MLFilterWheelClass.h"
 #include "MLConverters.h"
+#include "FramePool.h"
+#include "ImageStatistics.h"
+#include "DispatchQueue.h"
 #include <msclr\marshal.h>
 #include <msclr\marshal_cppstd.h>
 
@@ -20,9 +23,43 @@ namespace MLColorimeterCS {
 	{
 		// 定义托管回调委托
 		public delegate void NotifyCameraStateChangedDelegate(MLCommon::MLCameraState old_state, MLCommon::MLCameraState new_state);
-		public delegate void NotifyCameraFrameReceivedDelegate(IntPtr frame, int width, int height, int channels, MLCommon::MLPixelFormat format);
+		public delegate void NotifyCameraFrameReceivedDelegate(MLCommon::NativeImage^ frame, MLCommon::MLPixelFormat format);
+		public delegate void NotifyCameraPooledFrameReceivedDelegate(MLCommon::PooledFrame^ frame);
 		public delegate void NotifyCameraGrayLevelDelegate(int gray_level);
 
+		// 异步分发队列中的相机事件
+		struct CameraEvent
+		{
+			enum Kind { StateChanged, FrameReceived, PooledFrameReceived, GrayLevel };
+			int kind;
+			int oldState;
+			int newState;
+			int format;
+			int grayLevel;
+			int slot;
+			unsigned long long lease;
+			cv::Mat* frame;
+			MLCommon::FrameBufferPool* pool;
+
+			static CameraEvent Create(int kind)
+			{
+				CameraEvent e = {};
+				e.kind = kind;
+				e.slot = -1;
+				return e;
+			}
+
+			// 事件被溢出策略丢弃时释放帧
+			void Discard()
+			{
+				delete frame;
+				frame = nullptr;
+				if (pool != nullptr && slot >= 0) {
+					pool->Release(slot, lease);
+				}
+			}
+		};
+
 		// 托管回调类
 		public ref class ManagedCameraCallback
 		{
@@ -31,15 +68,50 @@ namespace MLColorimeterCS {
 			NotifyCameraStateChangedDelegate^ stateChangedDelegate;
 			NotifyCameraFrameReceivedDelegate^ frameReceivedDelegate;
 			NotifyCameraGrayLevelDelegate^ grayLevelDelegate;
+			NotifyCameraPooledFrameReceivedDelegate^ pooledFrameReceivedDelegate;
+			MLCommon::FramePool^ framePool;
+			MLCommon::CallbackDispatcher<CameraEvent, ManagedCameraCallback^>^ dispatcher;
 
 		public:
 			ManagedCameraCallback(NotifyCameraStateChangedDelegate^ stateChanged,
 				NotifyCameraFrameReceivedDelegate^ frameReceived,
 				NotifyCameraGrayLevelDelegate^ grayLevel);
 
+			// 帧缓冲池模式：帧拷贝到固定数量的复用缓冲区，所有槽位被占用时丢帧
+			ManagedCameraCallback(NotifyCameraStateChangedDelegate^ stateChanged,
+				NotifyCameraPooledFrameReceivedDelegate^ pooledFrameReceived,
+				NotifyCameraGrayLevelDelegate^ grayLevel,
+				int poolSlotCount);
+
 			~ManagedCameraCallback()
 			{
 				delete unmanagedCallback;
+				delete dispatcher;
+				// 处理函数仍持有帧时不释放缓冲池，由其终结器在帧不再被引用后释放
+				if (framePool != nullptr && framePool->LeasedCount == 0) {
+					delete framePool;
+				}
+			}
+
+			// 启用异步分发：委托在独立的分发线程上调用，不再阻塞 SDK 线程
+			// 需在把 GetUnmanagedCallback() 交给 SDK 之前调用
+			void EnableAsyncDispatch(MLCommon::DispatchOptions^ options);
+
+			// 由每帧图像计算灰度（统计内核，取各通道分位数的最大值），替代 SDK 上报的灰度
+			// 统计内核不支持的帧（多通道、ROI 超出图像）仍转发 SDK 上报的灰度
+			// 需在把 GetUnmanagedCallback() 交给 SDK 之前调用
+			void EnableFrameGrayLevel(MLCommon::StatisticsOptions^ options, double percentile);
+
+			// 分发队列统计，同步模式下为空
+			property MLCommon::DispatchStatistics DispatchStatistics {
+				MLCommon::DispatchStatistics get() {
+					return dispatcher == nullptr ? MLCommon::DispatchStatistics() : dispatcher->Statistics;
+				}
+			}
+
+			// 帧缓冲池，非缓冲池模式下为 nullptr
+			property MLCommon::FramePool^ FramePool {
+				MLCommon::FramePool^ get() { return framePool; }
 			}
 
 			// 获取非托管回调对象
@@ -54,9 +126,16 @@ namespace MLColorimeterCS {
 				stateChangedDelegate(old_state, new_state);
 			}
 
-			void NotifyCameraFrameReceived(IntPtr frame, int width, int height, int channels, MLCommon::MLPixelFormat format)
+			// 帧句柄由处理函数持有，用完后调用 Dispose() 释放
+			void NotifyCameraFrameReceived(MLCommon::NativeImage^ frame, MLCommon::MLPixelFormat format)
 			{
-				frameReceivedDelegate(frame, width, height, channels, format);
+				frameReceivedDelegate(frame, format);
+			}
+
+			// 处理函数用完后调用 frame->Release() 归还槽位
+			void NotifyCameraPooledFrameReceived(int slot, unsigned long long lease)
+			{
+				pooledFrameReceivedDelegate(framePool->GetFrame(slot, lease));
 			}
 
 			void NotifyCameraGrayLevel(int gray_level)
@@ -75,6 +154,29 @@ namespace MLColorimeterCS {
 				MLPixelFormat format = MLPixelFormat::MLMono16;
 				unmanagedCallback->NotifyCameraFrameReceived(frame, format);
 			}
+
+		internal:
+			// 分发线程调用
+			void Dispatch(const CameraEvent& e)
+			{
+				switch (e.kind) {
+				case CameraEvent::StateChanged:
+					NotifyCameraStateChanged(static_cast<MLCommon::MLCameraState>(e.oldState), static_cast<MLCommon::MLCameraState>(e.newState));
+					break;
+				case CameraEvent::FrameReceived: {
+					MLCommon::NativeImage^ image = gcnew MLCommon::NativeImage(*e.frame);
+					delete e.frame;
+					NotifyCameraFrameReceived(image, static_cast<MLCommon::MLPixelFormat>(e.format));
+					break;
+				}
+				case CameraEvent::PooledFrameReceived:
+					NotifyCameraPooledFrameReceived(e.slot, e.lease);
+					break;
+				case CameraEvent::GrayLevel:
+					NotifyCameraGrayLevel(e.grayLevel);
+					break;
+				}
+			}
 		};
 
 		// 非托管回调包装类
@@ -82,39 +184,105 @@ namespace MLColorimeterCS {
 		{
 		private:
 			gcroot<ManagedCameraCallback^> managedCallback;  // 使用 gcroot<> 代替 ^
+			MLCommon::FrameBufferPool* framePool;
+			MLCommon::DispatchQueue<CameraEvent>* dispatchQueue;
+			bool frameGrayLevel;
+			// 最近一帧无法统计（如 CV_8UC3 帧或 ROI 超出图像），改为转发 SDK 上报的灰度
+			bool frameGrayLevelFailed;
+			MLCommon::PixelStatisticsOptions grayLevelOptions;
+			double grayLevelPercentile;
+
+			void ForwardGrayLevel(int gray_level)
+			{
+				if (dispatchQueue != nullptr) {
+					CameraEvent e = CameraEvent::Create(CameraEvent::GrayLevel);
+					e.grayLevel = gray_level;
+					dispatchQueue->Enqueue(e);
+					return;
+				}
+				managedCallback->NotifyCameraGrayLevel(gray_level);
+			}
 
 		public:
-			MLCameraCallbackWrapper(ManagedCameraCallback^ callback);
+			MLCameraCallbackWrapper(ManagedCameraCallback^ callback, MLCommon::FrameBufferPool* pool = nullptr);
+
+			void SetDispatchQueue(MLCommon::DispatchQueue<CameraEvent>* queue)
+			{
+				dispatchQueue = queue;
+			}
+
+			void SetFrameGrayLevel(const MLCommon::PixelStatisticsOptions& options, double percentile)
+			{
+				grayLevelOptions = options;
+				grayLevelPercentile = percentile;
+				frameGrayLevelFailed = false;
+				frameGrayLevel = true;
+			}
 
 			virtual void NotifyCameraStateChanged(MLCameraState old_state, MLCameraState new_state)
 			{
+				if (dispatchQueue != nullptr) {
+					CameraEvent e = CameraEvent::Create(CameraEvent::StateChanged);
+					e.oldState = static_cast<int>(MLCommon::MLConverter::ToManaged(old_state));
+					e.newState = static_cast<int>(MLCommon::MLConverter::ToManaged(new_state));
+					dispatchQueue->Enqueue(e);
+					return;
+				}
 				managedCallback->NotifyCameraStateChanged(MLCommon::MLConverter::ToManaged(old_state), MLCommon::MLConverter::ToManaged(new_state));
 			}
 
 			virtual void NotifyCameraFrameReceived(cv::Mat frame, MLPixelFormat format)
 			{
-				// 将cv::Mat转换为托管数组
-				int width = frame.cols;
-				int height = frame.rows;
-				int channels = frame.channels();
+				if (frameGrayLevel) {
+					// 灰度事件先于帧事件分发
+					std::vector<MLCommon::PixelStatistics> channels;
+					frameGrayLevelFailed = !MLCommon::ComputePixelStatistics(frame, grayLevelOptions, channels, MLCommon::KernelAuto);
+					if (!frameGrayLevelFailed) {
+						double level = 0;
+						for (const MLCommon::PixelStatistics& channel : channels) {
+							level = std::max(level, MLCommon::HistogramPercentile(channel, grayLevelPercentile));
+						}
+						ForwardGrayLevel(static_cast<int>(level));
+					}
+				}
+				if (framePool != nullptr) {
+					// 缓冲池模式下像素缓冲区和帧句柄都按槽位复用，每帧不做任何分配
+					unsigned long long lease;
+					int slot = framePool->Store(frame, format, lease);
+					if (slot < 0) {
+						return;
+					}
+					if (dispatchQueue != nullptr) {
+						CameraEvent e = CameraEvent::Create(CameraEvent::PooledFrameReceived);
+						e.slot = slot;
+						e.lease = lease;
+						e.pool = framePool;
+						dispatchQueue->Enqueue(e);
+						return;
+					}
+					managedCallback->NotifyCameraPooledFrameReceived(slot, lease);
+					return;
+				}
+				if (dispatchQueue != nullptr) {
+					// 队列持有 cv::Mat 头，像素不拷贝
+					CameraEvent e = CameraEvent::Create(CameraEvent::FrameReceived);
+					e.frame = new cv::Mat(frame);
+					e.format = static_cast<int>(MLCommon::MLConverter::ToManaged(format));
+					dispatchQueue->Enqueue(e);
+					return;
+				}
+				// NativeImage 持有 cv::Mat 引用计数，像素不拷贝
 				MLCommon::MLPixelFormat formatInt = MLCommon::MLConverter::ToManaged(format);
-
-				//array<unsigned char>^ frameArray = gcnew array<unsigned char>(frame.total() * channels);
-				//Marshal::Copy(frame.data, frameArray, 0, frameArray->Length);
-
-				//array<unsigned char>^ frameArray = MLCommon::MLConverter::ConvertMatToManagedArray(frame);
-
-				MLColorimeterCS::MLCommon::MatWrapper^ wrapper = gcnew MLColorimeterCS::MLCommon::MatWrapper(&frame);
-				IntPtr matPtr = wrapper->GetMatPtr();
-				int cols = wrapper->GetMatCols();
-				int rows = wrapper->GetMatRows();
-
-				managedCallback->NotifyCameraFrameReceived(matPtr, width, height, channels, formatInt);
+				MLCommon::NativeImage^ image = gcnew MLCommon::NativeImage(frame);
+				managedCallback->NotifyCameraFrameReceived(image, formatInt);
 			}
 
 			virtual void NotifyCameraGrayLevel(int gray_level)
 			{
-				managedCallback->NotifyCameraGrayLevel(gray_level);
+				if (frameGrayLevel && !frameGrayLevelFailed) {
+					return;
+				}
+				ForwardGrayLevel(gray_level);
 			}
 		};
 	}
@@ -125,6 +293,18 @@ namespace MLColorimeterCS {
 		public delegate void NotifyMotionStateChangedDelegate(MLCommon::MLMotionState old_state, MLCommon::MLMotionState new_state);
 		public delegate void NotifyMotionPositionDelegate(int position);
 
+		// 异步分发队列中的运动事件
+		struct MotionEvent
+		{
+			enum Kind { StateChanged, Position };
+			int kind;
+			int oldState;
+			int newState;
+			int position;
+
+			void Discard() {}
+		};
+
 		// 托管回调类
 		public ref class ManagedMotionCallback
 		{
@@ -132,6 +312,7 @@ namespace MLColorimeterCS {
 			MLMotionCallback* unmanagedCallback;
 			NotifyMotionStateChangedDelegate^ stateChangedDelegate;
 			NotifyMotionPositionDelegate^ positionDelegate;
+			MLCommon::CallbackDispatcher<MotionEvent, ManagedMotionCallback^>^ dispatcher;
 
 		public:
 			ManagedMotionCallback(NotifyMotionStateChangedDelegate^ stateChanged,
@@ -140,6 +321,17 @@ namespace MLColorimeterCS {
 			~ManagedMotionCallback()
 			{
 				delete unmanagedCallback;
+				delete dispatcher;
+			}
+
+			// 启用异步分发，需在把 GetUnmanagedCallback() 交给 SDK 之前调用
+			void EnableAsyncDispatch(MLCommon::DispatchOptions^ options);
+
+			// 分发队列统计，同步模式下为空
+			property MLCommon::DispatchStatistics DispatchStatistics {
+				MLCommon::DispatchStatistics get() {
+					return dispatcher == nullptr ? MLCommon::DispatchStatistics() : dispatcher->Statistics;
+				}
 			}
 
 			// 获取非托管回调对象
@@ -163,6 +355,18 @@ namespace MLColorimeterCS {
 			{
 				unmanagedCallback->NotifyMotionPosition(20);
 			}
+
+		internal:
+			// 分发线程调用
+			void Dispatch(const MotionEvent& e)
+			{
+				if (e.kind == MotionEvent::StateChanged) {
+					NotifyMotionStateChanged(static_cast<MLCommon::MLMotionState>(e.oldState), static_cast<MLCommon::MLMotionState>(e.newState));
+				}
+				else {
+					NotifyMotionPosition(e.position);
+				}
+			}
 		};
 
 		// 非托管回调包装类
@@ -170,17 +374,38 @@ namespace MLColorimeterCS {
 		{
 		private:
 			gcroot<ManagedMotionCallback^> managedCallback;  // 使用 gcroot<> 代替 ^
+			MLCommon::DispatchQueue<MotionEvent>* dispatchQueue;
 
 		public:
 			MLMotionCallbackWrapper(ManagedMotionCallback^ callback);
 
+			void SetDispatchQueue(MLCommon::DispatchQueue<MotionEvent>* queue)
+			{
+				dispatchQueue = queue;
+			}
+
 			virtual void NotifyMotionStateChanged(MLMotionState old_state, MLMotionState new_state)
 			{
+				if (dispatchQueue != nullptr) {
+					MotionEvent e = {};
+					e.kind = MotionEvent::StateChanged;
+					e.oldState = static_cast<int>(MLCommon::MLConverter::ToManaged(old_state));
+					e.newState = static_cast<int>(MLCommon::MLConverter::ToManaged(new_state));
+					dispatchQueue->Enqueue(e);
+					return;
+				}
 				managedCallback->NotifyMotionStateChanged(MLCommon::MLConverter::ToManaged(old_state), MLCommon::MLConverter::ToManaged(new_state));
 			}
 
 			virtual void NotifyMotionPosition(int position)
 			{
+				if (dispatchQueue != nullptr) {
+					MotionEvent e = {};
+					e.kind = MotionEvent::Position;
+					e.position = position;
+					dispatchQueue->Enqueue(e);
+					return;
+				}
 				managedCallback->NotifyMotionPosition(position);
 			}
 		};
@@ -191,12 +416,22 @@ namespace MLColorimeterCS {
 		// 定义托管回调委托
 		public delegate void NotifyFilterStatusChangedDelegate(String^ object, MLCommon::MLFilterStatus status);
 
+		// 异步分发队列中的滤光轮事件
+		struct FilterWheelEvent
+		{
+			char object[64];
+			int status;
+
+			void Discard() {}
+		};
+
 		// 托管回调类
 		public ref class ManagedFilterWheelCallback
 		{
 		private:
 			MLFilterWheelCallback* unmanagedCallback;
 			NotifyFilterStatusChangedDelegate^ stateChangedDelegate;
+			MLCommon::CallbackDispatcher<FilterWheelEvent, ManagedFilterWheelCallback^>^ dispatcher;
 
 		public:
 			ManagedFilterWheelCallback(NotifyFilterStatusChangedDelegate^ stateChanged);
@@ -204,6 +439,17 @@ namespace MLColorimeterCS {
 			~ManagedFilterWheelCallback()
 			{
 				delete unmanagedCallback;
+				delete dispatcher;
+			}
+
+			// 启用异步分发，需在把 GetUnmanagedCallback() 交给 SDK 之前调用
+			void EnableAsyncDispatch(MLCommon::DispatchOptions^ options);
+
+			// 分发队列统计，同步模式下为空
+			property MLCommon::DispatchStatistics DispatchStatistics {
+				MLCommon::DispatchStatistics get() {
+					return dispatcher == nullptr ? MLCommon::DispatchStatistics() : dispatcher->Statistics;
+				}
 			}
 
 			// 获取非托管回调对象
@@ -217,6 +463,13 @@ namespace MLColorimeterCS {
 			{
 				stateChangedDelegate(object, status);
 			}
+
+		internal:
+			// 分发线程调用
+			void Dispatch(const FilterWheelEvent& e)
+			{
+				NotifyFilterStatusChanged(gcnew String(e.object), static_cast<MLCommon::MLFilterStatus>(e.status));
+			}
 		};
 
 		// 非托管回调包装类
@@ -224,12 +477,25 @@ namespace MLColorimeterCS {
 		{
 		private:
 			gcroot<ManagedFilterWheelCallback^> managedCallback;  // 使用 gcroot<> 代替 ^
+			MLCommon::DispatchQueue<FilterWheelEvent>* dispatchQueue;
 
 		public:
 			MLFilterWheelCallbackWrapper(ManagedFilterWheelCallback^ callback);
 
+			void SetDispatchQueue(MLCommon::DispatchQueue<FilterWheelEvent>* queue)
+			{
+				dispatchQueue = queue;
+			}
+
 			virtual void NotifyFilterStatusChanged(const std::string object, ML::MLFilterWheel::MLFilterStatus status)
 			{
+				if (dispatchQueue != nullptr) {
+					FilterWheelEvent e = {};
+					strncpy_s(e.object, object.c_str(), _TRUNCATE);
+					e.status = static_cast<int>(MLCommon::MLConverter::ToManaged(status));
+					dispatchQueue->Enqueue(e);
+					return;
+				}
 				managedCallback->NotifyFilterStatusChanged(MLCommon::MLConverter::ToManaged(object), MLCommon::MLConverter::ToManaged(status));
 			}
 		};
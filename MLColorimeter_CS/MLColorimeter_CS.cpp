@@ -1,13 +1,143 @@
 #include "pch.h"
 
 #include "MLColorimeter_CS.h"
+#include "MLMonoBusinessManage.h"
 #include <mutex>
+#include <set>
 
+#include <msclr\lock.h>
 #include <msclr\marshal_cppstd.h>
 
 namespace MLColorimeterCS {
 	namespace Interface
 	{
+		// ML_LoadCalibrationDataAsync() ĺ̨
+		ref class CalibrationLoadJob
+		{
+		public:
+			CalibrationLoadJob(ML::MLColorimeter::MLBinoBusinessManage* bino, Object^ sdkLock, const ML::MLColorimeter::CalibrationConfig& config,
+				ML::MLColorimeter::OperationMode mode, const std::vector<std::pair<MLCommon::CalibrationPipeline*, std::string>>& pipelines)
+				: bino(bino), sdkLock(sdkLock), mode(mode) {
+				this->config = new ML::MLColorimeter::CalibrationConfig(config);
+				this->pipelines = new std::vector<std::pair<MLCommon::CalibrationPipeline*, std::string>>(pipelines);
+			}
+
+			MLCommon::MLResult Run() {
+				try {
+					// ˮߵ SDK ļͬʱУøԵ㷨ʵҪ SDK 
+					for (auto& job : *pipelines) {
+						job.first->Prefetch(job.second, *config);
+					}
+					Result ret;
+					{
+						// ML_Measurement() ڼڼ仹˶Ͳͼ
+						msclr::lock guard(sdkLock);
+						ret = bino->ML_LoadCalibrationData(*config, mode);
+					}
+					for (auto& job : *pipelines) {
+						Result r = job.first->Preload(job.second, *config);
+						if (!r.success && ret.success) ret = r;
+					}
+					return MLCommon::MLConverter::ToManaged(ret);
+				}
+				finally {
+					delete config;
+					config = nullptr;
+					delete pipelines;
+					pipelines = nullptr;
+				}
+			}
+
+		private:
+			ML::MLColorimeter::MLBinoBusinessManage* bino;
+			Object^ sdkLock;
+			ML::MLColorimeter::CalibrationConfig* config;
+			ML::MLColorimeter::OperationMode mode;
+			std::vector<std::pair<MLCommon::CalibrationPipeline*, std::string>>* pipelines;
+		};
+
+		// ˹ƬֵĿλͨ˹Ƭöٿֻһ
+		static int CountSlots(const ML::MLFilterWheel::MLNDFilterConfiguation& config)
+		{
+			std::set<int> slots;
+			for (const auto& pair : config.positionName_List) {
+				slots.insert(pair.second);
+			}
+			for (const auto& pair : config.positionEnum_List) {
+				slots.insert(pair.second);
+			}
+			return static_cast<int>(slots.size());
+		}
+
+		static bool IsMonoFormat(ML::CameraV2::MLPixelFormat format)
+		{
+			return format == ML::CameraV2::MLPixelFormat::MLMono8 || format == ML::CameraV2::MLPixelFormat::MLMono10
+				|| format == ML::CameraV2::MLPixelFormat::MLMono12 || format == ML::CameraV2::MLPixelFormat::MLMono16;
+		}
+
+		// ML_MeasureBatch() 첽棬˳ںִ̨
+		ref class CalibrationSaveJob
+		{
+		public:
+			CalibrationSaveJob(ML::MLColorimeter::MLBinoBusinessManage* bino, Object^ sdkLock, int moduleID, const MLCommon::NativeCalibrationData& data,
+				const ML::MLColorimeter::SaveDataConfig& config)
+				: bino(bino), sdkLock(sdkLock), moduleID(moduleID) {
+				// һβḲˮߺ SDK ͼ񻺳
+				this->data = new MLCommon::NativeCalibrationData(data);
+				for (auto& stage : *this->data) {
+					for (auto& entry : stage.second) {
+						entry.second.Img = entry.second.Img.clone();
+					}
+				}
+				this->config = new ML::MLColorimeter::SaveDataConfig(config);
+			}
+
+			MLCommon::MLResult Run(System::Threading::Tasks::Task^ previous) {
+				try {
+					// ڽеĲ SDK û
+					msclr::lock guard(sdkLock);
+					Result ret = bino->ML_SaveCalibrationData(*data, moduleID, *config);
+					return MLCommon::MLConverter::ToManaged(ret);
+				}
+				catch (Exception^ e) {
+					return MLCommon::MLResult::CreateError(e->Message, 0);
+				}
+				finally {
+					delete data;
+					data = nullptr;
+					delete config;
+					config = nullptr;
+				}
+			}
+
+		private:
+			ML::MLColorimeter::MLBinoBusinessManage* bino;
+			Object^ sdkLock;
+			int moduleID;
+			MLCommon::NativeCalibrationData* data;
+			ML::MLColorimeter::SaveDataConfig* config;
+		};
+
+		// ML_MeasureBatch() ĺ̨
+		ref class MeasurementBatchJob
+		{
+		public:
+			MeasurementBatchJob(MLBinoBusinessModuleWrapper^ wrapper, MLCommon::MeasurementBatch^ batch, String^ ndKey, String^ xyzKey, MLCommon::OperationMode mode)
+				: wrapper(wrapper), batch(batch), ndKey(ndKey), xyzKey(xyzKey), mode(mode) {
+			}
+
+			MLCommon::MLResult Run() {
+				return wrapper->RunMeasurementBatch(batch, ndKey, xyzKey, mode);
+			}
+
+		private:
+			MLBinoBusinessModuleWrapper^ wrapper;
+			MLCommon::MeasurementBatch^ batch;
+			String^ ndKey;
+			String^ xyzKey;
+			MLCommon::OperationMode mode;
+		};
+
 		MLColorimeterWrapper::MLColorimeterWrapper()
 		{
 		}
@@ -33,47 +163,63 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_AddModule(String^ path)
 		{
+			WaitCalibrationLoad();
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_AddModule(MLCommon::MLConverter::ToNative(path).c_str()));
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_RemoveModule(int moduleID)
 		{
+			WaitCalibrationLoad();
+			if (pipelines != nullptr) {
+				auto it = pipelines->find(moduleID);
+				if (it != pipelines->end()) {
+					delete it->second;
+					pipelines->erase(it);
+				}
+			}
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_RemoveModule(moduleID));
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_AddIPDMotion(String^ path)
 		{
+			WaitCalibrationLoad();
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_AddIPDMotion(MLCommon::MLConverter::ToNative(path).c_str()));
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_RemoveIPDMotion()
 		{
+			WaitCalibrationLoad();
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_RemoveIPDMotion());
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_ConnectModules()
 		{
+			WaitCalibrationLoad();
 			Result ret = ml_bino->ML_ConnectModules();
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_DisconnectModules()
 		{
+			WaitCalibrationLoad();
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_DisconnectModules());
 		}
 
 		bool MLBinoBusinessModuleWrapper::ML_IsModulesConnect()
 		{
+			WaitCalibrationLoad();
 			return ml_bino->ML_IsModulesConnect();
 		}
 
 		bool MLBinoBusinessModuleWrapper::ML_IsModulesMoving()
 		{
+			WaitCalibrationLoad();
 			return ml_bino->ML_IsModulesMoving();
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_WaitForMovingStop(int timeout, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			return MLCommon::MLConverter::ToManaged(ml_bino->ML_WaitForMovingStop(timeout, MLCommon::MLConverter::ToNative(mode)));
 		}
 
@@ -84,6 +230,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, String^>^ MLBinoBusinessModuleWrapper::ML_GetModulesSerialNumber()
 		{
+			WaitCalibrationLoad();
 			std::map<int, std::string> native = ml_bino->ML_GetModulesSerialNumber();
 			Dictionary<int, String^>^ managed = gcnew Dictionary<int, String^>();
 			for (const auto& pair : native) {
@@ -94,6 +241,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, String^>^ MLBinoBusinessModuleWrapper::ML_GetModulesName()
 		{
+			WaitCalibrationLoad();
 			std::map<int, std::string> native = ml_bino->ML_GetModulesName();
 			Dictionary<int, String^>^ managed = gcnew Dictionary<int, String^>();
 			for (const auto& pair : native) {
@@ -104,6 +252,7 @@ namespace MLColorimeterCS {
 
 		List<int>^ MLBinoBusinessModuleWrapper::ML_GetModulesIDList()
 		{
+			WaitCalibrationLoad();
 			std::vector<int> native = ml_bino->ML_GetModulesIDList();
 			List<int>^ managed = gcnew List<int>();
 			for each (int value in native)
@@ -113,11 +262,13 @@ namespace MLColorimeterCS {
 
 		int MLBinoBusinessModuleWrapper::ML_GetModulesNumber()
 		{
+			WaitCalibrationLoad();
 			return ml_bino->ML_GetModulesNumber();
 		}
 
 		Dictionary<int, MLCommon::ModuleConfig^>^ MLBinoBusinessModuleWrapper::ML_GetModulesConfig()
 		{
+			WaitCalibrationLoad();
 			std::map<int, ML::MLColorimeter::ModuleConfig>native = ml_bino->ML_GetModulesConfig();
 			Dictionary<int, MLCommon::ModuleConfig^>^ managed = gcnew Dictionary<int, MLCommon::ModuleConfig^>();
 			for (const auto& pair : native) {
@@ -128,6 +279,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_MoveModulesND_XYZFilterAsync(String^ keyName, MLCommon::MLFilterEnum channle, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLFilterWheel::MLFilterEnum ml_filter = MLCommon::MLConverter::ToNative(channle);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
@@ -137,6 +289,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_MoveModulesND_XYZFilterSync(String^ keyName, MLCommon::MLFilterEnum channle, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLFilterWheel::MLFilterEnum ml_filter = MLCommon::MLConverter::ToNative(channle);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
@@ -146,6 +299,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, MLCommon::MLFilterEnum>^ MLBinoBusinessModuleWrapper::ML_GetND_XYZFilterChannel(String^ keyName)
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::MLFilterEnum>^ managed = gcnew Dictionary<int, MLCommon::MLFilterEnum>();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			std::map<int, ML::MLFilterWheel::MLFilterEnum> channelMap = ml_bino->ML_GetND_XYZFilterChannel(keyName_str);
@@ -157,6 +311,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_MoveModulesRXFilterAsync(String^ channelName, int degree, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string channelName_str = MLCommon::MLConverter::ToNative(channelName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_MoveModulesRXFilterAsync(channelName_str, degree, ml_mode, nullptr);
@@ -165,6 +320,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_MoveModulesRXFilterSync(String^ channelName, int degree, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string channelName_str = MLCommon::MLConverter::ToNative(channelName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_MoveModulesRXFilterSync(channelName_str, degree, ml_mode);
@@ -173,6 +329,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, String^>^ MLBinoBusinessModuleWrapper::ML_GetRXFilterChannel()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, String^>^ channel_dict = gcnew Dictionary<int, String^>();
 			std::map<int, std::string> channel_map = ml_bino->ML_GetRXFilterChannel();
 			for (const auto& pair : channel_map) {
@@ -183,6 +340,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, int>^ MLBinoBusinessModuleWrapper::ML_GetRXFilterAxis()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, int>^ channel_dict = gcnew Dictionary<int, int>();
 			std::map<int, int> channel_map = ml_bino->ML_GetRXFilterAxis();
 			for (const auto& pair : channel_map) {
@@ -193,6 +351,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetFocusAsync(double vid, MLCommon::OperationMode mode, MLCommon::FocusMethod method)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			ML::MLColorimeter::FocusMethod ml_method = MLCommon::MLConverter::ToNative(method);
 			Result ret = ml_bino->ML_SetFocusAsync(vid, ml_mode, ml_method);
@@ -201,6 +360,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetFocusSync(double vid, MLCommon::OperationMode mode, MLCommon::FocusMethod method)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			ML::MLColorimeter::FocusMethod ml_method = MLCommon::MLConverter::ToNative(method);
 			Result ret = ml_bino->ML_SetFocusSync(vid, ml_mode, ml_method);
@@ -209,6 +369,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, double>^ MLBinoBusinessModuleWrapper::ML_GetVID(MLCommon::FocusMethod method)
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, double>^ vid_dict = gcnew Dictionary<int, double>();
 			ML::MLColorimeter::FocusMethod ml_method = MLCommon::MLConverter::ToNative(method);
 			std::map<int, double> vid_map = ml_bino->ML_GetVID(ml_method);
@@ -223,6 +384,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_ThroughFocus(ThroughFocusParams^ params)
 		{
+			WaitCalibrationLoad();
 			std::string key = MLCommon::MLConverter::ToNative(params->KeyName);
 			std::map<int, double> vid;
 			for each (auto % pair in params->VID) { vid[pair.Key] = pair.Value;}
@@ -230,8 +392,31 @@ namespace MLColorimeterCS {
 			for each (auto % pair in params->Position) { pos[pair.Key] = pair.Value; }
 			ML::MLColorimeter::ThroughFocusConfig focusconfig = MLCommon::MLConverter::ToNative(params->FocusConfig);
 			ML::MLColorimeter::OperationMode mode = MLCommon::MLConverter::ToNative(params->Mode);
-			Result ret = ml_bino->ML_ThroughFocus(key, vid, pos, focusconfig, mode);
-			for each (auto % pair in params->VID) { vid[pair.Key] = pair.Value; }
+			Result ret;
+			if (params->FocusConfig != nullptr && params->FocusConfig->SweepMode != MLCommon::FocusSweepMode::Sdk) {
+				// װɨ裬ˮģʽµƶ MTF ص
+				MLCommon::FocusSweepSettings settings = MLCommon::FocusSweeper::ToNative(params->FocusConfig);
+				std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>> modules;
+				for (int id : ml_bino->ML_GetModulesIDList()) {
+					modules.push_back(std::make_pair(id, ml_bino->ML_GetModuleByID(id)));
+				}
+				if (focusCurves == nullptr) {
+					focusCurves = new std::map<int, MLCommon::FocusSweepCurves>();
+				}
+				ret = MLCommon::FocusSweep(modules, key, focusconfig, settings, mode == ML::MLColorimeter::OperationMode::Parallel, *focusCurves);
+				focusSweepResults = true;
+				if (ret.success) {
+					for (const auto& pair : *focusCurves) {
+						vid[pair.first] = pair.second.BestVid;
+						pos[pair.first] = pair.second.BestPosition;
+					}
+				}
+			}
+			else {
+				focusSweepResults = false;
+				ret = ml_bino->ML_ThroughFocus(key, vid, pos, focusconfig, mode);
+				for each (auto % pair in params->VID) { vid[pair.Key] = pair.Value; }
+			}
 			Dictionary<int, double>^ vid_dict = gcnew Dictionary<int, double>();
 			for (const auto& pair : vid) {vid_dict->Add(pair.first, pair.second);}
 			params->VID = vid_dict;
@@ -243,6 +428,10 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, List<double>^>^ MLBinoBusinessModuleWrapper::ML_GetVIDCurve()
 		{
+			WaitCalibrationLoad();
+			if (focusSweepResults && focusCurves != nullptr) {
+				return GetFocusCurves(&MLCommon::FocusSweepCurves::Vid);
+			}
 			std::map<int, std::vector<double>> vid_curveMap = ml_bino->ML_GetVIDCurve();
 			Dictionary<int, List<double>^>^ dict = gcnew Dictionary<int, List<double>^>();
 			for (const auto& pair : vid_curveMap) {
@@ -260,6 +449,10 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, List<double>^>^ MLBinoBusinessModuleWrapper::ML_GetMTFCurve()
 		{
+			WaitCalibrationLoad();
+			if (focusSweepResults && focusCurves != nullptr) {
+				return GetFocusCurves(&MLCommon::FocusSweepCurves::Mtf);
+			}
 			std::map<int, std::vector<double>> mtf_curveMap = ml_bino->ML_GetMTFCurve();
 			Dictionary<int, List<double>^>^ dict = gcnew Dictionary<int, List<double>^>();
 			for (const auto& pair : mtf_curveMap) {
@@ -274,6 +467,10 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, List<double>^>^ MLBinoBusinessModuleWrapper::ML_GetMotionCurve()
 		{
+			WaitCalibrationLoad();
+			if (focusSweepResults && focusCurves != nullptr) {
+				return GetFocusCurves(&MLCommon::FocusSweepCurves::Motion);
+			}
 			std::map<int, std::vector<double>> motion_curveMap = ml_bino->ML_GetMotionCurve();
 			Dictionary<int, List<double>^>^ dict = gcnew Dictionary<int, List<double>^>();
 			for (const auto& pair : motion_curveMap) {
@@ -286,8 +483,21 @@ namespace MLColorimeterCS {
 			return dict;
 		}
 
+		Dictionary<int, double>^ MLBinoBusinessModuleWrapper::ML_GetMaxFrameTravel()
+		{
+			WaitCalibrationLoad();
+			Dictionary<int, double>^ dict = gcnew Dictionary<int, double>();
+			if (focusSweepResults && focusCurves != nullptr) {
+				for (const auto& pair : *focusCurves) {
+					dict->Add(pair.first, pair.second.MaxFrameTravel);
+				}
+			}
+			return dict;
+		}
+
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetPosistionAbsAsync(String^ keyName, double pos, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetPosistionAbsAsync(keyName_str, pos, ml_mode);
@@ -296,6 +506,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetPosistionAbsSync(String^ keyName, double pos, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetPosistionAbsSync(keyName_str, pos, ml_mode);
@@ -304,6 +515,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetPositionRelAsync(String^ keyName, double pos, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetPositionRelAsync(keyName_str, pos, ml_mode);
@@ -312,6 +524,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetPositionRelSync(String^ keyName, double pos, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetPositionRelSync(keyName_str, pos, ml_mode);
@@ -320,6 +533,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, double>^ MLBinoBusinessModuleWrapper::ML_GetMotionPosition(String^ keyName)
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, double>^ posDict = gcnew Dictionary<int, double>();
 			std::string keyName_str = MLCommon::MLConverter::ToNative(keyName);
 			std::map<int, double> posMap = ml_bino->ML_GetMotionPosition(keyName_str);
@@ -339,6 +553,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetSphericalAsync(double sphere, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetSphericalAsync(sphere, ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -346,6 +561,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetSphericalSync(double sphere, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetSphericalSync(sphere, ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -353,6 +569,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, double>^ MLBinoBusinessModuleWrapper::ML_GetSpherical()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, double>^ sphereDict = gcnew Dictionary<int, double>();
 			std::map<int, double> sphereMap = ml_bino->ML_GetSpherical();
 			for (const auto& pair : sphereMap) {
@@ -363,6 +580,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetRXAsync(MLCommon::RXCombination^ rx, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::RXCombination ml_rx = MLCommon::MLConverter::ToNative(rx);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetRXAsync(ml_rx, ml_mode);
@@ -371,6 +589,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetRXSync(MLCommon::RXCombination^ rx, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::RXCombination ml_rx = MLCommon::MLConverter::ToNative(rx);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetRXSync(ml_rx, ml_mode);
@@ -379,6 +598,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, MLCommon::RXCombination^>^ MLBinoBusinessModuleWrapper::ML_GetRX()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::RXCombination^>^ rxDict = gcnew Dictionary<int, MLCommon::RXCombination^>();
 			std::map<int, ML::MLColorimeter::RXCombination> rxMap = ml_bino->ML_GetRX();
 			for (const auto& pair : rxMap) {
@@ -389,23 +609,27 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetIPDAsync(double ipd)
 		{
+			WaitCalibrationLoad();
 			Result ret = ml_bino->ML_SetIPDAsync(ipd);
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetIPDSync(double ipd)
 		{
+			WaitCalibrationLoad();
 			Result ret = ml_bino->ML_SetIPDSync(ipd);
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
 		double MLBinoBusinessModuleWrapper::ML_GetIPD()
 		{
+			WaitCalibrationLoad();
 			return ml_bino->ML_GetIPD();
 		}
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetAperture(String^ aperture)
 		{
+			WaitCalibrationLoad();
 			std::string aperture_str = MLCommon::MLConverter::ToNative(aperture);
 			Result ret = ml_bino->ML_SetAperture(aperture_str);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -413,6 +637,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, String^>^ MLBinoBusinessModuleWrapper::ML_GetAperture()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, String^>^ aperDict = gcnew Dictionary<int, String^>();
 			std::map<int, std::string> aperMap = ml_bino->ML_GetAperture();
 			for (const auto& pair : aperMap) {
@@ -423,6 +648,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetLightSource(String^ lightSource)
 		{
+			WaitCalibrationLoad();
 			std::string lightSource_str = MLCommon::MLConverter::ToNative(lightSource);
 			Result ret = ml_bino->ML_SetLightSource(lightSource_str);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -430,6 +656,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, String^>^ MLBinoBusinessModuleWrapper::ML_GetLightSource()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, String^>^ lightDict = gcnew Dictionary<int, String^>();
 			std::map<int, std::string> lightMap = ml_bino->ML_GetLightSource();
 			for (const auto& pair : lightMap) {
@@ -440,6 +667,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetExposure(MLCommon::ExposureSetting exposure, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::ExposureSetting ml_exposure = MLCommon::MLConverter::ToNative(exposure);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_SetExposure(ml_exposure, ml_mode);
@@ -448,6 +676,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, double>^ MLBinoBusinessModuleWrapper::ML_GetExposureTime()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, double>^ expoDict = gcnew Dictionary<int, double>();
 			std::map<int, double> expoMap = ml_bino->ML_GetExposureTime();
 			for (const auto& pair : expoMap) {
@@ -458,6 +687,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetBinning(MLCommon::Binning binning)
 		{
+			WaitCalibrationLoad();
 			ML::CameraV2::Binning ml_binning = MLCommon::MLConverter::ToNative(binning);
 			Result ret = ml_bino->ML_SetBinning(ml_binning);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -465,6 +695,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, MLCommon::Binning>^ MLBinoBusinessModuleWrapper::ML_GetBinning()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::Binning>^ binDict = gcnew Dictionary<int, MLCommon::Binning>();
 			std::map<int, ML::CameraV2::Binning> binMap = ml_bino->ML_GetBinning();
 			for (const auto& pair : binMap) {
@@ -475,6 +706,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetBinningMode(MLCommon::BinningMode binningMode)
 		{
+			WaitCalibrationLoad();
 			ML::CameraV2::BinningMode ml_binningMode = MLCommon::MLConverter::ToNative(binningMode);
 			Result ret = ml_bino->ML_SetBinningMode(ml_binningMode);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -482,6 +714,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, MLCommon::BinningMode>^ MLBinoBusinessModuleWrapper::ML_GetBinningMode()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::BinningMode>^ binmodeDict = gcnew Dictionary<int, MLCommon::BinningMode>();
 			std::map<int, ML::CameraV2::BinningMode> binmodeMap = ml_bino->ML_GetBinningMode();
 			for (const auto& pair : binmodeMap) {
@@ -492,6 +725,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetPixelFormat(MLCommon::MLPixelFormat pixelFormat)
 		{
+			WaitCalibrationLoad();
 			ML::CameraV2::MLPixelFormat ml_pixelFormat = MLCommon::MLConverter::ToNative(pixelFormat);
 			Result ret = ml_bino->ML_SetPixelFormat(ml_pixelFormat);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -499,6 +733,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, MLCommon::MLPixelFormat>^ MLBinoBusinessModuleWrapper::ML_GetPixelFormat()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::MLPixelFormat>^ formatDict = gcnew Dictionary<int, MLCommon::MLPixelFormat>();
 			std::map<int, ML::CameraV2::MLPixelFormat> formatMap = ml_bino->ML_GetPixelFormat();
 			for (const auto& pair : formatMap) {
@@ -509,6 +744,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_CaptureImageAsync(MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_CaptureImageAsync(ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -516,25 +752,53 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_CaptureImageSync(MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
 			Result ret = ml_bino->ML_CaptureImageSync(ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
-		Dictionary<int, IntPtr>^ MLBinoBusinessModuleWrapper::ML_GetImage()
+		Dictionary<int, MLCommon::NativeImage^>^ MLBinoBusinessModuleWrapper::ML_GetImage()
 		{
-			Dictionary<int, IntPtr>^ imageDict = gcnew Dictionary<int, IntPtr>();
+			WaitCalibrationLoad();
+			Dictionary<int, MLCommon::NativeImage^>^ imageDict = gcnew Dictionary<int, MLCommon::NativeImage^>();
 			std::map<int, cv::Mat> imageMap = ml_bino->ML_GetImage();
-			for (auto pair : imageMap) {
-				MLColorimeterCS::MLCommon::MatWrapper^ wrapper = gcnew MLColorimeterCS::MLCommon::MatWrapper(&pair.second);
-				IntPtr matPtr = wrapper->GetMatPtr();
-				imageDict->Add(pair.first, matPtr);
+			for (const auto& pair : imageMap) {
+				imageDict->Add(pair.first, gcnew MLCommon::NativeImage(pair.second));
+			}
+			return imageDict;
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_CaptureAverageImage(int avgCount, MLCommon::AveragingConfig^ config, MLCommon::OperationMode mode)
+		{
+			WaitCalibrationLoad();
+			if (avgCount < 1) {
+				throw gcnew ArgumentOutOfRangeException("avgCount");
+			}
+			MLCommon::FrameAverageSettings settings = MLCommon::ImageAverager::ToNative(config);
+			if (averageImages == nullptr) {
+				averageImages = new std::map<int, cv::Mat>();
+			}
+			averageImages->clear();
+			Result ret = MLCommon::CaptureAverage(ml_bino, MLCommon::MLConverter::ToNative(mode), avgCount, settings, *averageImages);
+			return MLCommon::MLConverter::ToManaged(ret);
+		}
+
+		Dictionary<int, MLCommon::NativeImage^>^ MLBinoBusinessModuleWrapper::ML_GetAverageImage()
+		{
+			Dictionary<int, MLCommon::NativeImage^>^ imageDict = gcnew Dictionary<int, MLCommon::NativeImage^>();
+			if (averageImages == nullptr) {
+				return imageDict;
+			}
+			for (const auto& pair : *averageImages) {
+				imageDict->Add(pair.first, gcnew MLCommon::NativeImage(pair.second));
 			}
 			return imageDict;
 		}
 
 		Dictionary<int, MLCommon::CaptureData^>^ MLBinoBusinessModuleWrapper::ML_GetCaptureData()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, MLCommon::CaptureData^>^ dataDict = gcnew Dictionary<int, MLCommon::CaptureData^>();
 			std::map<int, ML::MLColorimeter::CaptureData> dataMap = ml_bino->ML_GetCaptureData();
 			for (auto pair : dataMap) {
@@ -545,6 +809,7 @@ namespace MLColorimeterCS {
 
 		Dictionary<int, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaptureData^>^>^ MLBinoBusinessModuleWrapper::ML_GetColorCameraCaptureData()
 		{
+			WaitCalibrationLoad();
 			Dictionary<int, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaptureData^>^>^ dict =
 				gcnew Dictionary<int, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaptureData^>^>();
 			std::map<int, std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData>> dataMap = ml_bino->ML_GetColorCameraCaptureData();
@@ -556,6 +821,7 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_LoadDarkByExposureTimeList(String^ path)
 		{
+			WaitCalibrationLoad();
 			std::string ml_path = MLCommon::MLConverter::ToNative(path);
 			Result ret = ml_bino->ML_LoadDarkByExposureTimeList(ml_path.c_str());
 			return MLCommon::MLConverter::ToManaged(ret);
@@ -563,14 +829,483 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_LoadCalibrationData(MLCommon::CalibrationConfig^ config, MLCommon::OperationMode mode)
 		{
+			WaitCalibrationLoad();
 			ML::MLColorimeter::CalibrationConfig ml_config = MLCommon::MLConverter::ToNative(config);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
-			Result ret = ml_bino->ML_LoadCalibrationData(ml_config, ml_mode);
+			StartCalibrationLoad(ml_config, ml_mode, config != nullptr && config->ParallelFilterPipeline);
+			return WaitCalibrationLoad();
+		}
+
+		System::Threading::Tasks::Task<MLCommon::MLResult>^ MLBinoBusinessModuleWrapper::ML_LoadCalibrationDataAsync(MLCommon::CalibrationConfig^ config, MLCommon::OperationMode mode)
+		{
+			WaitCalibrationLoad();
+			ML::MLColorimeter::CalibrationConfig ml_config = MLCommon::MLConverter::ToNative(config);
+			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
+			return StartCalibrationLoad(ml_config, ml_mode, config != nullptr && config->ParallelFilterPipeline);
+		}
+
+		System::Threading::Tasks::Task<MLCommon::MLResult>^ MLBinoBusinessModuleWrapper::StartCalibrationLoad(const ML::MLColorimeter::CalibrationConfig& config, ML::MLColorimeter::OperationMode mode, bool withPipelines)
+		{
+			// ˮڵ̴ֻ̨߳ʹ
+			std::vector<std::pair<MLCommon::CalibrationPipeline*, std::string>> jobs;
+			if (withPipelines) {
+				for (int id : ml_bino->ML_GetModulesIDList()) {
+					jobs.push_back(std::make_pair(GetPipeline(id), ml_bino->ML_GetModuleByID(id)->ML_GetConfigPath()));
+				}
+			}
+			CalibrationLoadJob^ job = gcnew CalibrationLoadJob(ml_bino, sdkLock, config, mode, jobs);
+			pendingLoad = System::Threading::Tasks::Task<MLCommon::MLResult>::Run(gcnew Func<MLCommon::MLResult>(job, &CalibrationLoadJob::Run));
+			return pendingLoad;
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_Measurement(String^ ndKey, String^ xyzKey, MLCommon::CalibrationConfig^ config, MLCommon::ExposureSetting exposure, MLCommon::OperationMode mode)
+		{
+			if (config == nullptr) {
+				throw gcnew ArgumentNullException("config");
+			}
+			std::string ndKey_str = MLCommon::MLConverter::ToNative(ndKey);
+			std::string xyzKey_str = MLCommon::MLConverter::ToNative(xyzKey);
+			ML::MLColorimeter::CalibrationConfig mlconfig = MLCommon::MLConverter::ToNative(config);
+			ML::MLColorimeter::ExposureSetting ml_exposure = MLCommon::MLConverter::ToNative(exposure);
+			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
+			Result ret = Measure(ndKey_str, xyzKey_str, mlconfig, ml_exposure, ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
+		Result MLBinoBusinessModuleWrapper::Measure(const std::string& ndKey_str, const std::string& xyzKey_str, const ML::MLColorimeter::CalibrationConfig& mlconfig,
+			const ML::MLColorimeter::ExposureSetting& ml_exposure, ML::MLColorimeter::OperationMode ml_mode)
+		{
+			// ֮ǰļʧҲ޷¼
+			WaitCalibrationLoad();
+			std::vector<int> ids;
+			std::vector<std::pair<int, ML::MLColorimeter::MLMonoBusinessManage*>> modules;
+			{
+				// ʱһıܻڵ SDK
+				msclr::lock guard(sdkLock);
+				// ÿ˹ƬУֻںڰ
+				std::map<int, ML::CameraV2::MLPixelFormat> formats = ml_bino->ML_GetPixelFormat();
+				for (const auto& pair : formats) {
+					if (!IsMonoFormat(pair.second)) {
+						return Result(false, "ML_Measurement() supports mono cameras only.");
+					}
+				}
+				ids = ml_bino->ML_GetModulesIDList();
+				for (int id : ids) {
+					modules.push_back(std::make_pair(id, ml_bino->ML_GetModuleByID(id)));
+				}
+			}
+			measurementTimings = gcnew List<MLCommon::StageTiming>();
+			pipelineResults = false;
+			System::Diagnostics::Stopwatch^ total = System::Diagnostics::Stopwatch::StartNew();
+			System::Diagnostics::Stopwatch^ step = System::Diagnostics::Stopwatch::StartNew();
+
+			// 궨ں̨أ˹Ƭ˶͵һβͼصSDK ػ⣬ÿε֮ؿԲ
+			Result ret;
+			{
+				msclr::lock guard(sdkLock);
+				StartCalibrationLoad(mlconfig, ml_mode, true);
+				ret = ml_bino->ML_MoveModulesND_XYZFilterSync(ndKey_str, mlconfig.NDFilter, ml_mode);
+			}
+			AddMeasurementTiming("MoveND", MLCommon::MLFilterEnum::Unknown, step);
+			if (!ret.success) {
+				WaitCalibrationLoad();
+				return ret;
+			}
+
+			exposureReports = gcnew List<MLCommon::AutoExposureReport>();
+			std::vector<MLCommon::CalibrationPipeline*> started;
+			for (auto filter : mlconfig.ColorFilterList) {
+				MLCommon::MLFilterEnum managedFilter = MLCommon::MLConverter::ToManaged(filter);
+				{
+					msclr::lock guard(sdkLock);
+					ret = ml_bino->ML_MoveModulesND_XYZFilterSync(xyzKey_str, filter, ml_mode);
+				}
+				AddMeasurementTiming("MoveFilter", managedFilter, step);
+				if (ret.success && exposurePredictor != nullptr && ml_exposure.Mode == ML::MLColorimeter::ExposureMode::Auto) {
+					// ԤԶع⣬һβͼǲͼ
+					std::map<int, MLCommon::ExposureOutcome> outcomes;
+					{
+						msclr::lock guard(sdkLock);
+						ret = exposurePredictor->Run(modules, mlconfig.NDFilter, filter, ml_exposure.ExposureTime,
+							ml_mode == ML::MLColorimeter::OperationMode::Parallel, outcomes);
+					}
+					for (const auto& pair : outcomes) {
+						AddExposureReport(pair.first, mlconfig.NDFilter, filter, pair.second);
+					}
+					AddMeasurementTiming("AutoExposure", managedFilter, step);
+				}
+				else {
+					if (ret.success) {
+						msclr::lock guard(sdkLock);
+						ret = ml_bino->ML_SetExposure(ml_exposure, ml_mode);
+						AddMeasurementTiming("Exposure", managedFilter, step);
+					}
+					if (ret.success) {
+						msclr::lock guard(sdkLock);
+						ret = ml_bino->ML_CaptureImageSync(ml_mode);
+						AddMeasurementTiming("Capture", managedFilter, step);
+					}
+				}
+				if (!ret.success) {
+					break;
+				}
+				std::map<int, ML::MLColorimeter::CaptureData> captured;
+				{
+					msclr::lock guard(sdkLock);
+					captured = ml_bino->ML_GetCaptureData();
+				}
+
+				if (started.empty()) {
+					// һ֡УҪ궨
+					MLCommon::MLResult loaded = WaitCalibrationLoad();
+					AddMeasurementTiming("WaitCalibrationData", MLCommon::MLFilterEnum::Unknown, step);
+					if (!loaded.IsSuccess) {
+						return MLCommon::MLConverter::ToNative(loaded);
+					}
+					msclr::lock guard(sdkLock);
+					for (int id : ids) {
+						MLCommon::CalibrationPipeline* pipeline = GetPipeline(id);
+						ret = pipeline->Begin(ml_bino->ML_GetModuleByID(id)->ML_GetConfigPath(), mlconfig);
+						if (!ret.success) {
+							break;
+						}
+						started.push_back(pipeline);
+					}
+					if (!ret.success) {
+						break;
+					}
+				}
+
+				// ˹Ƭİ/ƽ/Уں̨Уͬʱ˹Ƭתһ
+				for (std::size_t i = 0; i < ids.size() && ret.success; i++) {
+					auto data = captured.find(ids[i]);
+					if (data == captured.end()) {
+						ret = Result(false, "No capture data for a module.");
+						break;
+					}
+					data->second.ColorFilter = filter;
+					ret = started[i]->StartFilter(filter, data->second);
+				}
+				if (!ret.success) {
+					break;
+				}
+			}
+
+			step->Restart();
+			Result finished;
+			{
+				// ɫģ鲽 SDK ģ㷨ʵ
+				msclr::lock guard(sdkLock);
+				finished = MLCommon::CalibrationPipeline::FinishModules(started, ml_mode == ML::MLColorimeter::OperationMode::Parallel);
+			}
+			AddMeasurementTiming("Finish", MLCommon::MLFilterEnum::Unknown, step);
+			if (ret.success) {
+				ret = finished;
+			}
+			pipelineResults = !started.empty();
+			AddMeasurementTiming("Total", MLCommon::MLFilterEnum::Unknown, total);
+			return ret;
+		}
+
+		List<MLCommon::StageTiming>^ MLBinoBusinessModuleWrapper::ML_GetMeasurementTimings()
+		{
+			if (measurementTimings == nullptr) {
+				return gcnew List<MLCommon::StageTiming>();
+			}
+			return gcnew List<MLCommon::StageTiming>(measurementTimings);
+		}
+
+		MLCommon::MeasurementBatch^ MLBinoBusinessModuleWrapper::ML_MeasureBatch(String^ ndKey, String^ xyzKey, List<MLCommon::MeasurementStep^>^ steps,
+			MLCommon::MeasurementStepHandler^ handler, MLCommon::OperationMode mode)
+		{
+			if (steps == nullptr) {
+				throw gcnew ArgumentNullException("steps");
+			}
+			if (pendingBatch != nullptr && !pendingBatch->Completion->IsCompleted) {
+				throw gcnew InvalidOperationException("A measurement batch is already running.");
+			}
+			// ں̨߳Уڵ̵߳ȴ
+			WaitCalibrationLoad();
+			List<MLCommon::MotionTarget^>^ targets = gcnew List<MLCommon::MotionTarget^>();
+			for each (MLCommon::MeasurementStep^ step in steps) {
+				if (step == nullptr || step->Config == nullptr) {
+					throw gcnew ArgumentException("Every step needs a calibration config.", "steps");
+				}
+				targets->Add(MLCommon::MotionTarget::FromConfig(step->Config));
+			}
+			// ˶·
+			MLCommon::MotionPlan^ plan = MLCommon::MotionPlanner::Plan(ML_GetMotionModel(ndKey, xyzKey), ML_GetMotionTarget(ndKey, xyzKey), targets);
+			MLCommon::MeasurementBatch^ batch = gcnew MLCommon::MeasurementBatch(gcnew List<MLCommon::MeasurementStep^>(steps), plan, handler);
+			MeasurementBatchJob^ job = gcnew MeasurementBatchJob(this, batch, ndKey, xyzKey, mode);
+			batch->completion = System::Threading::Tasks::Task<MLCommon::MLResult>::Factory->StartNew(
+				gcnew Func<MLCommon::MLResult>(job, &MeasurementBatchJob::Run), System::Threading::Tasks::TaskCreationOptions::LongRunning);
+			pendingBatch = batch;
+			return batch;
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::RunMeasurementBatch(MLCommon::MeasurementBatch^ batch, String^ ndKey, String^ xyzKey, MLCommon::OperationMode mode)
+		{
+			std::string ndKey_str = MLCommon::MLConverter::ToNative(ndKey);
+			std::string xyzKey_str = MLCommon::MLConverter::ToNative(xyzKey);
+			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
+			Result first;
+			List<System::Threading::Tasks::Task<MLCommon::MLResult>^>^ saves = gcnew List<System::Threading::Tasks::Task<MLCommon::MLResult>^>();
+			System::Threading::Tasks::Task^ lastSave = System::Threading::Tasks::Task::CompletedTask;
+			String^ lightSource = nullptr;
+			ML::MLColorimeter::RXCombination rx;
+			bool rxKnown = false;
+
+			try {
+				for (int sequence = 0; sequence < batch->order->Length; sequence++) {
+					if (batch->IsCancellationRequested) {
+						if (first.success) first = Result(false, "Measurement batch cancelled.", 1);
+						break;
+					}
+					int index = batch->order[sequence];
+					MLCommon::MeasurementStep^ step = batch->steps[index];
+					ML::MLColorimeter::CalibrationConfig mlconfig = MLCommon::MLConverter::ToNative(step->Config);
+
+					// Դ RX ֻڱ仯ʱл
+					measurementTimings = nullptr;
+					Result ret;
+					if (!String::IsNullOrEmpty(step->Config->LightSource) && !String::Equals(lightSource, step->Config->LightSource)) {
+						msclr::lock guard(sdkLock);
+						ret = ml_bino->ML_SetLightSource(mlconfig.LightSource);
+						lightSource = ret.success ? step->Config->LightSource : nullptr;
+					}
+					bool rxSet = mlconfig.RX.Sphere != DBL_MAX || mlconfig.RX.Cylinder != DBL_MAX || mlconfig.RX.Axis != INT_MAX;
+					if (ret.success && rxSet && !(rxKnown && rx.Sphere == mlconfig.RX.Sphere && rx.Cylinder == mlconfig.RX.Cylinder && rx.Axis == mlconfig.RX.Axis)) {
+						msclr::lock guard(sdkLock);
+						ret = ml_bino->ML_SetRXSync(mlconfig.RX, ml_mode);
+						rx = mlconfig.RX;
+						rxKnown = ret.success;
+					}
+					if (ret.success) {
+						ret = Measure(ndKey_str, xyzKey_str, mlconfig, MLCommon::MLConverter::ToNative(step->Exposure), ml_mode);
+					}
+
+					MLCommon::MeasurementStepResult^ result = gcnew MLCommon::MeasurementStepResult();
+					result->Index = index;
+					result->Sequence = sequence;
+					result->Step = step;
+					result->Result = MLCommon::MLConverter::ToManaged(ret);
+					result->Timings = ML_GetMeasurementTimings();
+					result->Data = gcnew Dictionary<int, MLCommon::CalibrationDataView^>();
+					if (ret.success && (step->SaveConfig != nullptr || batch->handler != nullptr)) {
+						msclr::lock guard(sdkLock);
+						for (int id : ml_bino->ML_GetModulesIDList()) {
+							MLCommon::NativeCalibrationData data = GetNativeCalibrationData(id);
+							// һβͬʱ
+							if (step->SaveConfig != nullptr) {
+								CalibrationSaveJob^ job = gcnew CalibrationSaveJob(ml_bino, sdkLock, id, data, MLCommon::MLConverter::ToNative(step->SaveConfig));
+								System::Threading::Tasks::Task<MLCommon::MLResult>^ save = lastSave->ContinueWith<MLCommon::MLResult>(
+									gcnew Func<System::Threading::Tasks::Task^, MLCommon::MLResult>(job, &CalibrationSaveJob::Run));
+								saves->Add(save);
+								lastSave = save;
+							}
+							if (batch->handler != nullptr) {
+								result->Data->Add(id, gcnew MLCommon::CalibrationDataView(std::move(data)));
+							}
+						}
+					}
+					if (!ret.success && first.success) {
+						first = ret;
+					}
+					batch->StepCompleted();
+					if (batch->handler != nullptr) {
+						batch->handler->Invoke(result);
+					}
+				}
+			}
+			finally {
+				lastSave->Wait();
+			}
+			for each (System::Threading::Tasks::Task<MLCommon::MLResult>^ save in saves) {
+				if (!save->Result.IsSuccess && first.success) {
+					first = MLCommon::MLConverter::ToNative(save->Result);
+				}
+			}
+			return MLCommon::MLConverter::ToManaged(first);
+		}
+
+		MLCommon::MotionModel^ MLBinoBusinessModuleWrapper::ML_GetMotionModel(String^ ndKey, String^ xyzKey)
+		{
+			WaitCalibrationLoad();
+			MLCommon::MotionModel^ model = gcnew MLCommon::MotionModel();
+			std::map<int, ML::MLColorimeter::ModuleConfig> configs = ml_bino->ML_GetModulesConfig();
+			if (configs.empty()) {
+				return model;
+			}
+			// ģ˹Ƭͬȡһģ
+			const ML::MLColorimeter::ModuleConfig& config = configs.begin()->second;
+			auto nd = config.NDFilterConfig_Map.find(MLCommon::MLConverter::ToNative(ndKey));
+			if (nd != config.NDFilterConfig_Map.end()) {
+				model->NDSlots = CountSlots(nd->second);
+				for (const auto& pair : nd->second.positionEnum_List) {
+					model->NDPositions[MLCommon::MLConverter::ToManaged(pair.first)] = pair.second;
+				}
+			}
+			auto xyz = config.NDFilterConfig_Map.find(MLCommon::MLConverter::ToNative(xyzKey));
+			if (xyz != config.NDFilterConfig_Map.end()) {
+				model->XYZSlots = CountSlots(xyz->second);
+				for (const auto& pair : xyz->second.positionEnum_List) {
+					model->XYZPositions[MLCommon::MLConverter::ToManaged(pair.first)] = pair.second;
+				}
+			}
+			// RX ˹Ƭֵͨ
+			const ML::MLFilterWheel::MLRXFilterConfiguation& rx = config.RXFilterConfig;
+			model->RXSlots = static_cast<int>(rx.positionName_List.size());
+			for (const auto& pair : rx.positionName_List) {
+				char* end = nullptr;
+				double cylinder = std::strtod(pair.first.c_str(), &end);
+				if (end != pair.first.c_str() && *end == '\0') {
+					model->RXPositions[cylinder] = pair.second;
+				}
+			}
+			model->AxisMin = rx.axis_info.Min;
+			model->AxisMax = rx.axis_info.Max;
+			return model;
+		}
+
+		MLCommon::MotionTarget^ MLBinoBusinessModuleWrapper::ML_GetMotionTarget(String^ ndKey, String^ xyzKey)
+		{
+			WaitCalibrationLoad();
+			MLCommon::MotionTarget^ target = gcnew MLCommon::MotionTarget();
+			std::map<int, ML::MLFilterWheel::MLFilterEnum> nd = ml_bino->ML_GetND_XYZFilterChannel(MLCommon::MLConverter::ToNative(ndKey));
+			if (!nd.empty()) {
+				target->NDFilter = MLCommon::MLConverter::ToManaged(nd.begin()->second);
+			}
+			std::map<int, ML::MLFilterWheel::MLFilterEnum> xyz = ml_bino->ML_GetND_XYZFilterChannel(MLCommon::MLConverter::ToNative(xyzKey));
+			if (!xyz.empty()) {
+				target->ColorFilters->Add(MLCommon::MLConverter::ToManaged(xyz.begin()->second));
+			}
+			std::map<int, ML::MLColorimeter::RXCombination> rx = ml_bino->ML_GetRX();
+			if (!rx.empty()) {
+				target->RX = MLCommon::MLConverter::ToManaged(rx.begin()->second);
+			}
+			std::map<int, std::string> light = ml_bino->ML_GetLightSource();
+			if (!light.empty()) {
+				target->LightSource = MLCommon::MLConverter::ToManaged(light.begin()->second);
+			}
+			return target;
+		}
+
+		void MLBinoBusinessModuleWrapper::StopMeasurementBatch()
+		{
+			if (pendingBatch == nullptr) {
+				return;
+			}
+			MLCommon::MeasurementBatch^ batch = pendingBatch;
+			pendingBatch = nullptr;
+			batch->Cancel();
+			try {
+				batch->Completion->Wait();
+			}
+			catch (AggregateException^) {
+				// ׳쳣Ѿ Completion 
+			}
+		}
+
+		void MLBinoBusinessModuleWrapper::ML_SetPredictiveAutoExposure(MLCommon::PredictiveExposureConfig^ config)
+		{
+			if (config == nullptr) {
+				delete exposurePredictor;
+				exposurePredictor = nullptr;
+				return;
+			}
+			if (config->TargetLevel <= 0 || config->TargetLevel >= 1) {
+				throw gcnew ArgumentOutOfRangeException("config", "TargetLevel must be between 0 and 1.");
+			}
+			if (config->MinExposureTime <= 0 || config->MaxExposureTime < config->MinExposureTime) {
+				throw gcnew ArgumentOutOfRangeException("config", "The exposure time range is invalid.");
+			}
+			if (config->MaxIterations < 1 || config->SampleStride < 1) {
+				throw gcnew ArgumentOutOfRangeException("config", "MaxIterations and SampleStride must be positive.");
+			}
+			if (config->Roi.X < 0 || config->Roi.Y < 0 || config->Roi.Width < 0 || config->Roi.Height < 0) {
+				throw gcnew ArgumentOutOfRangeException("config", "Roi must not be negative.");
+			}
+			MLCommon::PredictiveExposureSettings settings;
+			settings.TargetLevel = config->TargetLevel;
+			settings.Tolerance = config->Tolerance;
+			settings.Percentile = config->Percentile;
+			settings.SampleStride = config->SampleStride;
+			settings.MaxIterations = config->MaxIterations;
+			settings.MinTime = config->MinExposureTime;
+			settings.MaxTime = config->MaxExposureTime;
+			settings.LearningRate = config->LearningRate;
+			settings.PreviewBinning = MLCommon::MLConverter::ToNative(config->PreviewBinning);
+			settings.Roi = cv::Rect(config->Roi.X, config->Roi.Y, config->Roi.Width, config->Roi.Height);
+			// ѧ͸ʱ
+			if (exposurePredictor == nullptr) {
+				exposurePredictor = new MLCommon::ExposurePredictor();
+			}
+			exposurePredictor->SetSettings(settings);
+		}
+
+		void MLBinoBusinessModuleWrapper::ML_ResetPredictiveAutoExposure()
+		{
+			if (exposurePredictor != nullptr) {
+				exposurePredictor->Reset();
+			}
+		}
+
+		List<MLCommon::AutoExposureReport>^ MLBinoBusinessModuleWrapper::ML_GetAutoExposureReports()
+		{
+			if (exposureReports == nullptr) {
+				return gcnew List<MLCommon::AutoExposureReport>();
+			}
+			return gcnew List<MLCommon::AutoExposureReport>(exposureReports);
+		}
+
+		void MLBinoBusinessModuleWrapper::AddExposureReport(int moduleID, ML::MLFilterWheel::MLFilterEnum nd, ML::MLFilterWheel::MLFilterEnum filter, const MLCommon::ExposureOutcome& outcome)
+		{
+			MLCommon::AutoExposureReport report;
+			report.ModuleID = moduleID;
+			report.NDFilter = MLCommon::MLConverter::ToManaged(nd);
+			report.Filter = MLCommon::MLConverter::ToManaged(filter);
+			report.InitialTime = outcome.InitialTime;
+			report.ExposureTime = outcome.Time;
+			report.Level = outcome.Level;
+			report.Iterations = outcome.Iterations;
+			report.PreviewIterations = outcome.PreviewIterations;
+			report.Converged = outcome.Converged;
+			report.Milliseconds = outcome.Milliseconds;
+			exposureReports->Add(report);
+		}
+
+		void MLBinoBusinessModuleWrapper::AddMeasurementTiming(String^ stage, MLCommon::MLFilterEnum filter, System::Diagnostics::Stopwatch^ watch)
+		{
+			MLCommon::StageTiming timing;
+			timing.Stage = stage;
+			timing.Filter = filter;
+			timing.Milliseconds = watch->Elapsed.TotalMilliseconds;
+			measurementTimings->Add(timing);
+			watch->Restart();
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::WaitCalibrationLoad()
+		{
+			if (pendingLoad == nullptr) {
+				return MLCommon::MLConverter::ToManaged(Result());
+			}
+			MLCommon::MLResult loaded;
+			try {
+				loaded = pendingLoad->Result;
+			}
+			catch (AggregateException^ e) {
+				loaded = MLCommon::MLResult::CreateError(e->InnerException->Message, 0);
+			}
+			// ʧܵļһֱ棬ֱһμأ֮ǰı궨Ѳ
+			if (loaded.IsSuccess) {
+				pendingLoad = nullptr;
+			}
+			return loaded;
+		}
+
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetCaptureDataMap(int moduleID, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaptureData^>^ dataMap, bool isSubDarkFromList)
 		{
+			WaitCalibrationLoad();
 			std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaptureData> ml_dataMap;
 			for each (auto % pair in dataMap) {
 				ml_dataMap[MLCommon::MLConverter::ToNative(pair.Key)] = MLCommon::MLConverter::ToNative(pair.Value);
@@ -581,25 +1316,257 @@ namespace MLColorimeterCS {
 
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_Process(MLCommon::CalibrationConfig^ config, MLCommon::OperationMode mode)
 		{
+			MLCommon::MLResult loaded = WaitCalibrationLoad();
+			if (!loaded.IsSuccess) {
+				return loaded;
+			}
 			ML::MLColorimeter::CalibrationConfig mlconfig = MLCommon::MLConverter::ToNative(config);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
+			if (config != nullptr && config->ParallelFilterPipeline) {
+				std::vector<std::pair<MLCommon::CalibrationPipeline*, std::string>> jobs;
+				for (int id : ml_bino->ML_GetModulesIDList()) {
+					jobs.push_back(std::make_pair(GetPipeline(id), ml_bino->ML_GetModuleByID(id)->ML_GetConfigPath()));
+				}
+				Result ret = MLCommon::CalibrationPipeline::ProcessModules(jobs, mlconfig, ml_mode == ML::MLColorimeter::OperationMode::Parallel);
+				pipelineResults = true;
+				return MLCommon::MLConverter::ToManaged(ret);
+			}
+			pipelineResults = false;
 			Result ret = ml_bino->ML_Process(mlconfig, ml_mode);
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
+		MLCommon::CalibrationPipeline* MLBinoBusinessModuleWrapper::GetPipeline(int moduleID)
+		{
+			if (pipelines == nullptr) {
+				pipelines = new std::map<int, MLCommon::CalibrationPipeline*>();
+			}
+			auto it = pipelines->find(moduleID);
+			if (it != pipelines->end()) {
+				return it->second;
+			}
+			MLCommon::CalibrationPipeline* pipeline = new MLCommon::CalibrationPipeline(moduleID, ml_bino->ML_GetCalibrationProcessByID(moduleID), GetCalibrationCache());
+			if (sweepPlan != nullptr) {
+				pipeline->SetSweepPlan(*sweepPlan);
+			}
+			(*pipelines)[moduleID] = pipeline;
+			return pipeline;
+		}
+
+		MLCommon::CalibrationCache* MLBinoBusinessModuleWrapper::GetCalibrationCache()
+		{
+			if (calibrationCache == nullptr) {
+				calibrationCache = new MLCommon::CalibrationCache();
+			}
+			return calibrationCache;
+		}
+
+		MLCommon::NativeCalibrationData MLBinoBusinessModuleWrapper::GetNativeCalibrationData(int moduleID)
+		{
+			WaitCalibrationLoad();
+			if (pipelineResults && pipelines != nullptr) {
+				auto it = pipelines->find(moduleID);
+				if (it != pipelines->end()) {
+					return it->second->GetCalibrationData();
+				}
+			}
+			return ml_bino->ML_GetCalibrationData(moduleID);
+		}
+
+		void MLBinoBusinessModuleWrapper::DeletePipelines()
+		{
+			if (pipelines == nullptr) return;
+			for (auto& pair : *pipelines) {
+				delete pair.second;
+			}
+			delete pipelines;
+			pipelines = nullptr;
+			// After the pipelines, waits for running prefetches
+			delete calibrationCache;
+			calibrationCache = nullptr;
+			delete sweepPlan;
+			sweepPlan = nullptr;
+		}
+
+		Dictionary<int, List<double>^>^ MLBinoBusinessModuleWrapper::GetFocusCurves(std::vector<double> MLCommon::FocusSweepCurves::* curve)
+		{
+			Dictionary<int, List<double>^>^ dict = gcnew Dictionary<int, List<double>^>();
+			for (const auto& pair : *focusCurves) {
+				List<double>^ list = gcnew List<double>();
+				for (double value : pair.second.*curve) {
+					list->Add(value);
+				}
+				dict->Add(pair.first, list);
+			}
+			return dict;
+		}
+
+		List<MLCommon::StageTiming>^ MLBinoBusinessModuleWrapper::ML_GetProcessTimings(int moduleID)
+		{
+			List<MLCommon::StageTiming>^ list = gcnew List<MLCommon::StageTiming>();
+			if (pipelines == nullptr) return list;
+			auto it = pipelines->find(moduleID);
+			if (it == pipelines->end()) return list;
+			for (const auto& native : it->second->GetTimings()) {
+				MLCommon::StageTiming timing;
+				timing.Stage = MLCommon::MLConverter::ToManaged(native.Stage);
+				timing.Filter = MLCommon::MLConverter::ToManaged(native.Filter);
+				timing.Milliseconds = native.Milliseconds;
+				list->Add(timing);
+			}
+			return list;
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetDistortionRemap(int moduleID, array<double>^ cameraMatrix, array<double>^ coefficients, String^ cacheDirectory)
+		{
+			// ̨ػᰴǰӳ
+			WaitCalibrationLoad();
+			if (cameraMatrix == nullptr || cameraMatrix->Length != 9) {
+				return MLCommon::MLConverter::ToManaged(Result(false, "Camera matrix must have 9 values."));
+			}
+			if (coefficients == nullptr || coefficients->Length == 0) {
+				return MLCommon::MLConverter::ToManaged(Result(false, "Distortion coefficients are empty."));
+			}
+			std::vector<int> ids = ml_bino->ML_GetModulesIDList();
+			if (std::find(ids.begin(), ids.end(), moduleID) == ids.end()) {
+				return MLCommon::MLConverter::ToManaged(Result(false, "Module ID does not exist."));
+			}
+			cv::Mat matrix(3, 3, CV_64F);
+			for (int i = 0; i < 9; i++) {
+				matrix.at<double>(i / 3, i % 3) = cameraMatrix[i];
+			}
+			cv::Mat distortion(1, coefficients->Length, CV_64F);
+			for (int i = 0; i < coefficients->Length; i++) {
+				distortion.at<double>(0, i) = coefficients[i];
+			}
+			std::string directory = cacheDirectory != nullptr ? MLCommon::MLConverter::ToNative(cacheDirectory) : std::string();
+			GetPipeline(moduleID)->SetDistortion(matrix, distortion, directory);
+			return MLCommon::MLConverter::ToManaged(Result());
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_ClearDistortionRemap(int moduleID)
+		{
+			WaitCalibrationLoad();
+			if (pipelines != nullptr) {
+				auto it = pipelines->find(moduleID);
+				if (it != pipelines->end()) {
+					it->second->ClearDistortion();
+				}
+			}
+			return MLCommon::MLConverter::ToManaged(Result());
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SetColorShiftRemap(int moduleID, Dictionary<MLCommon::MLFilterEnum, System::Drawing::PointF>^ colorShift)
+		{
+			WaitCalibrationLoad();
+			std::vector<int> ids = ml_bino->ML_GetModulesIDList();
+			if (std::find(ids.begin(), ids.end(), moduleID) == ids.end()) {
+				return MLCommon::MLConverter::ToManaged(Result(false, "Module ID does not exist."));
+			}
+			std::map<ML::MLFilterWheel::MLFilterEnum, cv::Point2d> shifts;
+			if (colorShift != nullptr) {
+				for each (KeyValuePair<MLCommon::MLFilterEnum, System::Drawing::PointF> pair in colorShift) {
+					shifts[MLCommon::MLConverter::ToNative(pair.Key)] = cv::Point2d(pair.Value.X, pair.Value.Y);
+				}
+			}
+			GetPipeline(moduleID)->SetColorShift(shifts);
+			return MLCommon::MLConverter::ToManaged(Result());
+		}
+
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_CompareDistortionRemap(int moduleID, MLCommon::CalibrationConfig^ config,
+			Dictionary<MLCommon::MLFilterEnum, MLCommon::RemapDifference>^% differences)
+		{
+			if (config == nullptr) {
+				throw gcnew ArgumentNullException("config");
+			}
+			differences = gcnew Dictionary<MLCommon::MLFilterEnum, MLCommon::RemapDifference>();
+			MLCommon::MLResult loaded = WaitCalibrationLoad();
+			if (!loaded.IsSuccess) {
+				return loaded;
+			}
+			std::vector<int> ids = ml_bino->ML_GetModulesIDList();
+			if (std::find(ids.begin(), ids.end(), moduleID) == ids.end()) {
+				return MLCommon::MLConverter::ToManaged(Result(false, "Module ID does not exist."));
+			}
+			ML::MLColorimeter::CalibrationConfig mlconfig = MLCommon::MLConverter::ToNative(config);
+			std::map<ML::MLFilterWheel::MLFilterEnum, MLCommon::NativeRemapDifference> native;
+			Result ret = GetPipeline(moduleID)->CompareRemap(ml_bino->ML_GetModuleByID(moduleID)->ML_GetConfigPath(), mlconfig, native);
+			for (const auto& pair : native) {
+				MLCommon::RemapDifference difference;
+				difference.Mean = pair.second.Mean;
+				difference.Max = pair.second.Max;
+				differences->Add(MLCommon::MLConverter::ToManaged(pair.first), difference);
+			}
+			return MLCommon::MLConverter::ToManaged(ret);
+		}
+
+		void MLBinoBusinessModuleWrapper::ML_SetCalibrationSweepPlan(List<MLCommon::CalibrationConfig^>^ plan)
+		{
+			if (sweepPlan == nullptr) {
+				sweepPlan = new std::vector<ML::MLColorimeter::CalibrationConfig>();
+			}
+			sweepPlan->clear();
+			if (plan != nullptr) {
+				for each (MLCommon::CalibrationConfig^ config in plan) {
+					if (config != nullptr) {
+						sweepPlan->push_back(MLCommon::MLConverter::ToNative(config));
+					}
+				}
+			}
+			if (pipelines != nullptr) {
+				for (auto& pair : *pipelines) {
+					pair.second->SetSweepPlan(*sweepPlan);
+				}
+			}
+		}
+
+		void MLBinoBusinessModuleWrapper::ML_SetCalibrationCacheBudget(long long bytes)
+		{
+			if (bytes < 0) {
+				throw gcnew ArgumentOutOfRangeException("bytes");
+			}
+			GetCalibrationCache()->SetBudget(static_cast<std::uint64_t>(bytes));
+		}
+
+		void MLBinoBusinessModuleWrapper::ML_ClearCalibrationCache()
+		{
+			if (calibrationCache != nullptr) {
+				calibrationCache->Clear();
+			}
+		}
+
+		MLCommon::CalibrationCacheStatistics MLBinoBusinessModuleWrapper::ML_GetCalibrationCacheStatistics()
+		{
+			MLCommon::CalibrationCacheCounters native = GetCalibrationCache()->GetCounters();
+			MLCommon::CalibrationCacheStatistics statistics;
+			statistics.Hits = static_cast<long long>(native.Hits);
+			statistics.Misses = static_cast<long long>(native.Misses);
+			statistics.PrefetchHits = static_cast<long long>(native.PrefetchHits);
+			statistics.Evictions = static_cast<long long>(native.Evictions);
+			statistics.Count = static_cast<int>(native.Count);
+			statistics.Bytes = static_cast<long long>(native.Bytes);
+			statistics.BudgetBytes = static_cast<long long>(native.BudgetBytes);
+			return statistics;
+		}
+
 		Dictionary<MLCommon::CalibrationEnum, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaliProcessData^>^>^MLBinoBusinessModuleWrapper::ML_GetCalibrationData(int moduleID)
 		{
 			Dictionary<MLCommon::CalibrationEnum, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaliProcessData^>^>^ dict =
 				gcnew Dictionary<MLCommon::CalibrationEnum, Dictionary<MLCommon::MLFilterEnum, MLCommon::CaliProcessData^>^>();
 			std::map<
 				ML::MLColorimeter::CalibrationEnum,
-				std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaliProcessData>> calibrationDataMap = ml_bino->ML_GetCalibrationData(moduleID);
+				std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaliProcessData>> calibrationDataMap = GetNativeCalibrationData(moduleID);
 			for (const auto& outerPair : calibrationDataMap) {
 				dict->Add(MLCommon::MLConverter::ToManaged(outerPair.first), MLCommon::MLConverter::ToManaged(outerPair.second));
 			}
 			return dict;
 		}
 
+		MLCommon::CalibrationDataView^ MLBinoBusinessModuleWrapper::ML_GetCalibrationDataView(int moduleID)
+		{
+			return gcnew MLCommon::CalibrationDataView(GetNativeCalibrationData(moduleID));
+		}
+
 		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SaveCalibrationData(
 			Dictionary<
 			MLCommon::CalibrationEnum,
@@ -607,6 +1574,7 @@ namespace MLColorimeterCS {
 			caliData,
 			int moduleID, MLCommon::SaveDataConfig^ saveconfig)
 		{
+			WaitCalibrationLoad();
 			std::map<
 				ML::MLColorimeter::CalibrationEnum,
 				std::map<ML::MLFilterWheel::MLFilterEnum, ML::MLColorimeter::CaliProcessData>> calibrationDataMap;
@@ -619,6 +1587,17 @@ namespace MLColorimeterCS {
 			return MLCommon::MLConverter::ToManaged(ret);
 		}
 
+		MLCommon::MLResult MLBinoBusinessModuleWrapper::ML_SaveCalibrationData(MLCommon::CalibrationDataView^ caliData, int moduleID, MLCommon::SaveDataConfig^ saveconfig)
+		{
+			WaitCalibrationLoad();
+			if (caliData == nullptr) {
+				throw gcnew ArgumentNullException("caliData");
+			}
+			ML::MLColorimeter::SaveDataConfig ml_saveconfig = MLCommon::MLConverter::ToNative(saveconfig);
+			Result ret = ml_bino->ML_SaveCalibrationData(caliData->GetNativeData(), moduleID, ml_saveconfig);
+			return MLCommon::MLConverter::ToManaged(ret);
+		}
+
 		array<Byte>^ MLBinoBusinessModuleWrapper::GetImageByte()
 		{
 			cv::Mat image = cv::imread("D:/Image/img2.tif", -1);
@@ -633,8 +1612,8 @@ namespace MLColorimeterCS {
 			ML::MLColorimeter::CalibrationConfig mlconfig = MLCommon::MLConverter::ToNative(config);
 			ML::MLColorimeter::ExposureSetting ml_exposure = MLCommon::MLConverter::ToNative(exposure);
 			ML::MLColorimeter::OperationMode ml_mode = MLCommon::MLConverter::ToNative(mode);
-			ml_colorimeter->ML_Measurement(ndKey_str, xyzKey_str, mlconfig, ml_exposure, isColorCamera, ml_mode);
-			return MLCommon::MLResult();
+			Result ret = ml_colorimeter->ML_Measurement(ndKey_str, xyzKey_str, mlconfig, ml_exposure, isColorCamera, ml_mode);
+			return MLCommon::MLConverter::ToManaged(ret);
 		}
 	}
 }
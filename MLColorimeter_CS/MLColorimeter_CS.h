@@ -15,6 +15,16 @@ using namespace msclr::interop;
 #include "opencv2/opencv.hpp"
 #include "ModuleCommon.h"
 #include "MLConverters.h"
+#include "CalibrationDataView.h"
+#include "ImageCorrection.h"
+#include "ImageStatistics.h"
+#include "MeasurementBatch.h"
+#include "ExposurePredictor.h"
+#include "PredictiveExposure.h"
+#include "FrameAverager.h"
+#include "ImageAverager.h"
+#include "FocusSweeper.h"
+#include "MtfAnalyzer.h"
 #include "MLColorimeterCallback.h"
 
 //参数传入默认值的函数：   
@@ -57,14 +67,25 @@ namespace MLColorimeterCS {
         public:
             MLBinoBusinessModuleWrapper(ML::MLColorimeter::MLBinoBusinessManage* nativeModule) {
                 ml_bino = nativeModule;
+                sdkLock = gcnew Object();
             }
 
             ~MLBinoBusinessModuleWrapper() {
-                delete ml_bino;
+                StopMeasurementBatch();
+                WaitCalibrationLoad();
+                this->!MLBinoBusinessModuleWrapper();
             }
 
             !MLBinoBusinessModuleWrapper() {
+                DeletePipelines();
+                delete exposurePredictor;
+                exposurePredictor = nullptr;
+                delete averageImages;
+                averageImages = nullptr;
+                delete focusCurves;
+                focusCurves = nullptr;
                 delete ml_bino;
+                ml_bino = nullptr;
             }
 
             /// <summary>
@@ -247,6 +268,8 @@ namespace MLColorimeterCS {
 
             /// <summary>
             /// Perform through focus and return the vid and position on best mtf.
+            /// With any FocusConfig.SweepMode but Sdk the sweep is run by the wrapper and scored by the mean
+            /// SDK MTF (CalculateMTF()) of the ROIs at Freq; the curve getters then return the wrapper's curves.
             /// </summary>
             /// <param name="params">All parameter structures of through focus</param>
             MLCommon::MLResult ML_ThroughFocus(ThroughFocusParams^ params);
@@ -269,6 +292,14 @@ namespace MLColorimeterCS {
             /// <returns>A map of fine motion curve (format: {module id, motion curve}).</returns>
             Dictionary<int, List<double>^>^ ML_GetMotionCurve();
 
+            /// <summary>
+            /// Get the largest travel of the motion during the exposure of one frame, its motion blur, after a
+            /// ML_ThroughFocus() with FocusConfig.SweepMode FlyScan (unit: millimeter). 0 after the other wrapper
+            /// sweeps, empty after the SDK through focus.
+            /// </summary>
+            /// <returns>A map of travel (format: {module id, travel}).</returns>
+            Dictionary<int, double>^ ML_GetMaxFrameTravel();
+
             /// <summary>
             /// Set absolute motion position asynchronously.
             /// </summary>
@@ -480,8 +511,29 @@ namespace MLColorimeterCS {
             /// <summary>
             /// Get an image after calling ML_CaptureImageAsync() or ML_CaptureImageSync().
             /// </summary>
-            /// <returns>A map of signle channel image for mono camera, or a map a three-channel image for color camera (format: {module id, cv::Mat}).</returns>
-            Dictionary<int, IntPtr>^ ML_GetImage();
+            /// <returns>A map of signle channel image for mono camera, or a map a three-channel image for color camera (format: {module id, image}).</returns>
+            /// <note>The images share the native pixel buffers without copying, dispose them when done. The next
+            /// capture overwrites the pixels; Clone() an image to keep it.</note>
+            Dictionary<int, MLCommon::NativeImage^>^ ML_GetImage();
+
+            /// <summary>
+            /// Capture avgCount images and average them per module, like the averaging of ML_CaptureFFCImg() and
+            /// ML_CaptureImgAndCalMMatrix() but streaming: each frame is accumulated while the next one is exposed,
+            /// and the memory does not grow with avgCount.
+            /// </summary>
+            /// <param name="avgCount">Number of images to average.</param>
+            /// <param name="config">Outlier rejection, nullptr for a plain mean.</param>
+            /// <param name="mode">Operation mode between multiple modules.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_CaptureAverageImage(int avgCount, MLCommon::AveragingConfig^ config,
+                [Optional, DefaultParameterValue(MLCommon::OperationMode::Parallel)]MLCommon::OperationMode mode);
+
+            /// <summary>
+            /// Get the averaged images after calling ML_CaptureAverageImage().
+            /// </summary>
+            /// <returns>A map of float images, or of images of the camera pixel depth with KeepPixelDepth (format: {module id, image}).</returns>
+            /// <note>The images share the native pixel buffers without copying, dispose them when done.</note>
+            Dictionary<int, MLCommon::NativeImage^>^ ML_GetAverageImage();
 
             /// <summary>
             /// Get a CaptureData for mono camera.
@@ -505,12 +557,26 @@ namespace MLColorimeterCS {
 
             /// <summary>
             /// Load the corresponding calibration data according to the CalibrationConfig.
+            /// With CalibrationConfig.ParallelFilterPipeline the pipeline's calibration data and remap tables are loaded as well.
             /// </summary>
             /// <param name="config">Config setting to load calibration data.</param>
             /// <param name="mode">Operation mode between multiple modules</param>
             /// <returns>The result contains the message, code and status.</returns>
             /// <note>Dark images must named by exposure time.</note>
             MLCommon::MLResult ML_LoadCalibrationData(MLCommon::CalibrationConfig^ config, [Optional, DefaultParameterValue(MLCommon::OperationMode::Parallel)]MLCommon::OperationMode mode);
+
+            /// <summary>
+            /// Load the corresponding calibration data according to the CalibrationConfig on a background thread,
+            /// e.g. right after ML_MoveModulesND_XYZFilterAsync() or ML_SetRXAsync() so loading overlaps the motion.
+            /// With CalibrationConfig.ParallelFilterPipeline the pipeline's calibration data is loaded as well.
+            /// Every other method of this wrapper that calls the SDK waits for a pending load first, except
+            /// ML_StopModulesMovement() and ML_StopMotionMovement(). A failed load is reported by ML_Process() until
+            /// the next load.
+            /// </summary>
+            /// <param name="config">Config setting to load calibration data.</param>
+            /// <param name="mode">Operation mode between multiple modules</param>
+            /// <returns>A task with the result of the load.</returns>
+            System::Threading::Tasks::Task<MLCommon::MLResult>^ ML_LoadCalibrationDataAsync(MLCommon::CalibrationConfig^ config, [Optional, DefaultParameterValue(MLCommon::OperationMode::Parallel)]MLCommon::OperationMode mode);
             
             /// <summary>
             /// Set CaptureData map to perform calibration process.
@@ -539,6 +605,14 @@ namespace MLColorimeterCS {
             /// <param name="moduleID">Select a module to get calibration data.</param>
             /// <returns>The data after calibration process.</returns>
             Dictionary<MLCommon::CalibrationEnum,Dictionary<MLCommon::MLFilterEnum, MLCommon::CaliProcessData^>^>^ ML_GetCalibrationData(int moduleID);
+
+            /// <summary>
+            /// Get calibration data after calling ML_Process(), as a view that keeps the data on the native side.
+            /// Metadata is converted immediately, images only when a stage/filter image is requested.
+            /// </summary>
+            /// <param name="moduleID">Select a module to get calibration data.</param>
+            /// <returns>The calibration data view, dispose it when done.</returns>
+            MLCommon::CalibrationDataView^ ML_GetCalibrationDataView(int moduleID);
             
             /// <summary>
             /// Save calibration data after calling ML_Process().
@@ -553,10 +627,230 @@ namespace MLColorimeterCS {
                 caliData,
                 int moduleID, MLCommon::SaveDataConfig^ saveconfig);
 
+            /// <summary>
+            /// Save calibration data after calling ML_Process(), without converting the images back.
+            /// </summary>
+            /// <param name="caliData">The calibration data to save, get from ML_GetCalibrationDataView().</param>
+            /// <param name="moduleID">Select a module to save calibration data.</param>
+            /// <param name="saveconfig">Save config setting</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_SaveCalibrationData(MLCommon::CalibrationDataView^ caliData, int moduleID, MLCommon::SaveDataConfig^ saveconfig);
+
+            /// <summary>
+            /// Get the step timings of the last ML_Process() run with CalibrationConfig.ParallelFilterPipeline.
+            /// </summary>
+            /// <param name="moduleID">Select a module to get timings.</param>
+            /// <returns>The timings, empty if the module was not processed by the parallel pipeline.</returns>
+            List<MLCommon::StageTiming>^ ML_GetProcessTimings(int moduleID);
+
+            /// <summary>
+            /// Let the parallel pipeline (CalibrationConfig.ParallelFilterPipeline) correct the distortion of a module
+            /// with precomputed remap tables instead of the SDK. The tables are built when calibration data is loaded
+            /// (ML_LoadCalibrationData(), ML_LoadCalibrationDataAsync(), ML_Process(), ML_Measurement()) for every image
+            /// size and binning the module corrected before, so measurements only look them up. Check the matrix and
+            /// coefficients with ML_CompareDistortionRemap().
+            /// </summary>
+            /// <param name="moduleID">Select a module.</param>
+            /// <param name="cameraMatrix">Camera matrix of the unbinned sensor, 9 values, row-major.</param>
+            /// <param name="coefficients">Distortion coefficients (k1, k2, p1, p2[, k3[, k4, k5, k6]]).</param>
+            /// <param name="cacheDirectory">Directory to persist the tables in, nullptr to keep them in memory only.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_SetDistortionRemap(int moduleID, array<double>^ cameraMatrix, array<double>^ coefficients, String^ cacheDirectory);
+
+            /// <summary>
+            /// Go back to the SDK's distortion correction for a module.
+            /// </summary>
+            /// <param name="moduleID">Select a module.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_ClearDistortionRemap(int moduleID);
+
+            /// <summary>
+            /// Let the parallel pipeline apply the per-filter color shift instead of the SDK. With the distortion stage
+            /// it is folded into the remap tables set with ML_SetDistortionRemap(), so color shift and distortion resample
+            /// every filter image once: the ColorShift stage is then not in the calibration data, the Distortion stage
+            /// holds both corrections. Without the distortion stage the shift is applied alone, as the ColorShift stage.
+            /// ML_Process() fails if the distortion stage is on without ML_SetDistortionRemap(), or if a filter of
+            /// ColorFilterList has no shift. Check the signs with ML_CompareDistortionRemap().
+            /// </summary>
+            /// <param name="moduleID">Select a module.</param>
+            /// <param name="colorShift">Shift of every color filter in unbinned sensor pixels, same convention as the
+            /// calibration's color shift map. nullptr or empty to go back to the SDK's color shift stage.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_SetColorShiftRemap(int moduleID, Dictionary<MLCommon::MLFilterEnum, System::Drawing::PointF>^ colorShift);
+
+            /// <summary>
+            /// Compare the remap of ML_SetDistortionRemap() and the shifts of ML_SetColorShiftRemap() with the SDK's
+            /// distortion and color shift stages they replace for config: the capture data set with ML_SetCaptureDataMap()
+            /// is corrected both ways, the SDK's on a separate instance loaded with the module's calibration data, and the
+            /// difference is measured per filter of ColorFilterList. Fails if neither applies to config.
+            /// </summary>
+            /// <param name="moduleID">Select a module.</param>
+            /// <param name="config">Calibration config selecting the calibration data.</param>
+            /// <param name="differences">Difference per filter, in gray levels.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_CompareDistortionRemap(int moduleID, MLCommon::CalibrationConfig^ config,
+                [Out] Dictionary<MLCommon::MLFilterEnum, MLCommon::RemapDifference>^% differences);
+
+            /// <summary>
+            /// Declare the configurations a measurement sequence will process, in order. With
+            /// CalibrationConfig.ParallelFilterPipeline, every ML_Process() then loads the calibration data of the
+            /// next configuration of the plan in the background.
+            /// </summary>
+            /// <param name="plan">Configurations in processing order, nullptr or empty to stop prefetching.</param>
+            void ML_SetCalibrationSweepPlan(List<MLCommon::CalibrationConfig^>^ plan);
+
+            /// <summary>
+            /// Set the memory budget of the calibration data cache of the parallel pipeline. Least recently used
+            /// configurations are dropped above the budget, the most recent one is always kept.
+            /// </summary>
+            /// <param name="bytes">Budget in bytes, default 2 GB.</param>
+            void ML_SetCalibrationCacheBudget(long long bytes);
+
+            /// <summary>
+            /// Drop all cached calibration data of the parallel pipeline. Waits for running background loads, whose
+            /// data is dropped as well.
+            /// </summary>
+            void ML_ClearCalibrationCache();
+
+            /// <summary>
+            /// Get the hit/miss counters of the calibration data cache of the parallel pipeline.
+            /// </summary>
+            /// <returns>The counters.</returns>
+            MLCommon::CalibrationCacheStatistics ML_GetCalibrationCacheStatistics();
+
+            /// <summary>
+            /// Take one measurement for the X, Y, Z filters of a mono camera, pipelined: the pipeline's calibration data
+            /// loads while the ND/XYZ wheels move (the SDK's own load takes turns with the moves and captures, which use
+            /// the same modules), and the dark/FFC/color shift/distortion correction of each filter runs
+            /// in the background while the wheel moves to the next filter. The four color stage starts once the
+            /// last filter is corrected. Results are read like after ML_Process() with
+            /// CalibrationConfig.ParallelFilterPipeline: ML_GetCalibrationData() and ML_GetProcessTimings().
+            /// Fails without moving anything if a module has a color (RGB or Bayer) camera.
+            /// </summary>
+            /// <param name="ndKey">ND filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="xyzKey">Color filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="config">Calibration config setting for the measurement.</param>
+            /// <param name="exposure">Exposure setting during the measurement.</param>
+            /// <param name="mode">Operation mode between multiple modules.</param>
+            /// <returns>The result contains the message, code and status.</returns>
+            MLCommon::MLResult ML_Measurement(String^ ndKey, String^ xyzKey, MLCommon::CalibrationConfig^ config,
+                MLCommon::ExposureSetting exposure,
+                [Optional, DefaultParameterValue(MLCommon::OperationMode::Parallel)]MLCommon::OperationMode mode);
+
+            /// <summary>
+            /// Get the step timings of the last ML_Measurement(): MoveND, then MoveFilter, Exposure and Capture
+            /// (or AutoExposure with the predictive auto exposure) per filter, WaitCalibrationData, Finish and Total.
+            /// </summary>
+            /// <returns>The timings.</returns>
+            List<MLCommon::StageTiming>^ ML_GetMeasurementTimings();
+
+            /// <summary>
+            /// Run a list of measurements on a background thread, each like ML_Measurement(). The steps are reordered
+            /// by MotionPlanner for minimal wheel/RX travel from the current positions, the light source and RX are only
+            /// switched when they change, and a copy of the calibration data is saved in the background while the next step
+            /// is measured. The save takes turns with the next step's SDK calls, so it overlaps the corrections and the
+            /// handler. A failed or throwing save is reported in the batch result. Do not call other methods of this wrapper
+            /// until the batch completes.
+            /// </summary>
+            /// <param name="ndKey">ND filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="xyzKey">Color filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="steps">Measurements to take.</param>
+            /// <param name="handler">Called after each step with its result and calibration data, may be nullptr.</param>
+            /// <param name="mode">Operation mode between multiple modules.</param>
+            /// <returns>The progress and cancellation handle of the batch.</returns>
+            MLCommon::MeasurementBatch^ ML_MeasureBatch(String^ ndKey, String^ xyzKey, List<MLCommon::MeasurementStep^>^ steps,
+                MLCommon::MeasurementStepHandler^ handler,
+                [Optional, DefaultParameterValue(MLCommon::OperationMode::Parallel)]MLCommon::OperationMode mode);
+
+            /// <summary>
+            /// Get the travel time model of the ND/XYZ filter wheels and the RX wheel/axis for MotionPlanner,
+            /// with the wheel slots from NDFilterConfig.json and the axis range from the RX filter config.
+            /// The speeds are defaults, adjust them to the hardware.
+            /// </summary>
+            /// <param name="ndKey">ND filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="xyzKey">Color filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <returns>The model.</returns>
+            MLCommon::MotionModel^ ML_GetMotionModel(String^ ndKey, String^ xyzKey);
+
+            /// <summary>
+            /// Get the current ND/XYZ filters, RX and light source, as the start of a MotionPlanner plan.
+            /// </summary>
+            /// <param name="ndKey">ND filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <param name="xyzKey">Color filter keyword, from the "Key" field in NDFilterConfig.json.</param>
+            /// <returns>The current positions.</returns>
+            MLCommon::MotionTarget^ ML_GetMotionTarget(String^ ndKey, String^ xyzKey);
+
+            /// <summary>
+            /// Let ML_Measurement() and ML_MeasureBatch() do the auto exposure (ExposureMode::Auto) in the wrapper:
+            /// each filter starts from the exposure the previous filter converged to, scaled by the X/Y/Z/ND
+            /// transmission ratio learned from earlier measurements and shared by all modules, and is refined with
+            /// secant steps on the gray level. The modules run concurrently with OperationMode::Parallel, and the last
+            /// auto exposure frame is used as the measurement frame. The exposure time of the setting is the initial
+            /// time when there is nothing to predict from. Intermediate frames can be grabbed at a coarser binning
+            /// (PreviewBinning) and measured on a region (Roi); the measurement frame is always at the camera binning.
+            /// A module that does not reach the target within MaxIterations or the exposure time range fails the
+            /// measurement with ErrorCode 2; ML_GetAutoExposureReports() still holds its last gray level.
+            /// </summary>
+            /// <param name="config">Auto exposure settings, nullptr to use the SDK auto exposure again.</param>
+            void ML_SetPredictiveAutoExposure(MLCommon::PredictiveExposureConfig^ config);
+
+            /// <summary>
+            /// Forget the transmission ratios and exposures learned by the predictive auto exposure.
+            /// </summary>
+            void ML_ResetPredictiveAutoExposure();
+
+            /// <summary>
+            /// Get the predictive auto exposure results of the last ML_Measurement(), per module and filter.
+            /// </summary>
+            /// <returns>The reports, empty if the predictive auto exposure did not run.</returns>
+            List<MLCommon::AutoExposureReport>^ ML_GetAutoExposureReports();
+
             array<Byte>^ GetImageByte();
 
+        internal:
+            MLCommon::MLResult RunMeasurementBatch(MLCommon::MeasurementBatch^ batch, String^ ndKey, String^ xyzKey, MLCommon::OperationMode mode);
+
         private:
+            MLCommon::CalibrationPipeline* GetPipeline(int moduleID);
+            MLCommon::CalibrationCache* GetCalibrationCache();
+            MLCommon::MLResult WaitCalibrationLoad();
+            System::Threading::Tasks::Task<MLCommon::MLResult>^ StartCalibrationLoad(const ML::MLColorimeter::CalibrationConfig& config, ML::MLColorimeter::OperationMode mode, bool withPipelines);
+            void AddMeasurementTiming(String^ stage, MLCommon::MLFilterEnum filter, System::Diagnostics::Stopwatch^ watch);
+            Result Measure(const std::string& ndKey_str, const std::string& xyzKey_str, const ML::MLColorimeter::CalibrationConfig& mlconfig,
+                const ML::MLColorimeter::ExposureSetting& ml_exposure, ML::MLColorimeter::OperationMode ml_mode);
+            void StopMeasurementBatch();
+            void AddExposureReport(int moduleID, ML::MLFilterWheel::MLFilterEnum nd, ML::MLFilterWheel::MLFilterEnum filter, const MLCommon::ExposureOutcome& outcome);
+            MLCommon::NativeCalibrationData GetNativeCalibrationData(int moduleID);
+            void DeletePipelines();
+            Dictionary<int, List<double>^>^ GetFocusCurves(std::vector<double> MLCommon::FocusSweepCurves::* curve);
+
             ML::MLColorimeter::MLBinoBusinessManage* ml_bino = nullptr;
+            // 并行标定流水线，按模组 ID
+            std::map<int, MLCommon::CalibrationPipeline*>* pipelines = nullptr;
+            // 所有流水线共用的标定数据缓存
+            MLCommon::CalibrationCache* calibrationCache = nullptr;
+            // 标定配置序列，流水线据此预加载下一个配置
+            std::vector<ML::MLColorimeter::CalibrationConfig>* sweepPlan = nullptr;
+            // ML_LoadCalibrationDataAsync() 尚未等待的加载，或失败的上一次加载
+            System::Threading::Tasks::Task<MLCommon::MLResult>^ pendingLoad;
+            // 后台任务与 ML_Measurement() 同时调用 ml_bino 时互斥
+            Object^ sdkLock;
+            // 上一次 ML_Measurement() 的步骤耗时
+            List<MLCommon::StageTiming>^ measurementTimings;
+            // ML_MeasureBatch() 启动的批量测量
+            MLCommon::MeasurementBatch^ pendingBatch;
+            // 预测自动曝光，nullptr 时使用 SDK 的自动曝光
+            MLCommon::ExposurePredictor* exposurePredictor = nullptr;
+            // 上一次 ML_Measurement() 的自动曝光结果
+            List<MLCommon::AutoExposureReport>^ exposureReports;
+            // 上一次 ML_CaptureAverageImage() 的平均图
+            std::map<int, cv::Mat>* averageImages = nullptr;
+            // 上一次 ML_Process() 是否走并行流水线
+            bool pipelineResults = false;
+            // 封装层对焦扫描的曲线，按模组 ID
+            std::map<int, MLCommon::FocusSweepCurves>* focusCurves = nullptr;
+            // 上一次 ML_ThroughFocus() 是否由封装层扫描
+            bool focusSweepResults = false;
         };
 
         public ref class MLColorimeterModuleWrapper {
@@ -7,6 +7,8 @@
 #include "MLCamaraCommon.h"
 #include "MotionCommon.h"
 #include "Result.h"
+#include "NativeImage.h"
+#include "FrameSerializer.h"
 
 using namespace System;
 using namespace System::Runtime::InteropServices;
@@ -16,17 +18,6 @@ using namespace System::Drawing::Imaging;
 namespace MLColorimeterCS {
 	namespace MLCommon {
 
-		public ref class MatWrapper
-		{
-		public:
-			MatWrapper(cv::Mat* mat) : mat(mat) {}
-			IntPtr GetMatPtr() { return IntPtr(mat); }
-			int GetMatCols() { return mat->cols; }
-			int GetMatRows() { return mat->rows; }
-		private:
-			cv::Mat* mat;
-		};
-
 		private ref class MLConverter {
 		public:
 
@@ -92,20 +83,12 @@ namespace MLColorimeterCS {
 			}
 
 			// л cv::Mat  byte[]
+			// ɸʽ16ֽͷް汾벽´ʹ FrameSerializer
 			static array<Byte>^ ToByteArray(const cv::Mat & mat) {
 				if (mat.empty()) {
 					throw gcnew System::ArgumentException("Input Mat is empty!");
 				}
 
-				// ȷ
-				cv::Mat continuousMat;
-				if (!mat.isContinuous()) {
-					continuousMat = mat.clone();
-				}
-				else {
-					continuousMat = mat;
-				}
-
 				// ȡԪ
 				int type_code = CV_MAT_DEPTH(mat.type());
 				int channels = CV_MAT_CN(mat.type());
@@ -113,7 +96,8 @@ namespace MLColorimeterCS {
 				int cols = mat.cols;
 
 				// ֽ
-				size_t dataSize = continuousMat.total() * continuousMat.elemSize();
+				size_t rowSize = cols * mat.elemSize();
+				size_t dataSize = rowSize * rows;
 
 				// й byte[]ܳ=16ֽԪ + ݳȣ
 				array<Byte>^ byteArray = gcnew array<Byte>(16 + dataSize);
@@ -126,8 +110,15 @@ namespace MLColorimeterCS {
 				*reinterpret_cast<int*>(ptr) = cols;       ptr += 4;
 				*reinterpret_cast<int*>(ptr) = channels;   ptr += 4;
 
-				// д
-				memcpy(ptr, continuousMat.data, dataSize);
+				// дݣͼп
+				if (mat.isContinuous()) {
+					memcpy(ptr, mat.data, dataSize);
+				}
+				else {
+					for (int r = 0; r < rows; r++) {
+						memcpy(ptr + rowSize * r, mat.ptr(r), rowSize);
+					}
+				}
 
 				return byteArray;
 			}
@@ -158,14 +149,14 @@ namespace MLColorimeterCS {
 				// OpenCVͣCV_32FC3
 				int cv_type = CV_MAKETYPE(type_code, channels);
 
-				// cv::Mat
-				cv::Mat *nativeMat = new cv::Mat(rows, cols, cv_type);
-				size_t dataSize = rows * cols * channels * CV_ELEM_SIZE(cv_type);
-				if (byteData->Length - 16 != dataSize) {
+				// cv::MatݣCV_ELEM_SIZE Ѱͨ
+				size_t dataSize = static_cast<size_t>(rows) * cols * CV_ELEM_SIZE(cv_type);
+				if (static_cast<size_t>(byteData->Length - 16) != dataSize) {
 					throw gcnew System::ArgumentException("Data size mismatch!");
 				}
-				memcpy(nativeMat->data, dataPtr, dataSize);
-				return *nativeMat;
+				cv::Mat nativeMat(rows, cols, cv_type);
+				memcpy(nativeMat.data, dataPtr, dataSize);
+				return nativeMat;
 			}
 
 			// ת
@@ -332,24 +323,29 @@ namespace MLColorimeterCS {
 					ImageLockMode::ReadOnly,
 					managed->PixelFormat);
 
+				// ֻ LockBits ڼЧǰ
 				cv::Mat native;
-
-				switch (managed->PixelFormat)
-				{
-				case System::Drawing::Imaging::PixelFormat::Format8bppIndexed:
-					native = cv::Mat(managed->Height, managed->Width, CV_8UC1, bmpData->Scan0.ToPointer());
-					break;
-				case System::Drawing::Imaging::PixelFormat::Format24bppRgb:
-					native = cv::Mat(managed->Height, managed->Width, CV_8UC3, bmpData->Scan0.ToPointer());
-					break;
-				case System::Drawing::Imaging::PixelFormat::Format32bppArgb:
-					native = cv::Mat(managed->Height, managed->Width, CV_32FC1, bmpData->Scan0.ToPointer());
-					break;
-					// ʽ֧...
+				try {
+					switch (managed->PixelFormat)
+					{
+					case System::Drawing::Imaging::PixelFormat::Format8bppIndexed:
+						native = cv::Mat(managed->Height, managed->Width, CV_8UC1, bmpData->Scan0.ToPointer(), bmpData->Stride);
+						break;
+					case System::Drawing::Imaging::PixelFormat::Format24bppRgb:
+						native = cv::Mat(managed->Height, managed->Width, CV_8UC3, bmpData->Scan0.ToPointer(), bmpData->Stride);
+						break;
+					case System::Drawing::Imaging::PixelFormat::Format32bppArgb:
+						// 32bppArgb Ϊ 4 ͨ 8 λ BGRA
+						native = cv::Mat(managed->Height, managed->Width, CV_8UC4, bmpData->Scan0.ToPointer(), bmpData->Stride);
+						break;
+						// ʽ֧...
+					}
+					native = native.clone();
 				}
-
-				managed->UnlockBits(bmpData);
-				return native.clone();
+				finally {
+					managed->UnlockBits(bmpData);
+				}
+				return native;
 			}
 
 			static Bitmap^ ToManaged(const cv::Mat& native) {
@@ -364,19 +360,35 @@ namespace MLColorimeterCS {
 				case CV_8UC3:
 					format = PixelFormat::Format24bppRgb;
 					break;
-					// ʽ֧...
+				case CV_8UC4:
+					format = PixelFormat::Format32bppArgb;
+					break;
+					// λͼʹ NativeImage
 				default:
-					throw gcnew ArgumentException("Unsupported mat type");
+					throw gcnew ArgumentException("Unsupported mat type, use NativeImage for 16-bit and float images");
 				}
 
 				Bitmap^ managed = gcnew Bitmap(native.cols, native.rows, format);
+				if (format == PixelFormat::Format8bppIndexed) {
+					// Ҷȵɫ
+					ColorPalette^ palette = managed->Palette;
+					for (int i = 0; i < 256; i++) {
+						palette->Entries[i] = Color::FromArgb(i, i, i);
+					}
+					managed->Palette = palette;
+				}
 
 				BitmapData^ bmpData = managed->LockBits(
 					System::Drawing::Rectangle(0, 0, managed->Width, managed->Height),
 					ImageLockMode::WriteOnly,
 					format);
 
-				memcpy(bmpData->Scan0.ToPointer(), native.data, native.total() * native.elemSize());
+				// Bitmap а 4 ֽڶ룬п
+				size_t rowSize = native.cols * native.elemSize();
+				unsigned char* dst = static_cast<unsigned char*>(bmpData->Scan0.ToPointer());
+				for (int r = 0; r < native.rows; r++) {
+					memcpy(dst + static_cast<size_t>(bmpData->Stride) * r, native.ptr(r), rowSize);
+				}
 
 				managed->UnlockBits(bmpData);
 				return managed;
@@ -599,12 +611,20 @@ namespace MLColorimeterCS {
 				native.MovementRX = ToNative(managed->MovementRX);
 				native.VID = managed->VID;
 				native.ExposureTime = managed->ExposureTime;
-				native.Img = ToNative(managed->Img);
+				// йܶ˹أ
+				if (managed->Image != nullptr) {
+					native.Img = managed->Image->GetMat();
+				}
 				native.Binning = static_cast<ML::CameraV2::Binning>(managed->Bining);
 				native.PixelFormat = static_cast<ML::CameraV2::MLPixelFormat>(managed->PixelFormat);
 				return native;
 			}
 			static CaptureData^ ToManaged(const ML::MLColorimeter::CaptureData& native) {
+				return ToManaged(native, true);
+			}
+
+			// includeImage = false: metadata only, Image stays nullptr
+			static CaptureData^ ToManaged(const ML::MLColorimeter::CaptureData& native, bool includeImage) {
 				CaptureData^ managed = gcnew CaptureData();
 
 				managed->SerialNumber = ToManaged(native.SerialNumber);
@@ -617,7 +637,9 @@ namespace MLColorimeterCS {
 				managed->MovementRX = ToManaged(native.MovementRX);
 				managed->VID = native.VID;
 				managed->ExposureTime = native.ExposureTime;
-				managed->Img = ToManaged(native.Img);
+				if (includeImage && !native.Img.empty()) {
+					managed->Image = gcnew NativeImage(native.Img);
+				}
 				managed->Bining = ToManaged(native.Binning);
 				managed->PixelFormat = ToManaged(native.PixelFormat);
 				return managed;
@@ -826,5 +848,16 @@ namespace MLColorimeterCS {
 				return nativeMap;
 			}
 		};
+
+		inline Bitmap^ CaptureData::Img::get() {
+			if (Image == nullptr || Image->IsEmpty) return nullptr;
+			int type = Image->GetMat().type();
+			if (type != CV_8UC1 && type != CV_8UC3 && type != CV_8UC4) return nullptr;
+			return MLConverter::ToManaged(Image->GetMat());
+		}
+
+		inline void CaptureData::Img::set(Bitmap^ value) {
+			Image = value == nullptr ? nullptr : gcnew NativeImage(MLConverter::ToNative(value));
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "ModuleCommon.h"
+#include "CalibrationDataView.h"
+#include "MotionPlanner.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+using namespace System::Threading;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// One measurement of a batch: the ND filter, RX and light source come from the calibration config.
+		/// </summary>
+		public ref class MeasurementStep
+		{
+		public:
+			MeasurementStep(CalibrationConfig^ config, ExposureSetting exposure, SaveDataConfig^ saveConfig) {
+				Config = config;
+				Exposure = exposure;
+				SaveConfig = saveConfig;
+			}
+
+			/// <summary>
+			/// Calibration config of the measurement. RX is only moved if set (not double::MaxValue).
+			/// </summary>
+			property CalibrationConfig^ Config;
+
+			/// <summary>
+			/// Exposure setting during the measurement.
+			/// </summary>
+			property ExposureSetting Exposure;
+
+			/// <summary>
+			/// Where to save the calibration data of every module, nullptr to skip saving.
+			/// </summary>
+			property SaveDataConfig^ SaveConfig;
+		};
+
+		/// <summary>
+		/// Result of one step of a measurement batch.
+		/// </summary>
+		public ref class MeasurementStepResult
+		{
+		public:
+			/// <summary>
+			/// Index of the step in the list given to ML_MeasureBatch().
+			/// </summary>
+			property int Index;
+
+			/// <summary>
+			/// Position of the step in the executed order.
+			/// </summary>
+			property int Sequence;
+
+			property MeasurementStep^ Step;
+			property MLResult Result;
+
+			/// <summary>
+			/// Calibration data by module id, empty if the step failed. The handler owns the views and must dispose them.
+			/// </summary>
+			property Dictionary<int, CalibrationDataView^>^ Data;
+
+			/// <summary>
+			/// Step timings of the measurement, see ML_GetMeasurementTimings().
+			/// </summary>
+			property List<StageTiming>^ Timings;
+		};
+
+		/// <summary>
+		/// Called on the batch thread after each step.
+		/// </summary>
+		public delegate void MeasurementStepHandler(MeasurementStepResult^ result);
+
+		/// <summary>
+		/// Progress and cancellation handle of a running measurement batch.
+		/// </summary>
+		public ref class MeasurementBatch
+		{
+		public:
+			/// <summary>
+			/// Number of steps in the batch.
+			/// </summary>
+			property int Total {
+				int get() { return steps->Count; }
+			}
+
+			/// <summary>
+			/// Number of steps measured so far.
+			/// </summary>
+			property int Completed {
+				int get() { return Volatile::Read(completed); }
+			}
+
+			/// <summary>
+			/// Step indices in the executed order.
+			/// </summary>
+			property array<int>^ Order {
+				array<int>^ get() { return safe_cast<array<int>^>(order->Clone()); }
+			}
+
+			/// <summary>
+			/// Motion plan the order comes from, with the estimated travel time saved.
+			/// </summary>
+			property MotionPlan^ Plan {
+				MotionPlan^ get() { return plan; }
+			}
+
+			property bool IsCancellationRequested {
+				bool get() { return cancellation->IsCancellationRequested; }
+			}
+
+			/// <summary>
+			/// Completes after the last step and the last save: the first failure, or success.
+			/// </summary>
+			property System::Threading::Tasks::Task<MLResult>^ Completion {
+				System::Threading::Tasks::Task<MLResult>^ get() { return completion; }
+			}
+
+			/// <summary>
+			/// Stop after the step being measured. Saves already queued still complete.
+			/// </summary>
+			void Cancel() {
+				cancellation->Cancel();
+			}
+
+			/// <summary>
+			/// Wait for the batch to complete.
+			/// </summary>
+			/// <returns>The result of Completion.</returns>
+			MLResult Wait() {
+				return completion->Result;
+			}
+
+		internal:
+			MeasurementBatch(List<MeasurementStep^>^ steps, MotionPlan^ plan, MeasurementStepHandler^ handler) {
+				this->steps = steps;
+				this->plan = plan;
+				this->handler = handler;
+				order = plan->Order;
+				cancellation = gcnew CancellationTokenSource();
+			}
+
+			void StepCompleted() {
+				Interlocked::Increment(completed);
+			}
+
+			List<MeasurementStep^>^ steps;
+			MotionPlan^ plan;
+			array<int>^ order;
+			MeasurementStepHandler^ handler;
+			CancellationTokenSource^ cancellation;
+			System::Threading::Tasks::Task<MLResult>^ completion;
+
+		private:
+			int completed;
+		};
+	}
+}
@@ -90,13 +90,19 @@ namespace MLColorimeterCS {
             void NotifyFilterStatusChanged(String^ object, MLFilterStatus status);
         };
 
+        ref class NativeImage;
+
         /// <summary>
         /// Camera Callback Interface
         /// </summary>
         public interface class IMLCameraCallback
         {
             void NotifyCameraStateChanged(MLCameraState old_state, MLCameraState new_state);
-            void NotifyCameraFrameReceived(IntPtr frame, MLPixelFormat format);
+            /// <summary>
+            /// A captured frame. It shares the camera's capture buffer, which the next capture overwrites; Clone() it
+            /// to keep it past the callback.
+            /// </summary>
+            void NotifyCameraFrameReceived(NativeImage^ frame, MLPixelFormat format);
             void NotifyCameraGrayLevel(int gray_level);
         };
 
@@ -125,7 +131,7 @@ namespace MLColorimeterCS {
             property String^ ErrorMsg;
 
             /// <summary>
-            /// 룺0 (д); 1 (ֶֹͣ)
+            /// 룺0 (д); 1 (ֶֹͣ); 2 (ԤԶعδ)
             /// </summary>
             property int ErrorCode;
 
@@ -421,7 +427,18 @@ namespace MLColorimeterCS {
             property RXCombination^ MovementRX;
             property double VID;
             property double ExposureTime;
-            property Bitmap^ Img;
+            /// <summary>
+            /// Image as a native handle, any depth (8U/16U/32F...) and channel count, shared with the SDK without copying.
+            /// </summary>
+            property NativeImage^ Image;
+            /// <summary>
+            /// Image as a Bitmap, built from Image on every get (8-bit images only, nullptr otherwise).
+            /// Setting it replaces Image.
+            /// </summary>
+            property Bitmap^ Img {
+                Bitmap^ get();
+                void set(Bitmap^ value);
+            }
             property Binning Bining;
             property MLPixelFormat PixelFormat;
 
@@ -436,7 +453,7 @@ namespace MLColorimeterCS {
                 MovementRX = gcnew RXCombination();
                 VID = 0.0;
                 ExposureTime = 100.0;
-                Img = nullptr;
+                Image = nullptr;
                 Bining = Binning::ONE_BY_ONE;
                 PixelFormat = MLPixelFormat::MLMono12;
             }
@@ -593,6 +610,11 @@ namespace MLColorimeterCS {
             property bool FourColor_Flag;
             property bool Luminance_Flag;
             property bool FOVCrop_Flag;
+            /// <summary>
+            /// Run the per-filter stages (dark, FFC, color shift, distortion) of every color filter concurrently,
+            /// then exposure, four color, luminance and FOV crop once for the module. Wrapper extension, not sent to the SDK.
+            /// </summary>
+            property bool ParallelFilterPipeline;
 
             CalibrationConfig() {
                 InputPath = "";
@@ -612,6 +634,187 @@ namespace MLColorimeterCS {
                 FourColor_Flag = true;
                 Luminance_Flag = false;
                 FOVCrop_Flag = false;
+                ParallelFilterPipeline = false;
+            }
+        };
+
+        /// <summary>
+        /// Wall-clock time of one step of the parallel calibration pipeline or of a pipelined measurement.
+        /// </summary>
+        public value struct StageTiming {
+        public:
+            /// <summary>
+            /// Step name: LoadCalibrationData, RemapTables, FilterChain, FilterChains, ModuleStages or Total;
+            /// for a measurement MoveND, MoveFilter, Exposure, Capture, AutoExposure, WaitCalibrationData, Finish or Total.
+            /// </summary>
+            property String^ Stage;
+            /// <summary>
+            /// Filter of a FilterChain step, Unknown for module-wide steps.
+            /// </summary>
+            property MLFilterEnum Filter;
+            property double Milliseconds;
+        };
+
+        /// <summary>
+        /// Difference between the remap of the parallel pipeline and the SDK's correction of one filter image, in gray
+        /// levels, over the pixels both corrections cover.
+        /// </summary>
+        public value struct RemapDifference {
+        public:
+            property double Mean;
+            property double Max;
+        };
+
+        /// <summary>
+        /// Counters of the calibration data cache used by the parallel calibration pipeline.
+        /// </summary>
+        public value struct CalibrationCacheStatistics {
+        public:
+            /// <summary>
+            /// ML_Process() runs that found their calibration data in the cache.
+            /// </summary>
+            property long long Hits;
+            /// <summary>
+            /// ML_Process() runs that had to load their calibration data.
+            /// </summary>
+            property long long Misses;
+            /// <summary>
+            /// Hits on calibration data loaded in the background by the sweep plan, included in Hits.
+            /// </summary>
+            property long long PrefetchHits;
+            property long long Evictions;
+            /// <summary>
+            /// Cached configurations.
+            /// </summary>
+            property int Count;
+            /// <summary>
+            /// Estimated size of the calibration maps of the cached configurations: dark, flat field and luminance
+            /// maps as float images of the sensor size of the last processed frame.
+            /// </summary>
+            property long long Bytes;
+            property long long BudgetBytes;
+        };
+
+        /// <summary>
+        /// Settings of the wrapper's predictive auto exposure, see ML_SetPredictiveAutoExposure().
+        /// </summary>
+        public ref class PredictiveExposureConfig {
+        public:
+            /// <summary>
+            /// Target gray level, fraction of the full scale of the pixel format.
+            /// </summary>
+            property double TargetLevel;
+            /// <summary>
+            /// Accepted relative deviation from the target.
+            /// </summary>
+            property double Tolerance;
+            /// <summary>
+            /// Percentile of the sampled pixels used as the gray level.
+            /// </summary>
+            property double Percentile;
+            /// <summary>
+            /// Every SampleStride-th pixel of every SampleStride-th row is sampled.
+            /// </summary>
+            property int SampleStride;
+            property int MaxIterations;
+            /// <summary>
+            /// Exposure time range (unit: millisecond).
+            /// </summary>
+            property double MinExposureTime;
+            property double MaxExposureTime;
+            /// <summary>
+            /// Weight of a new observation in the learned transmission ratios.
+            /// </summary>
+            property double LearningRate;
+            /// <summary>
+            /// Binning of the intermediate iterations. When coarser than the camera binning, only the last frame is
+            /// captured at the camera binning, with the exposure time rescaled by the binning mode.
+            /// </summary>
+            property Binning PreviewBinning;
+            /// <summary>
+            /// Region the gray level is measured on, in unbinned sensor pixels. Empty for the whole frame.
+            /// </summary>
+            property Rect Roi;
+
+            PredictiveExposureConfig() {
+                TargetLevel = 0.7;
+                Tolerance = 0.05;
+                Percentile = 0.99;
+                SampleStride = 4;
+                MaxIterations = 10;
+                MinExposureTime = 0.05;
+                MaxExposureTime = 30000;
+                LearningRate = 0.3;
+                PreviewBinning = Binning::ONE_BY_ONE;
+            }
+        };
+
+        /// <summary>
+        /// Auto exposure of one module and filter, by the predictive auto exposure.
+        /// </summary>
+        public value struct AutoExposureReport {
+        public:
+            property int ModuleID;
+            property MLFilterEnum NDFilter;
+            property MLFilterEnum Filter;
+            /// <summary>
+            /// Predicted exposure time the iterations started from (unit: millisecond).
+            /// </summary>
+            property double InitialTime;
+            /// <summary>
+            /// Exposure time of the last capture (unit: millisecond).
+            /// </summary>
+            property double ExposureTime;
+            /// <summary>
+            /// Gray level of the last capture, fraction of the full scale.
+            /// </summary>
+            property double Level;
+            property int Iterations;
+            /// <summary>
+            /// Iterations run at the preview binning, included in Iterations.
+            /// </summary>
+            property int PreviewIterations;
+            /// <summary>
+            /// Whether the gray level reached the target; if not, the measurement failed with ErrorCode 2.
+            /// </summary>
+            property bool Converged;
+            property double Milliseconds;
+        };
+
+        /// <summary>
+        /// Outlier rejection of ML_CaptureAverageImage().
+        /// </summary>
+        public enum class FrameRejection {
+            /// <summary>Plain mean.</summary>
+            None = 0,
+            /// <summary>Samples far from the running mean of the pixel are left out.</summary>
+            SigmaClip = 1,
+            /// <summary>Mean of the per-pixel medians of groups of three frames.</summary>
+            MedianOfThree = 2
+        };
+
+        /// <summary>
+        /// Frame averaging settings of ML_CaptureAverageImage().
+        /// </summary>
+        public ref class AveragingConfig {
+        public:
+            property FrameRejection Rejection;
+            /// <summary>
+            /// SigmaClip: a sample further than Sigma standard deviations (at least Sigma gray levels) from the
+            /// running mean of its pixel is rejected once MinSamples samples were accepted.
+            /// </summary>
+            property double Sigma;
+            property int MinSamples;
+            /// <summary>
+            /// Round the average to the pixel depth of the frames instead of returning a float image.
+            /// </summary>
+            property bool KeepPixelDepth;
+
+            AveragingConfig() {
+                Rejection = FrameRejection::None;
+                Sigma = 3.0;
+                MinSamples = 3;
+                KeepPixelDepth = false;
             }
         };
 
@@ -755,6 +958,30 @@ namespace MLColorimeterCS {
             }
         };
 
+        /// <summary>
+        /// How ML_ThroughFocus() sweeps the focus.
+        /// </summary>
+        public enum class FocusSweepMode {
+            /// <summary>The SDK through focus.</summary>
+            Sdk = 0,
+            /// <summary>Wrapper sweep scored by the SDK's MTF of the ROIs at Freq, with ChessMode, LpmmUnit, FocalLength and
+            /// the camera binning: move, capture and compute in turn.</summary>
+            Sequential = 1,
+            /// <summary>Wrapper sweep whose MTF is computed on a worker while the motion moves to the next step.
+            /// Same curves as Sequential.</summary>
+            Pipelined = 2,
+            /// <summary>Wrapper search: rough steps only until the MTF has dropped beyond the noise after the peak, then
+            /// probes around the vertex of a parabola fitted to the captures near the peak until its 95% confidence
+            /// interval is narrower than FocusTolerance. The fine curves hold the captures near the peak.</summary>
+            Adaptive = 3,
+            /// <summary>Wrapper scan: one move from FocusMin to FocusMax while frames are captured back to back, each
+            /// tagged with the position at its exposure midpoint; the peak is a Gaussian fit of the curve. A move that
+            /// travels more than FineStep during an exposure is stopped and run again at a lower actuator speed
+            /// (SetSpeed()), interpolated from the travel measured at the speeds tried so far, and the speed is restored
+            /// afterwards. ML_GetMaxFrameTravel() reports the travel.</summary>
+            FlyScan = 4
+        };
+
         /// <summary>
         /// ͨ
         /// </summary>
@@ -774,6 +1001,15 @@ namespace MLColorimeterCS {
             property List<Rect>^ ROIs;
             property bool ChessMode;
             property bool LpmmUnit;
+            /// <summary>
+            /// Sweep implementation, Sdk by default.
+            /// </summary>
+            property FocusSweepMode SweepMode;
+            /// <summary>
+            /// Adaptive sweep: width of the 95% confidence interval of the peak (unit: millimeter of motion) at which
+            /// the search stops, 0 for FineStep.
+            /// </summary>
+            property double FocusTolerance;
 
             ThroughFocusConfig() {
                 FocusMax = Double::MaxValue;
@@ -789,6 +1025,8 @@ namespace MLColorimeterCS {
                 ROIs = gcnew List<Rect>();
                 ChessMode = true;
                 LpmmUnit = true;
+                SweepMode = FocusSweepMode::Sdk;
+                FocusTolerance = 0;
             }
         };
     }
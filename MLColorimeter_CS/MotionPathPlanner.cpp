@@ -0,0 +1,184 @@
+// Compiled without /clr: the order search runs as native code
+
+#include "MotionPathPlanner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			double PathCost(const std::vector<double>& fromStart, const std::vector<std::vector<double>>& cost, const std::vector<int>& path) {
+				if (path.empty()) return 0;
+				double total = fromStart[path[0]];
+				for (std::size_t i = 1; i < path.size(); i++) {
+					total += cost[path[i - 1]][path[i]];
+				}
+				return total;
+			}
+
+			// Held-Karp over open paths starting at the start state
+			std::vector<int> ExactOrder(const std::vector<double>& fromStart, const std::vector<std::vector<double>>& cost) {
+				const int n = static_cast<int>(fromStart.size());
+				const int full = 1 << n;
+				const double inf = std::numeric_limits<double>::infinity();
+				std::vector<double> best(static_cast<std::size_t>(full) * n, inf);
+				std::vector<int> previous(static_cast<std::size_t>(full) * n, -1);
+				for (int j = 0; j < n; j++) {
+					best[(static_cast<std::size_t>(1) << j) * n + j] = fromStart[j];
+				}
+				for (int mask = 1; mask < full; mask++) {
+					for (int j = 0; j < n; j++) {
+						double current = best[static_cast<std::size_t>(mask) * n + j];
+						if (!(mask & (1 << j)) || current == inf) continue;
+						for (int k = 0; k < n; k++) {
+							if (mask & (1 << k)) continue;
+							int next = mask | (1 << k);
+							double candidate = current + cost[j][k];
+							std::size_t at = static_cast<std::size_t>(next) * n + k;
+							if (candidate < best[at]) {
+								best[at] = candidate;
+								previous[at] = j;
+							}
+						}
+					}
+				}
+				int last = 0;
+				for (int j = 1; j < n; j++) {
+					if (best[static_cast<std::size_t>(full - 1) * n + j] < best[static_cast<std::size_t>(full - 1) * n + last]) last = j;
+				}
+				std::vector<int> order;
+				for (int mask = full - 1, j = last; j >= 0;) {
+					order.push_back(j);
+					int before = previous[static_cast<std::size_t>(mask) * n + j];
+					mask &= ~(1 << j);
+					j = before;
+				}
+				std::reverse(order.begin(), order.end());
+				return order;
+			}
+
+			std::vector<int> HeuristicOrder(const std::vector<double>& fromStart, const std::vector<std::vector<double>>& cost) {
+				const int n = static_cast<int>(fromStart.size());
+				std::vector<int> order;
+				std::vector<bool> used(n, false);
+				int current = -1;
+				for (int step = 0; step < n; step++) {
+					int next = -1;
+					double nearest = 0;
+					for (int k = 0; k < n; k++) {
+						if (used[k]) continue;
+						double c = current < 0 ? fromStart[k] : cost[current][k];
+						if (next < 0 || c < nearest) {
+							next = k;
+							nearest = c;
+						}
+					}
+					used[next] = true;
+					order.push_back(next);
+					current = next;
+				}
+
+				// 2-opt, segments are re-evaluated in full since the costs are not symmetric
+				double bestCost = PathCost(fromStart, cost, order);
+				for (int pass = 0; pass < 50; pass++) {
+					bool improved = false;
+					for (int i = 0; i < n - 1; i++) {
+						for (int j = i + 1; j < n; j++) {
+							std::reverse(order.begin() + i, order.begin() + j + 1);
+							double candidate = PathCost(fromStart, cost, order);
+							if (candidate + 1e-9 < bestCost) {
+								bestCost = candidate;
+								improved = true;
+							}
+							else {
+								std::reverse(order.begin() + i, order.begin() + j + 1);
+							}
+						}
+					}
+					if (!improved) break;
+				}
+				return order;
+			}
+		}
+
+		double MotionPathPlanner::WheelTime(const Wheel& wheel, int from, int to) const {
+			if (to < 0 || from == to) return 0;
+			if (from < 0) return wheel.SettleSeconds;
+			int distance = std::abs(to - from);
+			if (wheel.Slots > 0) {
+				distance %= wheel.Slots;
+				distance = std::min(distance, wheel.Slots - distance);
+			}
+			return wheel.SettleSeconds + distance * wheel.SecondsPerSlot;
+		}
+
+		double MotionPathPlanner::AxisTime(double from, double to) const {
+			if (std::isnan(to)) return 0;
+			const Axis& axis = model.RXAxis;
+			to = std::min(std::max(to, axis.Min), axis.Max);
+			if (std::isnan(from)) return axis.SettleSeconds;
+			from = std::min(std::max(from, axis.Min), axis.Max);
+			double distance = std::abs(to - from);
+			if (axis.Max - axis.Min >= 360) {
+				distance = std::fmod(distance, 360.0);
+				distance = std::min(distance, 360.0 - distance);
+			}
+			if (distance == 0) return 0;
+			return axis.SettleSeconds + distance * axis.SecondsPerDegree;
+		}
+
+		double MotionPathPlanner::TravelTime(const State& from, const State& to) const {
+			double time = WheelTime(model.ND, from.ND, to.ND);
+			time += WheelTime(model.XYZ, from.XYZLast, to.XYZFirst);
+			time += WheelTime(model.RX, from.RX, to.RX);
+			time += AxisTime(from.Axis, to.Axis);
+			if (to.Group >= 0 && from.Group >= 0 && to.Group != from.Group) {
+				time += model.GroupChangeSeconds;
+			}
+			return time;
+		}
+
+		MotionPathPlanner::State MotionPathPlanner::After(const State& current, const State& step) {
+			State next = current;
+			if (step.ND >= 0) next.ND = step.ND;
+			if (step.XYZLast >= 0) next.XYZFirst = next.XYZLast = step.XYZLast;
+			if (step.RX >= 0) next.RX = step.RX;
+			if (!std::isnan(step.Axis)) next.Axis = step.Axis;
+			if (step.Group >= 0) next.Group = step.Group;
+			return next;
+		}
+
+		double MotionPathPlanner::Simulate(const State& start, const std::vector<State>& states, const std::vector<int>& order) const {
+			State current = start;
+			double total = 0;
+			for (int index : order) {
+				total += TravelTime(current, states[index]);
+				current = After(current, states[index]);
+			}
+			return total;
+		}
+
+		std::vector<int> MotionPathPlanner::Plan(const State& start, const std::vector<State>& states) const {
+			const int n = static_cast<int>(states.size());
+			std::vector<int> requested(n);
+			std::iota(requested.begin(), requested.end(), 0);
+			if (n < 2) return requested;
+
+			// Actuators a step does not use are assumed to stay where the start left them
+			std::vector<double> fromStart(n);
+			std::vector<std::vector<double>> cost(n, std::vector<double>(n, 0));
+			for (int i = 0; i < n; i++) {
+				fromStart[i] = TravelTime(start, states[i]);
+				State reached = After(start, states[i]);
+				for (int j = 0; j < n; j++) {
+					if (i != j) cost[i][j] = TravelTime(reached, states[j]);
+				}
+			}
+			std::vector<int> order = n <= ExactLimit ? ExactOrder(fromStart, cost) : HeuristicOrder(fromStart, cost);
+			return Simulate(start, states, order) < Simulate(start, states, requested) ? order : requested;
+		}
+	}
+}
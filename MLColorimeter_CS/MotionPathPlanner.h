@@ -0,0 +1,79 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and MotionPathPlanner.cpp (compiled without /clr)
+
+#include <limits>
+#include <vector>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// Orders a set of motion states (ND/XYZ/RX wheel slots, RX axis angle, light source group) for minimal
+		/// travel time. Actuators are assumed to move one after another, as the business layer does.
+		/// Up to ExactLimit states the order is optimal for the model, above it nearest neighbour + 2-opt.
+		class MotionPathPlanner
+		{
+		public:
+			struct Wheel
+			{
+				/// Number of slots of the wheel, 0 if it does not wrap around.
+				int Slots = 0;
+				double SecondsPerSlot = 0.25;
+				double SettleSeconds = 0.2;
+			};
+
+			struct Axis
+			{
+				/// Range of the axis in degrees. A range of 360 degrees or more wraps around.
+				double Min = 0;
+				double Max = 360;
+				double SecondsPerDegree = 0.01;
+				double SettleSeconds = 0.2;
+			};
+
+			struct Model
+			{
+				Wheel ND;
+				Wheel XYZ;
+				Wheel RX;
+				Axis RXAxis;
+				/// Time to change the group (light source).
+				double GroupChangeSeconds = 5.0;
+			};
+
+			/// Positions of one step, -1 (NaN for the axis) where the step does not need the actuator.
+			/// The XYZ wheel is entered at XYZFirst and left at XYZLast, e.g. X and Z for an X, Y, Z measurement.
+			struct State
+			{
+				int ND = -1;
+				int XYZFirst = -1;
+				int XYZLast = -1;
+				int RX = -1;
+				double Axis = std::numeric_limits<double>::quiet_NaN();
+				int Group = -1;
+			};
+
+			static const int ExactLimit = 12;
+
+			explicit MotionPathPlanner(const Model& model) : model(model) {}
+
+			/// Time to move from the actual positions "from" (-1/NaN: unknown) to the positions of step "to".
+			double TravelTime(const State& from, const State& to) const;
+
+			/// Positions after running step "step" from "current".
+			static State After(const State& current, const State& step);
+
+			/// Total travel time when running the steps in the given order from "start".
+			double Simulate(const State& start, const std::vector<State>& states, const std::vector<int>& order) const;
+
+			/// Visiting order of the steps, never slower than the requested order under Simulate().
+			std::vector<int> Plan(const State& start, const std::vector<State>& states) const;
+
+		private:
+			double WheelTime(const Wheel& wheel, int from, int to) const;
+			double AxisTime(double from, double to) const;
+
+			Model model;
+		};
+	}
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "MotionPathPlanner.h"
+#include "ModuleCommon.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Travel time model of the filter wheels and the RX axis, see ML_GetMotionModel().
+		/// </summary>
+		public ref class MotionModel
+		{
+		public:
+			MotionModel() {
+				NDPositions = gcnew Dictionary<MLFilterEnum, int>();
+				XYZPositions = gcnew Dictionary<MLFilterEnum, int>();
+				RXPositions = gcnew Dictionary<double, int>();
+				AxisMin = 0;
+				AxisMax = 360;
+				SecondsPerSlot = 0.25;
+				WheelSettleSeconds = 0.2;
+				SecondsPerDegree = 0.01;
+				AxisSettleSeconds = 0.2;
+				LightSourceChangeSeconds = 5.0;
+			}
+
+			/// <summary>
+			/// Number of slots of each wheel, used for the wrap-around. 0 if the wheel does not wrap around.
+			/// </summary>
+			property int NDSlots;
+			property int XYZSlots;
+			property int RXSlots;
+
+			/// <summary>
+			/// Slot of each filter on the ND and XYZ wheels.
+			/// </summary>
+			property Dictionary<MLFilterEnum, int>^ NDPositions;
+			property Dictionary<MLFilterEnum, int>^ XYZPositions;
+
+			/// <summary>
+			/// Slot of each cylinder power on the RX wheel. Cylinders not listed do not count as a wheel move.
+			/// </summary>
+			property Dictionary<double, int>^ RXPositions;
+
+			/// <summary>
+			/// Range of the RX axis in degrees, from MLAxisInfo. A range of 360 degrees wraps around.
+			/// </summary>
+			property int AxisMin;
+			property int AxisMax;
+
+			property double SecondsPerSlot;
+			property double WheelSettleSeconds;
+			property double SecondsPerDegree;
+			property double AxisSettleSeconds;
+			property double LightSourceChangeSeconds;
+		};
+
+		/// <summary>
+		/// Positions needed by one measurement.
+		/// </summary>
+		public ref class MotionTarget
+		{
+		public:
+			MotionTarget() {
+				NDFilter = MLFilterEnum::Unknown;
+				ColorFilters = gcnew List<MLFilterEnum>();
+				RX = gcnew RXCombination();
+				LightSource = "";
+			}
+
+			/// <summary>
+			/// The positions a measurement with this calibration config needs.
+			/// </summary>
+			static MotionTarget^ FromConfig(CalibrationConfig^ config) {
+				if (config == nullptr) throw gcnew ArgumentNullException("config");
+				MotionTarget^ target = gcnew MotionTarget();
+				target->NDFilter = config->NDFilter;
+				if (config->ColorFilterList != nullptr) target->ColorFilters->AddRange(config->ColorFilterList);
+				if (config->RX != nullptr) target->RX = config->RX;
+				target->LightSource = config->LightSource;
+				return target;
+			}
+
+			/// <summary>
+			/// ND filter, Unknown if the ND wheel is not needed.
+			/// </summary>
+			property MLFilterEnum NDFilter;
+
+			/// <summary>
+			/// Color filters visited in order, empty if the XYZ wheel is not needed.
+			/// </summary>
+			property List<MLFilterEnum>^ ColorFilters;
+
+			/// <summary>
+			/// RX, fields left at MaxValue are not needed.
+			/// </summary>
+			property RXCombination^ RX;
+
+			/// <summary>
+			/// Light source, empty if not needed.
+			/// </summary>
+			property String^ LightSource;
+		};
+
+		/// <summary>
+		/// Visiting order computed by MotionPlanner.Plan().
+		/// </summary>
+		public ref class MotionPlan
+		{
+		public:
+			/// <summary>
+			/// Target indices in the order to run them.
+			/// </summary>
+			property array<int>^ Order;
+
+			/// <summary>
+			/// Simulated travel time of Order, in seconds.
+			/// </summary>
+			property double EstimatedSeconds;
+
+			/// <summary>
+			/// Simulated travel time of the targets in the requested order, in seconds.
+			/// </summary>
+			property double RequestedOrderSeconds;
+		};
+
+		/// <summary>
+		/// Minimal-travel ordering of ND/XYZ/RX positions. The result can be run by ML_MeasureBatch() or by the caller.
+		/// </summary>
+		public ref class MotionPlanner abstract sealed
+		{
+		public:
+			/// <summary>
+			/// Order the targets for minimal travel from the start positions. Up to 12 targets the order is optimal
+			/// for the model, above that it is a nearest neighbour + 2-opt search. Never slower than the requested order.
+			/// </summary>
+			/// <param name="model">Travel time model.</param>
+			/// <param name="start">Current positions, nullptr if unknown.</param>
+			/// <param name="targets">Positions to visit.</param>
+			/// <returns>The plan.</returns>
+			static MotionPlan^ Plan(MotionModel^ model, MotionTarget^ start, IList<MotionTarget^>^ targets) {
+				MotionPathPlanner planner(ToNative(model));
+				Dictionary<String^, int>^ groups = gcnew Dictionary<String^, int>();
+				MotionPathPlanner::State nativeStart = ToNative(model, start, groups);
+				std::vector<MotionPathPlanner::State> states = ToNative(model, targets, groups);
+				std::vector<int> order = planner.Plan(nativeStart, states);
+				std::vector<int> requested;
+				for (int i = 0; i < static_cast<int>(states.size()); i++) requested.push_back(i);
+
+				MotionPlan^ plan = gcnew MotionPlan();
+				plan->Order = gcnew array<int>(static_cast<int>(order.size()));
+				for (int i = 0; i < plan->Order->Length; i++) plan->Order[i] = order[i];
+				plan->EstimatedSeconds = planner.Simulate(nativeStart, states, order);
+				plan->RequestedOrderSeconds = planner.Simulate(nativeStart, states, requested);
+				return plan;
+			}
+
+			/// <summary>
+			/// Simulated travel time of running the targets in the given order.
+			/// </summary>
+			/// <param name="model">Travel time model.</param>
+			/// <param name="start">Current positions, nullptr if unknown.</param>
+			/// <param name="targets">Positions to visit.</param>
+			/// <param name="order">Target indices in the order to run them.</param>
+			/// <returns>The travel time in seconds.</returns>
+			static double Simulate(MotionModel^ model, MotionTarget^ start, IList<MotionTarget^>^ targets, array<int>^ order) {
+				if (order == nullptr) throw gcnew ArgumentNullException("order");
+				MotionPathPlanner planner(ToNative(model));
+				Dictionary<String^, int>^ groups = gcnew Dictionary<String^, int>();
+				MotionPathPlanner::State nativeStart = ToNative(model, start, groups);
+				std::vector<MotionPathPlanner::State> states = ToNative(model, targets, groups);
+				std::vector<int> nativeOrder;
+				for each (int index in order) {
+					if (index < 0 || index >= static_cast<int>(states.size())) throw gcnew ArgumentOutOfRangeException("order");
+					nativeOrder.push_back(index);
+				}
+				return planner.Simulate(nativeStart, states, nativeOrder);
+			}
+
+		internal:
+			static MotionPathPlanner::Model ToNative(MotionModel^ model) {
+				if (model == nullptr) throw gcnew ArgumentNullException("model");
+				MotionPathPlanner::Model native;
+				MotionPathPlanner::Wheel wheel;
+				wheel.SecondsPerSlot = model->SecondsPerSlot;
+				wheel.SettleSeconds = model->WheelSettleSeconds;
+				native.ND = native.XYZ = native.RX = wheel;
+				native.ND.Slots = model->NDSlots;
+				native.XYZ.Slots = model->XYZSlots;
+				native.RX.Slots = model->RXSlots;
+				native.RXAxis.Min = model->AxisMin;
+				native.RXAxis.Max = model->AxisMax;
+				native.RXAxis.SecondsPerDegree = model->SecondsPerDegree;
+				native.RXAxis.SettleSeconds = model->AxisSettleSeconds;
+				native.GroupChangeSeconds = model->LightSourceChangeSeconds;
+				return native;
+			}
+
+			static MotionPathPlanner::State ToNative(MotionModel^ model, MotionTarget^ target, Dictionary<String^, int>^ groups) {
+				MotionPathPlanner::State state;
+				if (target == nullptr) return state;
+				state.ND = Slot(model->NDPositions, target->NDFilter);
+				if (target->ColorFilters != nullptr && target->ColorFilters->Count > 0) {
+					state.XYZFirst = Slot(model->XYZPositions, target->ColorFilters[0]);
+					state.XYZLast = Slot(model->XYZPositions, target->ColorFilters[target->ColorFilters->Count - 1]);
+				}
+				if (target->RX != nullptr) {
+					int slot;
+					if (target->RX->Cylinder != double::MaxValue && model->RXPositions != nullptr && model->RXPositions->TryGetValue(target->RX->Cylinder, slot)) {
+						state.RX = slot;
+					}
+					if (target->RX->Axis != int::MaxValue) state.Axis = target->RX->Axis;
+				}
+				if (!String::IsNullOrEmpty(target->LightSource)) {
+					int group;
+					if (!groups->TryGetValue(target->LightSource, group)) {
+						group = groups->Count;
+						groups->Add(target->LightSource, group);
+					}
+					state.Group = group;
+				}
+				return state;
+			}
+
+			static std::vector<MotionPathPlanner::State> ToNative(MotionModel^ model, IList<MotionTarget^>^ targets, Dictionary<String^, int>^ groups) {
+				if (targets == nullptr) throw gcnew ArgumentNullException("targets");
+				std::vector<MotionPathPlanner::State> states;
+				for each (MotionTarget^ target in targets) {
+					if (target == nullptr) throw gcnew ArgumentException("Targets must not contain nullptr.", "targets");
+					states.push_back(ToNative(model, target, groups));
+				}
+				return states;
+			}
+
+		private:
+			static int Slot(Dictionary<MLFilterEnum, int>^ positions, MLFilterEnum filter) {
+				int slot;
+				if (filter == MLFilterEnum::Unknown || positions == nullptr || !positions->TryGetValue(filter, slot)) return -1;
+				return slot;
+			}
+		};
+	}
+}
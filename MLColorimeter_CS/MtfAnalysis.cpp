@@ -0,0 +1,421 @@
+// Compiled without /clr: the per-pixel loops run as native code, next to the SDK's MTF
+
+#include "MtfAnalysis.h"
+#include "MLColorimeterAlgorithms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			const double Pi = 3.14159265358979323846;
+			// ROIs of at least this many pixels are split into row stripes, at most MaxStripes
+			const long long StripePixels = 1 << 16;
+			const int MaxStripes = 16;
+			// Pixels across the edge below which a ROI is rejected
+			const int MinWidth = 8;
+
+			// CalculateMTF() runs its pipeline in the instance, so no instance is shared between threads
+			ML::MLColorimeter::MLColorimeterAlgorithms& Sdk() {
+				thread_local ML::MLColorimeter::MLColorimeterAlgorithms algorithms;
+				return algorithms;
+			}
+
+			// Fixed number of stripes, so the result does not depend on the thread count
+			int StripeCount(int lines, int positions) {
+				if (static_cast<long long>(lines) * positions < StripePixels) return 1;
+				return std::min(std::max(lines / 32, 1), MaxStripes);
+			}
+
+			// body(begin, end, stripe) over [0, count) in stripes, in parallel if there are several
+			template <typename Body>
+			void ForStripes(int count, int stripes, const Body& body) {
+				if (stripes <= 1) {
+					body(0, count, 0);
+					return;
+				}
+				cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+					for (int s = range.start; s < range.end; s++) {
+						body(static_cast<int>(static_cast<long long>(count) * s / stripes),
+							static_cast<int>(static_cast<long long>(count) * (s + 1) / stripes), s);
+					}
+				});
+			}
+
+			struct GradientSums
+			{
+				double horizontal = 0;
+				double vertical = 0;
+				double sum = 0;
+				double lo = std::numeric_limits<double>::max();
+				double hi = -std::numeric_limits<double>::max();
+			};
+
+			// Pixels of the ROI addressed as (line, position): lines run along the edge, positions across it
+			template <typename T>
+			struct Lines
+			{
+				const uchar* base;
+				std::size_t lineStep;
+				std::size_t positionStep;
+				int lines;
+				int positions;
+
+				double operator()(int line, int position) const {
+					return static_cast<double>(*reinterpret_cast<const T*>(base + line * lineStep + position * positionStep));
+				}
+			};
+
+			// Location of the edge (or line) on one line, -1 if the line is flat
+			template <typename T>
+			double Centroid(const Lines<T>& view, int line, bool edgeTarget, bool brightLine) {
+				double weightSum = 0, moment = 0;
+				if (edgeTarget) {
+					for (int p = 1; p + 1 < view.positions; p++) {
+						double w = std::abs(view(line, p + 1) - view(line, p - 1));
+						weightSum += w;
+						moment += w * p;
+					}
+				}
+				else {
+					double lo = std::numeric_limits<double>::max(), hi = -lo;
+					for (int p = 0; p < view.positions; p++) {
+						lo = std::min(lo, view(line, p));
+						hi = std::max(hi, view(line, p));
+					}
+					for (int p = 0; p < view.positions; p++) {
+						double w = brightLine ? view(line, p) - lo : hi - view(line, p);
+						weightSum += w;
+						moment += w * p;
+					}
+				}
+				return weightSum > 0 ? moment / weightSum : -1;
+			}
+
+			template <typename T>
+			bool Compute(const cv::Mat& image, const cv::Rect& roi, const MtfSettings& settings, std::vector<double>& storage,
+				int& samples, int& frequencies, double& angle) {
+				const uchar* base = image.ptr(roi.y) + roi.x * sizeof(T);
+				const std::size_t rowStep = image.step[0], columnStep = sizeof(T);
+
+				// The edge runs along the direction with the smaller gradient
+				int rowStripes = StripeCount(roi.height, roi.width);
+				GradientSums partial[MaxStripes];
+				ForStripes(std::max(roi.height - 1, 0), rowStripes, [&](int begin, int end, int stripe) {
+					GradientSums& sums = partial[stripe];
+					for (int y = begin; y < end; y++) {
+						const T* row = reinterpret_cast<const T*>(base + y * rowStep);
+						const T* next = reinterpret_cast<const T*>(base + (y + 1) * rowStep);
+						for (int x = 0; x + 1 < roi.width; x++) {
+							sums.horizontal += std::abs(static_cast<double>(row[x + 1]) - row[x]);
+							sums.vertical += std::abs(static_cast<double>(next[x]) - row[x]);
+							sums.sum += row[x];
+							sums.lo = std::min(sums.lo, static_cast<double>(row[x]));
+							sums.hi = std::max(sums.hi, static_cast<double>(row[x]));
+						}
+					}
+				});
+				GradientSums total;
+				for (int s = 0; s < rowStripes; s++) {
+					total.horizontal += partial[s].horizontal;
+					total.vertical += partial[s].vertical;
+					total.sum += partial[s].sum;
+					total.lo = std::min(total.lo, partial[s].lo);
+					total.hi = std::max(total.hi, partial[s].hi);
+				}
+				double lo = total.lo, hi = total.hi;
+				bool transposed = total.vertical > total.horizontal;
+				Lines<T> view;
+				view.base = base;
+				view.lineStep = transposed ? columnStep : rowStep;
+				view.positionStep = transposed ? rowStep : columnStep;
+				view.lines = transposed ? roi.width : roi.height;
+				view.positions = transposed ? roi.height : roi.width;
+				if (view.positions < MinWidth || view.lines < 2) return false;
+
+				// A line target is bright if the mean is nearer the minimum than the maximum
+				double mean = total.sum / std::max((roi.width - 1) * (roi.height - 1), 1);
+				bool brightLine = mean - lo < hi - mean;
+
+				const int oversampling = std::min(std::max(settings.Oversampling, 1), 16);
+				const int count = view.positions * oversampling;
+				const int frequencyCount = std::min(view.positions, count / 2) + 1;
+				const int stripes = StripeCount(view.lines, view.positions);
+				std::size_t size = 5 * static_cast<std::size_t>(count) + 2 * frequencyCount + view.lines +
+					2 * static_cast<std::size_t>(count) * (stripes - 1);
+				if (storage.size() < size) storage.resize(size);
+				std::fill(storage.begin(), storage.begin() + size, 0.0);
+				double* esf = storage.data();
+				double* lsf = esf + count;
+				double* position = lsf + count;
+				double* mtf = position + count;
+				double* frequency = mtf + frequencyCount;
+				double* binCounts = frequency + frequencyCount;
+				double* twiddles = binCounts + count;
+				double* centroids = twiddles + count;
+				double* stripeBins = centroids + view.lines;
+
+				ForStripes(view.lines, stripes, [&](int begin, int end, int) {
+					for (int l = begin; l < end; l++) centroids[l] = Centroid(view, l, settings.ChessMode, brightLine);
+				});
+
+				// Straight line through the per-line locations, position = slope * line + offset
+				double n = 0, sl = 0, sp = 0, sll = 0, slp = 0;
+				for (int l = 0; l < view.lines; l++) {
+					double p = centroids[l];
+					if (p < 0) continue;
+					n++;
+					sl += l;
+					sp += p;
+					sll += static_cast<double>(l) * l;
+					slp += l * p;
+				}
+				double denominator = n * sll - sl * sl;
+				if (n < 2 || denominator == 0) return false;
+				double slope = (n * slp - sl * sp) / denominator;
+				double offset = (sp - slope * sl) / n;
+				angle = std::atan(slope) * 180 / Pi;
+
+				// Supersampled profile, binned by the distance to the fitted line
+				// Stripes past the first bin into their own sums and counts, added in stripe order
+				const double center = view.positions / 2.0;
+				ForStripes(view.lines, stripes, [&](int begin, int end, int stripe) {
+					double* sums = stripe == 0 ? esf : stripeBins + 2 * static_cast<std::size_t>(count) * (stripe - 1);
+					double* counts = stripe == 0 ? binCounts : sums + count;
+					for (int l = begin; l < end; l++) {
+						double edge = slope * l + offset;
+						for (int p = 0; p < view.positions; p++) {
+							int bin = static_cast<int>(std::floor((p - edge + center) * oversampling));
+							if (bin < 0 || bin >= count) continue;
+							sums[bin] += view(l, p);
+							counts[bin]++;
+						}
+					}
+				});
+				for (int s = 1; s < stripes; s++) {
+					const double* sums = stripeBins + 2 * static_cast<std::size_t>(count) * (s - 1);
+					for (int i = 0; i < count; i++) {
+						esf[i] += sums[i];
+						binCounts[i] += sums[count + i];
+					}
+				}
+				int previous = -1;
+				for (int i = 0; i < count; i++) {
+					if (binCounts[i] == 0) continue;
+					esf[i] /= binCounts[i];
+					// Empty bins take the linear interpolation of their filled neighbours
+					for (int j = previous + 1; j < i; j++) {
+						esf[j] = previous < 0 ? esf[i] : esf[previous] + (esf[i] - esf[previous]) * (j - previous) / (i - previous);
+					}
+					previous = i;
+				}
+				if (previous < 0) return false;
+				for (int j = previous + 1; j < count; j++) esf[j] = esf[previous];
+				for (int i = 0; i < count; i++) position[i] = (i + 0.5) / oversampling - center;
+
+				if (settings.ChessMode) {
+					double total = 0;
+					for (int i = 1; i + 1 < count; i++) {
+						lsf[i] = (esf[i + 1] - esf[i - 1]) / 2;
+						total += lsf[i];
+					}
+					if (total < 0) {
+						for (int i = 0; i < count; i++) lsf[i] = -lsf[i];
+					}
+				}
+				else {
+					// The binned profile is the LSF, the ESF its running sum
+					double baseline = brightLine ? *std::min_element(esf, esf + count) : *std::max_element(esf, esf + count);
+					double running = 0;
+					for (int i = 0; i < count; i++) {
+						lsf[i] = brightLine ? esf[i] - baseline : baseline - esf[i];
+						running += lsf[i] / oversampling;
+						esf[i] = running;
+					}
+				}
+				for (int i = 0; i < count; i++) {
+					lsf[i] *= 0.54 + 0.46 * std::cos(2 * Pi * (i - count / 2.0) / count);
+				}
+
+				for (int i = 0; i < count; i++) {
+					binCounts[i] = std::cos(2 * Pi * i / count);
+					twiddles[i] = std::sin(2 * Pi * i / count);
+				}
+				// Cycles per sensor pixel, then per millimeter or degree
+				double scale = 1.0 / std::max(settings.BinNum, 1);
+				if (settings.PixelSize > 0) {
+					scale *= settings.LpmmUnit ? 1 / settings.PixelSize : settings.FocalLength * Pi / 180 / settings.PixelSize;
+				}
+				double dc = 0;
+				for (int k = 0; k < frequencyCount; k++) {
+					double re = 0, im = 0;
+					for (int i = 0; i < count; i++) {
+						int index = static_cast<int>((static_cast<long long>(k) * i) % count);
+						re += lsf[i] * binCounts[index];
+						im -= lsf[i] * twiddles[index];
+					}
+					double magnitude = std::sqrt(re * re + im * im);
+					if (k == 0) {
+						dc = magnitude;
+						if (dc <= 0) return false;
+					}
+					mtf[k] = magnitude / dc;
+					if (settings.ChessMode && k > 0) {
+						// Undo the response of the central difference
+						double w = 2 * Pi * k / count;
+						double response = std::sin(w) / w;
+						if (response > 0.1) mtf[k] /= response;
+					}
+					frequency[k] = static_cast<double>(k) / view.positions * scale;
+				}
+				samples = count;
+				frequencies = frequencyCount;
+				return true;
+			}
+
+			// Clone of the ROI with the edge vertical, the edge running along the direction with the smaller gradient.
+			// false if the ROI is invalid, flat or too narrow
+			bool OrientedRegion(const cv::Mat& image, const cv::Rect& roi, cv::Mat& region) {
+				if (image.empty() || image.channels() != 1 || (image.depth() != CV_8U && image.depth() != CV_16U)) return false;
+				if (roi.width < 2 || roi.height < 2 || (roi & cv::Rect(0, 0, image.cols, image.rows)) != roi) return false;
+				cv::Mat view = image(roi);
+				double across = cv::norm(view.colRange(1, roi.width), view.colRange(0, roi.width - 1), cv::NORM_L1);
+				double along = cv::norm(view.rowRange(1, roi.height), view.rowRange(0, roi.height - 1), cv::NORM_L1);
+				if (across + along == 0) return false;
+				if (along > across) {
+					cv::transpose(view, region);
+				}
+				else {
+					region = view.clone();
+				}
+				return region.cols >= MinWidth;
+			}
+		}
+
+		double MtfCurves::At(double frequency) const {
+			if (frequencies == 0) return std::numeric_limits<double>::quiet_NaN();
+			const double* axis = Frequency();
+			const double* values = Mtf();
+			if (frequency < axis[0] || frequency > axis[frequencies - 1]) return std::numeric_limits<double>::quiet_NaN();
+			int upper = static_cast<int>(std::lower_bound(axis, axis + frequencies, frequency) - axis);
+			if (upper == 0) return values[0];
+			int lower = upper - 1;
+			double t = (frequency - axis[lower]) / (axis[upper] - axis[lower]);
+			return values[lower] + t * (values[upper] - values[lower]);
+		}
+
+		bool CalculateMtf(const cv::Mat& image, const cv::Rect& roi, const MtfSettings& settings, MtfCurves& result) {
+			result.samples = 0;
+			result.frequencies = 0;
+			if (image.empty() || image.channels() != 1) return false;
+			if (roi.empty() || (roi & cv::Rect(0, 0, image.cols, image.rows)) != roi) return false;
+			result.spacing = 1.0 / std::min(std::max(settings.Oversampling, 1), 16);
+			bool done = false;
+			switch (image.depth()) {
+			case CV_8U:
+				done = Compute<uchar>(image, roi, settings, result.storage, result.samples, result.frequencies, result.angle);
+				break;
+			case CV_16U:
+				done = Compute<ushort>(image, roi, settings, result.storage, result.samples, result.frequencies, result.angle);
+				break;
+			case CV_32F:
+				done = Compute<float>(image, roi, settings, result.storage, result.samples, result.frequencies, result.angle);
+				break;
+			}
+			if (!done) {
+				result.samples = 0;
+				result.frequencies = 0;
+			}
+			return done;
+		}
+
+		int CalculateMtfAtFrequency(const cv::Mat& image, const std::vector<cv::Rect>& rois, double frequency,
+			const MtfSettings& settings, std::vector<double>& values) {
+			values.assign(rois.size(), std::numeric_limits<double>::quiet_NaN());
+			std::vector<MtfCurves> curves(rois.size());
+			// Large ROIs also split into row stripes; OpenCV runs those inline when all threads are busy with ROIs
+			cv::parallel_for_(cv::Range(0, static_cast<int>(rois.size())), [&](const cv::Range& range) {
+				for (int i = range.start; i < range.end; i++) {
+					if (CalculateMtf(image, rois[i], settings, curves[i])) values[i] = curves[i].At(frequency);
+				}
+			});
+			return static_cast<int>(std::count_if(values.begin(), values.end(), [](double v) { return !std::isnan(v); }));
+		}
+
+		int CalculateSdkMtfAtFrequency(const cv::Mat& image, const std::vector<cv::Rect>& rois, double frequency,
+			const MtfSettings& settings, std::vector<double>& values) {
+			values.assign(rois.size(), std::numeric_limits<double>::quiet_NaN());
+			// Each worker thread calls its own SDK instance
+			cv::parallel_for_(cv::Range(0, static_cast<int>(rois.size())), [&](const cv::Range& range) {
+				for (int i = range.start; i < range.end; i++) {
+					cv::Mat region;
+					if (!OrientedRegion(image, rois[i], region)) continue;
+					try {
+						double value = Sdk().CalculateMTF(region, frequency, settings.FocalLength, settings.LpmmUnit,
+							settings.ChessMode, settings.BinNum);
+						if (std::isfinite(value) && value >= 0) values[i] = value;
+					}
+					catch (...) {
+					}
+				}
+			});
+			return static_cast<int>(std::count_if(values.begin(), values.end(), [](double v) { return !std::isnan(v); }));
+		}
+
+		bool GaussianPeak(const std::vector<double>& positions, const std::vector<double>& values, double& peak) {
+			int n = static_cast<int>(std::min(positions.size(), values.size()));
+			int best = -1;
+			for (int i = 0; i < n; i++) {
+				if (values[i] > 0 && (best < 0 || values[i] > values[best])) best = i;
+			}
+			if (best < 0) return false;
+			peak = positions[best];
+
+			// Samples above half the maximum, at least the direct neighbours
+			int first = best, last = best;
+			while (first > 0 && values[first - 1] >= values[best] / 2) first--;
+			while (last + 1 < n && values[last + 1] >= values[best] / 2) last++;
+			if (first == best && first > 0 && values[first - 1] > 0) first--;
+			if (last == best && last + 1 < n && values[last + 1] > 0) last++;
+			if (last - first < 2) return true;
+
+			// log(value) = c0 + c1 u + c2 u^2 with u the scaled distance to the best sample, weighted by value^2
+			double scale = std::max(std::abs(positions[first] - peak), std::abs(positions[last] - peak));
+			if (scale <= 0) return true;
+			double m[3][4] = {};
+			for (int i = first; i <= last; i++) {
+				if (!(values[i] > 0)) continue;
+				double u = (positions[i] - peak) / scale;
+				double w = values[i] * values[i];
+				double powers[3] = { 1, u, u * u };
+				for (int r = 0; r < 3; r++) {
+					for (int c = 0; c < 3; c++) m[r][c] += w * powers[r] * powers[c];
+					m[r][3] += w * powers[r] * std::log(values[i]);
+				}
+			}
+			// Gaussian elimination with partial pivoting
+			for (int c = 0; c < 3; c++) {
+				int pivot = c;
+				for (int r = c + 1; r < 3; r++) {
+					if (std::abs(m[r][c]) > std::abs(m[pivot][c])) pivot = r;
+				}
+				if (std::abs(m[pivot][c]) < 1e-12) return true;
+				for (int k = 0; k < 4; k++) std::swap(m[c][k], m[pivot][k]);
+				for (int r = 0; r < 3; r++) {
+					if (r == c) continue;
+					double f = m[r][c] / m[c][c];
+					for (int k = c; k < 4; k++) m[r][k] -= f * m[c][k];
+				}
+			}
+			double c1 = m[1][3] / m[1][1], c2 = m[2][3] / m[2][2];
+			if (c2 >= 0) return true;
+			double vertex = -c1 / (2 * c2);
+			double lo = (positions[first] - peak) / scale, hi = (positions[last] - peak) / scale;
+			peak += std::min(std::max(vertex, lo), hi) * scale;
+			return true;
+		}
+	}
+}
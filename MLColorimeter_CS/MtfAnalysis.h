@@ -0,0 +1,97 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and MtfAnalysis.cpp (compiled without /clr)
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		struct MtfSettings
+		{
+			/// Edge target (chessboard, slanted edge) if true, line target (cross-hair) if false, as the SDK's chessMode.
+			bool ChessMode = true;
+			/// Pixel size of the sensor in millimeters, without binning. 0 leaves the frequencies in cycles per
+			/// sensor pixel.
+			double PixelSize = 0;
+			/// Focal length in millimeters, for lp/degree when LpmmUnit is false.
+			double FocalLength = 0;
+			bool LpmmUnit = true;
+			/// Binning factor of the image (1, 2, 4 or 8, the SDK's binNum): a pixel of the image spans BinNum sensor
+			/// pixels, which scales the frequency axis.
+			int BinNum = 1;
+			/// Bins per pixel of the supersampled edge profile.
+			int Oversampling = 4;
+		};
+
+		/// Curves of one MTF measurement in a single buffer: ESF and LSF with the position of each sample across the
+		/// edge (SampleCount values each, SampleSpacing pixels apart), MTF and its frequency axis (FrequencyCount
+		/// values each). The buffer also holds the scratch of the measurement; it is reused by the next CalculateMtf()
+		/// into the same object and only grows when a larger ROI needs it.
+		class MtfCurves
+		{
+		public:
+			const double* Esf() const { return storage.data(); }
+			const double* Lsf() const { return storage.data() + samples; }
+			/// Distance of each ESF / LSF sample to the fitted edge, in pixels.
+			const double* SamplePosition() const { return storage.data() + 2 * samples; }
+			const double* Mtf() const { return storage.data() + 3 * samples; }
+			const double* Frequency() const { return storage.data() + 3 * samples + frequencies; }
+			int SampleCount() const { return samples; }
+			int FrequencyCount() const { return frequencies; }
+			double SampleSpacing() const { return spacing; }
+			/// Angle of the edge or line to the sampling direction, in degrees.
+			double EdgeAngle() const { return angle; }
+			bool Empty() const { return frequencies == 0; }
+
+			/// MTF at a frequency, linearly interpolated. NaN outside the frequency axis.
+			double At(double frequency) const;
+
+		private:
+			friend bool CalculateMtf(const cv::Mat& image, const cv::Rect& roi, const MtfSettings& settings, MtfCurves& result);
+
+			// ESF | LSF | sample position | MTF | frequency | scratch (bin counts, twiddles, edge locations, stripe bins)
+			std::vector<double> storage;
+			int samples = 0;
+			int frequencies = 0;
+			double spacing = 1;
+			double angle = 0;
+		};
+
+		/// Slanted-edge MTF of a ROI holding one near-vertical or near-horizontal edge (or line): the edge is
+		/// located on every line, fitted with a straight line, and the pixels are binned by their distance to it
+		/// into a supersampled ESF. The LSF is its Hamming-windowed derivative (the binned profile itself for a
+		/// line target) and the MTF the normalized magnitude of its DFT, up to 1 cycle per pixel.
+		/// The ROI is read in place; the only allocation is the growth of result's buffer.
+		/// The SDK's ML_CalculateMTF() is not used: it returns its curves as bare new[] arrays whose lengths are
+		/// not part of its interface.
+		/// image: CV_8UC1, CV_16UC1 or CV_32FC1.
+		/// @return false if the ROI is invalid or holds no usable edge; result is then empty.
+		bool CalculateMtf(const cv::Mat& image, const cv::Rect& roi, const MtfSettings& settings, MtfCurves& result);
+
+		/// MTF at one frequency of several ROIs of the same frame (the ROIs of a ThroughFocusConfig), computed
+		/// concurrently: one task per ROI, and ROIs of 64K pixels or more split into a fixed number of row stripes,
+		/// so each value equals CalculateMtf() followed by MtfCurves::At() whatever the thread count.
+		/// frequency: in the units of settings, like MtfCurves::At().
+		/// values: one per ROI, NaN where the ROI is invalid, holds no edge or the frequency is off the axis.
+		/// @return the number of ROIs measured.
+		int CalculateMtfAtFrequency(const cv::Mat& image, const std::vector<cv::Rect>& rois, double frequency,
+			const MtfSettings& settings, std::vector<double>& values);
+
+		/// The same by the SDK's CalculateMTF() with ChessMode, FocalLength, LpmmUnit and BinNum, on a clone of each
+		/// ROI turned so that its edge is vertical; the score of the wrapper's through focus. One task per ROI,
+		/// each on the SDK instance of its thread. The SDK evaluates a whole ROI, so there are no row stripes.
+		/// frequency: the SDK's freq, in lp/mm or lp/degree as set by settings.
+		/// values: one per ROI, NaN where the ROI is invalid, flat or the SDK fails.
+		/// @return the number of ROIs measured.
+		int CalculateSdkMtfAtFrequency(const cv::Mat& image, const std::vector<cv::Rect>& rois, double frequency,
+			const MtfSettings& settings, std::vector<double>& values);
+
+		/// Peak of a through-focus MTF curve by a weighted least-squares Gaussian fit (a parabola in log(value)) of
+		/// the samples above half the maximum around it. The positions need not be evenly spaced or sorted by value,
+		/// but must be sorted by position. Falls back to the best sample when the fit is not concave.
+		/// @return false if no value is positive.
+		bool GaussianPeak(const std::vector<double>& positions, const std::vector<double>& values, double& peak);
+	}
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "MtfAnalysis.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+using namespace System::Collections::Generic;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Target and units of an MTF measurement.
+		/// </summary>
+		public ref class MtfConfig
+		{
+		public:
+			MtfConfig() {
+				ChessMode = true;
+				PixelSize = 0;
+				FocalLength = 0;
+				LpmmUnit = true;
+				BinNum = 1;
+				Oversampling = 4;
+			}
+
+			/// <summary>
+			/// Edge target (chessboard, slanted edge) if true, line target (cross-hair) if false, as the SDK's chessMode.
+			/// </summary>
+			property bool ChessMode;
+
+			/// <summary>
+			/// Pixel size of the sensor in millimeters, without binning. 0 leaves the frequencies in cycles per sensor pixel.
+			/// </summary>
+			property double PixelSize;
+
+			/// <summary>
+			/// Focal length in millimeters, used for lp/degree when LpmmUnit is false.
+			/// </summary>
+			property double FocalLength;
+
+			/// <summary>
+			/// Frequencies in lp/mm if true, lp/degree if false.
+			/// </summary>
+			property bool LpmmUnit;
+
+			/// <summary>
+			/// Binning factor of the image (1, 2, 4 or 8), as the SDK's binNum; the frequency axis scales with it.
+			/// </summary>
+			property int BinNum;
+
+			/// <summary>
+			/// Bins per pixel of the supersampled edge profile (1 to 16).
+			/// </summary>
+			property int Oversampling;
+
+		internal:
+			MtfSettings ToNative() {
+				if (BinNum != 1 && BinNum != 2 && BinNum != 4 && BinNum != 8) {
+					throw gcnew ArgumentOutOfRangeException("BinNum", "BinNum must be 1, 2, 4 or 8.");
+				}
+				MtfSettings native;
+				native.ChessMode = ChessMode;
+				native.PixelSize = PixelSize;
+				native.FocalLength = FocalLength;
+				native.LpmmUnit = LpmmUnit;
+				native.BinNum = BinNum;
+				native.Oversampling = Oversampling;
+				return native;
+			}
+		};
+
+		public enum class MtfCurve {
+			/// <summary>
+			/// Edge spread function, SampleCount values.
+			/// </summary>
+			Esf = 0,
+			/// <summary>
+			/// Line spread function, SampleCount values.
+			/// </summary>
+			Lsf = 1,
+			/// <summary>
+			/// Modulation transfer function, FrequencyCount values.
+			/// </summary>
+			Mtf = 2,
+			/// <summary>
+			/// Frequency of each MTF value, FrequencyCount values.
+			/// </summary>
+			Frequency = 3,
+			/// <summary>
+			/// Distance of each ESF / LSF sample to the fitted edge in pixels, SampleCount values.
+			/// </summary>
+			SamplePosition = 4
+		};
+
+		/// <summary>
+		/// Curves of one MTF measurement, held in a single native buffer owned by this object.
+		/// Each curve comes with its length; GetPointer() reads it in place, ToArray() / CopyTo() copy it.
+		/// Passing the result back to MtfAnalyzer.Calculate() reuses the buffer.
+		/// </summary>
+		public ref class MtfResult
+		{
+		public:
+			MtfResult() : curves(new MtfCurves()) {
+			}
+
+			~MtfResult() {
+				this->!MtfResult();
+			}
+
+			!MtfResult() {
+				if (curves != nullptr) {
+					delete curves;
+					curves = nullptr;
+				}
+			}
+
+			property int SampleCount {
+				int get() { return GetCurves().SampleCount(); }
+			}
+
+			property int FrequencyCount {
+				int get() { return GetCurves().FrequencyCount(); }
+			}
+
+			/// <summary>
+			/// Distance between two ESF / LSF samples, in pixels.
+			/// </summary>
+			property double SampleSpacing {
+				double get() { return GetCurves().SampleSpacing(); }
+			}
+
+			/// <summary>
+			/// Angle of the edge or line to the sampling direction, in degrees.
+			/// </summary>
+			property double EdgeAngle {
+				double get() { return GetCurves().EdgeAngle(); }
+			}
+
+			int GetLength(MtfCurve curve) {
+				return curve == MtfCurve::Mtf || curve == MtfCurve::Frequency ? FrequencyCount : SampleCount;
+			}
+
+			/// <summary>
+			/// Pointer to the first double of a curve, GetLength(curve) values.
+			/// Valid until Dispose() or the next Calculate() into this result.
+			/// </summary>
+			IntPtr GetPointer(MtfCurve curve) {
+				return IntPtr(const_cast<double*>(Data(curve)));
+			}
+
+			array<double>^ ToArray(MtfCurve curve) {
+				array<double>^ values = gcnew array<double>(GetLength(curve));
+				CopyTo(curve, values, 0);
+				return values;
+			}
+
+			/// <summary>
+			/// Copy a curve into an existing array.
+			/// </summary>
+			void CopyTo(MtfCurve curve, array<double>^ destination, int index) {
+				if (destination == nullptr) throw gcnew ArgumentNullException("destination");
+				int length = GetLength(curve);
+				if (index < 0 || destination->Length - index < length) {
+					throw gcnew ArgumentException("The destination is too small for the curve.", "destination");
+				}
+				if (length > 0) {
+					pin_ptr<double> pinned = &destination[index];
+					std::copy(Data(curve), Data(curve) + length, static_cast<double*>(pinned));
+				}
+			}
+
+			/// <summary>
+			/// MTF at a frequency, linearly interpolated. NaN outside the frequency axis.
+			/// </summary>
+			double At(double frequency) {
+				return GetCurves().At(frequency);
+			}
+
+		internal:
+			MtfCurves& GetCurves() {
+				if (curves == nullptr) {
+					throw gcnew ObjectDisposedException("MtfResult");
+				}
+				return *curves;
+			}
+
+		private:
+			const double* Data(MtfCurve curve) {
+				switch (curve) {
+				case MtfCurve::Esf: return GetCurves().Esf();
+				case MtfCurve::Lsf: return GetCurves().Lsf();
+				case MtfCurve::Mtf: return GetCurves().Mtf();
+				case MtfCurve::SamplePosition: return GetCurves().SamplePosition();
+				default: return GetCurves().Frequency();
+				}
+			}
+
+			MtfCurves* curves;
+		};
+
+		/// <summary>
+		/// Slanted-edge MTF of a region holding one near-vertical or near-horizontal edge or line.
+		/// </summary>
+		public ref class MtfAnalyzer
+		{
+		public:
+			/// <summary>
+			/// MTF curves of a region into a new result, read in place.
+			/// </summary>
+			/// <param name="image">8-bit, 16-bit or 32-bit float single channel image.</param>
+			/// <param name="roi">Region inside the image, at least 8 pixels across the edge.</param>
+			/// <param name="config">Target, units and binning, nullptr for an edge target in cycles per pixel.</param>
+			static MtfResult^ Calculate(NativeImage^ image, Rect roi, MtfConfig^ config) {
+				MtfResult^ result = gcnew MtfResult();
+				try {
+					Calculate(image, roi, config, result);
+				}
+				catch (...) {
+					delete result;
+					throw;
+				}
+				return result;
+			}
+
+			/// <summary>
+			/// MTF of a region into an existing result, reusing its buffer.
+			/// </summary>
+			static void Calculate(NativeImage^ image, Rect roi, MtfConfig^ config, MtfResult^ result) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				if (result == nullptr) throw gcnew ArgumentNullException("result");
+				MtfSettings settings = config != nullptr ? config->ToNative() : MtfSettings();
+				if (!CalculateMtf(image->GetMat(), cv::Rect(roi.X, roi.Y, roi.Width, roi.Height), settings, result->GetCurves())) {
+					throw gcnew ArgumentException("The ROI must lie inside a single channel image and hold one edge or line.", "roi");
+				}
+			}
+
+			/// <summary>
+			/// MTF at one frequency of several regions of the same image, for example the ROIs of a ThroughFocusConfig.
+			/// The regions are measured concurrently, and large regions are also split into row stripes; each value
+			/// equals Calculate() followed by MtfResult.At().
+			/// </summary>
+			/// <param name="image">8-bit, 16-bit or 32-bit float single channel image.</param>
+			/// <param name="rois">Regions to measure.</param>
+			/// <param name="frequency">Frequency in the units of config, as MtfResult.At().</param>
+			/// <param name="config">Target, units and binning, nullptr for an edge target in cycles per pixel.</param>
+			/// <returns>The MTF of each region, NaN where the region holds no edge or the frequency is off its axis.</returns>
+			static array<double>^ CalculateAtFrequency(NativeImage^ image, IList<Rect>^ rois, double frequency, MtfConfig^ config) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				if (rois == nullptr) throw gcnew ArgumentNullException("rois");
+				std::vector<cv::Rect> nativeRois;
+				nativeRois.reserve(rois->Count);
+				for each (Rect roi in rois) {
+					nativeRois.push_back(cv::Rect(roi.X, roi.Y, roi.Width, roi.Height));
+				}
+				MtfSettings settings = config != nullptr ? config->ToNative() : MtfSettings();
+				std::vector<double> values;
+				CalculateMtfAtFrequency(image->GetMat(), nativeRois, frequency, settings, values);
+				array<double>^ result = gcnew array<double>(static_cast<int>(values.size()));
+				for (int i = 0; i < result->Length; i++) {
+					result[i] = values[i];
+				}
+				return result;
+			}
+
+			/// <summary>
+			/// Peak of a through-focus MTF curve by a Gaussian fit of the samples above half its maximum, as used by
+			/// the wrapper's fly-scan through focus. Falls back to the best sample when the fit is not concave.
+			/// </summary>
+			/// <param name="positions">Motion positions, in increasing order; need not be evenly spaced.</param>
+			/// <param name="values">MTF at each position.</param>
+			/// <returns>The position of the peak.</returns>
+			static double FindFocusPeak(array<double>^ positions, array<double>^ values) {
+				if (positions == nullptr) throw gcnew ArgumentNullException("positions");
+				if (values == nullptr) throw gcnew ArgumentNullException("values");
+				if (positions->Length != values->Length) {
+					throw gcnew ArgumentException("positions and values must have the same length.");
+				}
+				std::vector<double> nativePositions(positions->Length), nativeValues(values->Length);
+				for (int i = 0; i < positions->Length; i++) {
+					nativePositions[i] = positions[i];
+					nativeValues[i] = values[i];
+				}
+				double peak;
+				if (!GaussianPeak(nativePositions, nativeValues, peak)) {
+					throw gcnew ArgumentException("At least one value must be positive.", "values");
+				}
+				return peak;
+			}
+		};
+	}
+}
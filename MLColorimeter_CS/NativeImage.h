@@ -0,0 +1,208 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Pixel depth of a native image, values match OpenCV's CV_8U ... CV_64F.
+		/// </summary>
+		public enum class ImageDepth {
+			U8 = CV_8U,
+			S8 = CV_8S,
+			U16 = CV_16U,
+			S16 = CV_16S,
+			S32 = CV_32S,
+			F32 = CV_32F,
+			F64 = CV_64F
+		};
+
+		/// <summary>
+		/// Zero-copy handle on a native image.
+		/// The handle keeps its own cv::Mat header, which shares the reference count of the pixel buffer,
+		/// so the buffer stays allocated until the handle is disposed even if the SDK drops its own copy.
+		/// It does not keep the SDK from writing into the buffer: images of ML_GetImage() and of
+		/// NotifyCameraFrameReceived wrap the camera's capture buffer and hold the latest frame only until
+		/// the next capture. Clone() them to keep a frame.
+		/// </summary>
+		public ref class NativeImage
+		{
+		public:
+			~NativeImage() {
+				this->!NativeImage();
+			}
+
+			!NativeImage() {
+				if (mat != nullptr) {
+					delete mat;
+					mat = nullptr;
+					if (pressure > 0) {
+						GC::RemoveMemoryPressure(pressure);
+						pressure = 0;
+					}
+				}
+			}
+
+			/// <summary>
+			/// Pointer to the first pixel. Valid until Dispose().
+			/// </summary>
+			property IntPtr Data {
+				IntPtr get() { return IntPtr(GetMat().data); }
+			}
+
+			/// <summary>
+			/// Image width in pixels.
+			/// </summary>
+			property int Width {
+				int get() { return GetMat().cols; }
+			}
+
+			/// <summary>
+			/// Image height in pixels.
+			/// </summary>
+			property int Height {
+				int get() { return GetMat().rows; }
+			}
+
+			/// <summary>
+			/// Number of channels per pixel.
+			/// </summary>
+			property int Channels {
+				int get() { return GetMat().channels(); }
+			}
+
+			/// <summary>
+			/// Depth of a single channel.
+			/// </summary>
+			property ImageDepth Depth {
+				ImageDepth get() { return static_cast<ImageDepth>(GetMat().depth()); }
+			}
+
+			/// <summary>
+			/// Size of one pixel in bytes (all channels).
+			/// </summary>
+			property int ElementSize {
+				int get() { return static_cast<int>(GetMat().elemSize()); }
+			}
+
+			/// <summary>
+			/// Distance in bytes between the starts of two consecutive rows.
+			/// </summary>
+			property int Stride {
+				int get() { return static_cast<int>(GetMat().step[0]); }
+			}
+
+			/// <summary>
+			/// Number of addressable bytes starting at Data, honouring Stride.
+			/// Use it with Data to build a Span&lt;byte&gt; on the C# side.
+			/// </summary>
+			property long long Length {
+				long long get() {
+					const cv::Mat& m = GetMat();
+					if (m.empty()) return 0;
+					return static_cast<long long>(m.step[0]) * (m.rows - 1) + static_cast<long long>(m.cols) * m.elemSize();
+				}
+			}
+
+			/// <summary>
+			/// True if the rows are stored without padding.
+			/// </summary>
+			property bool IsContinuous {
+				bool get() { return GetMat().isContinuous(); }
+			}
+
+			/// <summary>
+			/// True if the image holds no pixels.
+			/// </summary>
+			property bool IsEmpty {
+				bool get() { return GetMat().empty(); }
+			}
+
+			/// <summary>
+			/// Pointer to the underlying cv::Mat header. The header is owned by this handle, do not release it.
+			/// </summary>
+			property IntPtr NativeHandle {
+				IntPtr get() { GetMat(); return IntPtr(mat); }
+			}
+
+			/// <summary>
+			/// Get the pointer to the first pixel of a row.
+			/// </summary>
+			/// <param name="row">Row index.</param>
+			/// <returns>The row pointer.</returns>
+			IntPtr GetRowPointer(int row) {
+				const cv::Mat& m = GetMat();
+				if (row < 0 || row >= m.rows) {
+					throw gcnew ArgumentOutOfRangeException("row");
+				}
+				return IntPtr(const_cast<uchar*>(m.ptr(row)));
+			}
+
+			/// <summary>
+			/// Copy the pixels, tightly packed row by row, into a managed array.
+			/// </summary>
+			/// <param name="destination">Destination array, at least Width * Height * ElementSize bytes.</param>
+			void CopyTo(array<Byte>^ destination) {
+				const cv::Mat& m = GetMat();
+				size_t rowBytes = m.cols * m.elemSize();
+				if (destination == nullptr || static_cast<size_t>(destination->LongLength) < rowBytes * m.rows) {
+					throw gcnew ArgumentException("Destination array is too small.");
+				}
+				if (m.empty()) return;
+				pin_ptr<Byte> pinned = &destination[0];
+				unsigned char* dst = pinned;
+				for (int r = 0; r < m.rows; r++) {
+					memcpy(dst + rowBytes * r, m.ptr(r), rowBytes);
+				}
+			}
+
+			/// <summary>
+			/// Allocate a zero-filled image, e.g. to pass caller-generated data to the SDK.
+			/// </summary>
+			/// <param name="width">Image width in pixels.</param>
+			/// <param name="height">Image height in pixels.</param>
+			/// <param name="depth">Depth of a single channel.</param>
+			/// <param name="channels">Number of channels per pixel.</param>
+			/// <returns>The new image, with tightly packed rows.</returns>
+			static NativeImage^ Create(int width, int height, ImageDepth depth, int channels) {
+				if (width <= 0 || height <= 0) {
+					throw gcnew ArgumentOutOfRangeException(width <= 0 ? "width" : "height");
+				}
+				if (channels < 1 || channels > CV_CN_MAX) {
+					throw gcnew ArgumentOutOfRangeException("channels");
+				}
+				return gcnew NativeImage(cv::Mat::zeros(height, width, CV_MAKETYPE(static_cast<int>(depth), channels)));
+			}
+
+			/// <summary>
+			/// Deep copy of the pixels into a new handle.
+			/// </summary>
+			/// <returns>A new image which does not share its buffer.</returns>
+			NativeImage^ Clone() {
+				return gcnew NativeImage(GetMat().clone());
+			}
+
+		internal:
+			NativeImage(const cv::Mat& source) : mat(new cv::Mat(source)), pressure(0) {
+				if (!source.empty()) {
+					pressure = static_cast<long long>(source.step[0]) * source.rows;
+					GC::AddMemoryPressure(pressure);
+				}
+			}
+
+			const cv::Mat& GetMat() {
+				if (mat == nullptr) {
+					throw gcnew ObjectDisposedException("NativeImage");
+				}
+				return *mat;
+			}
+
+		private:
+			cv::Mat* mat;
+			long long pressure;
+		};
+	}
+}
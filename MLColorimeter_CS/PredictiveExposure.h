@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ExposurePredictor.h"
+#include "MLConverters.h"
+#include "ModuleCommon.h"
+#include "NativeImage.h"
+
+using namespace System;
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// <summary>
+		/// Gray level and exposure update of the wrapper's predictive auto exposure (ML_SetPredictiveAutoExposure()).
+		/// </summary>
+		public ref class PredictiveExposure
+		{
+		public:
+			/// <summary>
+			/// Gray level of an image, as measured on each auto exposure frame.
+			/// A color image gives the largest gray level of its channels.
+			/// </summary>
+			/// <param name="image">Captured frame.</param>
+			/// <param name="binning">Binning the frame was captured at.</param>
+			/// <param name="roi">Region in unbinned sensor pixels, empty for the whole frame.</param>
+			/// <param name="percentile">Percentile of the sampled pixels, between 0 and 1.</param>
+			/// <param name="stride">Every stride-th pixel of every stride-th row is sampled.</param>
+			static double GrayLevel(NativeImage^ image, Binning binning, Rect roi, double percentile, int stride) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				return ExposurePredictor::GrayLevel(image->GetMat(), MLConverter::ToNative(binning),
+					cv::Rect(roi.X, roi.Y, roi.Width, roi.Height), percentile, stride);
+			}
+
+			/// <summary>
+			/// Largest pixel value of a mono pixel format, or of the image depth for other formats.
+			/// </summary>
+			static double FullScale(MLPixelFormat format, NativeImage^ image) {
+				if (image == nullptr) throw gcnew ArgumentNullException("image");
+				return ExposurePredictor::FullScale(MLConverter::ToNative(format), image->GetMat());
+			}
+
+			/// <summary>
+			/// Next exposure time: a secant step through the last two samples, a proportional step without a usable
+			/// previous sample (previousTime 0). A saturated sample divides the time by 4, a black one multiplies it
+			/// by 8, and one step changes the time by at most a factor 16.
+			/// </summary>
+			/// <param name="previousTime">Exposure time of the sample before, 0 if none (unit: millisecond).</param>
+			/// <param name="previousLevel">Gray level of the sample before.</param>
+			/// <param name="time">Exposure time of the last sample (unit: millisecond).</param>
+			/// <param name="level">Gray level of the last sample.</param>
+			/// <param name="target">Target gray level.</param>
+			/// <param name="fullScale">Largest pixel value, see FullScale().</param>
+			static double NextTime(double previousTime, double previousLevel, double time, double level, double target,
+				double fullScale) {
+				return ExposurePredictor::NextTime(previousTime, previousLevel, time, level, target, fullScale);
+			}
+		};
+	}
+}
@@ -0,0 +1,213 @@
+// Compiled without /clr: uses std::mutex
+
+#include "RemapCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			const std::uint32_t FileMagic = 0x4D524C4D; // "MLRM"
+			const std::uint32_t FileVersion = 1;
+
+			struct FileHeader
+			{
+				std::uint32_t Magic;
+				std::uint32_t Version;
+				std::int32_t Width;
+				std::int32_t Height;
+			};
+
+			// FNV-1a
+			void Hash(std::uint64_t& hash, const void* data, std::size_t length) {
+				const unsigned char* bytes = static_cast<const unsigned char*>(data);
+				for (std::size_t i = 0; i < length; i++) {
+					hash ^= bytes[i];
+					hash *= 1099511628211ULL;
+				}
+			}
+
+			void Hash(std::uint64_t& hash, const cv::Mat& mat) {
+				cv::Mat values;
+				mat.convertTo(values, CV_64F);
+				values = values.reshape(1, 1);
+				Hash(hash, values.ptr(), values.total() * values.elemSize());
+			}
+
+			int BinningFactor(ML::CameraV2::Binning binning) {
+				return 1 << static_cast<int>(binning);
+			}
+
+			std::string FileName(const std::string& directory, std::uint64_t key) {
+				char name[32];
+				std::snprintf(name, sizeof(name), "%016llx.remap", static_cast<unsigned long long>(key));
+				std::string path = directory;
+				if (!path.empty() && path.back() != '\\' && path.back() != '/') {
+					path += '\\';
+				}
+				return path + name;
+			}
+		}
+
+		struct RemapCache::State
+		{
+			std::mutex lock;
+			std::map<std::uint64_t, std::shared_ptr<const RemapTables>> tables;
+			std::string directory;
+			// (width, height), binning
+			std::set<std::pair<std::pair<int, int>, int>> geometries;
+		};
+
+		RemapCache::RemapCache()
+			: state(new State()) {
+		}
+
+		RemapCache::~RemapCache() {
+		}
+
+		std::uint64_t RemapCache::Key(const cv::Mat& cameraMatrix, const cv::Mat& coefficients, cv::Size size,
+			ML::CameraV2::Binning binning, cv::Point2d shift) {
+			std::uint64_t hash = 14695981039346656037ULL;
+			Hash(hash, cameraMatrix);
+			Hash(hash, coefficients);
+			std::int32_t dims[3] = { size.width, size.height, BinningFactor(binning) };
+			Hash(hash, dims, sizeof(dims));
+			double offset[2] = { shift.x, shift.y };
+			Hash(hash, offset, sizeof(offset));
+			return hash;
+		}
+
+		void RemapCache::SetDirectory(const std::string& path) {
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->directory = path;
+		}
+
+		std::shared_ptr<const RemapTables> RemapCache::Get(const cv::Mat& cameraMatrix, const cv::Mat& coefficients,
+			cv::Size size, ML::CameraV2::Binning binning, cv::Point2d shift) {
+			if (cameraMatrix.rows != 3 || cameraMatrix.cols != 3 || coefficients.empty() || size.area() == 0) {
+				return nullptr;
+			}
+			std::uint64_t key = Key(cameraMatrix, coefficients, size, binning, shift);
+			std::string dir;
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->geometries.insert(std::make_pair(std::make_pair(size.width, size.height), static_cast<int>(binning)));
+				auto it = state->tables.find(key);
+				if (it != state->tables.end()) {
+					return it->second;
+				}
+				dir = state->directory;
+			}
+
+			// Build outside the lock, concurrent misses of the same key build twice and keep the first
+			std::shared_ptr<RemapTables> built = std::make_shared<RemapTables>();
+			std::string file = dir.empty() ? std::string() : FileName(dir, key);
+			if (file.empty() || !Load(file, size, *built)) {
+				cv::Mat k;
+				cameraMatrix.convertTo(k, CV_64F);
+				double factor = BinningFactor(binning);
+				// Pixel centers of a binned pixel: (c + 0.5) / factor - 0.5
+				k.at<double>(0, 0) /= factor;
+				k.at<double>(1, 1) /= factor;
+				k.at<double>(0, 2) = (k.at<double>(0, 2) + 0.5) / factor - 0.5;
+				k.at<double>(1, 2) = (k.at<double>(1, 2) + 0.5) / factor - 0.5;
+				if (shift == cv::Point2d()) {
+					cv::initUndistortRectifyMap(k, coefficients, cv::noArray(), k, size, CV_16SC2, built->Map1, built->Map2);
+				}
+				else {
+					// dst(p) = shifted(map(p)) = src(map(p) - shift), composed in float then converted to fixed point
+					cv::Mat map;
+					cv::initUndistortRectifyMap(k, coefficients, cv::noArray(), k, size, CV_32FC2, map, cv::noArray());
+					cv::subtract(map, cv::Scalar(shift.x / factor, shift.y / factor), map);
+					cv::convertMaps(map, cv::noArray(), built->Map1, built->Map2, CV_16SC2);
+				}
+				if (!file.empty()) {
+					Save(file, *built);
+				}
+			}
+
+			std::lock_guard<std::mutex> guard(state->lock);
+			auto inserted = state->tables.insert(std::make_pair(key, std::shared_ptr<const RemapTables>(built)));
+			return inserted.first->second;
+		}
+
+		void RemapCache::Clear() {
+			std::lock_guard<std::mutex> guard(state->lock);
+			state->tables.clear();
+		}
+
+		std::vector<RemapGeometry> RemapCache::Geometries() const {
+			std::lock_guard<std::mutex> guard(state->lock);
+			std::vector<RemapGeometry> geometries;
+			for (const auto& entry : state->geometries) {
+				RemapGeometry geometry;
+				geometry.Size = cv::Size(entry.first.first, entry.first.second);
+				geometry.Binning = static_cast<ML::CameraV2::Binning>(entry.second);
+				geometries.push_back(geometry);
+			}
+			return geometries;
+		}
+
+		std::size_t RemapCache::Count() const {
+			std::lock_guard<std::mutex> guard(state->lock);
+			return state->tables.size();
+		}
+
+		void RemapCache::Apply(const cv::Mat& src, cv::Mat& dst, const RemapTables& tables) {
+			cv::remap(src, dst, tables.Map1, tables.Map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+		}
+
+		void RemapCache::Translate(const cv::Mat& src, cv::Mat& dst, cv::Point2d shift, ML::CameraV2::Binning binning) {
+			double factor = BinningFactor(binning);
+			cv::Mat transform = (cv::Mat_<double>(2, 3) << 1, 0, shift.x / factor, 0, 1, shift.y / factor);
+			cv::warpAffine(src, dst, transform, src.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+		}
+
+		bool RemapCache::Load(const std::string& file, cv::Size size, RemapTables& tables) const {
+			std::ifstream in(file, std::ios::binary);
+			if (!in) return false;
+			FileHeader header;
+			if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+			if (header.Magic != FileMagic || header.Version != FileVersion
+				|| header.Width != size.width || header.Height != size.height) {
+				return false;
+			}
+			tables.Map1.create(size, CV_16SC2);
+			tables.Map2.create(size, CV_16UC1);
+			if (!in.read(reinterpret_cast<char*>(tables.Map1.ptr()), tables.Map1.total() * tables.Map1.elemSize())
+				|| !in.read(reinterpret_cast<char*>(tables.Map2.ptr()), tables.Map2.total() * tables.Map2.elemSize())) {
+				tables = RemapTables();
+				return false;
+			}
+			return true;
+		}
+
+		void RemapCache::Save(const std::string& file, const RemapTables& tables) const {
+			// Write to a temporary file first so a reader never sees a partial table
+			std::string temp = file + ".tmp";
+			{
+				std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+				if (!out) return;
+				FileHeader header = { FileMagic, FileVersion, tables.Map1.cols, tables.Map1.rows };
+				out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				out.write(reinterpret_cast<const char*>(tables.Map1.ptr()), tables.Map1.total() * tables.Map1.elemSize());
+				out.write(reinterpret_cast<const char*>(tables.Map2.ptr()), tables.Map2.total() * tables.Map2.elemSize());
+				if (!out) {
+					out.close();
+					std::remove(temp.c_str());
+					return;
+				}
+			}
+			std::remove(file.c_str());
+			if (std::rename(temp.c_str(), file.c_str()) != 0) {
+				std::remove(temp.c_str());
+			}
+		}
+	}
+}
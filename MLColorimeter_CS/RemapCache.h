@@ -0,0 +1,82 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and RemapCache.cpp (compiled without /clr)
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "MLCamaraCommon.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		/// Fixed-point undistortion maps for cv::remap (CV_16SC2 + CV_16UC1).
+		struct RemapTables
+		{
+			cv::Mat Map1;
+			cv::Mat Map2;
+		};
+
+		/// Image size and binning a set of tables was built for.
+		struct RemapGeometry
+		{
+			cv::Size Size;
+			ML::CameraV2::Binning Binning;
+		};
+
+		/// Undistortion maps keyed by (camera matrix, distortion coefficients, image size, binning, shift).
+		/// The camera matrix is given for unbinned sensor pixels and scaled by the binning factor.
+		/// A non-zero shift composes a translation applied before the undistortion (a color shift) into the
+		/// same maps, so both are done by one resampling.
+		/// Tables are built on the first Get() of a key and, if a directory is set, saved there and
+		/// loaded back by later instances instead of being rebuilt. Thread safe.
+		class RemapCache
+		{
+		public:
+			RemapCache();
+			~RemapCache();
+
+			RemapCache(const RemapCache&) = delete;
+			RemapCache& operator=(const RemapCache&) = delete;
+
+			/// Hash of everything the maps depend on, also the file name of persisted tables.
+			static std::uint64_t Key(const cv::Mat& cameraMatrix, const cv::Mat& coefficients, cv::Size size,
+				ML::CameraV2::Binning binning, cv::Point2d shift = cv::Point2d());
+
+			/// Directory for persisted tables, empty to keep them in memory only.
+			void SetDirectory(const std::string& path);
+
+			/// Tables for a key, built (or loaded from the directory) on first use.
+			/// shift: translation of the image content in unbinned sensor pixels, as cv::warpAffine with
+			/// [1 0 dx; 0 1 dy], applied before the undistortion. Scaled by the binning factor.
+			/// @return nullptr if cameraMatrix is not 3x3 or coefficients are empty.
+			std::shared_ptr<const RemapTables> Get(const cv::Mat& cameraMatrix, const cv::Mat& coefficients, cv::Size size,
+				ML::CameraV2::Binning binning, cv::Point2d shift = cv::Point2d());
+
+			/// Drop the tables kept in memory, persisted files and Geometries() are kept.
+			void Clear();
+
+			/// Every image size and binning Get() was called with, to build their tables ahead of use.
+			std::vector<RemapGeometry> Geometries() const;
+
+			std::size_t Count() const;
+
+			/// dst = src undistorted with the tables, bilinear.
+			static void Apply(const cv::Mat& src, cv::Mat& dst, const RemapTables& tables);
+
+			/// dst = src translated by shift alone, bilinear, with the same convention and binning scaling as
+			/// the shift of Get(). For a color shift without undistortion.
+			static void Translate(const cv::Mat& src, cv::Mat& dst, cv::Point2d shift, ML::CameraV2::Binning binning);
+
+		private:
+			bool Load(const std::string& file, cv::Size size, RemapTables& tables) const;
+			void Save(const std::string& file, const RemapTables& tables) const;
+
+			// Holds the std::mutex, which the /clr side cannot include
+			struct State;
+			std::unique_ptr<State> state;
+		};
+	}
+}
@@ -0,0 +1,336 @@
+// Compiled without /clr: AVX2 intrinsics
+
+#include "StatisticsKernels.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <immintrin.h>
+#include <intrin.h>
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		namespace {
+			// Samples of one channel: first sample at (X, Y) of the image, Step pixels apart in both directions
+			struct Plane
+			{
+				int X;
+				int Y;
+				int Columns;
+				int Rows;
+				int Step;
+			};
+
+			// Statistics of one stripe of rows, merged after the parallel pass
+			struct Partial
+			{
+				std::vector<unsigned int> histogram;
+				long long count = 0;
+				long long saturated = 0;
+				int min = INT_MAX;
+				int max = INT_MIN;
+				unsigned long long sum = 0;
+				unsigned long long sumSquares = 0;
+			};
+
+			// Stripes are only worth their histogram copy above this many samples each
+			const long long SamplesPerStripe = 1 << 18;
+
+			int FirstOf(int start, int parity) {
+				return start + (((parity - start) % 2) + 2) % 2;
+			}
+
+			int SampleCount(int first, int end, int step) {
+				return first < end ? (end - 1 - first) / step + 1 : 0;
+			}
+
+			template <typename T>
+			void ScalarRow(const T* row, int columns, int step, int saturation, int lastBin, Partial& partial) {
+				unsigned int* histogram = partial.histogram.data();
+				int minValue = partial.min, maxValue = partial.max;
+				unsigned long long sum = 0, sumSquares = 0;
+				long long saturated = 0;
+				for (int i = 0; i < columns; i++) {
+					int v = row[i * step];
+					histogram[std::min(v, lastBin)]++;
+					minValue = std::min(minValue, v);
+					maxValue = std::max(maxValue, v);
+					sum += v;
+					sumSquares += static_cast<unsigned long long>(v) * v;
+					saturated += v >= saturation;
+				}
+				partial.min = minValue;
+				partial.max = maxValue;
+				partial.sum += sum;
+				partial.sumSquares += sumSquares;
+				partial.saturated += saturated;
+				partial.count += columns;
+			}
+
+			inline unsigned long long HorizontalSum64(__m256i v) {
+				alignas(32) unsigned long long lanes[4];
+				_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+				return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			}
+
+			// Squares of eight 32-bit lanes, added to four 64-bit lanes
+			inline __m256i AddSquares(__m256i accumulator, __m256i v32) {
+				__m256i odd = _mm256_srli_epi64(v32, 32);
+				accumulator = _mm256_add_epi64(accumulator, _mm256_mul_epu32(v32, v32));
+				return _mm256_add_epi64(accumulator, _mm256_mul_epu32(odd, odd));
+			}
+
+			// Sixteen samples from x on, step 1 or 2 pixels apart (one channel of a Bayer row).
+			// With step 2 the 32 pixels loaded end one past the last sample, so the caller keeps x + 17 <= columns.
+			inline __m256i LoadSamples(const ushort* row, int x, int step) {
+				if (step == 1) return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+				const __m256i even = _mm256_set1_epi32(0xFFFF);
+				__m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + 2 * x)), even);
+				__m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + 2 * x + 16)), even);
+				// Lane order is lost, which none of the statistics depend on
+				return _mm256_packus_epi32(a, b);
+			}
+
+			inline __m256i LoadSamples(const uchar* row, int x, int step) {
+				if (step == 1) return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x));
+				const __m256i even = _mm256_set1_epi16(0xFF);
+				__m256i a = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + 2 * x)), even);
+				__m256i b = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + 2 * x + 32)), even);
+				return _mm256_packus_epi16(a, b);
+			}
+
+			void Avx2Row(const ushort* row, int columns, int step, int saturation, int lastBin, Partial& partial) {
+				const __m256i zero = _mm256_setzero_si256();
+				const __m256i vsaturation = _mm256_set1_epi16(static_cast<short>(saturation));
+				__m256i vmin = _mm256_set1_epi16(-1), vmax = zero;
+				__m256i sum32 = zero, squares = zero;
+				long long saturated = 0;
+				unsigned int* histogram = partial.histogram.data();
+				int x = 0;
+				for (; x + 16 + (step - 1) <= columns; x += 16) {
+					__m256i v = LoadSamples(row, x, step);
+					vmin = _mm256_min_epu16(vmin, v);
+					vmax = _mm256_max_epu16(vmax, v);
+					__m256i above = _mm256_cmpeq_epi16(_mm256_max_epu16(v, vsaturation), v);
+					saturated += _mm_popcnt_u32(static_cast<unsigned int>(_mm256_movemask_epi8(above))) / 2;
+					__m256i lo = _mm256_unpacklo_epi16(v, zero);
+					__m256i hi = _mm256_unpackhi_epi16(v, zero);
+					// Two values of at most 65535 per lane and iteration, a row cannot overflow 32 bits
+					sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(lo, hi));
+					squares = AddSquares(AddSquares(squares, lo), hi);
+					for (int k = 0; k < 16; k++) {
+						histogram[std::min(static_cast<int>(row[(x + k) * step]), lastBin)]++;
+					}
+				}
+				if (x > 0) {
+					alignas(32) ushort mins[16], maxs[16];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(mins), vmin);
+					_mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+					for (int k = 0; k < 16; k++) {
+						partial.min = std::min(partial.min, static_cast<int>(mins[k]));
+						partial.max = std::max(partial.max, static_cast<int>(maxs[k]));
+					}
+					partial.sum += HorizontalSum64(_mm256_add_epi64(_mm256_unpacklo_epi32(sum32, zero), _mm256_unpackhi_epi32(sum32, zero)));
+					partial.sumSquares += HorizontalSum64(squares);
+					partial.saturated += saturated;
+					partial.count += x;
+				}
+				ScalarRow(row + x * step, columns - x, step, saturation, lastBin, partial);
+			}
+
+			void Avx2Row(const uchar* row, int columns, int step, int saturation, int lastBin, Partial& partial) {
+				const __m256i zero = _mm256_setzero_si256();
+				const __m256i vsaturation = _mm256_set1_epi8(static_cast<char>(saturation));
+				__m256i vmin = _mm256_set1_epi8(-1), vmax = zero;
+				__m256i sum64 = zero, squares32 = zero;
+				long long saturated = 0;
+				unsigned int* histogram = partial.histogram.data();
+				int x = 0;
+				for (; x + 32 + (step - 1) <= columns; x += 32) {
+					__m256i v = LoadSamples(row, x, step);
+					vmin = _mm256_min_epu8(vmin, v);
+					vmax = _mm256_max_epu8(vmax, v);
+					__m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(v, vsaturation), v);
+					saturated += _mm_popcnt_u32(static_cast<unsigned int>(_mm256_movemask_epi8(above)));
+					sum64 = _mm256_add_epi64(sum64, _mm256_sad_epu8(v, zero));
+					__m256i lo = _mm256_unpacklo_epi8(v, zero);
+					__m256i hi = _mm256_unpackhi_epi8(v, zero);
+					// At most 4 * 255^2 per lane and iteration, a row cannot overflow 32 bits
+					squares32 = _mm256_add_epi32(squares32, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+					for (int k = 0; k < 32; k++) {
+						histogram[std::min(static_cast<int>(row[(x + k) * step]), lastBin)]++;
+					}
+				}
+				if (x > 0) {
+					alignas(32) uchar mins[32], maxs[32];
+					_mm256_store_si256(reinterpret_cast<__m256i*>(mins), vmin);
+					_mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+					for (int k = 0; k < 32; k++) {
+						partial.min = std::min(partial.min, static_cast<int>(mins[k]));
+						partial.max = std::max(partial.max, static_cast<int>(maxs[k]));
+					}
+					partial.sum += HorizontalSum64(sum64);
+					partial.sumSquares += HorizontalSum64(_mm256_add_epi64(_mm256_unpacklo_epi32(squares32, zero), _mm256_unpackhi_epi32(squares32, zero)));
+					partial.saturated += saturated;
+					partial.count += x;
+				}
+				ScalarRow(row + x * step, columns - x, step, saturation, lastBin, partial);
+			}
+
+			template <typename T>
+			void FusedPlane(const cv::Mat& image, const Plane& plane, int saturation, int bins, bool useAvx2,
+				PixelStatistics& result) {
+				long long samples = static_cast<long long>(plane.Rows) * plane.Columns;
+				int stripes = static_cast<int>(std::min<long long>(std::max(samples / SamplesPerStripe, 1LL),
+					std::max(cv::getNumThreads(), 1)));
+				stripes = std::min(stripes, std::max(plane.Rows, 1));
+				std::vector<Partial> partials(stripes);
+				cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range& range) {
+					for (int s = range.start; s < range.end; s++) {
+						Partial& partial = partials[s];
+						partial.histogram.assign(bins, 0);
+						int begin = static_cast<int>(static_cast<long long>(plane.Rows) * s / stripes);
+						int end = static_cast<int>(static_cast<long long>(plane.Rows) * (s + 1) / stripes);
+						for (int r = begin; r < end; r++) {
+							const T* row = image.ptr<T>(plane.Y + r * plane.Step) + plane.X;
+							// Mono data and Bayer data at stride 1 are vectorized, sparser samples are not worth the loads
+							if (useAvx2 && plane.Step <= 2) {
+								Avx2Row(row, plane.Columns, plane.Step, saturation, bins - 1, partial);
+							}
+							else {
+								ScalarRow(row, plane.Columns, plane.Step, saturation, bins - 1, partial);
+							}
+						}
+					}
+				});
+
+				result.Histogram.assign(bins, 0);
+				result.Count = 0;
+				result.Saturated = 0;
+				int minValue = INT_MAX, maxValue = INT_MIN;
+				unsigned long long sum = 0, sumSquares = 0;
+				for (const Partial& partial : partials) {
+					if (partial.count == 0) continue;
+					for (int b = 0; b < bins; b++) result.Histogram[b] += partial.histogram[b];
+					result.Count += partial.count;
+					result.Saturated += partial.saturated;
+					minValue = std::min(minValue, partial.min);
+					maxValue = std::max(maxValue, partial.max);
+					sum += partial.sum;
+					sumSquares += partial.sumSquares;
+				}
+				if (result.Count == 0) return;
+				result.Min = minValue;
+				result.Max = maxValue;
+				double count = static_cast<double>(result.Count);
+				result.Mean = static_cast<double>(sum) / count;
+				double variance = (static_cast<double>(sumSquares) - static_cast<double>(sum) * result.Mean) / count;
+				result.Std = std::sqrt(std::max(variance, 0.0));
+			}
+
+			// Reference: the samples are gathered, then measured with one OpenCV call per statistic
+			void MultiPassPlane(const cv::Mat& image, const Plane& plane, int saturation, int bins, PixelStatistics& result) {
+				cv::Mat samples;
+				if (plane.Step == 1) {
+					samples = image(cv::Rect(plane.X, plane.Y, plane.Columns, plane.Rows));
+				}
+				else {
+					samples.create(plane.Rows, plane.Columns, image.type());
+					for (int r = 0; r < plane.Rows; r++) {
+						for (int c = 0; c < plane.Columns; c++) {
+							int x = plane.X + c * plane.Step, y = plane.Y + r * plane.Step;
+							if (image.depth() == CV_8U) samples.at<uchar>(r, c) = image.at<uchar>(y, x);
+							else samples.at<ushort>(r, c) = image.at<ushort>(y, x);
+						}
+					}
+				}
+				result.Histogram.assign(bins, 0);
+				result.Count = static_cast<long long>(samples.total());
+				result.Saturated = 0;
+				if (result.Count == 0) return;
+
+				double minValue, maxValue;
+				cv::minMaxLoc(samples, &minValue, &maxValue);
+				result.Min = static_cast<int>(minValue);
+				result.Max = static_cast<int>(maxValue);
+				cv::Scalar mean, std;
+				cv::meanStdDev(samples, mean, std);
+				result.Mean = mean[0];
+				result.Std = std[0];
+				result.Saturated = cv::countNonZero(samples >= saturation);
+
+				cv::Mat clamped, histogram;
+				cv::min(samples, cv::Scalar(bins - 1), clamped);
+				int histogramSize[] = { bins };
+				float range[] = { 0, static_cast<float>(bins) };
+				const float* ranges[] = { range };
+				cv::calcHist(&clamped, 1, nullptr, cv::Mat(), histogram, 1, histogramSize, ranges);
+				for (int b = 0; b < bins; b++) {
+					result.Histogram[b] = static_cast<unsigned int>(std::lround(histogram.at<float>(b)));
+				}
+			}
+		}
+
+		bool ComputePixelStatistics(const cv::Mat& image, const PixelStatisticsOptions& options,
+			std::vector<PixelStatistics>& channels, NativeKernelPath path) {
+			if (image.empty() || (image.type() != CV_8UC1 && image.type() != CV_16UC1)) return false;
+			int depthBits = image.depth() == CV_8U ? 8 : 16;
+			int bits = options.Bits == 0 ? depthBits : options.Bits;
+			if (bits < 1 || bits > depthBits || options.Stride < 1) return false;
+			int bins = 1 << bits;
+			int saturation = options.SaturationLevel == 0 ? bins - 1 : options.SaturationLevel;
+			if (saturation < 0 || saturation > (1 << depthBits) - 1) return false;
+			cv::Rect roi = options.Roi.empty() ? cv::Rect(0, 0, image.cols, image.rows) : options.Roi;
+			if ((roi & cv::Rect(0, 0, image.cols, image.rows)) != roi) return false;
+
+			bool avx2 = IsAvx2Available();
+			if (path == KernelAvx2 && !avx2) return false;
+			bool useAvx2 = path == KernelAvx2 || (path == KernelAuto && avx2);
+
+			std::vector<Plane> planes;
+			if (options.Bayer) {
+				int step = 2 * options.Stride;
+				for (int c = 0; c < 4; c++) {
+					Plane plane;
+					plane.X = FirstOf(roi.x, c & 1);
+					plane.Y = FirstOf(roi.y, c >> 1);
+					plane.Columns = SampleCount(plane.X, roi.x + roi.width, step);
+					plane.Rows = SampleCount(plane.Y, roi.y + roi.height, step);
+					plane.Step = step;
+					planes.push_back(plane);
+				}
+			}
+			else {
+				planes.push_back(Plane{ roi.x, roi.y, SampleCount(roi.x, roi.x + roi.width, options.Stride),
+					SampleCount(roi.y, roi.y + roi.height, options.Stride), options.Stride });
+			}
+
+			channels.assign(planes.size(), PixelStatistics());
+			for (std::size_t c = 0; c < planes.size(); c++) {
+				if (path == KernelMultiPass) {
+					MultiPassPlane(image, planes[c], saturation, bins, channels[c]);
+				}
+				else if (image.depth() == CV_8U) {
+					FusedPlane<uchar>(image, planes[c], saturation, bins, useAvx2, channels[c]);
+				}
+				else {
+					FusedPlane<ushort>(image, planes[c], saturation, bins, useAvx2, channels[c]);
+				}
+			}
+			return true;
+		}
+
+		double HistogramPercentile(const PixelStatistics& statistics, double percentile) {
+			if (statistics.Count == 0 || statistics.Histogram.empty()) return 0;
+			percentile = std::min(std::max(percentile, 0.0), 1.0);
+			long long rank = static_cast<long long>(std::ceil(percentile * statistics.Count));
+			long long seen = 0;
+			for (std::size_t value = 0; value < statistics.Histogram.size(); value++) {
+				seen += statistics.Histogram[value];
+				if (seen >= rank && seen > 0) return static_cast<double>(value);
+			}
+			return static_cast<double>(statistics.Histogram.size() - 1);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Native only, shared by the /clr wrapper and StatisticsKernels.cpp (compiled without /clr)
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "CorrectionKernels.h"
+
+namespace MLColorimeterCS {
+	namespace MLCommon {
+
+		struct PixelStatisticsOptions
+		{
+			/// Region to measure, empty for the whole image.
+			cv::Rect Roi;
+			/// Every Stride-th pixel of every Stride-th row (of every Stride-th 2x2 block for Bayer) is sampled.
+			int Stride = 1;
+			/// Significant bits of the data (8, 10, 12, 16), 0 for the image depth. Larger values fall in the last bin.
+			int Bits = 0;
+			/// Pixels at or above this value count as saturated, 0 for the full scale of Bits.
+			int SaturationLevel = 0;
+			/// Raw Bayer data: one result per position of the 2x2 color filter array, in the order
+			/// (0,0), (1,0), (0,1), (1,1) of image coordinates.
+			bool Bayer = false;
+		};
+
+		struct PixelStatistics
+		{
+			/// One bin per value, 2^Bits bins.
+			std::vector<unsigned int> Histogram;
+			long long Count = 0;
+			long long Saturated = 0;
+			int Min = 0;
+			int Max = 0;
+			double Mean = 0;
+			/// Population standard deviation.
+			double Std = 0;
+		};
+
+		/// Histogram, saturation count and moments of a CV_8UC1 or CV_16UC1 image in one pass, split into row
+		/// stripes processed in parallel. The AVX2 path vectorizes min/max/saturation/moments of mono data and of
+		/// Bayer data at stride 1, the histogram is accumulated in the same pass. KernelMultiPass is the reference built from OpenCV calls; all paths give
+		/// the same histogram, count, saturation and extremes.
+		/// @param channels one entry for mono data, four for Bayer data.
+		/// @return false if the image or options are invalid or the requested path is not available.
+		bool ComputePixelStatistics(const cv::Mat& image, const PixelStatisticsOptions& options,
+			std::vector<PixelStatistics>& channels, NativeKernelPath path);
+
+		/// Smallest value with at least the given fraction of the samples at or below it.
+		double HistogramPercentile(const PixelStatistics& statistics, double percentile);
+	}
+}
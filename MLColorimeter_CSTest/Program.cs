@@ -133,12 +133,19 @@ namespace MLColorimeter_CSTest
         }
 
         // 回调方法：接收相机帧
-        static void OnCameraFrameReceived(IntPtr frame, int width, int height, int channels, MLPixelFormat format)
+        static void OnCameraFrameReceived(NativeImage frame, MLPixelFormat format)
         {
-            Console.WriteLine($"Received frame: {width}x{height}, {channels} channels, format {format}");
-            Mat mat = new Mat(frame);
-            string filePath = "output.tif";
-            mat.SaveImage(filePath);
+            using (frame)
+            {
+                Console.WriteLine($"Received frame: {frame.Width}x{frame.Height}, {frame.Channels} channels, format {format}");
+                // 直接引用原生像素，不拷贝
+                MatType type = MatType.MakeType((int)frame.Depth, frame.Channels);
+                using (Mat mat = new Mat(frame.Height, frame.Width, type, frame.Data, frame.Stride))
+                {
+                    string filePath = "output.tif";
+                    mat.SaveImage(filePath);
+                }
+            }
         }
 
         // 回调方法：灰度级别改变
@@ -0,0 +1,113 @@
+using System;
+using System.Diagnostics;
+using System.Runtime.InteropServices;
+using Xunit;
+using Xunit.Abstractions;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class CorrectionKernelTests
+    {
+        private readonly ITestOutputHelper output;
+
+        public CorrectionKernelTests(ITestOutputHelper output)
+        {
+            this.output = output;
+        }
+
+        [Theory]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.U16, true)]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.F32, true)]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.U16, false)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U16, true)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.F32, true)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U16, false)]
+        public void FusedKernelMatchesMultiPassBitExactly(CorrectionKernel kernel, ImageDepth darkDepth, bool withFlat)
+        {
+            if (kernel == CorrectionKernel.Avx2 && !ImageCorrection.IsAvx2Supported)
+            {
+                return;
+            }
+
+            // Width is not a multiple of 8 so the vector tail is covered
+            const int width = 1001, height = 67;
+            var random = new Random(1234);
+            using (NativeImage raw = CreateU16(width, height, random, 1000, 65535))
+            using (NativeImage dark = darkDepth == ImageDepth.U16 ? CreateU16(width, height, random, 0, 1000) : CreateF32(width, height, random, 0f, 1000f))
+            using (NativeImage flat = withFlat ? CreateF32(width, height, random, 0.5f, 1.5f) : null)
+            using (NativeImage expected = ImageCorrection.DarkFlatExposure(raw, dark, flat, 1.0f / 37.5f, CorrectionKernel.MultiPass))
+            using (NativeImage actual = ImageCorrection.DarkFlatExposure(raw, dark, flat, 1.0f / 37.5f, kernel))
+            {
+                Assert.Equal(ImageDepth.F32, actual.Depth);
+                Assert.Equal(ToBytes(expected), ToBytes(actual));
+            }
+        }
+
+        [Fact(Skip = "Benchmark: allocates several 4096x3072 frames; remove the Skip to measure the kernels.")]
+        [Trait("Category", "Benchmark")]
+        public void FusedKernelBenchmark()
+        {
+            const int width = 4096, height = 3072, iterations = 5;
+            var random = new Random(1);
+            using (NativeImage raw = CreateU16(width, height, random, 1000, 65535))
+            using (NativeImage dark = CreateU16(width, height, random, 0, 1000))
+            using (NativeImage flat = CreateF32(width, height, random, 0.5f, 1.5f))
+            using (NativeImage destination = NativeImage.Create(width, height, ImageDepth.F32, 1))
+            {
+                foreach (CorrectionKernel kernel in new[] { CorrectionKernel.MultiPass, CorrectionKernel.Scalar, CorrectionKernel.Avx2 })
+                {
+                    if (kernel == CorrectionKernel.Avx2 && !ImageCorrection.IsAvx2Supported)
+                    {
+                        continue;
+                    }
+                    ImageCorrection.DarkFlatExposure(raw, dark, flat, 0.01f, destination, kernel);
+                    var watch = Stopwatch.StartNew();
+                    for (int i = 0; i < iterations; i++)
+                    {
+                        ImageCorrection.DarkFlatExposure(raw, dark, flat, 0.01f, destination, kernel);
+                    }
+                    watch.Stop();
+                    output.WriteLine($"{kernel}: {watch.Elapsed.TotalMilliseconds / iterations:F2} ms per {width}x{height} frame");
+                }
+            }
+        }
+
+        private static NativeImage CreateU16(int width, int height, Random random, int min, int max)
+        {
+            NativeImage image = NativeImage.Create(width, height, ImageDepth.U16, 1);
+            var row = new short[width];
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    row[x] = unchecked((short)random.Next(min, max));
+                }
+                Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+            }
+            return image;
+        }
+
+        private static NativeImage CreateF32(int width, int height, Random random, float min, float max)
+        {
+            NativeImage image = NativeImage.Create(width, height, ImageDepth.F32, 1);
+            var row = new float[width];
+            for (int y = 0; y < height; y++)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    row[x] = min + (float)random.NextDouble() * (max - min);
+                }
+                Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+            }
+            return image;
+        }
+
+        private static byte[] ToBytes(NativeImage image)
+        {
+            var bytes = new byte[image.Width * image.Height * image.ElementSize];
+            image.CopyTo(bytes);
+            return bytes;
+        }
+    }
+}
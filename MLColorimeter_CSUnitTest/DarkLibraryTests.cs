@@ -0,0 +1,138 @@
+using System;
+using System.IO;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class DarkLibraryTests : IDisposable
+    {
+        private readonly string path = Path.Combine(Path.GetTempPath(), Guid.NewGuid().ToString("N") + ".mldark");
+
+        public void Dispose()
+        {
+            File.Delete(path);
+        }
+
+        [Fact]
+        public void ExposureTimesAreInterpolated()
+        {
+            // Dark level 100 at 10 ms and 300 at 30 ms: 10 per ms, 0 at 0 ms
+            WriteLibrary(ImageDepth.U16);
+            using (DarkLibrary library = DarkLibrary.Open(path))
+            {
+                Assert.Equal(new[] { 10.0, 30.0 }, library.GetExposureTimes(Binning.ONE_BY_ONE, MLPixelFormat.MLMono12));
+
+                using (NativeImage stored = library.GetDark(10, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                using (NativeImage between = library.GetDark(20, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                using (NativeImage again = library.GetDark(20, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                using (NativeImage above = library.GetDark(40, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                using (NativeImage below = library.GetDark(5, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                using (NativeImage clamped = library.GetDark(-5, Binning.ONE_BY_ONE, MLPixelFormat.MLMono12))
+                {
+                    Assert.Equal(ImageDepth.U16, stored.Depth);
+                    Assert.Equal(ImageDepth.F32, between.Depth);
+                    Assert.All(ReadF32(between), value => Assert.Equal(200f, value, 3));
+                    Assert.Equal(between.Data, again.Data);
+                    Assert.All(ReadF32(above), value => Assert.Equal(400f, value, 3));
+                    Assert.All(ReadF32(below), value => Assert.Equal(50f, value, 3));
+                    Assert.All(ReadF32(clamped), value => Assert.Equal(0f, value));
+                }
+                Assert.Throws<System.Collections.Generic.KeyNotFoundException>(() =>
+                    library.GetDark(20, Binning.TWO_BY_TWO, MLPixelFormat.MLMono12));
+            }
+        }
+
+        [Fact]
+        public void EightBitDarksAreRejected()
+        {
+            Assert.Throws<InvalidOperationException>(() => WriteLibrary(ImageDepth.U8));
+        }
+
+        [Fact]
+        public void EntryNotMatchingTheHeaderIsRejected()
+        {
+            WriteLibrary(ImageDepth.U16);
+            // Type of the first entry: 16 byte header, then exposure time, binning, pixel format, width, height
+            using (var stream = new FileStream(path, FileMode.Open, FileAccess.Write))
+            {
+                stream.Position = 16 + 8 + 4 * 4;
+                stream.Write(BitConverter.GetBytes(0), 0, 4); // CV_8UC1
+            }
+
+            Assert.Throws<IOException>(() => DarkLibrary.Open(path));
+        }
+
+        [Fact]
+        public void DuplicateExposureTimesAreRejected()
+        {
+            // Two darks of one exposure time leave nothing to interpolate between
+            using (NativeImage low = CreateFlat(ImageDepth.U16, 100))
+            using (NativeImage high = CreateFlat(ImageDepth.U16, 300))
+            {
+                Assert.Throws<InvalidOperationException>(() => DarkLibrary.Write(path, new[]
+                {
+                    new DarkFrame { ExposureTime = 10, Image = low },
+                    new DarkFrame { ExposureTime = 10, Image = high }
+                }));
+            }
+
+            WriteLibrary(ImageDepth.U16);
+            // Exposure time of the first entry (30 ms) set to that of the second (10 ms)
+            using (var stream = new FileStream(path, FileMode.Open, FileAccess.Write))
+            {
+                stream.Position = 16;
+                stream.Write(BitConverter.GetBytes(10.0), 0, 8);
+            }
+
+            Assert.Throws<IOException>(() => DarkLibrary.Open(path));
+        }
+
+        private void WriteLibrary(ImageDepth depth)
+        {
+            using (NativeImage low = CreateFlat(depth, 100))
+            using (NativeImage high = CreateFlat(depth, 300))
+            {
+                DarkLibrary.Write(path, new[]
+                {
+                    new DarkFrame { ExposureTime = 30, Image = high },
+                    new DarkFrame { ExposureTime = 10, Image = low }
+                });
+            }
+        }
+
+        private static NativeImage CreateFlat(ImageDepth depth, int level)
+        {
+            const int width = 37, height = 5;
+            NativeImage image = NativeImage.Create(width, height, depth, 1);
+            int elementSize = image.ElementSize;
+            var row = new byte[width * elementSize];
+            for (int x = 0; x < width; x++)
+            {
+                if (elementSize == 2)
+                {
+                    BitConverter.GetBytes((ushort)level).CopyTo(row, x * 2);
+                }
+                else
+                {
+                    row[x] = (byte)Math.Min(level, 255);
+                }
+            }
+            for (int y = 0; y < height; y++)
+            {
+                Marshal.Copy(row, 0, image.GetRowPointer(y), row.Length);
+            }
+            return image;
+        }
+
+        private static float[] ReadF32(NativeImage image)
+        {
+            var bytes = new byte[image.Width * image.Height * image.ElementSize];
+            image.CopyTo(bytes);
+            var values = new float[image.Width * image.Height];
+            Buffer.BlockCopy(bytes, 0, values, 0, bytes.Length);
+            return values;
+        }
+    }
+}
@@ -0,0 +1,307 @@
+using System;
+using System.Collections.Generic;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class FocusSweeperTests
+    {
+        private const int Size = 64;
+        private const double Focus = 1.13;
+
+        [Fact]
+        public void PipelinedMatchesSequential()
+        {
+            var sequential = new SimulatedFocusDevice();
+            var pipelined = new SimulatedFocusDevice();
+            FocusSweepResult first = FocusSweeper.Sweep(sequential, CreateConfig(FocusSweepMode.Sequential), 1);
+            FocusSweepResult second = FocusSweeper.Sweep(pipelined, CreateConfig(FocusSweepMode.Pipelined), 1);
+
+            Assert.Equal(first.RoughMotion, second.RoughMotion);
+            Assert.Equal(first.RoughMtf, second.RoughMtf);
+            Assert.Equal(first.Motion, second.Motion);
+            Assert.Equal(first.Vid, second.Vid);
+            Assert.Equal(first.Mtf, second.Mtf);
+            Assert.Equal(first.BestPosition, second.BestPosition);
+            Assert.Equal(sequential.Captures, pipelined.Captures);
+            // 9 rough steps, 11 fine steps
+            Assert.Equal(20, sequential.Captures);
+            Assert.Equal(20, first.Captures);
+            Assert.InRange(first.BestPosition, Focus - 0.05, Focus + 0.05);
+            Assert.Equal(first.BestPosition, pipelined.Position);
+        }
+
+        [Fact]
+        public void FlyScanSlowsDownToFineStepAndRestoresTheSpeed()
+        {
+            var device = new MovingFocusDevice { Speed = 100 };
+            ThroughFocusConfig config = CreateConfig(FocusSweepMode.FlyScan);
+            config.FineStep = 0.02;
+            FocusSweepResult result = FocusSweeper.Sweep(device, config, 1);
+
+            // 0.04 per exposure at speed 100: the first pass stops at its first frame, the second runs at 0.8 * 0.02 / 0.04
+            // of the speed, and the speed is restored
+            Assert.Equal(0.016, result.MaxFrameTravel, 3);
+            Assert.Equal(3, device.SpeedSettings.Count);
+            Assert.InRange(device.SpeedSettings[1], 39, 40);
+            Assert.Equal(100, device.Speed);
+            Assert.Equal(device.Captures, result.Captures);
+            // The whole range, although the motion reports moving 20 ms after the command
+            Assert.InRange(result.Motion.Length, 20, result.Captures);
+            Assert.InRange(result.Motion[result.Motion.Length - 1], 1.9, 2.0);
+            Assert.InRange(result.BestPosition, Focus - 0.05, Focus + 0.05);
+        }
+
+        [Fact]
+        public void FlyScanCalibratesASpeedNotProportionalToVelocity()
+        {
+            // 0.048 per exposure at speed 100 but 0.008 at speed 0: the speed proportional to the blur (33) still
+            // travels 0.0212, the secant through both passes (20) travels 0.016
+            var device = new MovingFocusDevice { Speed = 100, SpeedOffset = 20 };
+            ThroughFocusConfig config = CreateConfig(FocusSweepMode.FlyScan);
+            config.FineStep = 0.02;
+            FocusSweepResult result = FocusSweeper.Sweep(device, config, 1);
+
+            Assert.Equal(4, device.SpeedSettings.Count);
+            Assert.Equal(33, device.SpeedSettings[1]);
+            Assert.InRange(device.SpeedSettings[2], 19, 20);
+            Assert.Equal(100, device.Speed);
+            Assert.Equal(0.016, result.MaxFrameTravel, 3);
+            Assert.InRange(result.BestPosition, Focus - 0.05, Focus + 0.05);
+        }
+
+        [Fact]
+        public void SdkModeCannotSweepADevice()
+        {
+            Assert.Throws<ArgumentException>(() => FocusSweeper.Sweep(new SimulatedFocusDevice(), CreateConfig(FocusSweepMode.Sdk), 1));
+        }
+
+        [Fact]
+        public void AdaptiveSearchStopsAfterTheCleanPeak()
+        {
+            int captures = 0;
+            FocusSweepResult result = FocusSweeper.AdaptiveSearch(x => { captures++; return Curve(x, 1.63); }, 0, 4, 0.25, 0.02);
+
+            Assert.Equal(captures, result.Captures);
+            // Fewer captures than the 17 rough steps alone
+            Assert.InRange(result.Captures, 1, 16);
+            Assert.InRange(result.BestPosition, 1.63 - 0.005, 1.63 + 0.005);
+        }
+
+        [Theory]
+        [InlineData(1.63)]
+        [InlineData(0.0)]
+        [InlineData(4.0)]
+        public void AdaptiveSearchFindsTheNoisyPeak(double peak)
+        {
+            const int Seeds = 20;
+            var best = new double[Seeds];
+            for (int seed = 0; seed < Seeds; seed++)
+            {
+                var random = new Random(seed);
+                int captures = 0;
+                FocusSweepResult result = FocusSweeper.AdaptiveSearch(x =>
+                {
+                    captures++;
+                    return Curve(x, peak) + 0.003 * Gaussian(random);
+                }, 0, 4, 0.25, 0.02);
+
+                Assert.Equal(captures, result.Captures);
+                // Fewer captures than the 17 rough and 26 fine steps of the grid sweep
+                Assert.InRange(result.Captures, 1, 42);
+                Assert.InRange(result.BestPosition, peak - 0.05, peak + 0.05);
+                best[seed] = result.BestPosition;
+            }
+
+            double mean = 0, variance = 0;
+            foreach (double position in best)
+            {
+                mean += position / Seeds;
+            }
+            foreach (double position in best)
+            {
+                variance += (position - mean) * (position - mean) / (Seeds - 1);
+            }
+            Assert.InRange(Math.Sqrt(variance), 0, 0.015);
+        }
+
+        [Fact]
+        public void AdaptiveSearchReportsTheProbe()
+        {
+            Assert.Throws<InvalidOperationException>(() =>
+                FocusSweeper.AdaptiveSearch(x => { throw new TimeoutException("No frame."); }, 0, 4, 0.25, 0.02));
+            Assert.Throws<ArgumentOutOfRangeException>(() => FocusSweeper.AdaptiveSearch(x => 0, 0, 4, 0, 0.02));
+        }
+
+        private static ThroughFocusConfig CreateConfig(FocusSweepMode mode)
+        {
+            var config = new ThroughFocusConfig
+            {
+                FocusMin = 0,
+                FocusMax = 2,
+                RoughStep = 0.25,
+                FineRange = 0.5,
+                FineStep = 0.05,
+                SweepMode = mode
+            };
+            config.ROIs.Add(new Rect(4, 4, Size - 8, Size - 8));
+            // The SDK's freq in lp/mm, below the Nyquist frequency of pixels up to 20 um
+            config.Freq = 20;
+            return config;
+        }
+
+        // Through-focus MTF with a Gaussian peak of width 0.5 over a floor of 0.1
+        private static double Curve(double position, double peak)
+        {
+            return 0.1 + 0.5 * Math.Exp(-(position - peak) * (position - peak) / (2 * 0.5 * 0.5));
+        }
+
+        private static double Gaussian(Random random)
+        {
+            double u1 = random.NextDouble(), u2 = random.NextDouble();
+            return Math.Sqrt(-2 * Math.Log(1 - u1)) * Math.Cos(2 * Math.PI * u2);
+        }
+
+        // Instant motion; the frames show an edge blurred with the distance to Focus
+        private class SimulatedFocusDevice : IFocusDevice
+        {
+            private double target;
+
+            public int Captures { get; private set; }
+
+            public double Position { get; private set; }
+
+            public double Vid => 100 * Position;
+
+            public bool IsMoving => false;
+
+            public double ExposureTime => 10;
+
+            public int Speed { get; set; }
+
+            public void MoveTo(double position)
+            {
+                Position = position;
+            }
+
+            public void StartMove(double position)
+            {
+                target = position;
+            }
+
+            public void WaitForMove()
+            {
+                Position = target;
+            }
+
+            public void StopMove()
+            {
+            }
+
+            public NativeImage Capture()
+            {
+                Captures++;
+                return Render(Position);
+            }
+
+            public static NativeImage Render(double position)
+            {
+                double scale = 0.5 + 4 * Math.Abs(position - Focus);
+                double slope = Math.Tan(5.0 * Math.PI / 180);
+                NativeImage image = NativeImage.Create(Size, Size, ImageDepth.U16, 1);
+                var row = new short[Size];
+                for (int y = 0; y < Size; y++)
+                {
+                    double edge = Size / 2.0 + (y - Size / 2.0) * slope;
+                    for (int x = 0; x < Size; x++)
+                    {
+                        row[x] = (short)(100 + 3000 / (1 + Math.Exp(-(x - edge) / scale)));
+                    }
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), Size);
+                }
+                return image;
+            }
+        }
+
+        // Motion at (Speed + SpeedOffset) / 10000 per millisecond that starts, and reports moving, 20 ms after the
+        // command; a capture takes its exposure and shows the edge at the exposure midpoint. Time is simulated: it
+        // passes in Capture(), WaitForMove() and Sleep() only.
+        private class MovingFocusDevice : IFocusDevice, IFocusClock
+        {
+            private double now, from, to, start, stop;
+            private int speed;
+
+            public int Captures { get; private set; }
+
+            public int SpeedOffset { get; set; }
+
+            public List<int> SpeedSettings { get; } = new List<int>();
+
+            public int Speed
+            {
+                get { return speed; }
+                set
+                {
+                    SpeedSettings.Add(value);
+                    speed = value;
+                }
+            }
+
+            public double Position => PositionAt(now);
+
+            public double Vid => 100 * Position;
+
+            public bool IsMoving => now >= start && now < stop;
+
+            public double ExposureTime => 4;
+
+            public double Now => now;
+
+            public void Sleep(double milliseconds)
+            {
+                now += milliseconds;
+            }
+
+            public void MoveTo(double position)
+            {
+                from = to = position;
+                start = stop = now;
+            }
+
+            public void StartMove(double position)
+            {
+                from = PositionAt(now);
+                to = position;
+                start = now + 20;
+                stop = start + Math.Abs(to - from) / ((speed + SpeedOffset) / 10000.0);
+            }
+
+            public void WaitForMove()
+            {
+                now = Math.Max(now, stop);
+            }
+
+            public void StopMove()
+            {
+                from = to = PositionAt(now);
+                start = stop = now;
+            }
+
+            public NativeImage Capture()
+            {
+                Captures++;
+                now += ExposureTime;
+                return SimulatedFocusDevice.Render(PositionAt(now - ExposureTime / 2));
+            }
+
+            private double PositionAt(double time)
+            {
+                if (time <= start) return from;
+                if (time >= stop) return to;
+                return from + (to - from) * (time - start) / (stop - start);
+            }
+        }
+    }
+}
@@ -0,0 +1,145 @@
+using System;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class ImageAveragerTests
+    {
+        private const int Width = 4, Height = 4;
+
+        [Fact]
+        public void SigmaClipRejectsOutlier()
+        {
+            var config = new AveragingConfig { Rejection = FrameRejection.SigmaClip, Sigma = 3, MinSamples = 3 };
+            using (var clipped = new ImageAverager(config))
+            using (var plain = new ImageAverager(null))
+            {
+                // 999 and 1001 alternating; the fifth frame has a hot pixel at (1, 1)
+                for (int i = 0; i < 8; i++)
+                {
+                    int level = i % 2 == 0 ? 999 : 1001;
+                    using (NativeImage frame = CreateFlat(ImageDepth.U16, level, i == 4 ? 5000 : level))
+                    {
+                        clipped.Add(frame);
+                        plain.Add(frame);
+                    }
+                }
+
+                Assert.Equal(8, clipped.Count);
+                float[] average = Average(clipped);
+                Assert.Equal(12001f / 8, Average(plain)[Width + 1], 3);
+                // The hot sample is left out: three 999 and four 1001
+                Assert.Equal(7001f / 7, average[Width + 1], 3);
+                Assert.Equal(1000f, average[0], 3);
+            }
+        }
+
+        [Fact]
+        public void SigmaClipKeepsSamplesBeforeMinSamples()
+        {
+            var config = new AveragingConfig { Rejection = FrameRejection.SigmaClip, Sigma = 3, MinSamples = 3 };
+            using (var clipped = new ImageAverager(config))
+            {
+                foreach (int level in new[] { 5000, 1000, 1000 })
+                {
+                    using (NativeImage frame = CreateFlat(ImageDepth.U16, level, level))
+                    {
+                        clipped.Add(frame);
+                    }
+                }
+
+                Assert.Equal(7000f / 3, Average(clipped)[0], 2);
+            }
+        }
+
+        [Fact]
+        public void MedianOfThreeAveragesGroupMedians()
+        {
+            var config = new AveragingConfig { Rejection = FrameRejection.MedianOfThree };
+            using (var median = new ImageAverager(config))
+            {
+                // Group medians 12 and 11; the plain mean would be 41
+                foreach (int level in new[] { 10, 200, 12, 11, 13, 0 })
+                {
+                    using (NativeImage frame = CreateFlat(ImageDepth.U8, level, level))
+                    {
+                        median.Add(frame);
+                    }
+                }
+                Assert.Equal(11.5f, Average(median)[0], 4);
+                long bytes = median.BufferBytes;
+
+                // An incomplete group is averaged as it is
+                using (NativeImage frame = CreateFlat(ImageDepth.U8, 20, 20))
+                {
+                    median.Add(frame);
+                }
+                Assert.Equal(89f / 7, Average(median)[0], 4);
+                Assert.Equal(bytes, median.BufferBytes);
+            }
+        }
+
+        [Fact]
+        public void FramesMustMatch()
+        {
+            using (var averager = new ImageAverager(null))
+            using (NativeImage first = CreateFlat(ImageDepth.U16, 1, 1))
+            using (NativeImage other = CreateFlat(ImageDepth.U8, 1, 1))
+            using (NativeImage color = NativeImage.Create(Width, Height, ImageDepth.U8, 3))
+            {
+                Assert.Throws<InvalidOperationException>(() => averager.Average());
+                averager.Add(first);
+                Assert.Throws<ArgumentException>(() => averager.Add(other));
+                Assert.Throws<ArgumentException>(() => averager.Add(color));
+                Assert.Equal(1, averager.Count);
+
+                averager.Reset();
+                averager.Add(other);
+                Assert.Equal(1, averager.Count);
+            }
+        }
+
+        // Every pixel at level except (1, 1), at center
+        private static NativeImage CreateFlat(ImageDepth depth, int level, int center)
+        {
+            NativeImage image = NativeImage.Create(Width, Height, depth, 1);
+            for (int y = 0; y < Height; y++)
+            {
+                if (depth == ImageDepth.U8)
+                {
+                    var row = new byte[Width];
+                    for (int x = 0; x < Width; x++)
+                    {
+                        row[x] = (byte)(x == 1 && y == 1 ? center : level);
+                    }
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), Width);
+                }
+                else
+                {
+                    var row = new short[Width];
+                    for (int x = 0; x < Width; x++)
+                    {
+                        row[x] = (short)(x == 1 && y == 1 ? center : level);
+                    }
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), Width);
+                }
+            }
+            return image;
+        }
+
+        private static float[] Average(ImageAverager averager)
+        {
+            using (NativeImage average = averager.Average())
+            {
+                Assert.Equal(ImageDepth.F32, average.Depth);
+                var bytes = new byte[Width * Height * 4];
+                average.CopyTo(bytes);
+                var values = new float[Width * Height];
+                Buffer.BlockCopy(bytes, 0, values, 0, bytes.Length);
+                return values;
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class MotionPlannerTests
+    {
+        private static readonly MLFilterEnum[] NDFilters = { MLFilterEnum.ND0, MLFilterEnum.ND1, MLFilterEnum.ND2, MLFilterEnum.ND3, MLFilterEnum.ND4 };
+        private static readonly double[] Cylinders = { 0, -0.5, -1, -1.5, -2, -2.5 };
+
+        private static MotionModel CreateModel()
+        {
+            var model = new MotionModel { NDSlots = 8, XYZSlots = 8, RXSlots = Cylinders.Length, AxisMin = 0, AxisMax = 180 };
+            for (int i = 0; i < NDFilters.Length; i++)
+            {
+                model.NDPositions[NDFilters[i]] = i;
+            }
+            model.XYZPositions[MLFilterEnum.X] = 1;
+            model.XYZPositions[MLFilterEnum.Y] = 2;
+            model.XYZPositions[MLFilterEnum.Z] = 3;
+            for (int i = 0; i < Cylinders.Length; i++)
+            {
+                model.RXPositions[Cylinders[i]] = i;
+            }
+            return model;
+        }
+
+        private static MotionTarget CreateTarget(MLFilterEnum nd, double cylinder, int axis, string lightSource)
+        {
+            var target = new MotionTarget { NDFilter = nd, LightSource = lightSource };
+            target.ColorFilters.AddRange(new[] { MLFilterEnum.X, MLFilterEnum.Y, MLFilterEnum.Z });
+            target.RX = new RXCombination { Sphere = 0, Cylinder = cylinder, Axis = axis };
+            return target;
+        }
+
+        [Theory]
+        [InlineData(6)]
+        [InlineData(12)]
+        [InlineData(40)]
+        public void PlanIsAPermutationAndSavesTravel(int count)
+        {
+            var random = new Random(count);
+            var targets = Enumerable.Range(0, count)
+                .Select(i => CreateTarget(NDFilters[random.Next(NDFilters.Length)], Cylinders[random.Next(Cylinders.Length)],
+                    random.Next(0, 181), random.Next(2) == 0 ? "W" : "R"))
+                .ToList();
+            var model = CreateModel();
+
+            MotionPlan plan = MotionPlanner.Plan(model, null, targets);
+
+            Assert.Equal(Enumerable.Range(0, count), plan.Order.OrderBy(i => i));
+            Assert.Equal(plan.EstimatedSeconds, MotionPlanner.Simulate(model, null, targets, plan.Order), 9);
+            Assert.True(plan.EstimatedSeconds < plan.RequestedOrderSeconds);
+        }
+
+        [Fact]
+        public void WheelWrapsAroundButAxisStaysInRange()
+        {
+            var model = CreateModel();
+            var nd4 = new List<MotionTarget> { new MotionTarget { NDFilter = MLFilterEnum.ND4 } };
+            var start = new MotionTarget { NDFilter = MLFilterEnum.ND0 };
+            // Slot 0 to 4 on an 8 slot wheel is 4 slots either way, 0 to 7 would be one
+            model.NDPositions[MLFilterEnum.ND4] = 7;
+            double wrapped = MotionPlanner.Simulate(model, start, nd4, new[] { 0 });
+            Assert.Equal(model.WheelSettleSeconds + model.SecondsPerSlot, wrapped, 9);
+
+            // 0 to 170 degrees on a 0..180 axis cannot go through 180/0
+            var axis = new List<MotionTarget> { new MotionTarget { RX = new RXCombination { Axis = 170 } } };
+            var axisStart = new MotionTarget { RX = new RXCombination { Axis = 0 } };
+            double rotated = MotionPlanner.Simulate(model, axisStart, axis, new[] { 0 });
+            Assert.Equal(model.AxisSettleSeconds + 170 * model.SecondsPerDegree, rotated, 9);
+        }
+
+        [Fact]
+        public void LightSourceChangesAreGrouped()
+        {
+            var targets = new List<MotionTarget>
+            {
+                CreateTarget(MLFilterEnum.ND0, 0, 0, "W"),
+                CreateTarget(MLFilterEnum.ND0, 0, 0, "R"),
+                CreateTarget(MLFilterEnum.ND1, 0, 0, "W"),
+                CreateTarget(MLFilterEnum.ND1, 0, 0, "R"),
+            };
+
+            MotionPlan plan = MotionPlanner.Plan(CreateModel(), null, targets);
+
+            var sources = plan.Order.Select(i => targets[i].LightSource).ToList();
+            int changes = sources.Zip(sources.Skip(1), (a, b) => a != b ? 1 : 0).Sum();
+            Assert.Equal(1, changes);
+        }
+    }
+}
@@ -0,0 +1,225 @@
+using System;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class MtfAnalyzerTests
+    {
+        [Fact]
+        public void SharpEdgeHasHigherMtf()
+        {
+            var roi = new Rect(4, 4, 56, 56);
+            using (NativeImage sharp = CreateEdge(64, 64, 5.0, 0.5, false))
+            using (NativeImage blurred = CreateEdge(64, 64, 5.0, 2.0, false))
+            using (MtfResult sharpResult = MtfAnalyzer.Calculate(sharp, roi, null))
+            using (MtfResult blurredResult = MtfAnalyzer.Calculate(blurred, roi, null))
+            {
+                // 4 bins per pixel across the edge, frequencies up to 1 cycle per pixel
+                Assert.Equal(4 * 56, sharpResult.SampleCount);
+                Assert.Equal(56 + 1, sharpResult.FrequencyCount);
+                Assert.Equal(0.25, sharpResult.SampleSpacing);
+                Assert.Equal(5.0, sharpResult.EdgeAngle, 1);
+                Assert.Equal(1.0, sharpResult.At(0), 6);
+                Assert.Equal(sharpResult.SampleCount, sharpResult.ToArray(MtfCurve.SamplePosition).Length);
+                Assert.Equal(sharpResult.FrequencyCount, sharpResult.ToArray(MtfCurve.Frequency).Length);
+                // Logistic edge of scale s: MTF(f) = 2 pi^2 s f / sinh(2 pi^2 s f), 0.42 for s = 0.5 at 0.25 cycles/pixel
+                Assert.InRange(sharpResult.At(0.25), 0.38, 0.46);
+                Assert.True(sharpResult.At(0.25) > blurredResult.At(0.25));
+            }
+        }
+
+        [Fact]
+        public void HorizontalEdgeMatchesVerticalEdge()
+        {
+            using (NativeImage vertical = CreateEdge(64, 48, 5.0, 1.0, false))
+            using (NativeImage horizontal = CreateEdge(64, 48, 5.0, 1.0, true))
+            using (MtfResult verticalResult = MtfAnalyzer.Calculate(vertical, new Rect(4, 4, 56, 40), null))
+            using (MtfResult horizontalResult = MtfAnalyzer.Calculate(horizontal, new Rect(4, 4, 40, 56), null))
+            {
+                Assert.Equal(verticalResult.FrequencyCount, horizontalResult.FrequencyCount);
+                Assert.Equal(verticalResult.ToArray(MtfCurve.Mtf), horizontalResult.ToArray(MtfCurve.Mtf));
+            }
+        }
+
+        [Fact]
+        public void BinningScalesTheFrequencyAxis()
+        {
+            var roi = new Rect(4, 4, 56, 56);
+            using (NativeImage image = CreateEdge(64, 64, 5.0, 1.0, false))
+            using (MtfResult plain = MtfAnalyzer.Calculate(image, roi, null))
+            using (MtfResult binned = MtfAnalyzer.Calculate(image, roi, new MtfConfig { BinNum = 2 }))
+            using (MtfResult lpmm = MtfAnalyzer.Calculate(image, roi, new MtfConfig { BinNum = 2, PixelSize = 0.005 }))
+            {
+                double[] plainAxis = plain.ToArray(MtfCurve.Frequency), binnedAxis = binned.ToArray(MtfCurve.Frequency);
+                Assert.Equal(plain.FrequencyCount, binned.FrequencyCount);
+                Assert.Equal(1.0, plainAxis[plainAxis.Length - 1], 9);
+                Assert.Equal(plainAxis[plainAxis.Length - 1] / 2, binnedAxis[binnedAxis.Length - 1], 9);
+                // 0.5 cycles per sensor pixel of 5 um
+                Assert.Equal(100.0, lpmm.ToArray(MtfCurve.Frequency)[lpmm.FrequencyCount - 1], 9);
+            }
+        }
+
+        [Fact]
+        public void RecalculationReusesTheBuffer()
+        {
+            var roi = new Rect(4, 4, 56, 56);
+            using (NativeImage image = CreateEdge(64, 64, 5.0, 1.0, false))
+            using (var result = new MtfResult())
+            {
+                MtfAnalyzer.Calculate(image, roi, null, result);
+                IntPtr first = result.GetPointer(MtfCurve.Esf);
+                double[] mtf = result.ToArray(MtfCurve.Mtf);
+
+                MtfAnalyzer.Calculate(image, roi, null, result);
+
+                Assert.Equal(first, result.GetPointer(MtfCurve.Esf));
+                Assert.Equal(mtf, result.ToArray(MtfCurve.Mtf));
+            }
+        }
+
+        [Fact]
+        public void BatchMatchesSingleRegions()
+        {
+            // Small regions, a region large enough for row stripes, and two that cannot be measured: too small and flat
+            var rois = new[]
+            {
+                new Rect(240, 240, 64, 64), new Rect(200, 100, 200, 400), new Rect(226, 20, 48, 48),
+                new Rect(0, 0, 4, 32), new Rect(500, 500, 32, 32)
+            };
+            using (NativeImage image = CreateEdge(544, 544, 5.0, 1.0, false))
+            {
+                double[] values = MtfAnalyzer.CalculateAtFrequency(image, rois, 0.2, null);
+
+                Assert.Equal(rois.Length, values.Length);
+                for (int i = 0; i < 3; i++)
+                {
+                    using (MtfResult single = MtfAnalyzer.Calculate(image, rois[i], null))
+                    {
+                        Assert.Equal(single.At(0.2), values[i]);
+                    }
+                    Assert.Equal(MtfAnalyzer.CalculateAtFrequency(image, new[] { rois[i] }, 0.2, null)[0], values[i]);
+                    Assert.False(double.IsNaN(values[i]));
+                }
+                Assert.True(double.IsNaN(values[3]));
+                Assert.True(double.IsNaN(values[4]));
+            }
+        }
+
+        [Fact]
+        public void CrossHairLineMatchesItsProfile()
+        {
+            var roi = new Rect(4, 4, 56, 56);
+            var crossHair = new MtfConfig { ChessMode = false };
+            using (NativeImage image = CreateLine(64, 64, 5.0, 1.0))
+            using (MtfResult result = MtfAnalyzer.Calculate(image, roi, crossHair))
+            {
+                // Gaussian line of sigma s: MTF(f) = exp(-(2 pi s f)^2 / 2), 0.82 for s = 1 at 0.1 cycles/pixel
+                Assert.Equal(5.0, result.EdgeAngle, 1);
+                Assert.InRange(result.At(0.1), 0.79, 0.85);
+                Assert.Throws<ArgumentOutOfRangeException>(() => MtfAnalyzer.Calculate(image, roi, new MtfConfig { BinNum = 3 }));
+            }
+        }
+
+        [Fact]
+        public void FlatRegionIsRejected()
+        {
+            using (NativeImage image = NativeImage.Create(32, 32, ImageDepth.U16, 1))
+            {
+                Assert.Throws<ArgumentException>(() => MtfAnalyzer.Calculate(image, new Rect(0, 0, 32, 32), null));
+            }
+        }
+
+        [Fact]
+        public void FocusPeakOfUnevenSamples()
+        {
+            // Gaussian through-focus curve peaking at 3.13, sampled unevenly as by a fly scan
+            var positions = new[] { 1.0, 1.7, 2.2, 2.6, 2.95, 3.4, 3.7, 4.3, 5.0 };
+            var values = new double[positions.Length];
+            for (int i = 0; i < positions.Length; i++)
+            {
+                values[i] = 0.6 * Math.Exp(-Math.Pow(positions[i] - 3.13, 2) / (2 * 0.5 * 0.5));
+            }
+
+            Assert.Equal(3.13, MtfAnalyzer.FindFocusPeak(positions, values), 6);
+            Assert.Throws<ArgumentException>(() => MtfAnalyzer.FindFocusPeak(positions, new double[positions.Length]));
+        }
+
+        [Fact]
+        public void FocusPeakOfNoisySamples()
+        {
+            // Fly scan of a curve peaking at 2.37 over a floor of 0.05, with noise of 0.01, over 20 seeds
+            const int Seeds = 20;
+            var peaks = new double[Seeds];
+            for (int seed = 0; seed < Seeds; seed++)
+            {
+                var random = new Random(seed);
+                var positions = new double[100];
+                var values = new double[positions.Length];
+                for (int i = 0; i < positions.Length; i++)
+                {
+                    positions[i] = 0.04 * i + 0.013 * ((i * 7) % 5) / 4.0;
+                    double u1 = random.NextDouble(), u2 = random.NextDouble();
+                    double noise = Math.Sqrt(-2 * Math.Log(1 - u1)) * Math.Cos(2 * Math.PI * u2);
+                    values[i] = 0.05 + 0.6 * Math.Exp(-Math.Pow(positions[i] - 2.37, 2) / (2 * 0.5 * 0.5)) + 0.01 * noise;
+                }
+                peaks[seed] = MtfAnalyzer.FindFocusPeak(positions, values);
+                Assert.InRange(peaks[seed], 2.37 - 0.02, 2.37 + 0.02);
+            }
+
+            double mean = 0, variance = 0;
+            foreach (double peak in peaks)
+            {
+                mean += peak / Seeds;
+            }
+            foreach (double peak in peaks)
+            {
+                variance += (peak - mean) * (peak - mean) / (Seeds - 1);
+            }
+            Assert.InRange(Math.Sqrt(variance), 0, 0.01);
+        }
+
+        // Near-vertical bright Gaussian line of sigma scale through the image center, tilted by angle degrees
+        private static NativeImage CreateLine(int width, int height, double angle, double scale)
+        {
+            NativeImage image = NativeImage.Create(width, height, ImageDepth.U16, 1);
+            double slope = Math.Tan(angle * Math.PI / 180);
+            var row = new short[width];
+            for (int y = 0; y < height; y++)
+            {
+                double line = width / 2.0 + (y - height / 2.0) * slope;
+                for (int x = 0; x < width; x++)
+                {
+                    double u = (x - line) / scale;
+                    row[x] = (short)(100 + 3000 * Math.Exp(-u * u / 2));
+                }
+                Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+            }
+            return image;
+        }
+
+        // Near-vertical logistic edge through the image center, tilted by angle degrees; transposed, a near-horizontal one
+        private static NativeImage CreateEdge(int width, int height, double angle, double scale, bool transposed)
+        {
+            int columns = transposed ? height : width, rows = transposed ? width : height;
+            NativeImage image = NativeImage.Create(columns, rows, ImageDepth.U16, 1);
+            double slope = Math.Tan(angle * Math.PI / 180);
+            var pixels = new short[columns * rows];
+            for (int y = 0; y < height; y++)
+            {
+                double edge = width / 2.0 + (y - height / 2.0) * slope;
+                for (int x = 0; x < width; x++)
+                {
+                    var value = (short)(100 + 3000 / (1 + Math.Exp(-(x - edge) / scale)));
+                    pixels[transposed ? x * columns + y : y * columns + x] = value;
+                }
+            }
+            for (int y = 0; y < rows; y++)
+            {
+                Marshal.Copy(pixels, y * columns, image.GetRowPointer(y), columns);
+            }
+            return image;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+using System;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class PredictiveExposureTests
+    {
+        private const double FullScale = 4095;
+
+        [Fact]
+        public void ProportionalStepWithoutPreviousSample()
+        {
+            Assert.Equal(20.0, PredictiveExposure.NextTime(0, 0, 10, 1000, 2000, FullScale), 9);
+        }
+
+        [Fact]
+        public void SecantStepAccountsForOffset()
+        {
+            // Dark offset 100, 100 gray levels per millisecond: the target 3100 is at 30 ms, not at 20 * 3100 / 2100
+            Assert.Equal(30.0, PredictiveExposure.NextTime(10, 1100, 20, 2100, 3100, FullScale), 9);
+        }
+
+        [Fact]
+        public void UnusablePreviousSampleFallsBackToProportional()
+        {
+            // Saturated previous sample
+            Assert.Equal(20.0, PredictiveExposure.NextTime(40, FullScale, 10, 1000, 2000, FullScale), 9);
+            // Level fell while the time grew (noise): no positive slope
+            Assert.Equal(40.0, PredictiveExposure.NextTime(10, 1100, 20, 1000, 2000, FullScale), 9);
+            // Same time twice
+            Assert.Equal(20.0, PredictiveExposure.NextTime(10, 900, 10, 1000, 2000, FullScale), 9);
+        }
+
+        [Fact]
+        public void SaturatedAndBlackSamplesScaleByFixedFactors()
+        {
+            Assert.Equal(5.0, PredictiveExposure.NextTime(10, 1000, 20, FullScale, 2000, FullScale), 9);
+            Assert.Equal(5.0, PredictiveExposure.NextTime(0, 0, 20, 0.98 * FullScale, 2000, FullScale), 9);
+            Assert.Equal(160.0, PredictiveExposure.NextTime(0, 0, 20, 0, 2000, FullScale), 9);
+        }
+
+        [Fact]
+        public void StepIsLimitedToFactorSixteen()
+        {
+            Assert.Equal(160.0, PredictiveExposure.NextTime(0, 0, 10, 1, 2000, FullScale), 9);
+            Assert.Equal(10.0 / 16, PredictiveExposure.NextTime(0, 0, 10, 3900, 100, FullScale), 9);
+        }
+
+        [Fact]
+        public void GrayLevelIsPercentileOfSampledPixels()
+        {
+            // Every row holds 0 .. 63
+            using (NativeImage image = CreateRamp(64, 32))
+            {
+                Assert.Equal(63.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(), 1.0, 1));
+                Assert.Equal(31.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(), 0.5, 1));
+                Assert.Equal(62.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(), 1.0, 2));
+                Assert.Equal(0.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(), 0.0, 1));
+            }
+        }
+
+        [Fact]
+        public void GrayLevelRoiIsInUnbinnedPixels()
+        {
+            using (NativeImage image = CreateRamp(64, 32))
+            {
+                // Columns 8 .. 23 at 1x1, 4 .. 11 of the frame at 2x2
+                var roi = new Rect(8, 0, 16, 16);
+                Assert.Equal(23.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, roi, 1.0, 1));
+                Assert.Equal(11.0, PredictiveExposure.GrayLevel(image, Binning.TWO_BY_TWO, roi, 1.0, 1));
+                // Clipped to the frame
+                Assert.Equal(63.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(60, 0, 100, 4), 1.0, 1));
+            }
+        }
+
+        [Fact]
+        public void GrayLevelOfColorImageHonorsRoi()
+        {
+            // Channel 0 holds the column, channel 2 is bright right of column 16
+            using (NativeImage image = NativeImage.Create(32, 8, ImageDepth.U8, 3))
+            {
+                var row = new byte[32 * 3];
+                for (int x = 0; x < 32; x++)
+                {
+                    row[3 * x] = (byte)x;
+                    row[3 * x + 1] = 5;
+                    row[3 * x + 2] = (byte)(x >= 16 ? 250 : 0);
+                }
+                for (int y = 0; y < 8; y++)
+                {
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), row.Length);
+                }
+
+                Assert.Equal(250.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(), 1.0, 1));
+                Assert.Equal(15.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(0, 0, 16, 8), 1.0, 1));
+                Assert.Equal(7.0, PredictiveExposure.GrayLevel(image, Binning.ONE_BY_ONE, new Rect(0, 0, 16, 8), 0.5, 1));
+            }
+        }
+
+        [Fact]
+        public void FullScaleOfPixelFormat()
+        {
+            using (NativeImage image = NativeImage.Create(4, 4, ImageDepth.U16, 1))
+            using (NativeImage rgb = NativeImage.Create(4, 4, ImageDepth.U8, 3))
+            {
+                Assert.Equal(4095.0, PredictiveExposure.FullScale(MLPixelFormat.MLMono12, image));
+                Assert.Equal(1023.0, PredictiveExposure.FullScale(MLPixelFormat.MLMono10, image));
+                Assert.Equal(65535.0, PredictiveExposure.FullScale(MLPixelFormat.MLBayer, image));
+                Assert.Equal(255.0, PredictiveExposure.FullScale(MLPixelFormat.MLRGB24, rgb));
+            }
+        }
+
+        private static NativeImage CreateRamp(int width, int height)
+        {
+            NativeImage image = NativeImage.Create(width, height, ImageDepth.U16, 1);
+            var row = new short[width];
+            for (int x = 0; x < width; x++)
+            {
+                row[x] = (short)x;
+            }
+            for (int y = 0; y < height; y++)
+            {
+                Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+            }
+            return image;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+using System;
+using System.Runtime.InteropServices;
+using Xunit;
+using MLColorimeterCS.MLCommon;
+
+namespace MLColorimeter_CSUnitTest
+{
+    public class StatisticsKernelTests
+    {
+        [Theory]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.U16, 1, false)]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.U8, 3, false)]
+        [InlineData(CorrectionKernel.Scalar, ImageDepth.U16, 2, true)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U16, 1, false)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U8, 1, false)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U16, 1, true)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U8, 1, true)]
+        [InlineData(CorrectionKernel.Avx2, ImageDepth.U16, 2, true)]
+        public void FusedKernelMatchesMultiPass(CorrectionKernel kernel, ImageDepth depth, int stride, bool bayer)
+        {
+            if (kernel == CorrectionKernel.Avx2 && !ImageCorrection.IsAvx2Supported)
+            {
+                return;
+            }
+
+            // Odd ROI origin and a width that is not a multiple of the vector size
+            const int width = 1001, height = 67;
+            int max = depth == ImageDepth.U8 ? 256 : 4500;
+            var options = new StatisticsOptions
+            {
+                Roi = new Rect(3, 5, 997, 60),
+                Stride = stride,
+                Bits = depth == ImageDepth.U8 ? 8 : 12,
+                SaturationLevel = depth == ImageDepth.U8 ? 250 : 4000,
+                Bayer = bayer
+            };
+            using (NativeImage image = Create(width, height, depth, new Random(42), max))
+            {
+                ImageStatistics[] expected = ImageStatistics.Compute(image, options, CorrectionKernel.MultiPass);
+                ImageStatistics[] actual = ImageStatistics.Compute(image, options, kernel);
+
+                Assert.Equal(bayer ? 4 : 1, actual.Length);
+                for (int c = 0; c < actual.Length; c++)
+                {
+                    Assert.Equal(expected[c].Count, actual[c].Count);
+                    Assert.Equal(expected[c].Histogram, actual[c].Histogram);
+                    Assert.Equal(expected[c].Saturated, actual[c].Saturated);
+                    Assert.Equal(expected[c].Min, actual[c].Min);
+                    Assert.Equal(expected[c].Max, actual[c].Max);
+                    Assert.Equal(expected[c].Mean, actual[c].Mean, 6);
+                    Assert.Equal(expected[c].Std, actual[c].Std, 6);
+                }
+            }
+        }
+
+        [Fact]
+        public void PercentileAndSaturationOfKnownImage()
+        {
+            // 100 pixels valued 0..99, of which 10 at or above 90
+            using (NativeImage image = NativeImage.Create(100, 1, ImageDepth.U8, 1))
+            {
+                var row = new byte[100];
+                for (int x = 0; x < row.Length; x++)
+                {
+                    row[x] = (byte)x;
+                }
+                Marshal.Copy(row, 0, image.GetRowPointer(0), row.Length);
+
+                ImageStatistics statistics = ImageStatistics.Compute(image, new StatisticsOptions { SaturationLevel = 90 });
+
+                Assert.Equal(100, statistics.Count);
+                Assert.Equal(10, statistics.Saturated);
+                Assert.Equal(0.1, statistics.SaturatedFraction, 9);
+                Assert.Equal(49, statistics.Percentile(0.5));
+                Assert.Equal(49.5, statistics.Mean, 9);
+            }
+        }
+
+        private static NativeImage Create(int width, int height, ImageDepth depth, Random random, int max)
+        {
+            NativeImage image = NativeImage.Create(width, height, depth, 1);
+            for (int y = 0; y < height; y++)
+            {
+                if (depth == ImageDepth.U8)
+                {
+                    var row = new byte[width];
+                    random.NextBytes(row);
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+                }
+                else
+                {
+                    // Values above the 12-bit range land in the last histogram bin
+                    var row = new short[width];
+                    for (int x = 0; x < width; x++)
+                    {
+                        row[x] = unchecked((short)random.Next(0, max));
+                    }
+                    Marshal.Copy(row, 0, image.GetRowPointer(y), width);
+                }
+            }
+            return image;
+        }
+    }
+}